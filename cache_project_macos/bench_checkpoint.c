@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Measures checkpoints (see memory_subsystem_save_r()) of a subsystem
+// warmed up by the Pass 4 preset of test_memory_subsystem in full:
+// how long warming up takes, how long saving and restoring take, and
+// how large the checkpoint is and how much of the disk it takes up.
+// Restoring is repeated, since sweeps restore one checkpoint many
+// times, and then a restored subsystem is run on until it has touched
+// all of main memory, to show the cost of reading it in on demand.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_RESTORES 20
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+  WORKLOAD_CONFIG config = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS stats;
+  struct stat file_status;
+  char path[64];
+
+  snprintf(path, sizeof(path), "/tmp/bench_checkpoint_%d", (int) getpid());
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD *workload = workload_create(&config);
+  double start = now_in_seconds();
+  workload_run_r(ms, workload);
+  printf("Warmed up with %llu accesses in %.3f seconds\n", config.num_accesses, now_in_seconds() - start);
+
+  start = now_in_seconds();
+  if (memory_subsystem_save_r(ms, path) != 0) {
+    printf("Error: Could not save a checkpoint to %s\n", path);
+    exit(1);
+  }
+  printf("Saved in %.3f seconds\n", now_in_seconds() - start);
+  stat(path, &file_status);
+  printf("Checkpoint is %llu bytes, taking up %llu bytes on disk\n", (uint64_t) file_status.st_size,
+	 (uint64_t) file_status.st_blocks * 512);
+  memory_subsystem_destroy(ms);
+
+  start = now_in_seconds();
+  for (int i = 0; i < NUM_RESTORES; i++) {
+    ms = memory_subsystem_restore(path);
+    if (!ms) {
+      printf("Error: Could not restore the checkpoint\n");
+      exit(1);
+    }
+    memory_subsystem_destroy(ms);
+  }
+  printf("Restored in %.3f milliseconds (average of %d)\n", (now_in_seconds() - start) * 1e3 / NUM_RESTORES, NUM_RESTORES);
+
+  ms = memory_subsystem_restore(path);
+  config.num_accesses /= 8;
+  workload_destroy(workload);
+  workload = workload_create(&config);
+  start = now_in_seconds();
+  workload_run_r(ms, workload);
+  double restored = now_in_seconds() - start;
+  memory_get_stats_r(ms, &stats);
+  memory_subsystem_destroy(ms);
+
+  ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  workload_reset(workload);
+  start = now_in_seconds();
+  workload_run_r(ms, workload);
+  printf("%llu more accesses took %.3f seconds restored, %.3f seconds from empty\n", config.num_accesses,
+	 restored, now_in_seconds() - start);
+  memory_subsystem_destroy(ms);
+  workload_destroy(workload);
+  unlink(path);
+}
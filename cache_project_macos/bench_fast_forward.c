@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Measures fast-forwarding (see memory_start_fast_forward_r()) on the
+// Pass 3 and Pass 4 presets of test_memory_subsystem: the time taken
+// to simulate each in full, and to fast-forward through it keeping no
+// accesses, and keeping the last NUM_WARMING to warm the caches up
+// with (which is included). The workloads are generated beforehand, so
+// that only the accesses themselves are timed.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<23)
+#define BATCH_SIZE 4096
+#define NUM_WARMING (1<<16)
+
+static uint64_t addresses[NUM_ACCESSES], write_data[NUM_ACCESSES], read_data[BATCH_SIZE];
+static uint8_t controls[NUM_ACCESSES];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Returns the time taken to make the accesses, with num_warming -1 for
+//simulating them in full.
+static double run(int64_t num_warming)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  double start = now_in_seconds();
+  if (num_warming >= 0)
+    memory_start_fast_forward_r(ms, num_warming);
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    memory_access_batch_r(ms, addresses + i, write_data + i, controls + i, read_data, NULL, BATCH_SIZE);
+    memory_handle_clock_interrupt_r(ms);
+  }
+  memory_stop_fast_forward_r(ms);
+  double seconds = now_in_seconds() - start;
+  memory_subsystem_destroy(ms);
+  return seconds;
+}
+
+static void bench(WORKLOAD_CONFIG *config, const char *name)
+{
+  config->random = WORKLOAD_RANDOM_XOSHIRO;
+  WORKLOAD *workload = workload_create(config);
+  workload_generate(workload, addresses, write_data, controls, NUM_ACCESSES);
+  workload_destroy(workload);
+
+  double full = run(-1);
+  double fast = run(0);
+  double warmed = run(NUM_WARMING);
+  printf("%s: %.1f ns per access in full, %.1f fast-forwarding (%.1fx faster), %.1f warming up with the last %d\n",
+	 name, full * 1e9 / NUM_ACCESSES, fast * 1e9 / NUM_ACCESSES, full / fast,
+	 warmed * 1e9 / NUM_ACCESSES, NUM_WARMING);
+}
+
+int main()
+{
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  bench(&pass3, "Pass 3");
+  bench(&pass4, "Pass 4");
+}
@@ -0,0 +1,107 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "l1_cache.h"
+
+// Measures the speed of l1_cache_access() and l1_insert_line(),
+// in nanoseconds per access, for the default L1 and for a few other
+// geometries. Each workload is run several times and the fastest
+// run is reported.
+
+#define NUM_ACCESSES (1 << 25)
+#define NUM_RUNS 5
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A small xorshift generator, so that the cost of generating
+// addresses is small compared to the cost of the accesses.
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+// Reads words at random addresses within region_size bytes. On a miss,
+// the line is inserted and the access repeated, as memory_access() does.
+// Every 8K accesses the r bits are cleared. Returns ns per access.
+static double run_workload(L1_CACHE *l1, uint64_t region_size, uint64_t *checksum)
+{
+  uint64_t line[WORDS_PER_CACHE_LINE * 4] = {0};
+  uint64_t evicted_writeback_data[WORDS_PER_CACHE_LINE * 4];
+  uint64_t evicted_writeback_address;
+  uint64_t read_data = 0;
+  uint8_t status;
+  double best = 1e30;
+
+  for (int run = 0; run < NUM_RUNS; run++) {
+    uint64_t state = 0x9E3779B97F4A7C15;
+    l1_initialize_r(l1);
+
+    double start = now_in_seconds();
+    for (uint64_t i = 0; i < NUM_ACCESSES; i++) {
+      uint64_t address = next_random(&state) & (region_size - 1) & ~0x7;
+      uint8_t control = (i & 1) ? READ_ENABLE_MASK : WRITE_ENABLE_MASK;
+
+      l1_cache_access_r(l1, address, i, control, &read_data, &status);
+      if (!(status & 0x1)) {
+	l1_insert_line_r(l1, address, line, &evicted_writeback_address,
+			 evicted_writeback_data, &status);
+	l1_cache_access_r(l1, address, i, control, &read_data, &status);
+      }
+      *checksum += read_data;
+
+      if (!(i & 0x1fff)) {
+	l1_clear_r_bits_r(l1);
+      }
+    }
+    double elapsed = now_in_seconds() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return best * 1e9 / NUM_ACCESSES;
+}
+
+int main()
+{
+  L1_GEOMETRY geometries[] = {
+    L1_DEFAULT_GEOMETRY,
+    {64 * 1024, 8, 64},
+    {64 * 1024, 2, 64},
+    {256 * 1024, 4, 64},
+    {64 * 1024, 4, 128},
+  };
+  uint64_t regions[] = {32 * 1024, 1024 * 1024};
+  uint64_t checksum = 0;
+
+  printf("%10s %6s %6s %10s %12s\n", "size", "ways", "line", "region", "ns/access");
+
+  for (int g = 0; g < (int) (sizeof(geometries) / sizeof(geometries[0])); g++) {
+    L1_CACHE *l1 = l1_create_with_geometry(&geometries[g]);
+    if (!l1) {
+      printf("Error: could not create L1 cache\n");
+      exit(1);
+    }
+    for (int r = 0; r < (int) (sizeof(regions) / sizeof(regions[0])); r++) {
+      double ns = run_workload(l1, regions[r], &checksum);
+      printf("%10llu %6u %6u %10llu %12.2f\n", geometries[g].size_in_bytes,
+	     geometries[g].lines_per_set, geometries[g].bytes_per_line, regions[r], ns);
+    }
+    l1_destroy(l1);
+  }
+
+  //printed so that the accesses can't be optimized away
+  printf("checksum %llu\n", checksum);
+}
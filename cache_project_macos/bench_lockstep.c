@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "workload.h"
+
+// Measures how long replaying a trace against K memory subsystems of
+// different configurations takes, one replay after another and all K
+// in lockstep (see trace_replay_lockstep_r()), for a plain and a
+// compact trace of the Pass 4 preset. The trace is recorded to /tmp
+// first, and replayed once before timing so that it is in the host's
+// page cache.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<23)
+#define MAX_CONFIGS 8
+
+static char path[64];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void record_trace(uint32_t flags)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, flags);
+  WORKLOAD_CONFIG config = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  config.num_accesses = NUM_ACCESSES;
+  config.random = WORKLOAD_RANDOM_XOSHIRO;
+  WORKLOAD *workload = workload_create(&config);
+  memory_subsystem_set_recorder_r(ms, recorder);
+  workload_run_r(ms, workload);
+  memory_subsystem_set_recorder_r(ms, NULL);
+  trace_recorder_destroy(recorder);
+  workload_destroy(workload);
+  memory_subsystem_destroy(ms);
+}
+
+//Creates the first k of MAX_CONFIGS configurations: the L2 cache with
+//1 to 8 ways, and the L1 cache using NRU or LRU.
+static void create_subsystems(MEMORY_SUBSYSTEM *ms[], int k)
+{
+  for (int i = 0; i < k; i++) {
+    MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    config.l2_geometry.lines_per_set = 1 << (i % 4);
+    config.l1_replacement_policy = i < 4 ? REPLACEMENT_NRU : REPLACEMENT_LRU;
+    ms[i] = memory_subsystem_create_with_config(&config);
+  }
+}
+
+static void destroy_subsystems(MEMORY_SUBSYSTEM *ms[], int k)
+{
+  for (int i = 0; i < k; i++)
+    memory_subsystem_destroy(ms[i]);
+}
+
+static void bench(uint32_t flags, const char *name)
+{
+  MEMORY_SUBSYSTEM *ms[MAX_CONFIGS];
+
+  record_trace(flags);
+  create_subsystems(ms, 1);
+  trace_replay_r(ms[0], path, NULL);
+  destroy_subsystems(ms, 1);
+
+  for (int k = 1; k <= MAX_CONFIGS; k *= 2) {
+    create_subsystems(ms, k);
+    double start = now_in_seconds();
+    for (int i = 0; i < k; i++)
+      trace_replay_r(ms[i], path, NULL);
+    double separate = now_in_seconds() - start;
+    destroy_subsystems(ms, k);
+
+    create_subsystems(ms, k);
+    start = now_in_seconds();
+    trace_replay_lockstep_r(ms, k, path, NULL);
+    double lockstep = now_in_seconds() - start;
+    destroy_subsystems(ms, k);
+
+    printf("%s trace, %d configurations: %.3f seconds one after another, %.3f seconds in lockstep (%.1f ns per access per configuration)\n",
+	   name, k, separate, lockstep, lockstep * 1e9 / NUM_ACCESSES / k);
+  }
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/bench_lockstep_%d.trace", (int) getpid());
+  bench(0, "Plain");
+  bench(TRACE_COMPACT, "Compact");
+  unlink(path);
+}
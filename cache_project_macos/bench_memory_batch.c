@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+
+// Compares the time taken by the same accesses made through a loop
+// of memory_access() calls and through memory_access_batch(), for
+// the access patterns of Pass 3 (random words) and Pass 4 (runs of
+// consecutive words) of test_memory_subsystem.c, with a clock
+// interrupt every 8K accesses. Reports ns per access, and checks
+// that both ways give the same miss counts.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<24)
+#define INTERRUPT_INTERVAL 0x2000
+#define LONGEST_SEQUENCE 10000
+
+extern uint64_t num_l1_misses;
+extern uint64_t num_l2_misses;
+
+static uint64_t addresses[NUM_ACCESSES];
+static uint64_t write_data[NUM_ACCESSES];
+static uint64_t read_data[NUM_ACCESSES];
+static uint8_t controls[NUM_ACCESSES];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void generate(int sequential)
+{
+  uint64_t i = 0;
+  srand(12345);
+  while (i < NUM_ACCESSES) {
+    uint64_t length = sequential ? rand() % LONGEST_SEQUENCE : 1;
+    uint64_t address = (rand() % MAIN_MEMORY_SIZE_IN_BYTES) & ~0x7;
+    for (uint64_t j = 0; j < length && address + (j << 3) < MAIN_MEMORY_SIZE_IN_BYTES && i < NUM_ACCESSES; j++, i++) {
+      addresses[i] = address + (j << 3);
+      write_data[i] = i;
+      controls[i] = (rand() % 2) ? READ_ENABLE_MASK : WRITE_ENABLE_MASK;
+    }
+  }
+}
+
+static double run(int batched, uint64_t *l1_misses, uint64_t *l2_misses)
+{
+  memory_subsystem_initialize(MAIN_MEMORY_SIZE_IN_BYTES);
+  double start = now_in_seconds();
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += INTERRUPT_INTERVAL) {
+    if (batched) {
+      memory_access_batch(addresses + i, write_data + i, controls + i, read_data + i, NULL, INTERRUPT_INTERVAL);
+    } else {
+      for (uint64_t j = i; j < i + INTERRUPT_INTERVAL; j++)
+	memory_access(addresses[j], write_data[j], controls[j], &read_data[j]);
+    }
+    memory_handle_clock_interrupt();
+  }
+  double elapsed = now_in_seconds() - start;
+  *l1_misses = num_l1_misses;
+  *l2_misses = num_l2_misses;
+  return elapsed * 1e9 / NUM_ACCESSES;
+}
+
+int main()
+{
+  const char *names[] = {"random (Pass 3)", "sequences (Pass 4)"};
+
+  printf("%-20s %12s %12s %8s\n", "pattern", "loop ns", "batch ns", "speedup");
+  for (int sequential = 0; sequential < 2; sequential++) {
+    uint64_t loop_l1, loop_l2, batch_l1, batch_l2;
+    generate(sequential);
+    double loop = run(0, &loop_l1, &loop_l2);
+    double batch = run(1, &batch_l1, &batch_l2);
+    if (loop_l1 != batch_l1 || loop_l2 != batch_l2) {
+      printf("Error: Miss counts differ\n");
+      exit(1);
+    }
+    printf("%-20s %12.2f %12.2f %8.2f\n", names[sequential], loop, batch, loop / batch);
+  }
+}
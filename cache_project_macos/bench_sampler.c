@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "workload.h"
+#include "sampler.h"
+
+// Measures the accuracy and the speed of sampled simulation (see
+// sampler.h) on the Pass 3 and Pass 4 presets of test_memory_subsystem,
+// in full: each is run against the default subsystem with a recorder
+// attached, which gives the statistics of the full caches, and the
+// compact trace recorded is then replayed in full and sampled, by
+// set and by line, at several rates. For each, the estimated L1 and
+// L2 misses are printed with their 95% confidence intervals, their
+// error against the full run, and the time taken.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+
+static char path[64];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void print_estimate(const char *name, SAMPLER_ESTIMATE *estimate, uint64_t actual)
+{
+  printf("    %s %.0f +- %.0f (actual %llu, error %+.2f%%%s)\n", name, estimate->estimate, estimate->half_width,
+	 actual, 100.0 * (estimate->estimate - actual) / actual,
+	 fabs(estimate->estimate - actual) <= estimate->half_width ? "" : ", outside the interval");
+}
+
+static void bench(WORKLOAD_CONFIG *workload_config, const char *name)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, TRACE_COMPACT);
+  WORKLOAD *workload = workload_create(workload_config);
+  MEMORY_SUBSYSTEM_STATS full;
+
+  memory_subsystem_set_recorder_r(ms, recorder);
+  workload_run_r(ms, workload);
+  memory_subsystem_set_recorder_r(ms, NULL);
+  trace_recorder_destroy(recorder);
+  workload_destroy(workload);
+  memory_get_stats_r(ms, &full);
+  memory_subsystem_destroy(ms);
+
+  ms = memory_subsystem_create_with_config(&config);
+  double start = now_in_seconds();
+  trace_replay_r(ms, path, NULL);
+  double full_seconds = now_in_seconds() - start;
+  memory_subsystem_destroy(ms);
+  printf("%s: replayed in full in %.3f seconds, %llu L1 misses, %llu L2 misses\n", name, full_seconds,
+	 full.num_l1_misses, full.num_l2_misses);
+
+  double rates[] = {1.0 / 8, 1.0 / 32, 1.0 / 128};
+  for (int mode = SAMPLER_SETS; mode <= SAMPLER_LINES; mode++) {
+    for (int r = 0; r < (int) (sizeof(rates) / sizeof(rates[0])); r++) {
+      SAMPLER_CONFIG sampling = {(SAMPLER_MODE) mode, rates[r], 1};
+      SAMPLER_STATS stats;
+      SAMPLER *sampler = sampler_create(&config, &sampling);
+      if (!sampler) {
+	printf("  %s sampling at 1/%.0f: not possible with these caches\n", mode == SAMPLER_SETS ? "Set" : "Line", 1 / rates[r]);
+	continue;
+      }
+      start = now_in_seconds();
+      sampler_replay_r(sampler, path, NULL);
+      sampler_get_stats_r(sampler, &stats);
+      double seconds = now_in_seconds() - start;
+      printf("  %s sampling at 1/%.0f (%d groups): %.3f seconds (%.1fx faster), %llu accesses simulated\n",
+	     mode == SAMPLER_SETS ? "Set" : "Line", 1 / stats.rate, stats.num_groups, seconds,
+	     full_seconds / seconds, stats.num_simulated);
+      print_estimate("L1 misses", &stats.l1_misses, full.num_l1_misses);
+      print_estimate("L2 misses", &stats.l2_misses, full.num_l2_misses);
+      sampler_destroy(sampler);
+    }
+  }
+}
+
+int main()
+{
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  snprintf(path, sizeof(path), "/tmp/bench_sampler_%d.trace", (int) getpid());
+  bench(&pass3, "Pass 3");
+  bench(&pass4, "Pass 4");
+  unlink(path);
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "text_trace.h"
+
+// Measures how fast text traces are parsed, in GB of text per second,
+// by text_trace_read() and, for comparison, by fscanf(). A Dinero and
+// a hexadecimal trace of NUM_LINES random accesses are written to
+// /tmp first. Only the parsing is timed, not the simulation, so that
+// it can be seen whether reading a text trace would hold back a
+// replay.
+
+#define NUM_LINES 20000000
+#define BATCH_SIZE 4096
+
+static char path[64];
+static uint64_t addresses[BATCH_SIZE];
+static uint8_t controls[BATCH_SIZE];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t write_trace(int format)
+{
+  FILE *file = fopen(path, "w");
+  uint64_t state = 777;
+  for (uint64_t i = 0; i < NUM_LINES; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    uint64_t address = (state >> 16) & 0x7FFFFFFFF8;
+    if (format == TEXT_TRACE_DINERO)
+      fprintf(file, "%d %llx\n", (int)(state % 3), address);
+    else
+      fprintf(file, "%llx\n", address);
+  }
+  uint64_t size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+static void bench(int format, const char *name)
+{
+  uint64_t size = write_trace(format);
+  uint64_t sum = 0, n, total = 0;
+
+  //Read the file once first, so that both parsers find it in the
+  //host's page cache.
+  TEXT_TRACE *trace = text_trace_open(path, format);
+  while ((n = text_trace_read(trace, addresses, controls, BATCH_SIZE)) > 0)
+    ;
+  text_trace_close(trace);
+
+  double start = now_in_seconds();
+  trace = text_trace_open(path, format);
+  while ((n = text_trace_read(trace, addresses, controls, BATCH_SIZE)) > 0) {
+    total += n;
+    sum += addresses[n - 1];
+  }
+  text_trace_close(trace);
+  double seconds = now_in_seconds() - start;
+  printf("%s, text_trace_read(): %llu lines, %.2f GB/s (%.1f ns per line)\n",
+	 name, total, size / seconds / 1e9, seconds * 1e9 / total);
+
+  start = now_in_seconds();
+  FILE *file = fopen(path, "r");
+  unsigned long long address;
+  int label;
+  total = 0;
+  if (format == TEXT_TRACE_DINERO) {
+    while (fscanf(file, "%d %llx", &label, &address) == 2) {
+      total++;
+      sum += address;
+    }
+  } else {
+    while (fscanf(file, "%llx", &address) == 1) {
+      total++;
+      sum += address;
+    }
+  }
+  fclose(file);
+  seconds = now_in_seconds() - start;
+  printf("%s, fscanf(): %llu lines, %.2f GB/s (%.1f ns per line)\n",
+	 name, total, size / seconds / 1e9, seconds * 1e9 / total);
+
+  if (sum == 42)
+    printf("\n");
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/bench_text_trace_%d.txt", (int) getpid());
+  bench(TEXT_TRACE_DINERO, "Dinero");
+  bench(TEXT_TRACE_HEX, "Hexadecimal");
+  unlink(path);
+}
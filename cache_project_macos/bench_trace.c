@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "workload.h"
+
+// Measures the cost of recording a trace (see trace.h) on the Pass 3
+// and Pass 4 presets of test_memory_subsystem: the time taken to
+// simulate each with no recorder, and while recording it to a flat
+// and to a compact trace. Two times are given for each: the wall time,
+// and the CPU time of the thread being traced, which is the cost of
+// recording to the producer (storing each record in the ring, and
+// waiting when it is full) without the writer thread's own work.
+// With a spare core, the writer runs there and the wall time is close
+// to the producer's; on a single core the writer takes its turns on
+// the same core, and the wall time includes its work too. The
+// workloads are generated beforehand, so that only the accesses
+// themselves are timed, and the best of NUM_RUNS runs is given.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<23)
+#define BATCH_SIZE 4096
+#define NUM_RUNS 5
+
+static uint64_t addresses[NUM_ACCESSES], write_data[NUM_ACCESSES], read_data[BATCH_SIZE];
+static uint8_t controls[NUM_ACCESSES];
+static char path[64];
+
+static double seconds(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Makes the accesses, recording them with the given flags (-1 for no
+//recorder), and returns the wall and thread CPU time taken in
+//nanoseconds per access. Destroying the recorder, which waits for
+//the writer to finish, is included in the wall time.
+static void run(int flags, double *wall, double *cpu)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  TRACE_RECORDER *recorder = NULL;
+  if (flags >= 0) {
+    recorder = trace_recorder_create(path, flags);
+    if (!recorder) {
+      printf("Error: Could not create the trace %s\n", path);
+      exit(1);
+    }
+    memory_subsystem_set_recorder_r(ms, recorder);
+  }
+  double wall_start = seconds(CLOCK_MONOTONIC);
+  double cpu_start = seconds(CLOCK_THREAD_CPUTIME_ID);
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    memory_access_batch_r(ms, addresses + i, write_data + i, controls + i, read_data, NULL, BATCH_SIZE);
+    memory_handle_clock_interrupt_r(ms);
+  }
+  memory_subsystem_set_recorder_r(ms, NULL);
+  *cpu = (seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_start) * 1e9 / NUM_ACCESSES;
+  if (recorder && trace_recorder_destroy(recorder) != 0) {
+    printf("Error: Could not write the trace %s\n", path);
+    exit(1);
+  }
+  *wall = (seconds(CLOCK_MONOTONIC) - wall_start) * 1e9 / NUM_ACCESSES;
+  memory_subsystem_destroy(ms);
+  unlink(path);
+}
+
+static void bench(WORKLOAD_CONFIG *config, const char *name)
+{
+  int flags[] = {-1, 0, TRACE_COMPACT};
+  const char *names[] = {"not recording", "recording flat", "recording compact"};
+  double wall[3], cpu[3];
+
+  config->random = WORKLOAD_RANDOM_XOSHIRO;
+  WORKLOAD *workload = workload_create(config);
+  workload_generate(workload, addresses, write_data, controls, NUM_ACCESSES);
+  workload_destroy(workload);
+
+  for (int f = 0; f < 3; f++) {
+    wall[f] = cpu[f] = 1e30;
+    for (int r = 0; r < NUM_RUNS; r++) {
+      double run_wall, run_cpu;
+      run(flags[f], &run_wall, &run_cpu);
+      if (run_wall < wall[f])
+	wall[f] = run_wall;
+      if (run_cpu < cpu[f])
+	cpu[f] = run_cpu;
+    }
+    printf("%s, %-17s  wall %6.1f ns per access (%+5.1f%%)  traced thread %6.1f ns per access (%+5.1f%%)\n",
+	   name, names[f], wall[f], 100 * (wall[f] / wall[0] - 1), cpu[f], 100 * (cpu[f] / cpu[0] - 1));
+  }
+}
+
+int main()
+{
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  snprintf(path, sizeof(path), "/tmp/bench_trace_%d.trace", (int) getpid());
+  printf("%ld CPUs online\n", sysconf(_SC_NPROCESSORS_ONLN));
+  bench(&pass3, "Pass 3");
+  bench(&pass4, "Pass 4");
+}
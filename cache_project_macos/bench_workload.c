@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Measures how long each workload takes to generate its accesses, in
+// nanoseconds per access, and how long running the Pass 3 and Pass 4
+// presets against a 32MB memory subsystem takes, with the random
+// numbers drawn from rand() (as test_memory_subsystem does) and from
+// xoshiro256**. The difference is the cost of rand() in those passes.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define BATCH_SIZE 4096
+
+static uint64_t addresses[BATCH_SIZE];
+static uint64_t write_data[BATCH_SIZE];
+static uint8_t controls[BATCH_SIZE];
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_generate(WORKLOAD_CONFIG *config, const char *name)
+{
+  WORKLOAD *workload = workload_create(config);
+  uint64_t sum = 0;
+  double start = now_in_seconds();
+  for (uint64_t i = 0; i < config->num_accesses; i += BATCH_SIZE) {
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+    sum += addresses[BATCH_SIZE - 1];
+  }
+  double seconds = now_in_seconds() - start;
+  printf("Generating %-16s %.1f ns per access\n", name, seconds * 1e9 / config->num_accesses);
+  workload_destroy(workload);
+  if (sum == 42)
+    printf("\n");
+}
+
+static void bench_run(WORKLOAD_CONFIG *config, const char *name)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS stats;
+  WORKLOAD *workload = workload_create(config);
+  double start = now_in_seconds();
+  workload_run_r(ms, workload);
+  double seconds = now_in_seconds() - start;
+  memory_get_stats_r(ms, &stats);
+  printf("Running %-19s %.3f seconds (%.1f ns per access), %llu L1 misses, %llu L2 misses\n", name,
+	 seconds, seconds * 1e9 / config->num_accesses, stats.num_l1_misses, stats.num_l2_misses);
+  workload_destroy(workload);
+  memory_subsystem_destroy(ms);
+}
+
+int main()
+{
+  const char *names[] = {"stream", "strided", "uniform", "zipf", "chase", "runs"};
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG config;
+
+  bench_generate(&pass3, "pass3 (rand)");
+  bench_generate(&pass4, "pass4 (rand)");
+  pass3.random = pass4.random = WORKLOAD_RANDOM_XOSHIRO;
+  bench_generate(&pass3, "pass3 (xoshiro)");
+  bench_generate(&pass4, "pass4 (xoshiro)");
+  for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+    workload_config_from_name(names[i], MAIN_MEMORY_SIZE_IN_BYTES, &config);
+    bench_generate(&config, names[i]);
+  }
+
+  pass3.random = pass4.random = WORKLOAD_RANDOM_LIBC;
+  bench_run(&pass3, "pass3 (rand)");
+  bench_run(&pass4, "pass4 (rand)");
+  pass3.random = pass4.random = WORKLOAD_RANDOM_XOSHIRO;
+  bench_run(&pass3, "pass3 (xoshiro)");
+  bench_run(&pass4, "pass4 (xoshiro)");
+}
@@ -0,0 +1,79 @@
+/************************************************************
+
+                   cache_tags.h
+
+Tag matching shared by the L1 and L2 caches. Both keep their
+tags in a packed array of 64-bit words, one per line, with the
+tags of a set next to each other and the status bits (valid,
+dirty, ...) above the tag.
+
+cache_find_tag() returns the number of the line in a set (whose
+tags start at tags) for which (tags[line] & compare_mask) equals
+wanted, or -1 if there is none. The caller builds wanted from
+the valid bit and the tag, and compare_mask from everything but
+the status bits that don't matter for a match (reference,
+dirty, ...).
+
+With AVX2, four tags are compared at once with
+_mm256_cmpeq_epi64; with SSE2, two at a time, by comparing
+32-bit halves and combining each pair of halves.
+_mm*_movemask_pd then gives a bit per matching line. Any lines
+left over (or all of them, on other processors) are compared
+one at a time.
+
+It is always inlined, so when a caller passes a constant
+lines_per_set the compares are unrolled for that number.
+
+**************************************************************/
+
+#ifndef CACHE_TAGS_H
+#define CACHE_TAGS_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline __attribute__((always_inline))
+int cache_find_tag(const uint64_t *tags, uint64_t lines_per_set,
+                   uint64_t wanted, uint64_t compare_mask) {
+  uint64_t line = 0;
+
+#if defined(__AVX2__)
+  const __m256i wanted4 = _mm256_set1_epi64x(wanted);
+  const __m256i compare_mask4 = _mm256_set1_epi64x(compare_mask);
+  for (; line + 4 <= lines_per_set; line += 4) {
+    __m256i tags4 = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(tags + line)), compare_mask4);
+    int matches = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(tags4, wanted4)));
+    if (matches) {
+      return line + __builtin_ctz(matches);
+    }
+  }
+#endif
+
+#if defined(__SSE2__)
+  const __m128i wanted2 = _mm_set1_epi64x(wanted);
+  const __m128i compare_mask2 = _mm_set1_epi64x(compare_mask);
+  for (; line + 2 <= lines_per_set; line += 2) {
+    __m128i tags2 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(tags + line)), compare_mask2);
+    __m128i equal_halves = _mm_cmpeq_epi32(tags2, wanted2);
+    __m128i equal = _mm_and_si128(equal_halves, _mm_shuffle_epi32(equal_halves, _MM_SHUFFLE(2, 3, 0, 1)));
+    int matches = _mm_movemask_pd(_mm_castsi128_pd(equal));
+    if (matches) {
+      return line + __builtin_ctz(matches);
+    }
+  }
+#endif
+
+  for (; line < lines_per_set; line++) {
+    if ((tags[line] & compare_mask) == wanted) {
+      return line;
+    }
+  }
+  return -1;
+}
+
+#endif
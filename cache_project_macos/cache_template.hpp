@@ -0,0 +1,276 @@
+/************************************************************
+
+                   cache_template.hpp
+
+A header-only C++ version of the caches in l1_cache.c and
+l2_cache.c, with the whole geometry fixed at compile time:
+
+  Cache<Sets, Ways, LineBytes, ReplacementPolicy, WritePolicy>
+
+Sets and LineBytes must be powers of two (LineBytes at least one
+8-byte word). Because they are template parameters, the masks and
+shifts used to take an address apart are constexpr, and the scan
+over the ways of a set is unrolled separately for each
+instantiation, so there are no loops over a run-time number of
+ways on the hot path.
+
+ReplacementPolicy chooses which line of a full set to evict:
+  NRU:  the policy of l1_cache.c. A line is chosen in the order
+        invalid, r=0 d=0, r=0 d=1, r=1 d=0, and otherwise way 0.
+        The r bits are cleared by clear_r_bits().
+With one way per set (a direct-mapped cache, like l2_cache.c)
+every policy simply picks way 0.
+
+WritePolicy says what a write hit does:
+  WriteBack:    the line is marked dirty, and is written back
+                when it is evicted.
+  WriteThrough: the line is never marked dirty, so evictions
+                never need a write-back; the caller is responsible
+                for also sending each write to the next level.
+
+The entries of a cache are stored inside the Cache object itself
+(a Cache<32768, 1, 64, ...> is over 2MB), so large caches should
+be static or allocated with new rather than put on the stack.
+
+Two instantiations reproduce the C caches exactly:
+
+  L1Cache:  Cache<256, 4, 64, NRU, WriteBack>      (64KB, 4-way)
+  L2Cache:  Cache<32768, 1, 64, NRU, WriteBack>    (2MB, direct-mapped)
+
+and tmpl_l1_cache.cpp / tmpl_l2_cache.cpp use them to provide the
+C interface of l1_cache.h / l2_cache.h, so that test_l1 and test_l2
+can be run against them (make tmpl).
+
+**************************************************************/
+
+#ifndef CACHE_TEMPLATE_HPP
+#define CACHE_TEMPLATE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace cache_template {
+
+// Replacement policies
+struct NRU {};
+
+// Write policies
+struct WriteBack {};
+struct WriteThrough {};
+
+//Returns log2(x) for a power of two x, at compile time.
+constexpr unsigned log2_of(uint64_t x) {
+  return x <= 1 ? 0 : 1 + log2_of(x >> 1);
+}
+
+constexpr bool is_power_of_two(uint64_t x) {
+  return x != 0 && (x & (x - 1)) == 0;
+}
+
+//Calls f(std::integral_constant<unsigned, way>) for way = 0, 1, ...
+//Ways - 1, in order, stopping after the first call that returns true.
+//Returns whether any call returned true. Since the way numbers are
+//compile-time constants, this unrolls into a straight-line sequence.
+template <unsigned Ways, typename F, unsigned... Way>
+inline bool for_each_way_until(F &&f, std::integer_sequence<unsigned, Way...>) {
+  return (... || f(std::integral_constant<unsigned, Way>{}));
+}
+
+template <unsigned Ways, typename F>
+inline bool for_each_way_until(F &&f) {
+  return for_each_way_until<Ways>(std::forward<F>(f), std::make_integer_sequence<unsigned, Ways>{});
+}
+
+
+template <uint64_t Sets, unsigned Ways, unsigned LineBytes,
+          typename ReplacementPolicy, typename WritePolicy>
+class Cache {
+  static_assert(is_power_of_two(Sets), "the number of sets must be a power of two");
+  static_assert(Ways >= 1, "a set must have at least one way");
+  static_assert(is_power_of_two(LineBytes) && LineBytes >= 8,
+                "a line must be a power of two of at least one 8-byte word");
+  static_assert(std::is_same<ReplacementPolicy, NRU>::value,
+                "unknown replacement policy");
+  static_assert(std::is_same<WritePolicy, WriteBack>::value ||
+                std::is_same<WritePolicy, WriteThrough>::value,
+                "unknown write policy");
+
+public:
+  static constexpr uint64_t num_sets = Sets;
+  static constexpr unsigned lines_per_set = Ways;
+  static constexpr unsigned bytes_per_line = LineBytes;
+  static constexpr unsigned words_per_line = LineBytes / 8;
+  static constexpr uint64_t size_in_bytes = Sets * Ways * LineBytes;
+
+  // Only the lowest 48 bits of an address are used.
+  static constexpr uint64_t lower_48_bit_mask = 0xFFFFFFFFFFFF;
+
+  static constexpr unsigned word_offset_shift = 3;
+  static constexpr uint64_t word_offset_mask = LineBytes - 8;
+  static constexpr unsigned set_index_shift = log2_of(LineBytes);
+  static constexpr uint64_t set_index_mask = (Sets - 1) << set_index_shift;
+  static constexpr unsigned address_tag_shift = set_index_shift + log2_of(Sets);
+  static constexpr uint64_t entry_tag_mask = (uint64_t(1) << (48 - address_tag_shift)) - 1;
+
+  static_assert(address_tag_shift < 48, "the cache is too big for a 48-bit address");
+
+  // Status bits, kept above the tag in v_r_d_tag as in l1_cache.c.
+  static constexpr uint64_t vbit_mask = uint64_t(1) << 63;
+  static constexpr uint64_t rbit_mask = uint64_t(1) << 62;
+  static constexpr uint64_t dirtybit_mask = uint64_t(1) << 61;
+
+  static constexpr uint64_t set_index(uint64_t address) {
+    return (address & lower_48_bit_mask & set_index_mask) >> set_index_shift;
+  }
+
+  static constexpr uint64_t tag(uint64_t address) {
+    return (address & lower_48_bit_mask) >> address_tag_shift;
+  }
+
+  static constexpr uint64_t word_offset(uint64_t address) {
+    return (address & word_offset_mask) >> word_offset_shift;
+  }
+
+  static constexpr uint64_t line_address(uint64_t tag, uint64_t set_index) {
+    return (tag << address_tag_shift) | (set_index << set_index_shift);
+  }
+
+  Cache() { initialize(); }
+
+  //Clears the valid bit of every entry.
+  void initialize() {
+    for (uint64_t set = 0; set < Sets; set++)
+      for (unsigned way = 0; way < Ways; way++)
+        sets_[set].lines[way].v_r_d_tag = 0;
+  }
+
+  //Reads and/or writes one word, as l1_cache_access() does.
+  //Returns true on a hit; a miss changes nothing.
+  bool access_word(uint64_t address, uint64_t write_data, uint8_t control, uint64_t *read_data) {
+    Entry *entry = find(address);
+    if (!entry)
+      return false;
+    entry->v_r_d_tag |= rbit_mask;
+    uint64_t offset = word_offset(address);
+    if (control & 0x1)
+      *read_data = entry->line[offset];
+    if (control & 0x2) {
+      entry->line[offset] = write_data;
+      mark_written(entry);
+    }
+    return true;
+  }
+
+  //Reads and/or writes a whole line, as l2_cache_access() does.
+  //Returns true on a hit; a miss changes nothing.
+  bool access_line(uint64_t address, const uint64_t write_data[], uint8_t control, uint64_t read_data[]) {
+    Entry *entry = find(address);
+    if (!entry)
+      return false;
+    entry->v_r_d_tag |= rbit_mask;
+    if (control & 0x1)
+      memcpy(read_data, entry->line, LineBytes);
+    if (control & 0x2) {
+      memcpy(entry->line, write_data, LineBytes);
+      mark_written(entry);
+    }
+    return true;
+  }
+
+  //Inserts the line containing address, as l1_insert_line() and
+  //l2_insert_line() do. Returns true if the evicted line was dirty,
+  //in which case its address and data have been stored in
+  //evicted_writeback_address and evicted_writeback_data.
+  bool insert_line(uint64_t address, const uint64_t write_data[],
+                   uint64_t *evicted_writeback_address, uint64_t evicted_writeback_data[]) {
+    uint64_t index = set_index(address);
+    Set &set = sets_[index];
+    Entry &victim = set.lines[choose_victim(set)];
+
+    bool writeback = (victim.v_r_d_tag & (vbit_mask | dirtybit_mask)) == (vbit_mask | dirtybit_mask);
+    if (writeback) {
+      *evicted_writeback_address = line_address(victim.v_r_d_tag & entry_tag_mask, index);
+      memcpy(evicted_writeback_data, victim.line, LineBytes);
+    }
+
+    victim.v_r_d_tag = (tag(address) & entry_tag_mask) | vbit_mask;
+    memcpy(victim.line, write_data, LineBytes);
+    return writeback;
+  }
+
+  //Clears the r bit of every entry, for NRU.
+  void clear_r_bits() {
+    for (uint64_t set = 0; set < Sets; set++)
+      for (unsigned way = 0; way < Ways; way++)
+        sets_[set].lines[way].v_r_d_tag &= ~rbit_mask;
+  }
+
+private:
+  struct Entry {
+    uint64_t v_r_d_tag;
+    uint64_t line[words_per_line];
+  };
+
+  struct Set {
+    Entry lines[Ways];
+  };
+
+  Set sets_[Sets];
+
+  Entry *find(uint64_t address) {
+    Set &set = sets_[set_index(address)];
+    const uint64_t wanted = tag(address) | vbit_mask;
+    Entry *found = nullptr;
+    for_each_way_until<Ways>([&](auto way) {
+      if ((set.lines[way].v_r_d_tag & ~(rbit_mask | dirtybit_mask)) == wanted) {
+        found = &set.lines[way];
+        return true;
+      }
+      return false;
+    });
+    return found;
+  }
+
+  void mark_written(Entry *entry) {
+    if (std::is_same<WritePolicy, WriteBack>::value)
+      entry->v_r_d_tag |= dirtybit_mask;
+  }
+
+  //NRU victim choice: the first invalid line; otherwise the first line
+  //in the best of the classes r=0 d=0, r=0 d=1, r=1 d=0; otherwise way 0.
+  //The class of a valid line is (r << 1) | d, so the best class is the
+  //smallest, with r=1 d=1 (3) never preferred over way 0.
+  unsigned choose_victim(const Set &set) {
+    if (Ways == 1)
+      return 0;
+
+    unsigned chosen = 0;
+    unsigned best_class = 3;
+    for_each_way_until<Ways>([&](auto way) {
+      uint64_t v_r_d_tag = set.lines[way].v_r_d_tag;
+      if (!(v_r_d_tag & vbit_mask)) {
+        chosen = way;
+        return true;
+      }
+      unsigned line_class = (unsigned)(((v_r_d_tag & rbit_mask) ? 2 : 0) | ((v_r_d_tag & dirtybit_mask) ? 1 : 0));
+      if (line_class < best_class) {
+        best_class = line_class;
+        chosen = way;
+      }
+      return false;
+    });
+    return chosen;
+  }
+};
+
+// The two caches of the memory subsystem.
+typedef Cache<256, 4, 64, NRU, WriteBack> L1Cache;
+typedef Cache<32768, 1, 64, NRU, WriteBack> L2Cache;
+
+} // namespace cache_template
+
+#endif
@@ -48,40 +48,82 @@ cache hardware would not have those.
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "memory_subsystem_constants.h"
 #include "l1_cache.h"
+#include "cache_tags.h"
+#include "replacement_policy.h"
 
 
 /***************************************************
-This struct defines the structure of a single cache
-entry in the L1 cache. It has the following fields:
-  v_r_d_tag: 64-bit unsigned word containing the 
-           valid (v) bit at bit 63 (leftmost bit),
-           the reference (r) bit at bit 62,
-           the dirty bit (d) at bit 61, and the tag 
-           in bits 0 through 33 (the 34 rightmost bits)
-  cache_line: an array of 8 words, constituting a single
-              cache line.
+The shape of an L1 cache is given by an L1_GEOMETRY (see
+l1_cache.h): its size in bytes, the number of lines per set
+and the number of bytes per line. Everything else -- the
+number of sets, and the masks and shifts used to pull the
+word offset, set index and tag out of an address -- is
+derived from those three numbers when the cache is created.
+
+The default geometry is the one described above: 64KB,
+4 lines per set and 64 bytes per line, so 256 sets, with
+the set index in bits 6-13 and the tag in bits 14-47.
 ****************************************************/
 
-typedef struct {
-  uint64_t v_r_d_tag;
-  uint64_t cache_line[WORDS_PER_CACHE_LINE];
-} L1_CACHE_ENTRY;
-
 //4-way set-associative cache, so there are
-//4 cache lines per set.
+//4 cache lines per set by default.
 #define L1_LINES_PER_SET 4
 
 /***************************************************
-  This structure defines an L1 cache set. Its only
-  field, lines, is an array of four cache lines.
+The tags and the line data are kept in two separate
+arrays, so that looking a tag up only touches the tags:
+
+  tags:  one 64-bit v_r_d_tag word per entry, containing
+         the valid (v) bit at bit 63 (leftmost bit), the
+         dirty bit (d) at bit 61, the replacement policy's
+         bits for the line at bits 48-60, and the tag in the
+         rightmost bits. The r bit is not stored as such:
+         NRU keeps an epoch stamp in the policy bits instead,
+         so that clearing every r bit takes constant time
+         (see replacement_policy.h). Bit 62 is unused.
+         The tags of a set are next to each other, so the
+         4 tags of a default set fill 32 bytes (half of a
+         64-byte host cache line) and can be compared with
+         the wanted tag all at once using SIMD instructions.
+  lines: the cache line data of each entry, in the same
+         order as the tags.
+****************************************************/
+
+/***************************************************
+  This structure defines one instance of the L1 cache.
+  Every procedure whose name ends in _r operates on the
+  instance passed to it, so independent caches can be
+  used from separate threads.
 ***************************************************/
 
-typedef struct {
-  L1_CACHE_ENTRY lines[L1_LINES_PER_SET];
-} L1_CACHE_SET;
+struct L1_CACHE {
+  L1_GEOMETRY geometry;
+
+  uint64_t num_sets;
+  uint64_t lines_per_set;
+  uint64_t words_per_line;
+
+  uint64_t word_offset_mask;  // mask and shift for the word within a line
+  uint64_t set_index_mask;    // mask and shift for the set index
+  uint64_t set_index_shift;
+  uint64_t address_tag_shift; // the tag is everything above the set index
+  uint64_t entry_tag_mask;    // mask for the tag within v_r_d_tag
+
+  uint64_t *tags;             // num_sets * lines_per_set v_r_d_tag words
+  uint64_t *lines;            // num_sets * lines_per_set * words_per_line words
+
+  REPLACEMENT_STATE replacement; // the replacement policy (see replacement_policy.h)
+
+  uint64_t last_hit_entry;    // entry of the last hit in l1_cache_access_r()
+};
+
+//The instance used by the original, non-reentrant procedures
+//(l1_initialize(), l1_cache_access(), etc).
+static L1_CACHE l1_default_cache;
 
 // Although addresses are 64 bits, only the lowest 48
 // bits are actually used. The upper 16 bits are
@@ -89,56 +131,100 @@ typedef struct {
 
 #define LOWER_48_BIT_MASK 0xFFFFFFFFFFFF
 
-//There are 256 sets in the L1 cache
-#define L1_NUM_CACHE_SETS 256
-
-//The L1 cache itself is just an array of 256 cache sets.
-L1_CACHE_SET l1_cache[L1_NUM_CACHE_SETS];
-
 //Mask for v bit: Bit 63 of v_r_d_tag
 #define L1_VBIT_MASK ((uint64_t) 1 << 63)
 
-//Mask for r bit: Bit 62 of v_r_d_tag
-#define L1_RBIT_MASK ((uint64_t) 1 << 62)
-
 //Mask for d bit: Bit 61 of v_r_d_tag
 #define L1_DIRTYBIT_MASK ((uint64_t) 1 << 61)
 
-//The tag is the low 34 bits of v_r_d_tag
-//The mask is just 34 ones, so 3FFFFFFFF hex
+//This can be used to set or clear the lowest bit of the status
+//register to indicate a cache hit or miss.
+#define L1_CACHE_HIT_MASK 0x1
 
-#define L1_ENTRY_TAG_MASK 0x3FFFFFFFF
 
-//Bits 3-5 of an address specifies the offset of the addressed
-//word within the cache line
-//Mask is 111000 in binary = 0x38
+//Returns log2(x), or -1 if x is not a power of two.
+static int l1_log2(uint64_t x) {
+  if (x == 0 || (x & (x - 1))) {
+    return -1;
+  }
+  int n = 0;
+  while (x > 1) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
 
-#define WORD_OFFSET_MASK 0x38
 
-//After masking to extract the word offset, it needs
-//to be shifted to the right by 3.
-#define WORD_OFFSET_SHIFT 3
+/************************************************
+            l1_setup()
 
-// Bits 14-47 of an address are used as the 34 tag bits
-// The mask is 34 ones (see L1_ENTRY_TAG_MASK, above) shifted
-// left by 14 bits.
-#define L1_ADDRESS_TAG_MASK ((uint64_t) L1_ENTRY_TAG_MASK << 14)
+This procedure fills in the derived fields of an
+L1 cache from its geometry, sets up its replacement
+policy, and allocates the tag and line arrays. It returns
+FALSE if the geometry is not valid, the policy cannot be
+used with that many lines per set, or the allocation fails.
+************************************************/
 
-//After masking to extract the tag from the address, it needs to 
-//be shifted right by 14.
-#define L1_ADDRESS_TAG_SHIFT 14
+static BOOL l1_setup(L1_CACHE *l1, const L1_GEOMETRY *geometry, REPLACEMENT_POLICY policy) {
+  int line_shift = l1_log2(geometry->bytes_per_line);
 
-//Bits 6-13 are used to extract the set index from an address.
-//The mask is 8 ones (so FF hex) shifted left by 6.
-#define L1_SET_INDEX_MASK (0xff << 6)
+  if (line_shift < BYTES_TO_WORDS_SHIFT || geometry->lines_per_set == 0) {
+    return FALSE;
+  }
 
-//After masking to extract the set index from an address, it
-//needs to be shifted to the right by 6
-#define L1_SET_INDEX_SHIFT 6
+  uint64_t bytes_per_set = (uint64_t) geometry->bytes_per_line * geometry->lines_per_set;
+  if (geometry->size_in_bytes == 0 || geometry->size_in_bytes % bytes_per_set) {
+    return FALSE;
+  }
 
-//This can be used to set or clear the lowest bit of the status
-//register to indicate a cache hit or miss.
-#define L1_CACHE_HIT_MASK 0x1
+  uint64_t num_sets = geometry->size_in_bytes / bytes_per_set;
+  int set_bits = l1_log2(num_sets);
+  if (set_bits < 0 || line_shift + set_bits >= 48) {
+    return FALSE;
+  }
+
+  if (policy == REPLACEMENT_DEFAULT) {
+    policy = REPLACEMENT_NRU;
+  }
+  if (!replacement_setup(&l1->replacement, policy, geometry->lines_per_set,
+                         L1_VBIT_MASK, L1_DIRTYBIT_MASK)) {
+    return FALSE;
+  }
+
+  l1->geometry = *geometry;
+  l1->num_sets = num_sets;
+  l1->lines_per_set = geometry->lines_per_set;
+  l1->words_per_line = geometry->bytes_per_line >> BYTES_TO_WORDS_SHIFT;
+
+  l1->word_offset_mask = (uint64_t) geometry->bytes_per_line - BYTES_PER_WORD;
+  l1->set_index_shift = line_shift;
+  l1->set_index_mask = (num_sets - 1) << line_shift;
+  l1->address_tag_shift = line_shift + set_bits;
+  l1->entry_tag_mask = ((uint64_t) 1 << (48 - l1->address_tag_shift)) - 1;
+
+  //The tags are aligned to a 64-byte host cache line, so that
+  //the tags of a set never straddle two host cache lines.
+  uint64_t num_entries = num_sets * l1->lines_per_set;
+  uint64_t tag_bytes = (num_entries * sizeof(uint64_t) + 63) & ~(uint64_t)63;
+  l1->tags = (uint64_t *)aligned_alloc(64, tag_bytes);
+  l1->lines = (uint64_t *)malloc(num_entries * l1->words_per_line * sizeof(uint64_t));
+  return l1->tags != NULL && l1->lines != NULL;
+}
+
+//Returns the index of the set containing address.
+static inline uint64_t l1_set_index(L1_CACHE *l1, uint64_t address) {
+  return (address & l1->set_index_mask) >> l1->set_index_shift;
+}
+
+//Returns the number of the line in a set (whose tags start at tags)
+//that holds a valid entry with the given tag, or -1 if there is none.
+//Inlined with lines_per_set as a constant for the default geometry.
+static inline __attribute__((always_inline))
+int l1_find_line(const uint64_t *tags, uint64_t lines_per_set, uint64_t tag) {
+  return cache_find_tag(tags, lines_per_set, tag | L1_VBIT_MASK,
+                        ~(L1_DIRTYBIT_MASK | REPLACEMENT_STATE_MASK));
+}
 
 
 /************************************************
@@ -149,12 +235,107 @@ the valid bit of each cache entry in each set in
 the cache.
 ************************************************/
 
+void l1_initialize_r(L1_CACHE *l1) {
+  uint64_t num_entries = l1->num_sets * l1->lines_per_set;
+  for (uint64_t entry = 0; entry < num_entries; entry++) {
+    l1->tags[entry] = 0;  // Clearing the entire v_r_d_tag field
+  }
+  replacement_reset(&l1->replacement, l1->tags, l1->num_sets);
+}
+
 void l1_initialize() {
-  for (int set = 0; set < L1_NUM_CACHE_SETS; set++) {
-    for (int line = 0; line < L1_LINES_PER_SET; line++) {
-      l1_cache[set].lines[line].v_r_d_tag = 0;  // Clearing the entire v_r_d_tag field
+  if (!l1_default_cache.tags) {
+    L1_GEOMETRY geometry = L1_DEFAULT_GEOMETRY;
+    if (!l1_setup(&l1_default_cache, &geometry, REPLACEMENT_DEFAULT)) {
+      printf("Error: L1 cache allocation failed\n");
+      exit(1);
     }
   }
+  l1_initialize_r(&l1_default_cache);
+}
+
+
+/************************************************
+            l1_create_with_policy()
+
+This procedure allocates a new, initialized L1 cache
+instance with the given geometry and replacement policy.
+It returns NULL if the geometry is not valid (see
+l1_cache.h), the policy cannot be used with it, or the
+allocation fails.
+************************************************/
+
+L1_CACHE *l1_create_with_policy(const L1_GEOMETRY *geometry, REPLACEMENT_POLICY policy) {
+  L1_CACHE *l1 = (L1_CACHE *)calloc(1, sizeof(L1_CACHE));
+  if (!l1) {
+    return NULL;
+  }
+  if (!l1_setup(l1, geometry, policy)) {
+    free(l1->tags);
+    free(l1->lines);
+    free(l1);
+    return NULL;
+  }
+  l1_initialize_r(l1);
+  return l1;
+}
+
+
+/************************************************
+            l1_create_with_geometry()
+
+This procedure allocates a new, initialized L1 cache
+instance with the given geometry and the NRU policy.
+************************************************/
+
+L1_CACHE *l1_create_with_geometry(const L1_GEOMETRY *geometry) {
+  return l1_create_with_policy(geometry, REPLACEMENT_DEFAULT);
+}
+
+
+/************************************************
+            l1_create()
+
+This procedure allocates a new, initialized L1 cache
+instance with the default geometry (64KB, 4-way,
+64-byte lines). It returns NULL if the allocation fails.
+************************************************/
+
+L1_CACHE *l1_create() {
+  L1_GEOMETRY geometry = L1_DEFAULT_GEOMETRY;
+  return l1_create_with_geometry(&geometry);
+}
+
+
+/************************************************
+            l1_destroy()
+
+This procedure frees an L1 cache instance created
+by l1_create() or l1_create_with_geometry().
+************************************************/
+
+void l1_destroy(L1_CACHE *l1) {
+  if (l1) {
+    free(l1->tags);
+    free(l1->lines);
+    free(l1);
+  }
+}
+
+
+/************************************************
+            l1_get_geometry()
+
+This procedure copies out the geometry an L1 cache
+instance was created with.
+************************************************/
+
+void l1_get_geometry(L1_CACHE *l1, L1_GEOMETRY *geometry) {
+  *geometry = l1->geometry;
+}
+
+REPLACEMENT_POLICY l1_get_policy(L1_CACHE *l1) {
+  return l1->replacement.policy;
 }
 
 
@@ -195,43 +376,63 @@ effect is to set the lowest bit of the status byte to 0.
 
 **********************************************************/
 
-void l1_cache_access(uint64_t address, uint64_t write_data, 
-                     uint8_t control, uint64_t *read_data, uint8_t *status) {
-  address &= LOWER_48_BIT_MASK;
-  uint64_t set_index = (address & L1_SET_INDEX_MASK) >> L1_SET_INDEX_SHIFT;
-  uint64_t tag = (address & L1_ADDRESS_TAG_MASK) >> L1_ADDRESS_TAG_SHIFT;
-  uint64_t word_offset = (address & WORD_OFFSET_MASK) >> WORD_OFFSET_SHIFT;
+//Looks up the line containing address (whose upper 16 bits must
+//already be clear). On a hit, the hit is recorded with the replacement
+//policy and as the last hit, and the entry number is returned; on a
+//miss, -1 is returned.
+static inline __attribute__((always_inline))
+int64_t l1_lookup(L1_CACHE *l1, uint64_t address) {
+  uint64_t first_entry = l1_set_index(l1, address) * l1->lines_per_set;
+  uint64_t *tags = l1->tags + first_entry;
+  uint64_t tag = address >> l1->address_tag_shift;
+  int line;
+
+  // The default geometry gets its own copy of the search, with the
+  // number of lines per set known at compile time.
+  if (l1->lines_per_set == L1_LINES_PER_SET) {
+    line = l1_find_line(tags, L1_LINES_PER_SET, tag);
+  } else {
+    line = l1_find_line(tags, l1->lines_per_set, tag);
+  }
+
+  if (line < 0) {
+    return -1;  // Cache miss
+  }
 
-  *status = 0;  // Assume a cache miss initially
+  // Cache hit
+  l1->last_hit_entry = first_entry + line;
+  replacement_on_hit(&l1->replacement, tags, line); // Sets the reference bit for NRU
+  return first_entry + line;
+}
 
-  for (int line = 0; line < L1_LINES_PER_SET; line++) {
-    uint64_t v_r_d_tag = l1_cache[set_index].lines[line].v_r_d_tag;
-    uint64_t entry_tag = v_r_d_tag & L1_ENTRY_TAG_MASK;
+void l1_cache_access_r(L1_CACHE *l1, uint64_t address, uint64_t write_data, 
+                       uint8_t control, uint64_t *read_data, uint8_t *status) {
+  address &= LOWER_48_BIT_MASK;
+  uint64_t word_offset = (address & l1->word_offset_mask) >> BYTES_TO_WORDS_SHIFT;
+  int64_t entry = l1_lookup(l1, address);
 
-    if ((v_r_d_tag & L1_VBIT_MASK) && (entry_tag == tag)) {
-      // Cache hit
-      *status = L1_CACHE_HIT_MASK;
-      l1_cache[set_index].lines[line].v_r_d_tag |= L1_RBIT_MASK; // Set reference bit
+  if (entry < 0) {
+    *status = 0;  // Cache miss
+    return;
+  }
 
-      if (control & READ_ENABLE_MASK) {
-        *read_data = l1_cache[set_index].lines[line].cache_line[word_offset];
-      }
+  uint64_t *cache_line = l1->lines + entry * l1->words_per_line;
+  *status = L1_CACHE_HIT_MASK;
 
-      if (control & WRITE_ENABLE_MASK) {
-        l1_cache[set_index].lines[line].cache_line[word_offset] = write_data;
-        l1_cache[set_index].lines[line].v_r_d_tag |= L1_DIRTYBIT_MASK; // Set dirty bit
-      }
+  if (control & READ_ENABLE_MASK) {
+    *read_data = cache_line[word_offset];
+  }
 
-      break;
-    }
+  if (control & WRITE_ENABLE_MASK) {
+    cache_line[word_offset] = write_data;
+    l1->tags[entry] |= L1_DIRTYBIT_MASK; // Set dirty bit
   }
 }
 
-
-// This (all 1's) is used in l1_insert_line(), below, to indicate a value that
-// is uninitialized.
-
-#define UNINITIALIZED ~0x0
+void l1_cache_access(uint64_t address, uint64_t write_data, 
+                     uint8_t control, uint64_t *read_data, uint8_t *status) {
+  l1_cache_access_r(&l1_default_cache, address, write_data, control, read_data, status);
+}
 
 
 /************************************************************
@@ -267,9 +468,10 @@ status: this in an 8-bit output parameter (thus, a pointer to it is
             1: evicted cache line needs to be written back.
 
 
- The cache replacement algorithm uses a simple NRU
- algorithm. A cache entry (among the cache entries in the set) is 
- chosen to be written to in the following order of preference:
+ The entry to be replaced is chosen by the cache's replacement
+ policy (see replacement_policy.h). By default this is a simple
+ NRU algorithm: a cache entry (among the cache entries in the set)
+ is chosen to be written to in the following order of preference:
     - valid bit = 0
     - reference bit = 0 and dirty bit = 0
     - reference bit = 0 and dirty bit = 1
@@ -278,68 +480,71 @@ status: this in an 8-bit output parameter (thus, a pointer to it is
 *********************************************************/
 
 
-void l1_insert_line(uint64_t address, uint64_t write_data[], 
-                    uint64_t *evicted_writeback_address, 
-                    uint64_t evicted_writeback_data[], 
-                    uint8_t *status) {
-  address &= LOWER_48_BIT_MASK;
-  uint64_t set_index = (address & L1_SET_INDEX_MASK) >> L1_SET_INDEX_SHIFT;
-  uint64_t tag = (address & L1_ADDRESS_TAG_MASK) >> L1_ADDRESS_TAG_SHIFT;
-
-  uint64_t r0_d0_index = UNINITIALIZED, r0_d1_index = UNINITIALIZED, r1_d0_index = UNINITIALIZED;
-  int chosen_line = -1;
-
-  for (int line = 0; line < L1_LINES_PER_SET; line++) {
-    uint64_t v_r_d_tag = l1_cache[set_index].lines[line].v_r_d_tag;
-
-    if (!(v_r_d_tag & L1_VBIT_MASK)) { // valid bit = 0
-      chosen_line = line;
-      break;
-    } else {
-      BOOL is_r_set = (v_r_d_tag & L1_RBIT_MASK) != 0;
-      BOOL is_d_set = (v_r_d_tag & L1_DIRTYBIT_MASK) != 0;
-
-      if (!is_r_set && !is_d_set && r0_d0_index == UNINITIALIZED) {
-        r0_d0_index = line;
-      } else if (!is_r_set && is_d_set && r0_d1_index == UNINITIALIZED) {
-        r0_d1_index = line;
-      } else if (is_r_set && !is_d_set && r1_d0_index == UNINITIALIZED) {
-        r1_d0_index = line;
-      }
-    }
-  }
+//The body of l1_replace_line_r(), inlined with lines_per_set and
+//words_per_line as constants for the default geometry (see l1_find_line()).
+//Returns the chosen line's data, which is still the evicted line's.
+static inline __attribute__((always_inline))
+uint64_t *l1_replace_in_set(L1_CACHE *l1, uint64_t address,
+                            uint64_t *evicted_writeback_address,
+                            uint8_t *status, uint64_t lines_per_set, uint64_t words_per_line) {
+  uint64_t set_index = l1_set_index(l1, address);
+  uint64_t first_entry = set_index * lines_per_set;
+  uint64_t *tags = l1->tags + first_entry;
+  uint64_t tag = address >> l1->address_tag_shift;
 
-  if (chosen_line == -1) {
-    if (r0_d0_index != UNINITIALIZED) {
-      chosen_line = r0_d0_index;
-    } else if (r0_d1_index != UNINITIALIZED) {
-      chosen_line = r0_d1_index;
-    } else if (r1_d0_index != UNINITIALIZED) {
-      chosen_line = r1_d0_index;
-    } else {
-      chosen_line = 0; // Evict the first line if all are recently used
-    }
-  }
+  uint64_t chosen_line = replacement_choose_victim(&l1->replacement, tags);
 
-  uint64_t evict_v_r_d_tag = l1_cache[set_index].lines[chosen_line].v_r_d_tag;
+  uint64_t *cache_line = l1->lines + (first_entry + chosen_line) * words_per_line;
+  uint64_t evict_v_r_d_tag = tags[chosen_line];
   BOOL evict_is_dirty = (evict_v_r_d_tag & L1_DIRTYBIT_MASK) != 0;
 
   if (evict_is_dirty) {
     *status = 1; // Write-back is needed
-    uint64_t evict_tag = evict_v_r_d_tag & L1_ENTRY_TAG_MASK;
-    *evicted_writeback_address = (evict_tag << L1_ADDRESS_TAG_SHIFT) | (set_index << L1_SET_INDEX_SHIFT);
-    for (int i = 0; i < WORDS_PER_CACHE_LINE; i++) {
-      evicted_writeback_data[i] = l1_cache[set_index].lines[chosen_line].cache_line[i];
-    }
+    uint64_t evict_tag = evict_v_r_d_tag & l1->entry_tag_mask;
+    *evicted_writeback_address = (evict_tag << l1->address_tag_shift) | (set_index << l1->set_index_shift);
   } else {
     *status = 0; // No write-back needed
   }
 
-  // Insert the new line
-  l1_cache[set_index].lines[chosen_line].v_r_d_tag = (tag & L1_ENTRY_TAG_MASK) | L1_VBIT_MASK;
-  for (int i = 0; i < WORDS_PER_CACHE_LINE; i++) {
-    l1_cache[set_index].lines[chosen_line].cache_line[i] = write_data[i];
+  // Insert the new line (its data is filled in by the caller)
+  tags[chosen_line] = (tags[chosen_line] & REPLACEMENT_STATE_MASK) | (tag & l1->entry_tag_mask) | L1_VBIT_MASK;
+  replacement_on_insert(&l1->replacement, tags, chosen_line);
+  return cache_line;
+}
+
+uint64_t *l1_replace_line_r(L1_CACHE *l1, uint64_t address,
+                            uint64_t *evicted_writeback_address, uint8_t *status) {
+  address &= LOWER_48_BIT_MASK;
+  if (l1->lines_per_set == L1_LINES_PER_SET && l1->words_per_line == WORDS_PER_CACHE_LINE) {
+    return l1_replace_in_set(l1, address, evicted_writeback_address, status,
+                             L1_LINES_PER_SET, WORDS_PER_CACHE_LINE);
   }
+  return l1_replace_in_set(l1, address, evicted_writeback_address, status,
+                           l1->lines_per_set, l1->words_per_line);
+}
+
+void l1_insert_line_r(L1_CACHE *l1, uint64_t address, uint64_t write_data[], 
+                      uint64_t *evicted_writeback_address, 
+                      uint64_t evicted_writeback_data[], 
+                      uint8_t *status) {
+  uint64_t *cache_line = l1_replace_line_r(l1, address, evicted_writeback_address, status);
+
+  if (*status) {
+    for (uint64_t i = 0; i < l1->words_per_line; i++) {
+      evicted_writeback_data[i] = cache_line[i];
+    }
+  }
+  for (uint64_t i = 0; i < l1->words_per_line; i++) {
+    cache_line[i] = write_data[i];
+  }
+}
+
+void l1_insert_line(uint64_t address, uint64_t write_data[], 
+                    uint64_t *evicted_writeback_address, 
+                    uint64_t evicted_writeback_data[], 
+                    uint8_t *status) {
+  l1_insert_line_r(&l1_default_cache, address, write_data,
+                   evicted_writeback_address, evicted_writeback_data, status);
 }
 
 
@@ -349,14 +554,182 @@ void l1_insert_line(uint64_t address, uint64_t write_data[],
 
 This procedure clears the r bit of each entry in each set of the L1
 cache. It is called periodically to support the the NRU algorithm.
+Since an r bit is only set while the entry's epoch stamp is current,
+this just starts a new epoch, without touching the entries.
 
 ***********************************************/
     
+void l1_clear_r_bits_r(L1_CACHE *l1) {
+  replacement_clear_references(&l1->replacement, l1->tags, l1->num_sets * l1->lines_per_set);
+}
+
 void l1_clear_r_bits() {
-  for (int set = 0; set < L1_NUM_CACHE_SETS; set++) {
-    for (int line = 0; line < L1_LINES_PER_SET; line++) {
-      l1_cache[set].lines[line].v_r_d_tag &= ~L1_RBIT_MASK; // Clear the reference bit
+  l1_clear_r_bits_r(&l1_default_cache);
+}
+
+
+/************************************************
+
+       l1_cache_access_again_r()
+
+See l1_cache.h. The entry of the last hit is still
+the right one, since nothing has been inserted since,
+and its replacement state needs no update: a second
+hit on the line that was just hit changes nothing,
+whatever the policy (the LRU rank is already 0, the
+PLRU tree already points away from it, the RRPV is
+already 0, and the NRU stamp is already current,
+since there has been no clock interrupt).
+
+***********************************************/
+
+void l1_cache_access_again_r(L1_CACHE *l1, uint64_t address, uint64_t write_data,
+                             uint8_t control, uint64_t *read_data) {
+  uint64_t word_offset = (address & l1->word_offset_mask) >> BYTES_TO_WORDS_SHIFT;
+  uint64_t *cache_line = l1->lines + l1->last_hit_entry * l1->words_per_line;
+
+  if (control & READ_ENABLE_MASK) {
+    *read_data = cache_line[word_offset];
+  }
+
+  if (control & WRITE_ENABLE_MASK) {
+    cache_line[word_offset] = write_data;
+    l1->tags[l1->last_hit_entry] |= L1_DIRTYBIT_MASK; // Set dirty bit
+  }
+}
+
+
+/************************************************
+
+       l1_cache_access_words_r()
+
+See l1_cache.h. The line is looked up once, and
+recording the hit once is the same as recording it
+for every word, for the reason given above.
+
+***********************************************/
+
+void l1_cache_access_words_r(L1_CACHE *l1, uint64_t address, uint64_t num_words,
+                             const uint64_t write_data[], uint8_t control,
+                             uint64_t read_data[], uint8_t *status) {
+  address &= LOWER_48_BIT_MASK;
+  uint64_t word_offset = (address & l1->word_offset_mask) >> BYTES_TO_WORDS_SHIFT;
+  int64_t entry = l1_lookup(l1, address);
+
+  if (entry < 0) {
+    *status = 0;  // Cache miss
+    return;
+  }
+
+  uint64_t *cache_line = l1->lines + entry * l1->words_per_line + word_offset;
+  *status = L1_CACHE_HIT_MASK;
+
+  if (control & READ_ENABLE_MASK) {
+    for (uint64_t i = 0; i < num_words; i++) {
+      read_data[i] = cache_line[i];
+    }
+  }
+
+  if (control & WRITE_ENABLE_MASK) {
+    for (uint64_t i = 0; i < num_words; i++) {
+      cache_line[i] = write_data[i];
     }
+    l1->tags[entry] |= L1_DIRTYBIT_MASK; // Set dirty bit
+  }
+}
+
+
+/************************************************
+
+       l1_get_dirty_line_r()
+
+See l1_cache.h.
+
+***********************************************/
+
+int l1_get_dirty_line_r(L1_CACHE *l1, uint64_t entry, uint64_t *address, uint64_t data[]) {
+  uint64_t v_r_d_tag = l1->tags[entry];
+  if ((v_r_d_tag & (L1_VBIT_MASK | L1_DIRTYBIT_MASK)) != (L1_VBIT_MASK | L1_DIRTYBIT_MASK)) {
+    return 0;
+  }
+  uint64_t set_index = entry / l1->lines_per_set;
+  *address = ((v_r_d_tag & l1->entry_tag_mask) << l1->address_tag_shift) | (set_index << l1->set_index_shift);
+  uint64_t *cache_line = l1->lines + entry * l1->words_per_line;
+  for (uint64_t i = 0; i < l1->words_per_line; i++) {
+    data[i] = cache_line[i];
+  }
+  return 1;
+}
+
+
+/************************************************
+
+       l1_prefetch_r() / l1_probe_r()
+
+See l1_cache.h. These are used to look ahead in a
+batch of accesses, so l1_probe_r() leaves the
+replacement state alone.
+
+***********************************************/
+
+void l1_prefetch_r(L1_CACHE *l1, uint64_t address) {
+  address &= LOWER_48_BIT_MASK;
+  __builtin_prefetch(l1->tags + l1_set_index(l1, address) * l1->lines_per_set);
+}
+
+int l1_probe_r(L1_CACHE *l1, uint64_t address, uint64_t *writeback_address) {
+  address &= LOWER_48_BIT_MASK;
+  uint64_t set_index = l1_set_index(l1, address);
+  const uint64_t *tags = l1->tags + set_index * l1->lines_per_set;
+  if (l1_find_line(tags, l1->lines_per_set, address >> l1->address_tag_shift) >= 0) {
+    return 1;
+  }
+
+  uint64_t victim_v_r_d_tag = tags[replacement_peek_victim(&l1->replacement, tags)];
+  if ((victim_v_r_d_tag & (L1_VBIT_MASK | L1_DIRTYBIT_MASK)) == (L1_VBIT_MASK | L1_DIRTYBIT_MASK)) {
+    *writeback_address = ((victim_v_r_d_tag & l1->entry_tag_mask) << l1->address_tag_shift) |
+                         (set_index << l1->set_index_shift);
+  } else {
+    *writeback_address = L1_NO_WRITEBACK;
   }
+  return 0;
+}
+
+
+
+/************************************************
+
+       l1_save_state_r() / l1_restore_state_r()
+
+See l1_cache.h. The state is the REPLACEMENT_STATE,
+then the tags, then the line data. The entry of the
+last hit is not part of it, since it only matters
+between two accesses to the same line.
+
+***********************************************/
+
+uint64_t l1_state_size_r(L1_CACHE *l1) {
+  uint64_t num_entries = l1->num_sets * l1->lines_per_set;
+  return sizeof(REPLACEMENT_STATE) + num_entries * (1 + l1->words_per_line) * sizeof(uint64_t);
 }
 
+void l1_save_state_r(L1_CACHE *l1, void *state) {
+  uint64_t num_entries = l1->num_sets * l1->lines_per_set;
+  uint8_t *p = (uint8_t *) state;
+  memcpy(p, &l1->replacement, sizeof(REPLACEMENT_STATE));
+  p += sizeof(REPLACEMENT_STATE);
+  memcpy(p, l1->tags, num_entries * sizeof(uint64_t));
+  p += num_entries * sizeof(uint64_t);
+  memcpy(p, l1->lines, num_entries * l1->words_per_line * sizeof(uint64_t));
+}
+
+void l1_restore_state_r(L1_CACHE *l1, const void *state) {
+  uint64_t num_entries = l1->num_sets * l1->lines_per_set;
+  const uint8_t *p = (const uint8_t *) state;
+  memcpy(&l1->replacement, p, sizeof(REPLACEMENT_STATE));
+  p += sizeof(REPLACEMENT_STATE);
+  memcpy(l1->tags, p, num_entries * sizeof(uint64_t));
+  p += num_entries * sizeof(uint64_t);
+  memcpy(l1->lines, p, num_entries * l1->words_per_line * sizeof(uint64_t));
+  l1->last_hit_entry = 0;
+}
@@ -1,3 +1,10 @@
+#ifndef L1_CACHE_H
+#define L1_CACHE_H
+
+#include <stdint.h>
+
+#include "replacement_policy.h"
+
 
 /************************************************
             l2_initialize()
@@ -105,3 +112,216 @@ cache. It should be called periodically to support the the NRU algorithm.
 ***********************************************/
 
 void l1_clear_r_bits();
+
+
+/************************************************************
+
+       Reentrant interface
+
+The procedures above all operate on a single, process-wide L1
+cache. The procedures below do the same jobs on an L1_CACHE
+instance that is passed as the first parameter, so that any
+number of independent L1 caches can exist at once (for example,
+one per thread). An instance is allocated with l1_create(),
+which returns NULL if the allocation fails, and is released
+with l1_destroy().
+
+************************************************************/
+
+typedef struct L1_CACHE L1_CACHE;
+
+L1_CACHE *l1_create();
+
+
+/************************************************************
+
+       L1 geometry
+
+An L1 cache can also be created with a shape other than the
+default 64KB, 4-way, 64-byte-line one, by describing it in an
+L1_GEOMETRY:
+
+size_in_bytes:  total amount of data the cache holds.
+lines_per_set:  the associativity (1 means direct-mapped).
+bytes_per_line: size of a cache line, a power of two of at
+                least one word (8 bytes).
+
+size_in_bytes must be a multiple of lines_per_set * bytes_per_line,
+and the resulting number of sets must be a power of two.
+l1_create_with_geometry() returns NULL if that is not the case.
+
+The set index sits just above the byte offset within a line, and
+the tag is made up of the remaining bits of the 48-bit address.
+For a cache with a line size other than 64 bytes, the write_data
+and evicted_writeback_data arrays passed to l1_insert_line_r()
+hold one line of that size.
+
+************************************************************/
+
+typedef struct {
+  uint64_t size_in_bytes;
+  uint32_t lines_per_set;
+  uint32_t bytes_per_line;
+} L1_GEOMETRY;
+
+#define L1_DEFAULT_GEOMETRY {64 * 1024, 4, 64}
+
+L1_CACHE *l1_create_with_geometry(const L1_GEOMETRY *geometry);
+
+void l1_get_geometry(L1_CACHE *l1, L1_GEOMETRY *geometry);
+
+
+/************************************************************
+
+       L1 replacement policy
+
+The caches created above replace lines with the NRU algorithm
+described under l1_insert_line(). l1_create_with_policy() creates
+a cache that uses another of the policies in replacement_policy.h
+instead (REPLACEMENT_DEFAULT meaning NRU). It returns NULL if the
+policy cannot be used with the geometry (tree-PLRU needs a power
+of two lines per set, and LRU at most 256). The r bits are only
+used by NRU; l1_clear_r_bits_r() has no effect on the others.
+
+************************************************************/
+
+L1_CACHE *l1_create_with_policy(const L1_GEOMETRY *geometry, REPLACEMENT_POLICY policy);
+
+REPLACEMENT_POLICY l1_get_policy(L1_CACHE *l1);
+
+void l1_destroy(L1_CACHE *l1);
+
+void l1_initialize_r(L1_CACHE *l1);
+
+void l1_cache_access_r(L1_CACHE *l1, uint64_t address, uint64_t write_data, 
+		       uint8_t control, uint64_t *read_data, uint8_t *status);
+
+void l1_insert_line_r(L1_CACHE *l1, uint64_t address, uint64_t write_data[], 
+		      uint64_t *evicted_writeback_address, 
+		      uint64_t evicted_writeback_data[], 
+		      uint8_t *status);
+
+void l1_clear_r_bits_r(L1_CACHE *l1);
+
+
+/************************************************************
+
+       Look-ahead
+
+These two procedures let a caller that knows which addresses
+it will access next (see memory_access_batch()) prepare for
+them. Neither changes the state of the cache.
+
+l1_prefetch_r() asks the host to start loading the tags of the
+                set that address maps to.
+l1_probe_r()    returns 1 if the line containing address is in
+                the cache, 0 otherwise. On a miss, if inserting
+                the line now would evict a dirty line, the address
+                of that line is stored in *writeback_address;
+                otherwise *writeback_address is set to
+                L1_NO_WRITEBACK.
+
+************************************************************/
+
+#define L1_NO_WRITEBACK (~(uint64_t) 0)
+
+void l1_prefetch_r(L1_CACHE *l1, uint64_t address);
+
+int l1_probe_r(L1_CACHE *l1, uint64_t address, uint64_t *writeback_address);
+
+/************************************************************
+
+       l1_cache_access_again_r()
+
+The same as l1_cache_access_r(), for an address in the same
+line as the address of the last call to l1_cache_access_r().
+That call must have been a hit, and there must have been no
+other call since that changes the cache (inserting a line,
+clearing the r bits or initializing it). Since the line is
+known to be in the cache, it is not looked for again, and
+the access is always a hit.
+
+************************************************************/
+
+void l1_cache_access_again_r(L1_CACHE *l1, uint64_t address, uint64_t write_data,
+			     uint8_t control, uint64_t *read_data);
+
+
+/************************************************************
+
+       l1_cache_access_words_r()
+
+The same as num_words calls of l1_cache_access_r(), for the
+consecutive words starting at address, which must all be in
+the same cache line: word i is written from write_data[i],
+or read into read_data[i]. The line is only looked up once,
+and *status tells whether it was found (in which case every
+word was read or written) or not (in which case nothing was).
+
+************************************************************/
+
+void l1_cache_access_words_r(L1_CACHE *l1, uint64_t address, uint64_t num_words,
+			     const uint64_t write_data[], uint8_t control,
+			     uint64_t read_data[], uint8_t *status);
+
+
+/************************************************************
+
+       l1_get_dirty_line_r()
+
+This procedure lets the caller write the cache's dirty lines
+back (for example, to save the contents of memory) without
+evicting them. If line entry of the cache, from 0 up to the
+number of lines in the cache (size_in_bytes / bytes_per_line)
+- 1, is valid and dirty, its address is stored in *address,
+its data is copied to data, and 1 is returned. Otherwise 0 is
+returned. Either way the cache is unchanged; the line stays
+dirty.
+
+************************************************************/
+
+int l1_get_dirty_line_r(L1_CACHE *l1, uint64_t entry, uint64_t *address, uint64_t data[]);
+
+
+/************************************************************
+
+       l1_replace_line_r()
+
+This procedure does the work of l1_insert_line_r() without
+copying any data: it chooses the line to replace, makes it the
+line for address, and returns a pointer to the line's storage
+in the cache. The data there is still that of the evicted line,
+which the caller must copy out first if *status is 1 (meaning
+it has to be written back, to *evicted_writeback_address),
+before writing the new line's data through the pointer. This
+lets a line be copied straight from the L2 cache's storage into
+the L1 cache's (see l2_access_line_r()). The pointer is only
+good until the set is next changed.
+
+************************************************************/
+
+uint64_t *l1_replace_line_r(L1_CACHE *l1, uint64_t address,
+			    uint64_t *evicted_writeback_address, uint8_t *status);
+
+
+/************************************************************
+
+       l1_save_state_r() / l1_restore_state_r()
+
+These procedures are for checkpoints (see memory_subsystem_save_r()).
+l1_save_state_r() copies the whole state of the cache -- the state
+of its replacement policy, and the tag word (with its status and
+replacement bits) and data of every line -- into state, which must
+have room for l1_state_size_r() bytes. l1_restore_state_r() copies
+such a state back, into a cache of the same geometry and policy,
+which then carries on exactly as the cache saved would have.
+
+************************************************************/
+
+uint64_t l1_state_size_r(L1_CACHE *l1);
+
+void l1_save_state_r(L1_CACHE *l1, void *state);
+
+void l1_restore_state_r(L1_CACHE *l1, const void *state);
+
+#endif
@@ -5,74 +5,337 @@
 
 #include "memory_subsystem_constants.h"
 #include "l2_cache.h"
+#include "cache_tags.h"
+#include "replacement_policy.h"
 
-#define L2_NUM_CACHE_ENTRIES (1<<15)
+/***************************************************
+The default L2 cache is a 2MB, direct-mapped, write-back
+cache with 64-byte lines, so it has 32K (2^15) sets of one
+line each: the set index is bits 6-20 of an address and the
+tag is bits 21-47. An L2_GEOMETRY (see l2_cache.h) can give
+it more lines per set; the number of sets, masks and shifts
+are derived from the geometry when the cache is created.
 
-typedef struct {
-  uint32_t v_d_tag;
-  uint64_t cache_line[WORDS_PER_CACHE_LINE];
-} L2_CACHE_ENTRY;
+As in the L1 cache, the tags and the line data are kept in
+separate arrays:
+
+  tags:  one 64-bit v_d_tag word per line, with the valid
+         bit at bit 63, the dirty bit at bit 62, the
+         replacement policy's bits for the line at bits 48-60
+         and the tag in the rightmost bits. The tags of a set are next
+         to each other.
+  lines: the line data, in the same order as the tags.
+
+When a set has more than one line, the line a full set
+evicts is chosen by the cache's replacement policy (see
+replacement_policy.h), which is LRU by default.
+****************************************************/
 
 #define LOWER_48_BIT_MASK 0xFFFFFFFFFFFF
-#define L2_VBIT_MASK (0x1 << 31)
-#define L2_DIRTYBIT_MASK (0x1 << 30)
-#define L2_ENTRY_TAG_MASK 0x7FFFFFF
+#define L2_VBIT_MASK ((uint64_t) 1 << 63)
+#define L2_DIRTYBIT_MASK ((uint64_t) 1 << 62)
+#define L2_HIT_STATUS_MASK 0x1
+
+//One instance of the L2 cache. The _r procedures
+//operate on the instance passed to them.
+struct L2_CACHE {
+  L2_GEOMETRY geometry;
+
+  uint64_t num_sets;
+  uint64_t lines_per_set;
+  uint64_t words_per_line;
+
+  uint64_t index_mask;         // mask and shift for the set index
+  uint64_t index_shift;
+  uint64_t address_tag_shift;  // the tag is everything above the set index
+  uint64_t entry_tag_mask;     // mask for the tag within v_d_tag
+
+  uint64_t *tags;              // num_sets * lines_per_set v_d_tag words
+  uint64_t *lines;             // num_sets * lines_per_set * words_per_line words
+  REPLACEMENT_STATE replacement;
+};
+
+//The instance used by l2_initialize(), l2_cache_access() and l2_insert_line().
+static L2_CACHE l2_default_cache;
+
+//Returns log2(x), or -1 if x is not a power of two.
+static int l2_log2(uint64_t x) {
+  if (x == 0 || (x & (x - 1))) {
+    return -1;
+  }
+  int n = 0;
+  while (x > 1) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
 
-L2_CACHE_ENTRY l2_cache[L2_NUM_CACHE_ENTRIES];
+//Fills in the derived fields of an L2 cache from its geometry, sets
+//up its replacement policy and allocates its arrays. Returns FALSE if
+//the geometry is not valid, the policy cannot be used with it, or
+//the allocation fails.
+static BOOL l2_setup(L2_CACHE *l2, const L2_GEOMETRY *geometry, REPLACEMENT_POLICY policy) {
+  int line_shift = l2_log2(geometry->bytes_per_line);
+
+  if (line_shift < BYTES_TO_WORDS_SHIFT || geometry->lines_per_set == 0) {
+    return FALSE;
+  }
+
+  uint64_t bytes_per_set = (uint64_t) geometry->bytes_per_line * geometry->lines_per_set;
+  if (geometry->size_in_bytes == 0 || geometry->size_in_bytes % bytes_per_set) {
+    return FALSE;
+  }
+
+  uint64_t num_sets = geometry->size_in_bytes / bytes_per_set;
+  int set_bits = l2_log2(num_sets);
+  if (set_bits < 0 || line_shift + set_bits >= 48) {
+    return FALSE;
+  }
+
+  if (policy == REPLACEMENT_DEFAULT) {
+    policy = REPLACEMENT_LRU;
+  }
+  if (!replacement_setup(&l2->replacement, policy, geometry->lines_per_set,
+                         L2_VBIT_MASK, L2_DIRTYBIT_MASK)) {
+    return FALSE;
+  }
+
+  l2->geometry = *geometry;
+  l2->num_sets = num_sets;
+  l2->lines_per_set = geometry->lines_per_set;
+  l2->words_per_line = geometry->bytes_per_line >> BYTES_TO_WORDS_SHIFT;
+  l2->index_shift = line_shift;
+  l2->index_mask = (num_sets - 1) << line_shift;
+  l2->address_tag_shift = line_shift + set_bits;
+  l2->entry_tag_mask = ((uint64_t) 1 << (48 - l2->address_tag_shift)) - 1;
+
+  uint64_t num_lines = num_sets * l2->lines_per_set;
+  uint64_t tag_bytes = (num_lines * sizeof(uint64_t) + 63) & ~(uint64_t)63;
+  l2->tags = (uint64_t *)aligned_alloc(64, tag_bytes);
+  l2->lines = (uint64_t *)malloc(num_lines * l2->words_per_line * sizeof(uint64_t));
+  return l2->tags != NULL && l2->lines != NULL;
+}
+
+void l2_initialize_r(L2_CACHE *l2) {
+  uint64_t num_lines = l2->num_sets * l2->lines_per_set;
+  for (uint64_t i = 0; i < num_lines; i++) {
+    l2->tags[i] = 0;
+  }
+  replacement_reset(&l2->replacement, l2->tags, l2->num_sets);
+}
 
 void l2_initialize() {
-  for (int i = 0; i < L2_NUM_CACHE_ENTRIES; i++) {
-    l2_cache[i].v_d_tag = 0;
+  if (!l2_default_cache.tags) {
+    L2_GEOMETRY geometry = L2_DEFAULT_GEOMETRY;
+    if (!l2_setup(&l2_default_cache, &geometry, REPLACEMENT_DEFAULT)) {
+      printf("Error: L2 cache allocation failed\n");
+      exit(1);
+    }
   }
+  l2_initialize_r(&l2_default_cache);
 }
 
-#define L2_ADDRESS_TAG_MASK ((uint64_t) 0x7ffffff << 21)
-#define L2_ADDRESS_TAG_SHIFT 21
-#define L2_INDEX_MASK (0x7fff << 6)
-#define L2_INDEX_SHIFT 6
-#define L2_HIT_STATUS_MASK 0x1
+L2_CACHE *l2_create_with_policy(const L2_GEOMETRY *geometry, REPLACEMENT_POLICY policy) {
+  L2_CACHE *l2 = (L2_CACHE *)calloc(1, sizeof(L2_CACHE));
+  if (!l2) {
+    return NULL;
+  }
+  if (!l2_setup(l2, geometry, policy)) {
+    l2_destroy(l2);
+    return NULL;
+  }
+  l2_initialize_r(l2);
+  return l2;
+}
 
-void l2_cache_access(uint64_t address, uint64_t write_data[], 
-                     uint8_t control, uint64_t read_data[], uint8_t *status) {
+L2_CACHE *l2_create_with_geometry(const L2_GEOMETRY *geometry) {
+  return l2_create_with_policy(geometry, REPLACEMENT_DEFAULT);
+}
+
+L2_CACHE *l2_create() {
+  L2_GEOMETRY geometry = L2_DEFAULT_GEOMETRY;
+  return l2_create_with_geometry(&geometry);
+}
+
+void l2_destroy(L2_CACHE *l2) {
+  if (l2) {
+    free(l2->tags);
+    free(l2->lines);
+    free(l2);
+  }
+}
+
+void l2_get_geometry(L2_CACHE *l2, L2_GEOMETRY *geometry) {
+  *geometry = l2->geometry;
+}
+
+REPLACEMENT_POLICY l2_get_policy(L2_CACHE *l2) {
+  return l2->replacement.policy;
+}
+
+//See l2_cache.h. This is the lookup behind l2_cache_access_r().
+uint64_t *l2_access_line_r(L2_CACHE *l2, uint64_t address, uint8_t control) {
   address = address & LOWER_48_BIT_MASK;
-  uint64_t index = (address & L2_INDEX_MASK) >> L2_INDEX_SHIFT;
-  uint64_t tag = (address & L2_ADDRESS_TAG_MASK) >> L2_ADDRESS_TAG_SHIFT;
+  uint64_t index = (address & l2->index_mask) >> l2->index_shift;
+  uint64_t tag = address >> l2->address_tag_shift;
+  uint64_t first_line = index * l2->lines_per_set;
 
-  uint32_t entry_v_d_tag = l2_cache[index].v_d_tag;
-  uint32_t entry_tag = entry_v_d_tag & L2_ENTRY_TAG_MASK;
+  uint64_t compare_mask = ~(L2_DIRTYBIT_MASK | REPLACEMENT_STATE_MASK);
+  int line;
+  if (l2->lines_per_set == 1) {
+    line = cache_find_tag(l2->tags + first_line, 1, tag | L2_VBIT_MASK, compare_mask);
+  } else {
+    line = cache_find_tag(l2->tags + first_line, l2->lines_per_set, tag | L2_VBIT_MASK, compare_mask);
+  }
+
+  if (line < 0) {
+    return NULL;  // Cache miss
+  }
+
+  uint64_t entry = first_line + line;
+  replacement_on_hit(&l2->replacement, l2->tags + first_line, line);
+  if (control & 0x2) {  // Write
+    l2->tags[entry] |= L2_DIRTYBIT_MASK;  // Set dirty bit
+  }
+  return l2->lines + entry * l2->words_per_line;
+}
 
-  if (!(entry_v_d_tag & L2_VBIT_MASK) || (entry_tag != tag)) {
+void l2_cache_access_r(L2_CACHE *l2, uint64_t address, uint64_t write_data[],
+                       uint8_t control, uint64_t read_data[], uint8_t *status) {
+  uint64_t *cache_line = l2_access_line_r(l2, address, control);
+
+  if (!cache_line) {
     *status = 0;  // Cache miss
-  } else {
-    *status = L2_HIT_STATUS_MASK;  // Cache hit
-    if (control & 0x1) {  // Read
-      memcpy(read_data, l2_cache[index].cache_line, sizeof(uint64_t) * WORDS_PER_CACHE_LINE);
-    }
-    if (control & 0x2) {  // Write
-      memcpy(l2_cache[index].cache_line, write_data, sizeof(uint64_t) * WORDS_PER_CACHE_LINE);
-      l2_cache[index].v_d_tag |= L2_DIRTYBIT_MASK;  // Set dirty bit
-    }
+    return;
+  }
+  *status = L2_HIT_STATUS_MASK;  // Cache hit
+  if (control & 0x1) {  // Read
+    memcpy(read_data, cache_line, sizeof(uint64_t) * l2->words_per_line);
+  }
+  if (control & 0x2) {  // Write
+    memcpy(cache_line, write_data, sizeof(uint64_t) * l2->words_per_line);
   }
 }
 
-void l2_insert_line(uint64_t address, uint64_t write_data[], 
-                    uint64_t *evicted_writeback_address, 
-                    uint64_t evicted_writeback_data[], 
-                    uint8_t *status) {
+void l2_cache_access(uint64_t address, uint64_t write_data[],
+                     uint8_t control, uint64_t read_data[], uint8_t *status) {
+  l2_cache_access_r(&l2_default_cache, address, write_data, control, read_data, status);
+}
+
+//See l2_cache.h. This is the choice of a line behind l2_insert_line_r().
+uint64_t *l2_replace_line_r(L2_CACHE *l2, uint64_t address,
+                            uint64_t *evicted_writeback_address, uint8_t *status) {
   address = address & LOWER_48_BIT_MASK;
-  uint64_t index = (address & L2_INDEX_MASK) >> L2_INDEX_SHIFT;
-  uint64_t tag = (address & L2_ADDRESS_TAG_MASK) >> L2_ADDRESS_TAG_SHIFT;
+  uint64_t index = (address & l2->index_mask) >> l2->index_shift;
+  uint64_t tag = address >> l2->address_tag_shift;
+  uint64_t first_line = index * l2->lines_per_set;
 
-  uint32_t entry_v_d_tag = l2_cache[index].v_d_tag;
+  uint64_t *tags = l2->tags + first_line;
+  uint64_t line = l2->lines_per_set == 1 ? 0 : replacement_choose_victim(&l2->replacement, tags);
+  uint64_t entry = first_line + line;
+  uint64_t entry_v_d_tag = l2->tags[entry];
+  uint64_t *cache_line = l2->lines + entry * l2->words_per_line;
 
   if (!(entry_v_d_tag & L2_VBIT_MASK) || !(entry_v_d_tag & L2_DIRTYBIT_MASK)) {
     *status = 0;  // No write-back needed
   } else {
-    *evicted_writeback_address = ((entry_v_d_tag & L2_ENTRY_TAG_MASK) << L2_ADDRESS_TAG_SHIFT) | (index << L2_INDEX_SHIFT);
-    memcpy(evicted_writeback_data, l2_cache[index].cache_line, sizeof(uint64_t) * WORDS_PER_CACHE_LINE);
+    *evicted_writeback_address = ((entry_v_d_tag & l2->entry_tag_mask) << l2->address_tag_shift) | (index << l2->index_shift);
     *status = 1;  // Write-back needed
   }
 
-  memcpy(l2_cache[index].cache_line, write_data, sizeof(uint64_t) * WORDS_PER_CACHE_LINE);
-  l2_cache[index].v_d_tag = (tag | L2_VBIT_MASK) & ~L2_DIRTYBIT_MASK;
-}
\ No newline at end of file
+  tags[line] = (tags[line] & REPLACEMENT_STATE_MASK) | (tag & l2->entry_tag_mask) | L2_VBIT_MASK;
+  replacement_on_insert(&l2->replacement, tags, line);
+  return cache_line;
+}
+
+void l2_insert_line_r(L2_CACHE *l2, uint64_t address, uint64_t write_data[],
+                      uint64_t *evicted_writeback_address,
+                      uint64_t evicted_writeback_data[],
+                      uint8_t *status) {
+  uint64_t *cache_line = l2_replace_line_r(l2, address, evicted_writeback_address, status);
+  if (*status) {
+    memcpy(evicted_writeback_data, cache_line, sizeof(uint64_t) * l2->words_per_line);
+  }
+  memcpy(cache_line, write_data, sizeof(uint64_t) * l2->words_per_line);
+}
+
+void l2_insert_line(uint64_t address, uint64_t write_data[],
+                    uint64_t *evicted_writeback_address,
+                    uint64_t evicted_writeback_data[],
+                    uint8_t *status) {
+  l2_insert_line_r(&l2_default_cache, address, write_data,
+                   evicted_writeback_address, evicted_writeback_data, status);
+}
+
+//Clears the reference bit of every line, for the NRU policy (by
+//starting a new epoch, see replacement_policy.h).
+void l2_clear_r_bits_r(L2_CACHE *l2) {
+  replacement_clear_references(&l2->replacement, l2->tags, l2->num_sets * l2->lines_per_set);
+}
+
+void l2_prefetch_r(L2_CACHE *l2, uint64_t address) {
+  address = address & LOWER_48_BIT_MASK;
+  uint64_t index = (address & l2->index_mask) >> l2->index_shift;
+  __builtin_prefetch(l2->tags + index * l2->lines_per_set);
+}
+
+int l2_get_dirty_line_r(L2_CACHE *l2, uint64_t entry, uint64_t *address, uint64_t data[]) {
+  uint64_t v_d_tag = l2->tags[entry];
+  if ((v_d_tag & (L2_VBIT_MASK | L2_DIRTYBIT_MASK)) != (L2_VBIT_MASK | L2_DIRTYBIT_MASK)) {
+    return 0;
+  }
+  uint64_t index = entry / l2->lines_per_set;
+  *address = ((v_d_tag & l2->entry_tag_mask) << l2->address_tag_shift) | (index << l2->index_shift);
+  memcpy(data, l2->lines + entry * l2->words_per_line, sizeof(uint64_t) * l2->words_per_line);
+  return 1;
+}
+
+int l2_probe_r(L2_CACHE *l2, uint64_t address, uint64_t *writeback_address) {
+  address = address & LOWER_48_BIT_MASK;
+  uint64_t index = (address & l2->index_mask) >> l2->index_shift;
+  uint64_t first_line = index * l2->lines_per_set;
+  uint64_t *tags = l2->tags + first_line;
+  int line = cache_find_tag(tags, l2->lines_per_set,
+                            (address >> l2->address_tag_shift) | L2_VBIT_MASK,
+                            ~(L2_DIRTYBIT_MASK | REPLACEMENT_STATE_MASK));
+  if (line >= 0) {
+    __builtin_prefetch(l2->lines + (first_line + line) * l2->words_per_line);
+    return 1;
+  }
+
+  uint64_t victim = replacement_peek_victim(&l2->replacement, tags);
+  uint64_t victim_v_d_tag = tags[victim];
+  if ((victim_v_d_tag & (L2_VBIT_MASK | L2_DIRTYBIT_MASK)) == (L2_VBIT_MASK | L2_DIRTYBIT_MASK)) {
+    *writeback_address = ((victim_v_d_tag & l2->entry_tag_mask) << l2->address_tag_shift) | (index << l2->index_shift);
+  } else {
+    *writeback_address = L2_NO_WRITEBACK;
+  }
+  __builtin_prefetch(l2->lines + (first_line + victim) * l2->words_per_line, 1);
+  return 0;
+}
+
+uint64_t l2_state_size_r(L2_CACHE *l2) {
+  uint64_t num_lines = l2->num_sets * l2->lines_per_set;
+  return sizeof(REPLACEMENT_STATE) + num_lines * (1 + l2->words_per_line) * sizeof(uint64_t);
+}
+
+void l2_save_state_r(L2_CACHE *l2, void *state) {
+  uint64_t num_lines = l2->num_sets * l2->lines_per_set;
+  uint8_t *p = (uint8_t *) state;
+  memcpy(p, &l2->replacement, sizeof(REPLACEMENT_STATE));
+  p += sizeof(REPLACEMENT_STATE);
+  memcpy(p, l2->tags, num_lines * sizeof(uint64_t));
+  p += num_lines * sizeof(uint64_t);
+  memcpy(p, l2->lines, num_lines * l2->words_per_line * sizeof(uint64_t));
+}
+
+void l2_restore_state_r(L2_CACHE *l2, const void *state) {
+  uint64_t num_lines = l2->num_sets * l2->lines_per_set;
+  const uint8_t *p = (const uint8_t *) state;
+  memcpy(&l2->replacement, p, sizeof(REPLACEMENT_STATE));
+  p += sizeof(REPLACEMENT_STATE);
+  memcpy(l2->tags, p, num_lines * sizeof(uint64_t));
+  p += num_lines * sizeof(uint64_t);
+  memcpy(l2->lines, p, num_lines * l2->words_per_line * sizeof(uint64_t));
+}
@@ -1,3 +1,10 @@
+#ifndef L2_CACHE_H
+#define L2_CACHE_H
+
+#include <stdint.h>
+
+#include "replacement_policy.h"
+
 
 
 /************************************************
@@ -91,3 +98,148 @@ void l2_insert_line(uint64_t address, uint64_t write_data[],
 
 
 
+
+
+/************************************************************
+
+       Reentrant interface
+
+The procedures above all operate on a single, process-wide L2
+cache. The procedures below do the same jobs on an L2_CACHE
+instance passed as the first parameter, so that any number of
+independent L2 caches can exist at once. An instance is allocated
+with l2_create(), which returns NULL if the allocation fails, and
+is released with l2_destroy().
+
+************************************************************/
+
+typedef struct L2_CACHE L2_CACHE;
+
+L2_CACHE *l2_create();
+
+
+/************************************************************
+
+       L2 geometry
+
+By default the L2 cache is 2MB, direct-mapped, with 64-byte
+lines. l2_create_with_geometry() builds one of another shape,
+described by an L2_GEOMETRY:
+
+size_in_bytes:  total amount of data the cache holds.
+lines_per_set:  the associativity (1 means direct-mapped).
+bytes_per_line: size of a cache line, a power of two of at
+                least one word (8 bytes).
+
+size_in_bytes must be a multiple of lines_per_set * bytes_per_line,
+and the resulting number of sets must be a power of two, otherwise
+l2_create_with_geometry() returns NULL. When a set has more than one
+line, the least recently used line of a full set is replaced (but
+see l2_create_with_policy() below).
+l2_cache_access_r() and l2_insert_line_r() work exactly as described
+above, except that they move lines of bytes_per_line bytes.
+
+************************************************************/
+
+typedef struct {
+  uint64_t size_in_bytes;
+  uint32_t lines_per_set;
+  uint32_t bytes_per_line;
+} L2_GEOMETRY;
+
+#define L2_DEFAULT_GEOMETRY {2 * 1024 * 1024, 1, 64}
+
+L2_CACHE *l2_create_with_geometry(const L2_GEOMETRY *geometry);
+
+void l2_get_geometry(L2_CACHE *l2, L2_GEOMETRY *geometry);
+
+//Creates an L2 cache that uses one of the replacement policies in
+//replacement_policy.h (REPLACEMENT_DEFAULT meaning LRU). Returns NULL
+//if the geometry is not valid or the policy cannot be used with it.
+L2_CACHE *l2_create_with_policy(const L2_GEOMETRY *geometry, REPLACEMENT_POLICY policy);
+
+REPLACEMENT_POLICY l2_get_policy(L2_CACHE *l2);
+
+//Clears the reference bit of every line. Like l1_clear_r_bits(), this
+//should be called periodically, but only matters for the NRU policy.
+void l2_clear_r_bits_r(L2_CACHE *l2);
+
+//Look-ahead, as for the L1 cache (see l1_prefetch_r() and l1_probe_r()):
+//l2_prefetch_r() starts loading the tags of the set address maps to into
+//the host cache. l2_probe_r() returns 1 if the line containing address is
+//in the cache. Otherwise it returns 0, and sets *writeback_address to the
+//address of the dirty line that inserting the line would evict, or to
+//L2_NO_WRITEBACK if there is none. Either way it also starts loading the
+//data of the line that would be used (the line hit, or the victim).
+//Neither changes the state of the cache.
+#define L2_NO_WRITEBACK (~(uint64_t) 0)
+
+void l2_prefetch_r(L2_CACHE *l2, uint64_t address);
+
+int l2_probe_r(L2_CACHE *l2, uint64_t address, uint64_t *writeback_address);
+
+//For writing the cache's dirty lines back without evicting them (see
+//l1_get_dirty_line_r()): if line entry of the cache, from 0 up to the
+//number of lines in the cache - 1, is valid and dirty, copies its
+//address and data out and returns 1. Otherwise returns 0. Either way
+//the cache is unchanged.
+int l2_get_dirty_line_r(L2_CACHE *l2, uint64_t entry, uint64_t *address, uint64_t data[]);
+
+/************************************************************
+
+       Line handles
+
+These two procedures do the work of l2_cache_access_r() and
+l2_insert_line_r(), but hand back a pointer to the line's
+storage in the cache instead of copying the line in or out,
+so that a caller moving a line between levels can copy it
+straight from one level's storage to the other's. The pointer
+is only good until the set is next changed (a line is
+inserted into it, or the cache is initialized or destroyed).
+
+l2_access_line_r()  looks the line containing address up,
+                    exactly as l2_cache_access_r() does, and
+                    returns a pointer to its data, or NULL on a
+                    miss. If control has the write bit set, the
+                    line is marked dirty, and the caller is to
+                    write the line's new data through the pointer.
+l2_replace_line_r() chooses the line to replace and makes it
+                    the line for address, exactly as
+                    l2_insert_line_r() does, and returns a pointer
+                    to its data. The data there is still that of
+                    the line evicted, which the caller must copy
+                    out first if *status is 1 (meaning it has to
+                    be written back, from *evicted_writeback_address),
+                    before filling in the new line.
+
+************************************************************/
+
+uint64_t *l2_access_line_r(L2_CACHE *l2, uint64_t address, uint8_t control);
+
+uint64_t *l2_replace_line_r(L2_CACHE *l2, uint64_t address,
+			    uint64_t *evicted_writeback_address, uint8_t *status);
+
+//For checkpoints, as for the L1 cache (see l1_save_state_r()):
+//l2_save_state_r() copies the state of the replacement policy and the
+//tag word and data of every line into state, which must have room for
+//l2_state_size_r() bytes, and l2_restore_state_r() copies it back into
+//a cache of the same geometry and policy.
+uint64_t l2_state_size_r(L2_CACHE *l2);
+
+void l2_save_state_r(L2_CACHE *l2, void *state);
+
+void l2_restore_state_r(L2_CACHE *l2, const void *state);
+
+void l2_destroy(L2_CACHE *l2);
+
+void l2_initialize_r(L2_CACHE *l2);
+
+void l2_cache_access_r(L2_CACHE *l2, uint64_t address, uint64_t write_data[], 
+		       uint8_t control, uint64_t read_data[], uint8_t *status);
+
+void l2_insert_line_r(L2_CACHE *l2, uint64_t address, uint64_t write_data[], 
+		      uint64_t *evicted_writeback_address, 
+		      uint64_t evicted_writeback_data[], 
+		      uint8_t *status);
+
+#endif
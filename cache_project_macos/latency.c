@@ -0,0 +1,94 @@
+/************************************************************
+
+                        latency.c
+
+The latency model (see latency.h). Each outcome's cycles are worked
+out from the latencies, and its count adds to the totals; outcomes
+that take the same number of cycles share a bucket of the
+histogram.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "latency.h"
+
+void latency_report(const LATENCY_CONFIG *config, const MEMORY_SUBSYSTEM_STATS *stats, LATENCY_REPORT *report) {
+  memset(report, 0, sizeof(*report));
+  for (int level = MEMORY_HIT_L1; level <= MEMORY_HIT_MAIN_MEMORY; level++) {
+    for (int l1_writebacks = 0; l1_writebacks <= 1; l1_writebacks++) {
+      for (int l2_writebacks = 0; l2_writebacks <= 2; l2_writebacks++) {
+	uint64_t n = stats->num_accesses_by_outcome[MEMORY_OUTCOME(level, l1_writebacks, l2_writebacks)];
+	if (n == 0) {
+	  continue;
+	}
+	uint64_t l2 = level >= MEMORY_HIT_L2 ? config->l2_hit_cycles : 0;
+	uint64_t main_memory = level == MEMORY_HIT_MAIN_MEMORY ? config->main_memory_cycles : 0;
+	uint64_t l1_writeback = (uint64_t) l1_writebacks * config->l1_writeback_cycles;
+	uint64_t l2_writeback = (uint64_t) l2_writebacks * config->l2_writeback_cycles;
+	uint64_t cycles = config->l1_hit_cycles + l2 + main_memory + l1_writeback + l2_writeback;
+
+	report->num_accesses += n;
+	report->num_cycles += n * cycles;
+	report->l1_cycles += n * config->l1_hit_cycles;
+	report->l2_stall_cycles += n * l2;
+	report->main_memory_stall_cycles += n * main_memory;
+	report->l1_writeback_stall_cycles += n * l1_writeback;
+	report->l2_writeback_stall_cycles += n * l2_writeback;
+
+	//Into its bucket, keeping them in order.
+	int b = 0;
+	while (b < report->num_buckets && report->buckets[b].cycles < cycles) {
+	  b++;
+	}
+	if (b == report->num_buckets || report->buckets[b].cycles != cycles) {
+	  memmove(&report->buckets[b + 1], &report->buckets[b], (report->num_buckets - b) * sizeof(LATENCY_BUCKET));
+	  report->buckets[b].cycles = cycles;
+	  report->buckets[b].num_accesses = 0;
+	  report->num_buckets++;
+	}
+	report->buckets[b].num_accesses += n;
+      }
+    }
+  }
+  if (report->num_accesses) {
+    report->average_cycles = (double) report->num_cycles / report->num_accesses;
+  }
+}
+
+void latency_print_report(const LATENCY_REPORT *report) {
+  printf("Simulated cycles = %llu\n", report->num_cycles);
+  printf("Average memory access time = %.2f cycles\n", report->average_cycles);
+  printf("Cycles in L1 = %llu\n", report->l1_cycles);
+  printf("Stall cycles in L2 = %llu\n", report->l2_stall_cycles);
+  printf("Stall cycles in main memory = %llu\n", report->main_memory_stall_cycles);
+  printf("Stall cycles writing back from L1 = %llu\n", report->l1_writeback_stall_cycles);
+  printf("Stall cycles writing back from L2 = %llu\n", report->l2_writeback_stall_cycles);
+  printf("Latency histogram (cycles: accesses):\n");
+  for (int b = 0; b < report->num_buckets; b++) {
+    printf("  %6llu: %llu (%.2f%%)\n", report->buckets[b].cycles, report->buckets[b].num_accesses,
+	   100.0 * report->buckets[b].num_accesses / report->num_accesses);
+  }
+}
+
+int latency_config_from_string(const char *string, LATENCY_CONFIG *config) {
+  uint32_t cycles[5];
+  int end = 0;
+
+  if (strchr(string, '-') ||
+      sscanf(string, "%u,%u,%u,%u,%u%n", &cycles[0], &cycles[1], &cycles[2], &cycles[3], &cycles[4], &end) != 5 ||
+      string[end] != '\0') {
+    return -1;
+  }
+  config->l1_hit_cycles = cycles[0];
+  config->l2_hit_cycles = cycles[1];
+  config->main_memory_cycles = cycles[2];
+  config->l1_writeback_cycles = cycles[3];
+  config->l2_writeback_cycles = cycles[4];
+  return 0;
+}
@@ -0,0 +1,74 @@
+/************************************************************
+
+                        latency.h
+
+A latency model, for comparing memory subsystems on time rather
+than on misses. Each access takes l1_hit_cycles, plus l2_hit_cycles
+if it misses in L1, plus main_memory_cycles if it misses in L2 too,
+plus l1_writeback_cycles for the line it writes back from L1 and
+l2_writeback_cycles for each line it writes back from L2 (which is
+how much of a writeback a write buffer does not hide). The cycles
+of an access only depend on its outcome, which every memory
+subsystem counts as it goes (see MEMORY_SUBSYSTEM_STATS), so the
+model costs nothing while simulating, is applied to the statistics
+afterwards, and can be applied with any number of latencies to the
+same run.
+
+latency_report() gives the simulated cycles of the accesses counted
+in a subsystem's statistics, their average memory access time, the
+stall cycles spent at each level beyond L1, and a histogram of the
+cycles each access took. With at most MEMORY_NUM_OUTCOMES different
+outcomes, the histogram is exact: one bucket for each number of
+cycles that some access took.
+
+**************************************************************/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+
+typedef struct {
+  uint32_t l1_hit_cycles;
+  uint32_t l2_hit_cycles;         // added by an L1 miss
+  uint32_t main_memory_cycles;    // added by an L2 miss
+  uint32_t l1_writeback_cycles;   // added by each line written back from L1
+  uint32_t l2_writeback_cycles;   // added by each line written back from L2
+} LATENCY_CONFIG;
+
+//Roughly a desktop processor of today, with most of each writeback
+//hidden by a write buffer.
+#define LATENCY_DEFAULT_CONFIG {4, 12, 200, 2, 40}
+
+typedef struct {
+  uint64_t cycles;
+  uint64_t num_accesses;          // that took that many
+} LATENCY_BUCKET;
+
+typedef struct {
+  uint64_t num_accesses;
+  uint64_t num_cycles;            // of all of them
+  double average_cycles;          // the average memory access time, 0 with no accesses
+  uint64_t l1_cycles;             // num_accesses * l1_hit_cycles
+  uint64_t l2_stall_cycles;       // the rest, by where they were spent
+  uint64_t main_memory_stall_cycles;
+  uint64_t l1_writeback_stall_cycles;
+  uint64_t l2_writeback_stall_cycles;
+  int num_buckets;
+  LATENCY_BUCKET buckets[MEMORY_NUM_OUTCOMES];   // by increasing cycles
+} LATENCY_REPORT;
+
+void latency_report(const LATENCY_CONFIG *config, const MEMORY_SUBSYSTEM_STATS *stats, LATENCY_REPORT *report);
+
+//Prints a report, in the style of the statistics printed by
+//replay_trace.
+void latency_print_report(const LATENCY_REPORT *report);
+
+//Reads the five latencies of a config, in the order above, from a
+//string such as "4,12,200,2,40". Returns 0, or -1 (leaving config
+//alone) if there are not exactly five numbers.
+int latency_config_from_string(const char *string, LATENCY_CONFIG *config);
+
+#endif
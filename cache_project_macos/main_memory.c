@@ -1,14 +1,110 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "memory_subsystem_constants.h"
 #include "main_memory.h"
 
-//main memory is just a (dynamically allocated) array
-//of unsigned 64-bit words.
-uint64_t *main_memory;
-uint64_t main_memory_size_in_bytes;
+//Not every host has MAP_NORESERVE; the mappings are lazily backed anyway.
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/************************************************************************
+
+Main memory is kept in 2MB regions of unsigned 64-bit words, which are
+only mapped when something is first written to them, so that a memory
+can be as large as the whole 48-bit address space while only taking up
+host memory for the parts of it that are actually used. A region that
+has never been written reads as all zeroes.
+
+The regions are found through a directory with one pointer per 2MB of
+the memory (up to 2^27 pointers, for the whole 48-bit space):
+
+     16           27               21
+  ------------------------------------------
+ | unused |  region number  |  byte in      |
+ |        |                 |  region       |
+  ------------------------------------------
+
+The directory and the regions are anonymous memory mappings, which
+the host fills with zeroes as they are first touched, one host page at
+a time. So creating a memory takes the same time whatever its size, a
+region costs nothing until it is written, and then only the host pages
+that are actually written take up memory. Finding a line takes just
+one load from the directory.
+
+A memory can also be a mapping of a file (see main_memory_create_from_file()).
+Then the whole file is mapped at once, every region points into that
+mapping, and the host reads the file in as its pages are touched.
+
+*************************************************************************/
+
+#define MAIN_MEMORY_REGION_SHIFT 21
+#define MAIN_MEMORY_REGION_SIZE ((uint64_t) 1 << MAIN_MEMORY_REGION_SHIFT)
+#define MAIN_MEMORY_REGION_MASK (MAIN_MEMORY_REGION_SIZE - 1)
+
+//Each MAIN_MEMORY is independent of every other one.
+struct MAIN_MEMORY {
+  uint64_t **regions;         // num_regions pointers, NULL until a region is written
+  uint64_t num_regions;
+  uint64_t num_mapped_regions;
+  uint64_t size_in_bytes;
+  uint8_t *file_mapping;      // the mapped file, or NULL
+};
+
+//What a region that has never been written holds.
+static const uint64_t main_memory_zero_line[WORDS_PER_CACHE_LINE];
+
+//The instance used by main_memory_initialize() and main_memory_access().
+static MAIN_MEMORY main_memory_default;
+
+//Maps size_in_bytes of zeroed memory, which the host only backs as it
+//is touched. Returns NULL if that fails.
+static void *main_memory_map(uint64_t size_in_bytes) {
+  void *p = mmap(NULL, size_in_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+//Unmaps the directory and every region of a memory.
+static void main_memory_unmap(MAIN_MEMORY *memory) {
+  if (!memory->regions) {
+    return;
+  }
+  if (memory->file_mapping) {
+    munmap(memory->file_mapping, memory->size_in_bytes);
+    memory->file_mapping = NULL;
+  } else {
+    for (uint64_t i = 0; i < memory->num_regions; i++) {
+      if (memory->regions[i]) {
+        munmap(memory->regions[i], MAIN_MEMORY_REGION_SIZE);
+      }
+    }
+  }
+  munmap(memory->regions, memory->num_regions * sizeof(uint64_t *));
+  memory->regions = NULL;
+}
+
+//Sets up an empty memory of the given size, mapping only its
+//directory. Returns FALSE if that fails.
+static BOOL main_memory_setup(MAIN_MEMORY *memory, uint64_t size_in_bytes) {
+  uint64_t covered = size_in_bytes < MAIN_MEMORY_FULL_SIZE ? size_in_bytes : MAIN_MEMORY_FULL_SIZE;
+  memory->num_regions = (covered + MAIN_MEMORY_REGION_MASK) >> MAIN_MEMORY_REGION_SHIFT;
+  memory->num_mapped_regions = 0;
+  memory->size_in_bytes = size_in_bytes;
+  memory->regions = NULL;
+  memory->file_mapping = NULL;
+  if (memory->num_regions) {
+    memory->regions = (uint64_t **)main_memory_map(memory->num_regions * sizeof(uint64_t *));
+    return memory->regions != NULL;
+  }
+  return TRUE;
+}
 
 /************************************************************************
                  main_memory_initialize
@@ -23,19 +119,114 @@ void main_memory_initialize(uint64_t size_in_bytes) {
     exit(1);
   }
 
-  //Allocate the main memory to be the specified size, using malloc
-  main_memory = (uint64_t *)malloc(size_in_bytes);
-  if (!main_memory) {
+  //Start again with an empty memory of the specified size. Its
+  //regions are only mapped as they are written, and every word
+  //in main memory reads as 0 until then.
+  main_memory_unmap(&main_memory_default);
+  if (!main_memory_setup(&main_memory_default, size_in_bytes)) {
     printf("Error: Memory allocation failed\n");
     exit(1);
   }
-  main_memory_size_in_bytes = size_in_bytes;
+}
+
 
-  //Write a 0 to each word in main memory
-  uint64_t num_words = size_in_bytes / sizeof(uint64_t);
-  for (uint64_t i = 0; i < num_words; i++) {
-    main_memory[i] = 0;
+/************************************************************************
+                 main_memory_create
+This procedure allocates a new, zeroed main memory instance of the
+specified size in bytes. Unlike main_memory_initialize(), it returns
+NULL (rather than exiting) if the size is not a multiple of 64 or if
+the allocation fails.
+*************************************************************************/
+MAIN_MEMORY *main_memory_create(uint64_t size_in_bytes) {
+  if (size_in_bytes & 0x3F) {
+    return NULL;
+  }
+
+  MAIN_MEMORY *memory = (MAIN_MEMORY *)malloc(sizeof(MAIN_MEMORY));
+  if (!memory) {
+    return NULL;
+  }
+  if (!main_memory_setup(memory, size_in_bytes)) {
+    free(memory);
+    return NULL;
   }
+  return memory;
+}
+
+
+/************************************************************************
+                 main_memory_create_from_file
+This procedure creates a main memory instance that is a mapping of the
+file at path (see main_memory.h). It returns NULL if the file cannot be
+opened, extended or mapped, or if the size is not valid.
+*************************************************************************/
+MAIN_MEMORY *main_memory_create_from_file(const char *path, uint64_t size_in_bytes, int mode) {
+  BOOL shared = mode == MAIN_MEMORY_FILE_SHARED;
+  int fd = open(path, shared ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  //Use the size of the file if no size is given, and extend the
+  //file (with zeroes) if it is smaller than the size that is. A
+  //private mapping cannot extend the file, since it never writes
+  //to it.
+  struct stat file_status;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &file_status) == 0) {
+    uint64_t file_size = file_status.st_size;
+    if (size_in_bytes == 0) {
+      size_in_bytes = file_size;
+    }
+    if (size_in_bytes != 0 && !(size_in_bytes & 0x3F) && size_in_bytes <= MAIN_MEMORY_FULL_SIZE &&
+        (file_size >= size_in_bytes || (shared && ftruncate(fd, size_in_bytes) == 0))) {
+      mapping = mmap(NULL, size_in_bytes, PROT_READ | PROT_WRITE,
+                     shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    }
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  MAIN_MEMORY *memory = (MAIN_MEMORY *)malloc(sizeof(MAIN_MEMORY));
+  if (!memory || !main_memory_setup(memory, size_in_bytes)) {
+    munmap(mapping, size_in_bytes);
+    free(memory);
+    return NULL;
+  }
+  memory->file_mapping = (uint8_t *)mapping;
+  for (uint64_t i = 0; i < memory->num_regions; i++) {
+    memory->regions[i] = (uint64_t *)(memory->file_mapping + (i << MAIN_MEMORY_REGION_SHIFT));
+  }
+  return memory;
+}
+
+
+/************************************************************************
+                 main_memory_destroy
+This procedure frees a main memory instance created by main_memory_create()
+or main_memory_create_from_file().
+*************************************************************************/
+void main_memory_destroy(MAIN_MEMORY *memory) {
+  if (memory) {
+    main_memory_unmap(memory);
+    free(memory);
+  }
+}
+
+
+/************************************************************************
+                 main_memory_allocated_bytes_r
+This procedure returns how many bytes of regions a memory has mapped,
+which is 2MB for each region that has been written to, or the whole
+size of a memory that is a mapped file.
+*************************************************************************/
+uint64_t main_memory_allocated_bytes_r(MAIN_MEMORY *memory) {
+  if (memory->file_mapping) {
+    return memory->size_in_bytes;
+  }
+  return memory->num_mapped_regions << MAIN_MEMORY_REGION_SHIFT;
 }
 
 // Although addresses are 64 bits, only the lowest 48
@@ -51,6 +242,26 @@ void main_memory_initialize(uint64_t size_in_bytes) {
 //gives 111...11000000 in binary.
 #define CACHE_LINE_ADDRESS_MASK ~0x3F
 
+
+//Returns the line at cache_line_address (which is within the memory).
+//If its region has not been mapped, it is mapped now if allocate is
+//TRUE, and otherwise NULL is returned.
+static inline uint64_t *main_memory_find_line(MAIN_MEMORY *memory, uint64_t cache_line_address, BOOL allocate) {
+  uint64_t **region = &memory->regions[cache_line_address >> MAIN_MEMORY_REGION_SHIFT];
+  if (!*region) {
+    if (!allocate) {
+      return NULL;
+    }
+    *region = (uint64_t *)main_memory_map(MAIN_MEMORY_REGION_SIZE);
+    if (!*region) {
+      printf("Error: Memory allocation failed\n");
+      exit(1);
+    }
+    memory->num_mapped_regions++;
+  }
+  return *region + (cache_line_address & MAIN_MEMORY_REGION_MASK) / sizeof(uint64_t);
+}
+
 /********************************************************************
                main_memory_access
 
@@ -74,15 +285,15 @@ read_data: an array of unsigned 64-bit integers. On a write operation,
            memory to read_data.
 
 *********************************************************/
-void main_memory_access(uint64_t address, uint64_t write_data[], 
-                        uint8_t control, uint64_t read_data[]) {
+void main_memory_access_r(MAIN_MEMORY *memory, uint64_t address, uint64_t write_data[], 
+                          uint8_t control, uint64_t read_data[]) {
   // Only the lower 48 bits of the address are used.
   address = address & LOWER_48_BIT_MASK;
 
   //Need to check that the specified address is within the 
   //size of the memory. If not, print an error message and
   //exit from the program by calling "exit(1)", see above.
-  if (address >= main_memory_size_in_bytes) {
+  if (address >= memory->size_in_bytes) {
     printf("Error: Address out of memory bounds\n");
     exit(1);
   }
@@ -92,10 +303,9 @@ void main_memory_access(uint64_t address, uint64_t write_data[],
   //number of low bits of the address. This address is in bytes.
   uint64_t cache_line_address = address & CACHE_LINE_ADDRESS_MASK;
 
-  //Since the above address is in bytes, but memory is an array of
-  //8-byte words, the address needs to be converted to an index
-  //into the memory array.
-  uint64_t index_in_memory = cache_line_address / sizeof(uint64_t);
+  //Find the line in its region. Only a write needs the region to
+  //exist; reading a region that has never been written gives zeroes.
+  uint64_t *line = main_memory_find_line(memory, cache_line_address, (control & WRITE_ENABLE_MASK) != 0);
 
   //If the read-enable bit of the control parameter is set, then copy
   //the cache line starting at the above index in memory into read_data.
@@ -103,8 +313,9 @@ void main_memory_access(uint64_t address, uint64_t write_data[],
   //testing the bits of the control parameter.
 
   if (control & READ_ENABLE_MASK) {
+    const uint64_t *source = line ? line : main_memory_zero_line;
     for (int i = 0; i < 8; i++) {
-      read_data[i] = main_memory[index_in_memory + i];
+      read_data[i] = source[i];
     }
   }
 
@@ -113,8 +324,162 @@ void main_memory_access(uint64_t address, uint64_t write_data[],
 
 if (control & WRITE_ENABLE_MASK) {
     for (int i = 0; i < 8; i++) {
-      main_memory[index_in_memory + i] = write_data[i];
+      line[i] = write_data[i];
+    }
+  }
+}
+
+void main_memory_access(uint64_t address, uint64_t write_data[], 
+                        uint8_t control, uint64_t read_data[]) {
+  main_memory_access_r(&main_memory_default, address, write_data, control, read_data);
+}
+
+void main_memory_access_word_r(MAIN_MEMORY *memory, uint64_t address, uint64_t write_data,
+                               uint8_t control, uint64_t *read_data) {
+  address = address & LOWER_48_BIT_MASK;
+  if (address >= memory->size_in_bytes) {
+    printf("Error: Address out of memory bounds\n");
+    exit(1);
+  }
+  uint64_t *line = main_memory_find_line(memory, address & CACHE_LINE_ADDRESS_MASK, (control & WRITE_ENABLE_MASK) != 0);
+  uint64_t word = (address & ~CACHE_LINE_ADDRESS_MASK) >> BYTES_TO_WORDS_SHIFT;
+  if (control & READ_ENABLE_MASK) {
+    *read_data = line ? line[word] : 0;
+  }
+  if (control & WRITE_ENABLE_MASK) {
+    line[word] = write_data;
+  }
+}
+
+void main_memory_prefetch_r(MAIN_MEMORY *memory, uint64_t address) {
+  address = address & LOWER_48_BIT_MASK;
+  if (address < memory->size_in_bytes) {
+    uint64_t *line = main_memory_find_line(memory, address & CACHE_LINE_ADDRESS_MASK, FALSE);
+    if (line) {
+      __builtin_prefetch(line);
+    }
+  }
+}
+
+
+/************************************************************************
+                 main_memory_save_r / main_memory_restore
+These procedures write a memory's regions to a checkpoint file, and map
+them back from it (see main_memory.h). What is written at offset is a
+MAIN_MEMORY_CHECKPOINT header, followed by the numbers of the regions
+saved, and then the regions themselves, each aligned so that it can be
+mapped on its own. Zero blocks are checked for MAIN_MEMORY_CHECKPOINT_BLOCK
+bytes at a time; reading a host page that was never touched does not
+make the host back it.
+*************************************************************************/
+
+#define MAIN_MEMORY_CHECKPOINT_BLOCK 4096
+
+typedef struct {
+  uint64_t size_in_bytes;
+  uint64_t num_saved_regions;
+} MAIN_MEMORY_CHECKPOINT;
+
+static uint64_t main_memory_checkpoint_align(uint64_t offset) {
+  return (offset + MAIN_MEMORY_CHECKPOINT_ALIGNMENT - 1) & ~(uint64_t) (MAIN_MEMORY_CHECKPOINT_ALIGNMENT - 1);
+}
+
+//Writes size bytes at offset, however many calls that takes.
+static BOOL main_memory_pwrite(int fd, const void *data, uint64_t size, uint64_t offset) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n <= 0) {
+      return FALSE;
     }
+    p += n;
+    size -= n;
+    offset += n;
   }
+  return TRUE;
 }
 
+static BOOL main_memory_block_is_zero(const uint64_t *block) {
+  for (uint64_t i = 0; i < MAIN_MEMORY_CHECKPOINT_BLOCK / sizeof(uint64_t); i++) {
+    if (block[i]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+uint64_t main_memory_save_r(MAIN_MEMORY *memory, int fd, uint64_t offset) {
+  if (memory->file_mapping || offset % MAIN_MEMORY_CHECKPOINT_ALIGNMENT) {
+    return 0;
+  }
+  MAIN_MEMORY_CHECKPOINT header = {memory->size_in_bytes, memory->num_mapped_regions};
+  uint64_t *numbers = (uint64_t *)malloc((header.num_saved_regions + 1) * sizeof(uint64_t));
+  if (!numbers) {
+    return 0;
+  }
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < memory->num_regions; i++) {
+    if (memory->regions[i]) {
+      numbers[n++] = i;
+    }
+  }
+
+  BOOL ok = main_memory_pwrite(fd, &header, sizeof(header), offset) &&
+            main_memory_pwrite(fd, numbers, n * sizeof(uint64_t), offset + sizeof(header));
+  uint64_t region_offset = main_memory_checkpoint_align(offset + sizeof(header) + n * sizeof(uint64_t));
+  for (uint64_t r = 0; ok && r < n; r++, region_offset += MAIN_MEMORY_REGION_SIZE) {
+    const uint64_t *region = memory->regions[numbers[r]];
+    for (uint64_t b = 0; ok && b < MAIN_MEMORY_REGION_SIZE; b += MAIN_MEMORY_CHECKPOINT_BLOCK) {
+      const uint64_t *block = region + b / sizeof(uint64_t);
+      if (!main_memory_block_is_zero(block)) {
+        ok = main_memory_pwrite(fd, block, MAIN_MEMORY_CHECKPOINT_BLOCK, region_offset + b);
+      }
+    }
+  }
+  free(numbers);
+  if (!ok || ftruncate(fd, region_offset) != 0) {
+    return 0;
+  }
+  return region_offset;
+}
+
+MAIN_MEMORY *main_memory_restore(int fd, uint64_t offset) {
+  MAIN_MEMORY_CHECKPOINT header;
+  struct stat file_status;
+
+  if (offset % MAIN_MEMORY_CHECKPOINT_ALIGNMENT || fstat(fd, &file_status) != 0 ||
+      pread(fd, &header, sizeof(header), offset) != sizeof(header)) {
+    return NULL;
+  }
+  MAIN_MEMORY *memory = main_memory_create(header.size_in_bytes);
+  if (!memory) {
+    return NULL;
+  }
+  uint64_t numbers_size = header.num_saved_regions * sizeof(uint64_t);
+  uint64_t region_offset = main_memory_checkpoint_align(offset + sizeof(header) + numbers_size);
+  uint64_t *numbers = NULL;
+  BOOL ok = header.num_saved_regions <= memory->num_regions &&
+            region_offset + (header.num_saved_regions << MAIN_MEMORY_REGION_SHIFT) <= (uint64_t) file_status.st_size &&
+            (numbers = (uint64_t *)malloc(numbers_size + 1)) != NULL &&
+            pread(fd, numbers, numbers_size, offset + sizeof(header)) == (ssize_t) numbers_size;
+
+  for (uint64_t r = 0; ok && r < header.num_saved_regions; r++, region_offset += MAIN_MEMORY_REGION_SIZE) {
+    if (numbers[r] >= memory->num_regions || memory->regions[numbers[r]]) {
+      ok = FALSE;
+      break;
+    }
+    void *region = mmap(NULL, MAIN_MEMORY_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, region_offset);
+    if (region == MAP_FAILED) {
+      ok = FALSE;
+      break;
+    }
+    memory->regions[numbers[r]] = (uint64_t *)region;
+    memory->num_mapped_regions++;
+  }
+  free(numbers);
+  if (!ok) {
+    main_memory_destroy(memory);
+    return NULL;
+  }
+  return memory;
+}
@@ -1,12 +1,26 @@
 
 
+#ifndef MAIN_MEMORY_H
+#define MAIN_MEMORY_H
+
+#include <stdint.h>
+
 /************************************************************************
                  main_memory_initialize
 This procedure allocates main memory, according to the size specified in bytes.
 The procedure should check to make sure that the size is a multiple of 64 (since
 there are 8 bytes per word and 8 words per cache line).
+
+Main memory is sparse: it starts out as all zeroes, and host memory is
+only used for it as it is written (2MB regions of it are mapped as they
+are first written, and the host backs only the pages of a region that
+are touched). So initializing it takes the same (short) time whatever
+its size, and the size can be as large as MAIN_MEMORY_FULL_SIZE, in
+which case every 48-bit address is valid.
 *************************************************************************/
 
+#define MAIN_MEMORY_FULL_SIZE ((uint64_t) 1 << 48)
+
 void main_memory_initialize(uint64_t size_in_bytes);
 
 /********************************************************************
@@ -37,3 +51,111 @@ void main_memory_access(uint64_t address, uint64_t write_data[],
 			uint8_t control, uint64_t read_data[]);
 
 
+
+
+/********************************************************************
+
+       Reentrant interface
+
+The procedures above operate on a single, process-wide main memory.
+The procedures below operate on a MAIN_MEMORY instance instead, so
+that several independent memories can exist at once. 
+main_memory_create() returns NULL if the size is not a multiple of
+64 bytes or the allocation fails.
+
+*********************************************************/
+
+typedef struct MAIN_MEMORY MAIN_MEMORY;
+
+MAIN_MEMORY *main_memory_create(uint64_t size_in_bytes);
+
+
+/********************************************************************
+
+       File-backed main memory
+
+main_memory_create_from_file() creates a main memory that is a
+memory mapping of the file at path: the memory's contents are the
+file's contents, and the host reads the file in on demand as the
+memory is accessed, so opening even a very large image is immediate.
+
+mode is one of:
+  MAIN_MEMORY_FILE_SHARED:  writes to the memory are written to the
+                            file, so that a later run can open it again
+                            and carry on with the same contents. The
+                            file is created if it does not exist.
+  MAIN_MEMORY_FILE_PRIVATE: the file is only read. Writes to the memory
+                            are private to this process, and are lost
+                            when it is destroyed. Any number of processes
+                            can share one image this way, through the
+                            host's page cache.
+
+The size of the memory is size_in_bytes, or the size of the file if
+size_in_bytes is 0. A shared file smaller than size_in_bytes is
+extended with zeroes; a private one must be at least that large.
+Returns NULL if the file cannot be opened, extended or mapped, or if
+the size is not a multiple of 64 bytes no larger than
+MAIN_MEMORY_FULL_SIZE. The memory is released, and the file unmapped,
+with main_memory_destroy().
+
+*********************************************************/
+
+#define MAIN_MEMORY_FILE_SHARED 0
+#define MAIN_MEMORY_FILE_PRIVATE 1
+
+MAIN_MEMORY *main_memory_create_from_file(const char *path, uint64_t size_in_bytes, int mode);
+
+void main_memory_destroy(MAIN_MEMORY *memory);
+
+void main_memory_access_r(MAIN_MEMORY *memory, uint64_t address, uint64_t write_data[], 
+			  uint8_t control, uint64_t read_data[]);
+
+//The same as main_memory_access_r(), for the single word at address
+//instead of its whole line: write_data is written to it, and it is
+//read into *read_data (before the write, if control has both bits set).
+//This is what fast-forwarding uses (see memory_start_fast_forward_r()).
+void main_memory_access_word_r(MAIN_MEMORY *memory, uint64_t address, uint64_t write_data,
+			       uint8_t control, uint64_t *read_data);
+
+//Asks the host to start loading the cache line containing address, which
+//is about to be accessed. Addresses outside the memory are ignored.
+void main_memory_prefetch_r(MAIN_MEMORY *memory, uint64_t address);
+
+//Returns the number of bytes of host address space mapped for the
+//memory's contents: 2MB for each region that has been written to so far.
+uint64_t main_memory_allocated_bytes_r(MAIN_MEMORY *memory);
+
+
+/********************************************************************
+
+       Checkpoints
+
+main_memory_save_r() writes a memory to the file open as fd, from
+offset on (which must be a multiple of MAIN_MEMORY_CHECKPOINT_ALIGNMENT):
+its size, the numbers of the regions that have been written to, and
+then the contents of each of those regions, starting at the next
+multiple of MAIN_MEMORY_CHECKPOINT_ALIGNMENT. Regions never written
+are not saved at all, and blocks of a region that are all zeroes
+(such as its host pages that were never touched) are left as holes
+in the file. The file is extended to the end of the last region,
+and the offset of that end is returned, or 0 if the memory is a
+mapped file or writing fails.
+
+main_memory_restore() creates a memory from what main_memory_save_r()
+wrote to the file open as fd at offset. Each region is a private
+mapping of its contents in the file, so restoring takes the same
+short time however much was saved, nothing is read until it is
+accessed, and writes to the memory never reach the file. fd can be
+closed afterwards, but the file must not be changed while the memory
+exists. Returns NULL if what is at offset is not a saved memory, or
+it cannot be mapped.
+
+*********************************************************/
+
+#define MAIN_MEMORY_CHECKPOINT_ALIGNMENT 65536
+
+uint64_t main_memory_save_r(MAIN_MEMORY *memory, int fd, uint64_t offset);
+
+MAIN_MEMORY *main_memory_restore(int fd, uint64_t offset);
+
+#endif
@@ -12,24 +12,58 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "memory_subsystem_constants.h"
 #include "main_memory.h"
 #include "l1_cache.h"
 #include "l2_cache.h"
+#include "trace.h"
 #include "memory_subsystem.h"
 
 
+/*******************************************************
+
+This structure holds one complete memory subsystem: its
+own L1 cache, L2 cache and main memory, along with the
+statistics gathered while accessing it. Nothing in it is
+shared with any other instance.
+
+*******************************************************/
+
+struct MEMORY_SUBSYSTEM {
+  L1_CACHE *l1;
+  L2_CACHE *l2;
+  MAIN_MEMORY *main_memory;
+  MEMORY_SUBSYSTEM_STATS stats;
+  BOOL main_memory_is_file;   // flushed to its file when destroyed
+  TRACE_RECORDER *recorder;   // NULL unless the accesses are being traced
+  BOOL fast_forward;          // see memory_start_fast_forward_r()
+  uint64_t *warming;          // the last num_warming accesses fast-forwarded, a ring
+  uint64_t num_warming;
+  uint64_t num_warming_kept;  // how many of them have been made so far
+  uint64_t next_warming;      // the slot of the next one
+};
+
 //These are defined below.
-void memory_handle_l1_miss(uint64_t address);
-void memory_handle_l2_miss(uint64_t address, uint8_t control);
+static uint8_t memory_handle_l1_miss(MEMORY_SUBSYSTEM *ms, uint64_t address, const uint64_t new_line[]);
+static void memory_handle_l2_miss(MEMORY_SUBSYSTEM *ms, uint64_t address, uint8_t control);
 
 //We are going to count how many L1 and L2 cache misses 
-//have occurred. These are the variables used to keep
-//track of the misses.
+//have occurred in the subsystem set up by
+//memory_subsystem_initialize(). These are the variables
+//used to keep track of the misses.
 uint64_t num_l1_misses;
 uint64_t num_l2_misses;
 
+//The instance used by memory_subsystem_initialize(), memory_access()
+//and memory_handle_clock_interrupt().
+static MEMORY_SUBSYSTEM *memory_default;
+
 /*******************************************************
 
         memory_subsystem_initialize()
@@ -43,19 +77,129 @@ that determines large the main memory will be.
 void memory_subsystem_initialize(uint64_t memory_size_in_bytes)
 {
 
-  //Call the intialization procedures for main memory,
-  // L2 cache, and L1 cache. 
+  //Create a fresh subsystem (main memory, L2 cache, and L1
+  //cache) for the non-reentrant procedures to use.
 
   //Also initializes num_l1_misses and num_l2_misses to 0.
 
-  main_memory_initialize(memory_size_in_bytes);
-  l1_initialize();
-  l2_initialize();
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(memory_size_in_bytes);
+  memory_subsystem_initialize_with_config(&config);
+}
+
+
+/*******************************************************
+
+        memory_subsystem_initialize_with_config()
+
+The same as memory_subsystem_initialize(), with the shape
+of the memory subsystem given by config.
+
+*******************************************************/
+
+void memory_subsystem_initialize_with_config(const MEMORY_SUBSYSTEM_CONFIG *config)
+{
+  if (config->main_memory_size_in_bytes & 0x3F) {
+    printf("Error: Memory size (in bytes) must be a multiple of 8-word cache lines (64 bytes)\n");
+    exit(1);
+  }
+
+  memory_subsystem_destroy(memory_default);
+  memory_default = memory_subsystem_create_with_config(config);
+  if (!memory_default) {
+    printf("Error: Invalid cache geometry, memory allocation failed, or main memory file could not be mapped\n");
+    exit(1);
+  }
 
   num_l1_misses = 0;
   num_l2_misses = 0;
+}
+
+
+/*******************************************************
 
+        memory_subsystem_create()
 
+This procedure allocates and initializes an independent
+memory subsystem with a main memory of memory_size_in_bytes
+bytes. It returns NULL if the size is not a multiple of 64
+or if any part of the subsystem cannot be allocated.
+
+*******************************************************/
+
+MEMORY_SUBSYSTEM *memory_subsystem_create(uint64_t memory_size_in_bytes)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(memory_size_in_bytes);
+  return memory_subsystem_create_with_config(&config);
+}
+
+
+/*******************************************************
+
+        memory_subsystem_create_with_config()
+
+This procedure allocates and initializes an independent
+memory subsystem shaped as described by config. It returns
+NULL if the configuration is not valid or if any part of
+the subsystem cannot be allocated.
+
+*******************************************************/
+
+MEMORY_SUBSYSTEM *memory_subsystem_create_with_config(const MEMORY_SUBSYSTEM_CONFIG *config)
+{
+  //Main memory moves whole 64-byte lines, so the caches
+  //have to use the same line size.
+  if (config->l1_geometry.bytes_per_line != BYTES_PER_CACHE_LINE ||
+      config->l2_geometry.bytes_per_line != BYTES_PER_CACHE_LINE) {
+    return NULL;
+  }
+
+  MEMORY_SUBSYSTEM *ms = (MEMORY_SUBSYSTEM *)calloc(1, sizeof(MEMORY_SUBSYSTEM));
+  if (!ms) {
+    return NULL;
+  }
+
+  if (config->main_memory_file) {
+    ms->main_memory = main_memory_create_from_file(config->main_memory_file, config->main_memory_size_in_bytes,
+                                                   config->main_memory_file_mode);
+    ms->main_memory_is_file = TRUE;
+  } else {
+    ms->main_memory = main_memory_create(config->main_memory_size_in_bytes);
+  }
+  ms->l1 = l1_create_with_policy(&config->l1_geometry, config->l1_replacement_policy);
+  ms->l2 = l2_create_with_policy(&config->l2_geometry, config->l2_replacement_policy);
+
+  if (!ms->main_memory || !ms->l1 || !ms->l2) {
+    memory_subsystem_destroy(ms);
+    return NULL;
+  }
+  return ms;
+}
+
+
+/*******************************************************
+
+        memory_subsystem_destroy()
+
+This procedure frees a subsystem created by
+memory_subsystem_create(). Passing NULL does nothing.
+If main memory is a file, the caches are flushed to it
+first.
+
+*******************************************************/
+
+void memory_subsystem_destroy(MEMORY_SUBSYSTEM *ms)
+{
+  if (!ms) {
+    return;
+  }
+  if (ms->main_memory_is_file && ms->main_memory && ms->l1 && ms->l2) {
+    memory_subsystem_flush_r(ms);
+  }
+  main_memory_destroy(ms->main_memory);
+  l1_destroy(ms->l1);
+  l2_destroy(ms->l2);
+  free(ms->warming);
+  free(ms);
 }
 
 
@@ -85,21 +229,24 @@ read_data: a 64-bit ouput parameter (thus, a pointer to it is passed).
 
 ****************************************************/
 
-void memory_access(uint64_t address, uint64_t write_data, 
-		   uint8_t control, uint64_t *read_data)
+//The body of memory_access_r(). Returns the level that the
+//data came from (see MEMORY_HIT_L1 etc. in memory_subsystem.h).
+static inline uint8_t memory_access_one(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t write_data, 
+					uint8_t control, uint64_t *read_data)
 {
 
   uint8_t status = 0;
+  uint8_t level = MEMORY_HIT_L1;
 
   //call l1_cache_access to try to read or write the 
   //data from or to the L1 cache.
 
-  l1_cache_access(address, write_data, control, read_data, &status);
+  l1_cache_access_r(ms->l1, address, write_data, control, read_data, &status);
 
   
 
   //If an L1 cache miss occurred, then:
-  // -- increment num_l1_misses
+  // -- increment the L1 miss count
   // -- call memory_handle_l1_miss(), below, specifying
   //    the requested address, to bring the needed 
   //    cache line into L1.
@@ -107,10 +254,342 @@ void memory_access(uint64_t address, uint64_t write_data,
   //      write the data.
 
   if((status & 1) == 0) {
-    num_l1_misses++;
-    memory_handle_l1_miss(address);
-    l1_cache_access(address, write_data, control, read_data, &status);
+    ms->stats.num_l1_misses++;
+    level = memory_handle_l1_miss(ms, address, NULL);
+    l1_cache_access_r(ms->l1, address, write_data, control, read_data, &status);
+  } else {
+    ms->stats.num_accesses_by_outcome[MEMORY_OUTCOME(MEMORY_HIT_L1, 0, 0)]++;
+  }
+  return level;
+}
+
+//Keeps an access (or, with control TRACE_CLOCK_INTERRUPT, a clock
+//interrupt) made fast-forwarding, for warming the caches up (see
+//memory_start_fast_forward_r()). As in a trace record, the control
+//is kept in bits 56-63 of the address.
+static inline void memory_fast_forward_keep(MEMORY_SUBSYSTEM *ms, uint64_t address, uint8_t control)
+{
+  if (ms->num_warming) {
+    ms->warming[ms->next_warming] = (address & 0xFFFFFFFFFFFF) | (uint64_t) control << 56;
+    if (++ms->next_warming == ms->num_warming) {
+      ms->next_warming = 0;
+    }
+    ms->num_warming_kept++;
+  }
+}
+
+//Makes one access fast-forwarding, straight to main memory.
+static inline void memory_fast_forward_one(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t write_data,
+					   uint8_t control, uint64_t *read_data)
+{
+  memory_fast_forward_keep(ms, address, control);
+  main_memory_access_word_r(ms->main_memory, address, write_data, control, read_data);
+}
+
+//Hands one access to the subsystem's trace recorder, if it has one.
+static inline void memory_trace(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t write_data, uint8_t control)
+{
+  if (ms->recorder) {
+    trace_recorder_record(ms->recorder, address, control,
+			  (control & WRITE_ENABLE_MASK) ? write_data : 0);
+  }
+}
+
+void memory_access_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t write_data, 
+		     uint8_t control, uint64_t *read_data)
+{
+  memory_trace(ms, address, write_data, control);
+  if (ms->fast_forward) {
+    memory_fast_forward_one(ms, address, write_data, control, read_data);
+    return;
   }
+  memory_access_one(ms, address, write_data, control, read_data);
+}
+
+void memory_access(uint64_t address, uint64_t write_data, 
+		   uint8_t control, uint64_t *read_data)
+{
+  //The caller is allowed to reset num_l1_misses and num_l2_misses
+  //at any time, so they are copied into and back out of the
+  //default subsystem's statistics around each access.
+
+  memory_default->stats.num_l1_misses = num_l1_misses;
+  memory_default->stats.num_l2_misses = num_l2_misses;
+
+  memory_access_r(memory_default, address, write_data, control, read_data);
+
+  num_l1_misses = memory_default->stats.num_l1_misses;
+  num_l2_misses = memory_default->stats.num_l2_misses;
+}
+
+
+/*****************************************************
+
+              memory_access_batch()
+
+This procedure performs n accesses, exactly as n calls
+to memory_access() in order would (see memory_subsystem.h).
+
+Going through a whole batch lets it look ahead: while
+entry i is being performed, the host is already loading
+what later entries will need. The look-ahead runs in
+three stages, each MEMORY_BATCH_STAGE entries apart:
+
+  -- the L1 tags of the set of entry i + 3 * STAGE are
+     prefetched;
+  -- entry i + 2 * STAGE is looked up in L1 (without
+     changing L1). If it misses, the tags of its L2 set
+     are prefetched, and so are those of the dirty line
+     it would evict from L1, if any;
+  -- if entry i + STAGE missed in L1, it and the line it
+     evicts are looked up in L2, which prefetches the L2
+     line data that will be read or replaced. Whatever
+     will have to come from, or be written back to, main
+     memory is prefetched too.
+
+An entry in the same line as the entry before it will
+find that line in L1, so it is not looked up at all.
+
+The look-ahead never changes the simulated state, and
+the caches can change between the look-ahead and the
+access itself, so a prefetch can be wasted, but the
+result of the batch never depends on it.
+
+****************************************************/
+
+#define MEMORY_BATCH_STAGE 4
+#define MEMORY_BATCH_RING 16   // power of two, more than 2 * MEMORY_BATCH_STAGE
+
+//Whether entry i is in the same line as entry i - 1.
+static inline int same_line(const uint64_t addresses[], uint64_t i)
+{
+  return i > 0 && !(((addresses[i] ^ addresses[i - 1]) & 0xFFFFFFFFFFFF) >> (BYTES_TO_WORDS_SHIFT + WORDS_TO_CACHE_LINES_SHIFT));
+}
+
+//The state of the look-ahead for the entries between i + STAGE and
+//i + 2 * STAGE, indexed by entry number % MEMORY_BATCH_RING.
+typedef struct {
+  uint8_t l1_missing[MEMORY_BATCH_RING];
+  uint64_t l1_writeback[MEMORY_BATCH_RING];
+} MEMORY_LOOK_AHEAD;
+
+//The second stage of the look-ahead, for entry i.
+static inline void memory_look_ahead_l1(MEMORY_SUBSYSTEM *ms, MEMORY_LOOK_AHEAD *la,
+					const uint64_t addresses[], uint64_t i)
+{
+  uint64_t slot = i % MEMORY_BATCH_RING;
+  la->l1_missing[slot] = !same_line(addresses, i) &&
+                         !l1_probe_r(ms->l1, addresses[i], &la->l1_writeback[slot]);
+  if (la->l1_missing[slot]) {
+    l2_prefetch_r(ms->l2, addresses[i]);
+    if (la->l1_writeback[slot] != L1_NO_WRITEBACK) {
+      l2_prefetch_r(ms->l2, la->l1_writeback[slot]);
+    }
+  }
+}
+
+//The third stage of the look-ahead, for entry i.
+static inline void memory_look_ahead_l2(MEMORY_SUBSYSTEM *ms, MEMORY_LOOK_AHEAD *la,
+					const uint64_t addresses[], uint64_t i)
+{
+  uint64_t slot = i % MEMORY_BATCH_RING;
+  uint64_t l2_writeback;
+  if (!la->l1_missing[slot]) {
+    return;
+  }
+  if (!l2_probe_r(ms->l2, addresses[i], &l2_writeback)) {
+    main_memory_prefetch_r(ms->main_memory, addresses[i]);
+    if (l2_writeback != L2_NO_WRITEBACK) {
+      main_memory_prefetch_r(ms->main_memory, l2_writeback);
+    }
+  }
+  if (la->l1_writeback[slot] != L1_NO_WRITEBACK &&
+      !l2_probe_r(ms->l2, la->l1_writeback[slot], &l2_writeback) &&
+      l2_writeback != L2_NO_WRITEBACK) {
+    main_memory_prefetch_r(ms->main_memory, l2_writeback);
+  }
+}
+
+void memory_access_batch_r(MEMORY_SUBSYSTEM *ms, const uint64_t addresses[], const uint64_t write_data[],
+			   const uint8_t controls[], uint64_t read_data[], uint8_t hit_levels[], uint64_t n)
+{
+  MEMORY_LOOK_AHEAD la;
+  uint64_t i;
+
+  //Fast-forwarding, only main memory is looked ahead in.
+  if (ms->fast_forward) {
+    for (i = 0; i < MEMORY_BATCH_STAGE && i < n; i++) {
+      main_memory_prefetch_r(ms->main_memory, addresses[i]);
+    }
+    for (i = 0; i < n; i++) {
+      memory_trace(ms, addresses[i], write_data ? write_data[i] : 0, controls[i]);
+      if (i + MEMORY_BATCH_STAGE < n && !same_line(addresses, i + MEMORY_BATCH_STAGE)) {
+	main_memory_prefetch_r(ms->main_memory, addresses[i + MEMORY_BATCH_STAGE]);
+      }
+      memory_fast_forward_one(ms, addresses[i], write_data ? write_data[i] : 0,
+			      controls[i], read_data ? &read_data[i] : NULL);
+      if (hit_levels) {
+	hit_levels[i] = MEMORY_HIT_MAIN_MEMORY;
+      }
+    }
+    return;
+  }
+
+  //Fill the pipeline for the first entries.
+  for (i = 0; i < 3 * MEMORY_BATCH_STAGE && i < n; i++) {
+    l1_prefetch_r(ms->l1, addresses[i]);
+  }
+  for (i = 0; i < 2 * MEMORY_BATCH_STAGE && i < n; i++) {
+    memory_look_ahead_l1(ms, &la, addresses, i);
+  }
+  for (i = 0; i < MEMORY_BATCH_STAGE && i < n; i++) {
+    memory_look_ahead_l2(ms, &la, addresses, i);
+  }
+
+  for (i = 0; i < n; i++) {
+    memory_trace(ms, addresses[i], write_data ? write_data[i] : 0, controls[i]);
+    if (i + 3 * MEMORY_BATCH_STAGE < n && !same_line(addresses, i + 3 * MEMORY_BATCH_STAGE)) {
+      l1_prefetch_r(ms->l1, addresses[i + 3 * MEMORY_BATCH_STAGE]);
+    }
+    if (i + 2 * MEMORY_BATCH_STAGE < n) {
+      memory_look_ahead_l1(ms, &la, addresses, i + 2 * MEMORY_BATCH_STAGE);
+    }
+    if (i + MEMORY_BATCH_STAGE < n) {
+      memory_look_ahead_l2(ms, &la, addresses, i + MEMORY_BATCH_STAGE);
+    }
+
+    //Every access ends with a hit in L1, so an entry in the
+    //same line as the one before it is a hit on the same line.
+    uint8_t level = MEMORY_HIT_L1;
+    if (same_line(addresses, i)) {
+      l1_cache_access_again_r(ms->l1, addresses[i], write_data ? write_data[i] : 0,
+			      controls[i], read_data ? &read_data[i] : NULL);
+      ms->stats.num_accesses_by_outcome[MEMORY_OUTCOME(MEMORY_HIT_L1, 0, 0)]++;
+    } else {
+      level = memory_access_one(ms, addresses[i], write_data ? write_data[i] : 0,
+				controls[i], read_data ? &read_data[i] : NULL);
+    }
+    if (hit_levels) {
+      hit_levels[i] = level;
+    }
+  }
+}
+
+void memory_access_batch(const uint64_t addresses[], const uint64_t write_data[],
+			 const uint8_t controls[], uint64_t read_data[], uint8_t hit_levels[], uint64_t n)
+{
+  memory_default->stats.num_l1_misses = num_l1_misses;
+  memory_default->stats.num_l2_misses = num_l2_misses;
+
+  memory_access_batch_r(memory_default, addresses, write_data, controls, read_data, hit_levels, n);
+
+  num_l1_misses = memory_default->stats.num_l1_misses;
+  num_l2_misses = memory_default->stats.num_l2_misses;
+}
+
+
+/*****************************************************
+
+              memory_read_block() / memory_write_block()
+
+These procedures perform the same accesses as a
+memory_access() call for each word in the block, but
+handle the block one cache line at a time: each line is
+looked up in L1 once, and the words of the block in it are
+copied in or out together (see l1_cache_access_words_r()).
+
+A line that misses in L1 is brought in exactly as it would
+be for the first word of the block in it, so the misses and
+writebacks counted are the same as word by word. The one
+shortcut is for a write that covers a whole line: none of
+the line's old contents survive, so they are not read from
+main memory on an L2 miss, and the line inserted into L1 is
+the new data (see memory_handle_l1_miss()).
+
+****************************************************/
+
+//Performs the accesses to the num_words words of the block that
+//start at address, all of which are in the same line.
+static inline void memory_access_words(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_words,
+				       const uint64_t write_data[], uint8_t control, uint64_t read_data[])
+{
+  uint8_t status = 0;
+
+  if (ms->fast_forward) {
+    for (uint64_t i = 0; i < num_words; i++) {
+      memory_fast_forward_one(ms, address + (i << WORDS_TO_BYTES_SHIFT), write_data ? write_data[i] : 0,
+			      control, read_data ? &read_data[i] : NULL);
+    }
+    return;
+  }
+  //Word by word, only the first word could miss.
+  l1_cache_access_words_r(ms->l1, address, num_words, write_data, control, read_data, &status);
+  if((status & 1) == 0) {
+    ms->stats.num_l1_misses++;
+    memory_handle_l1_miss(ms, address,
+			  (control & WRITE_ENABLE_MASK) && num_words == WORDS_PER_CACHE_LINE ? write_data : NULL);
+    l1_cache_access_words_r(ms->l1, address, num_words, write_data, control, read_data, &status);
+    num_words--;
+  }
+  ms->stats.num_accesses_by_outcome[MEMORY_OUTCOME(MEMORY_HIT_L1, 0, 0)] += num_words;
+}
+
+//Splits the block into its lines.
+static void memory_access_block(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_bytes,
+				const uint64_t write_data[], uint8_t control, uint64_t read_data[])
+{
+  uint64_t num_words = num_bytes >> BYTES_TO_WORDS_SHIFT;
+  uint64_t done = 0;
+
+  address &= ~(uint64_t)(BYTES_PER_WORD - 1);
+  while (done < num_words) {
+    uint64_t word_in_line = (address >> BYTES_TO_WORDS_SHIFT) & (WORDS_PER_CACHE_LINE - 1);
+    uint64_t words = WORDS_PER_CACHE_LINE - word_in_line;
+    if (words > num_words - done) {
+      words = num_words - done;
+    }
+    if (ms->recorder) {
+      for (uint64_t i = 0; i < words; i++) {
+	memory_trace(ms, address + (i << WORDS_TO_BYTES_SHIFT), write_data ? write_data[done + i] : 0, control);
+      }
+    }
+    memory_access_words(ms, address, words, write_data ? write_data + done : NULL, control,
+			read_data ? read_data + done : NULL);
+    done += words;
+    address += words << WORDS_TO_BYTES_SHIFT;
+  }
+}
+
+void memory_read_block_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_bytes, uint64_t read_data[])
+{
+  memory_access_block(ms, address, num_bytes, NULL, READ_ENABLE_MASK, read_data);
+}
+
+void memory_write_block_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_bytes, const uint64_t write_data[])
+{
+  memory_access_block(ms, address, num_bytes, write_data, WRITE_ENABLE_MASK, NULL);
+}
+
+void memory_read_block(uint64_t address, uint64_t num_bytes, uint64_t read_data[])
+{
+  memory_default->stats.num_l1_misses = num_l1_misses;
+  memory_default->stats.num_l2_misses = num_l2_misses;
+
+  memory_read_block_r(memory_default, address, num_bytes, read_data);
+
+  num_l1_misses = memory_default->stats.num_l1_misses;
+  num_l2_misses = memory_default->stats.num_l2_misses;
+}
+
+void memory_write_block(uint64_t address, uint64_t num_bytes, const uint64_t write_data[])
+{
+  memory_default->stats.num_l1_misses = num_l1_misses;
+  memory_default->stats.num_l2_misses = num_l2_misses;
+
+  memory_write_block_r(memory_default, address, num_bytes, write_data);
+
+  num_l1_misses = memory_default->stats.num_l1_misses;
+  num_l2_misses = memory_default->stats.num_l2_misses;
 }
 
 
@@ -123,69 +602,100 @@ It doesn't matter if the miss occured on a read or a write
 operation. It takes as a parameter the address that resulted
 in the L1 cache miss.
 
+If the access that missed is about to overwrite the whole
+line, new_line holds the line's new contents; otherwise it
+is NULL. The caches see the same accesses either way, but
+with new_line there is no need for the line's old contents:
+they are not read from main memory on an L2 miss (just as
+for the write of a line evicted from L1, below), and L1 is
+given new_line instead of the line read from L2.
+
 ****************************************************/
 
 
-void memory_handle_l1_miss(uint64_t address)  
+static uint8_t memory_handle_l1_miss(MEMORY_SUBSYSTEM *ms, uint64_t address, const uint64_t new_line[])  
 {
+  uint8_t level = MEMORY_HIT_L2;
+  uint64_t l1_writebacks = ms->stats.num_l1_writebacks;
+  uint64_t l2_writebacks = ms->stats.num_l2_writebacks;
 
-  //call l2_cache_access to read the cache line containing
+  //call l2_access_line to read the cache line containing
   //the specified address from the L2 cache. This is necessary
   //regardless if the operation that caused the L1 cache miss
-  //was a read or a write.
-  uint8_t control = 1;
-  uint64_t read_data[WORDS_PER_CACHE_LINE];
-  uint8_t l2_status = 0;
-
-  l2_cache_access(address, NULL, control, read_data, &l2_status);
+  //was a read or a write. (When the line is being replaced
+  //as a whole, the access is made without reading the data.)
+  //Rather than copying the line out, L2 hands back a pointer
+  //to it, so that it can be copied straight into L1 below.
+  uint8_t control = new_line ? 0 : 1;
+  const uint64_t *line = l2_access_line_r(ms->l2, address, control);
 
 
   //if the result was an L2 cache miss, then:
-  //   -- increment num_l2_misses
+  //   -- increment the L2 miss count
   //   -- call memory_handle_l2_miss, specifying the address that 
   //      caused the L2 miss (which is the same as the address that
   //      caused the L1 miss), and specifying that the L2 miss 
   //      occurred when attempting to read from L2 cache.
-  //  --  call l2_cache_access again to read the needed cache line
+  //  --  call l2_access_line again to read the needed cache line
   //      from the l2 cache.
 
-  if((l2_status & 1) == 0) {
-    num_l2_misses++;
-    memory_handle_l2_miss(address, control);
-    l2_cache_access(address, NULL, control, read_data, &l2_status);
+  if(!line) {
+    ms->stats.num_l2_misses++;
+    level = MEMORY_HIT_MAIN_MEMORY;
+    memory_handle_l2_miss(ms, address, new_line ? 0x2 : control);
+    line = l2_access_line_r(ms->l2, address, control);
+  }
+  if(new_line) {
+    line = new_line;
   }
   
-  //Now that the needed cache line has been retrieved from the 
+  //Now that the needed cache line has been found in the 
   //L2 cache (whether an L2 cache miss occurred or not),
-  //insert the cache line into the l1 cache by calling l1_insert_line.
+  //make room for it in the l1 cache by calling l1_replace_line.
+  //The line it hands back still holds the evicted line's data.
   uint64_t evicted_writeback_address;
-  uint64_t evicted_writeback_data[WORDS_PER_CACHE_LINE];
-  l2_status = 0;
-
-
-  l1_insert_line(address, read_data, &evicted_writeback_address, evicted_writeback_data, &l2_status);
+  uint64_t line_copy[WORDS_PER_CACHE_LINE];
+  uint8_t l1_status = 0;
+  uint64_t *l1_line = l1_replace_line_r(ms->l1, address, &evicted_writeback_address, &l1_status);
   
   //if the cache line that was evicted from L1 has to be written back,
-  //then l2_cache_access must be called to write the evicted cache line
+  //then l2_access_line must be called to write the evicted cache line
   //to L2. If a cache miss occurs when writing the evicted cache line
   //to L2, then:
   //   -- memory_handle_l2_miss, below, should be called, specifying the 
   //      address (of the evicted line) that caused the L2 cache miss,
   //      and specifying that the operation that caused the L2 miss
   //      was a write (not a read).
-  //   -- l2_cache_access should be called again to write the cache line
+  //   -- l2_access_line should be called again to write the cache line
   //      evicted from L1 into L2.
   //      
 
-  if(l2_status & 1) {
+  if(l1_status & 1) {
 
+    ms->stats.num_l1_writebacks++;
     control = 0x2;
-    l2_cache_access(evicted_writeback_address, evicted_writeback_data, control, NULL, &l2_status);
-    memory_handle_l2_miss(evicted_writeback_address, control);
-    l2_cache_access(evicted_writeback_address, evicted_writeback_data, control, NULL, &l2_status);
+    uint64_t *l2_line = l2_access_line_r(ms->l2, evicted_writeback_address, control);
+    if(!l2_line) {
+      //Making room in L2 for the evicted line may evict the line
+      //that line points to, so it has to be copied out first.
+      if(line != new_line) {
+        memcpy(line_copy, line, BYTES_PER_CACHE_LINE);
+        line = line_copy;
+      }
+      memory_handle_l2_miss(ms, evicted_writeback_address, control);
+      l2_line = l2_access_line_r(ms->l2, evicted_writeback_address, control);
+    }
+    memcpy(l2_line, l1_line, BYTES_PER_CACHE_LINE);
     
   }
 
+  //Finally, fill in the line in L1, and count the access that
+  //missed by its outcome.
+  memcpy(l1_line, line, BYTES_PER_CACHE_LINE);
+  ms->stats.num_accesses_by_outcome[MEMORY_OUTCOME(level, ms->stats.num_l1_writebacks - l1_writebacks,
+						   ms->stats.num_l2_writebacks - l2_writebacks)]++;
+
+  return level;
 }
 
 /****************************************************
@@ -205,45 +715,35 @@ due to a read or a write. It takes the following parameters:
 ****************************************************/
 
 
-void memory_handle_l2_miss(uint64_t address, uint8_t control)
+static void memory_handle_l2_miss(MEMORY_SUBSYSTEM *ms, uint64_t address, uint8_t control)
 {
-  uint64_t cache_line[WORDS_PER_CACHE_LINE];
   uint64_t evicted_writeback_address;
-  uint64_t evicted_writeback_data[WORDS_PER_CACHE_LINE];
+  uint8_t status = 0; 
+  
+  //Call l2_replace_line to make room for the line in L2. It hands
+  //back the line's storage in L2, which still holds the evicted
+  //line's data.
 
+  uint64_t *cache_line = l2_replace_line_r(ms->l2, address, &evicted_writeback_address, &status);
+  
+  //If the evicted cache line has to be written back to main memory,
+  //call main_memory_access to write it to main memory, at the evicted
+  //line's own address, straight from L2.
 
+  if(status) {
+    ms->stats.num_l2_writebacks++;
+    main_memory_access_r(ms->main_memory, evicted_writeback_address, cache_line, WRITE_ENABLE_MASK, NULL);
+  }
 
   //If the L2 miss was on a read operation, then main_memory_access
-  //must be called to fetch the needed cache line from main_memory.
-  //The fetched cache line should be written to cache_line (see above).
+  //must be called to fetch the needed cache line from main_memory,
+  //straight into L2.
   //However, if the L2 miss was on a write operation (with an evicted line from L1), 
   //there's no need to read the cache line from main memory, since 
   //that line will be overwritten. 
-  uint64_t read_data[WORDS_PER_CACHE_LINE] = {};
-  if(control & 1) {
-    main_memory_access(address, NULL, control, read_data);
-    for(int i = 0; i < WORDS_PER_CACHE_LINE; i++) {
-      cache_line[i] = read_data[i];
-    }
-  }
-
-  uint8_t status = 0; 
-  
-  //Now call l2_insert_line to insert the cache line data in cache_line,
-  //above, into L2. In the case of a read, this is the cache line data 
-  //that has been read from main memory. In the case of a write, then 
-  //it's just meaningless data being written to L2 (i.e. whatever happened
-  //to be in cache_line), since that line in L2 will be overwritten subsequently.
-
-  l2_insert_line(address, cache_line, &evicted_writeback_address, evicted_writeback_data, &status);
-  
-  //If the call to l2_insert_line resulted in an evicted cache line
-  //that has to be written back to main memory, call main_memory_access
-  //to write the evicted cache line to main memory.
 
-  if(status) {
-    control = 0x2;
-    main_memory_access(address, evicted_writeback_data, control, NULL);
+  if(control & 1) {
+    main_memory_access_r(ms->main_memory, address, NULL, control, cache_line);
   }
 }
 
@@ -255,13 +755,322 @@ void memory_handle_l2_miss(uint64_t address, uint8_t control)
 This procedure should be called periodically (e.g. when a clock 
 interrupt occurs) in order to cause the r bits in the 
 L1 cache to be clear in support of the NRU replacement algorithm.
+(The L2 cache's r bits are cleared too, if it also uses NRU.)
+This takes constant time whatever the size of the caches, since
+the r bits are kept as per-line epoch stamps.
 
 *****************************************************/
 
-void memory_handle_clock_interrupt()
+void memory_handle_clock_interrupt_r(MEMORY_SUBSYSTEM *ms)
 {
+  if (ms->recorder) {
+    trace_recorder_record(ms->recorder, 0, TRACE_CLOCK_INTERRUPT, 0);
+  }
+  if (ms->fast_forward) {
+    memory_fast_forward_keep(ms, 0, TRACE_CLOCK_INTERRUPT);
+    return;
+  }
+
   //call the function which clears the r bits in the L1 cache  
 
-  l1_clear_r_bits();
+  l1_clear_r_bits_r(ms->l1);
+  l2_clear_r_bits_r(ms->l2);
   
 }
+
+void memory_handle_clock_interrupt()
+{
+  memory_handle_clock_interrupt_r(memory_default);
+}
+
+
+/****************************************************
+
+     memory_subsystem_flush
+
+This procedure copies every dirty line in the caches to
+main memory, L2 first so that a newer copy of a line in
+L1 is the one that ends up there. Nothing in the caches
+changes: a dirty line is still written back when it is
+evicted, as if it had never been flushed.
+
+*****************************************************/
+
+void memory_subsystem_flush_r(MEMORY_SUBSYSTEM *ms)
+{
+  uint64_t address;
+  uint64_t data[WORDS_PER_CACHE_LINE];
+  L1_GEOMETRY l1_geometry;
+  L2_GEOMETRY l2_geometry;
+
+  l2_get_geometry(ms->l2, &l2_geometry);
+  for (uint64_t entry = 0; entry < l2_geometry.size_in_bytes / l2_geometry.bytes_per_line; entry++) {
+    if (l2_get_dirty_line_r(ms->l2, entry, &address, data)) {
+      main_memory_access_r(ms->main_memory, address, data, WRITE_ENABLE_MASK, NULL);
+    }
+  }
+
+  l1_get_geometry(ms->l1, &l1_geometry);
+  for (uint64_t entry = 0; entry < l1_geometry.size_in_bytes / l1_geometry.bytes_per_line; entry++) {
+    if (l1_get_dirty_line_r(ms->l1, entry, &address, data)) {
+      main_memory_access_r(ms->main_memory, address, data, WRITE_ENABLE_MASK, NULL);
+    }
+  }
+}
+
+void memory_subsystem_flush()
+{
+  memory_subsystem_flush_r(memory_default);
+}
+
+
+/****************************************************
+
+     memory_subsystem_save_r / memory_subsystem_restore
+
+A checkpoint file starts with a MEMORY_CHECKPOINT header,
+followed by the states of the L1 and L2 caches (see
+l1_save_state_r()), and then, from main_memory_offset,
+main memory (see main_memory_save_r()). The header and
+the cache states are mapped in and copied into a new
+subsystem's caches; main memory stays mapped from the
+file.
+
+*****************************************************/
+
+#define MEMORY_CHECKPOINT_MAGIC "MEMCKPT1"
+
+typedef struct {
+  char magic[8];
+  L1_GEOMETRY l1_geometry;
+  L2_GEOMETRY l2_geometry;
+  int32_t l1_replacement_policy;
+  int32_t l2_replacement_policy;
+  MEMORY_SUBSYSTEM_STATS stats;
+  uint64_t l1_state_size;
+  uint64_t l2_state_size;
+  uint64_t main_memory_offset;
+} MEMORY_CHECKPOINT;
+
+//Writes size bytes at offset, however many calls that takes.
+static BOOL memory_pwrite(int fd, const void *data, uint64_t size, uint64_t offset)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n <= 0) {
+      return FALSE;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return TRUE;
+}
+
+int memory_subsystem_save_r(MEMORY_SUBSYSTEM *ms, const char *path)
+{
+  MEMORY_CHECKPOINT header;
+
+  if (ms->main_memory_is_file) {
+    return -1;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MEMORY_CHECKPOINT_MAGIC, sizeof(header.magic));
+  l1_get_geometry(ms->l1, &header.l1_geometry);
+  l2_get_geometry(ms->l2, &header.l2_geometry);
+  header.l1_replacement_policy = l1_get_policy(ms->l1);
+  header.l2_replacement_policy = l2_get_policy(ms->l2);
+  header.stats = ms->stats;
+  header.l1_state_size = l1_state_size_r(ms->l1);
+  header.l2_state_size = l2_state_size_r(ms->l2);
+  uint64_t caches_size = sizeof(header) + header.l1_state_size + header.l2_state_size;
+  header.main_memory_offset = (caches_size + MAIN_MEMORY_CHECKPOINT_ALIGNMENT - 1) &
+                              ~(uint64_t) (MAIN_MEMORY_CHECKPOINT_ALIGNMENT - 1);
+
+  uint8_t *caches = (uint8_t *)malloc(caches_size);
+  char *temporary_path = (char *)malloc(strlen(path) + 5);
+  if (!caches || !temporary_path) {
+    free(caches);
+    free(temporary_path);
+    return -1;
+  }
+  memcpy(caches, &header, sizeof(header));
+  l1_save_state_r(ms->l1, caches + sizeof(header));
+  l2_save_state_r(ms->l2, caches + sizeof(header) + header.l1_state_size);
+  sprintf(temporary_path, "%s.tmp", path);
+
+  int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  BOOL ok = fd >= 0 && memory_pwrite(fd, caches, caches_size, 0) &&
+            main_memory_save_r(ms->main_memory, fd, header.main_memory_offset) != 0;
+  if (fd >= 0 && close(fd) != 0) {
+    ok = FALSE;
+  }
+  ok = ok && rename(temporary_path, path) == 0;
+  if (!ok && fd >= 0) {
+    unlink(temporary_path);
+  }
+  free(caches);
+  free(temporary_path);
+  return ok ? 0 : -1;
+}
+
+MEMORY_SUBSYSTEM *memory_subsystem_restore(const char *path)
+{
+  MEMORY_CHECKPOINT header;
+  struct stat file_status;
+  MEMORY_SUBSYSTEM *ms = NULL;
+  BOOL ok = FALSE;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (pread(fd, &header, sizeof(header), 0) == sizeof(header) && fstat(fd, &file_status) == 0 &&
+      memcmp(header.magic, MEMORY_CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 &&
+      header.main_memory_offset <= (uint64_t) file_status.st_size &&
+      header.l1_state_size <= header.main_memory_offset &&
+      header.l2_state_size <= header.main_memory_offset - header.l1_state_size &&
+      sizeof(header) <= header.main_memory_offset - header.l1_state_size - header.l2_state_size) {
+    //Main memory is created empty, and replaced by the one saved.
+    MEMORY_SUBSYSTEM_CONFIG config = {0, header.l1_geometry, header.l2_geometry,
+                                      (REPLACEMENT_POLICY) header.l1_replacement_policy,
+                                      (REPLACEMENT_POLICY) header.l2_replacement_policy,
+                                      NULL, MAIN_MEMORY_FILE_SHARED};
+    ms = memory_subsystem_create_with_config(&config);
+  }
+  if (ms && l1_state_size_r(ms->l1) == header.l1_state_size && l2_state_size_r(ms->l2) == header.l2_state_size) {
+    uint8_t *caches = (uint8_t *)mmap(NULL, header.main_memory_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (caches != MAP_FAILED) {
+      l1_restore_state_r(ms->l1, caches + sizeof(header));
+      l2_restore_state_r(ms->l2, caches + sizeof(header) + header.l1_state_size);
+      munmap(caches, header.main_memory_offset);
+      main_memory_destroy(ms->main_memory);
+      ms->main_memory = main_memory_restore(fd, header.main_memory_offset);
+      ms->stats = header.stats;
+      ok = ms->main_memory != NULL;
+    }
+  }
+  close(fd);
+  if (!ok) {
+    memory_subsystem_destroy(ms);
+    return NULL;
+  }
+  return ms;
+}
+
+
+/****************************************************
+
+     memory_start_fast_forward_r / memory_stop_fast_forward_r
+
+See memory_subsystem.h. Emptying the caches when
+fast-forwarding starts means that main memory holds every
+word's current value from then on, so that warming the
+caches up can take the data for a write from there, and
+is then the same as simulating the accesses kept (with
+writes of the values they end up leaving).
+
+*****************************************************/
+
+int memory_start_fast_forward_r(MEMORY_SUBSYSTEM *ms, uint64_t num_warming_accesses)
+{
+  uint64_t *warming = NULL;
+
+  if (ms->fast_forward) {
+    return -1;
+  }
+  if (num_warming_accesses) {
+    warming = (uint64_t *)malloc(num_warming_accesses * sizeof(uint64_t));
+    if (!warming) {
+      return -1;
+    }
+  }
+  memory_subsystem_flush_r(ms);
+  l1_initialize_r(ms->l1);
+  l2_initialize_r(ms->l2);
+  ms->fast_forward = TRUE;
+  ms->warming = warming;
+  ms->num_warming = num_warming_accesses;
+  ms->num_warming_kept = 0;
+  ms->next_warming = 0;
+  return 0;
+}
+
+void memory_stop_fast_forward_r(MEMORY_SUBSYSTEM *ms)
+{
+  MEMORY_SUBSYSTEM_STATS stats = ms->stats;
+
+  if (!ms->fast_forward) {
+    return;
+  }
+  ms->fast_forward = FALSE;
+
+  //Until the ring has filled up, the oldest access kept is in slot 0.
+  uint64_t n = ms->num_warming_kept < ms->num_warming ? ms->num_warming_kept : ms->num_warming;
+  uint64_t slot = n < ms->num_warming ? 0 : ms->next_warming;
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t address = ms->warming[slot] & 0xFFFFFFFFFFFF;
+    uint8_t control = ms->warming[slot] >> 56;
+    uint64_t data;
+    if (control == TRACE_CLOCK_INTERRUPT) {
+      l1_clear_r_bits_r(ms->l1);
+      l2_clear_r_bits_r(ms->l2);
+    } else if (control & WRITE_ENABLE_MASK) {
+      main_memory_access_word_r(ms->main_memory, address, 0, READ_ENABLE_MASK, &data);
+      memory_access_one(ms, address, data, WRITE_ENABLE_MASK, NULL);
+    } else {
+      memory_access_one(ms, address, 0, READ_ENABLE_MASK, &data);
+    }
+    if (++slot == ms->num_warming) {
+      slot = 0;
+    }
+  }
+  ms->stats = stats;
+  free(ms->warming);
+  ms->warming = NULL;
+  ms->num_warming = 0;
+}
+
+
+/****************************************************
+
+     memory_subsystem_set_recorder
+
+This procedure starts (or, given NULL, stops) recording
+the accesses made of a memory subsystem, and its clock
+interrupts, with a trace recorder (see trace.h).
+
+*****************************************************/
+
+void memory_subsystem_set_recorder_r(MEMORY_SUBSYSTEM *ms, TRACE_RECORDER *recorder)
+{
+  ms->recorder = recorder;
+}
+
+void memory_subsystem_set_recorder(TRACE_RECORDER *recorder)
+{
+  memory_subsystem_set_recorder_r(memory_default, recorder);
+}
+
+
+/****************************************************
+
+     memory_get_stats_r / memory_reset_stats_r
+
+These procedures copy out, and zero, the statistics
+gathered by a subsystem since it was created (or since
+its statistics were last reset).
+
+*****************************************************/
+
+void memory_get_stats_r(MEMORY_SUBSYSTEM *ms, MEMORY_SUBSYSTEM_STATS *stats)
+{
+  *stats = ms->stats;
+}
+
+void memory_reset_stats_r(MEMORY_SUBSYSTEM *ms)
+{
+  MEMORY_SUBSYSTEM_STATS zero = {0};
+  ms->stats = zero;
+}
@@ -1,3 +1,12 @@
+#ifndef MEMORY_SUBSYSTEM_H
+#define MEMORY_SUBSYSTEM_H
+
+#include <stdint.h>
+
+#include "l1_cache.h"
+#include "l2_cache.h"
+#include "main_memory.h"
+#include "trace.h"
 
 
 /*******************************************************
@@ -13,6 +22,7 @@ that determines large the main memory will be.
 void memory_subsystem_initialize(uint64_t size_in_bytes);
 
 
+
 /*****************************************************
 
               memory_access()
@@ -54,4 +64,264 @@ L1 cache to be clear in support of the NRU replacement algorithm.
 *******************************************************/
 
 void memory_handle_clock_interrupt();
+
+
+
+/*****************************************************
+
+              memory_access_batch()
+
+This procedure performs n accesses, entry i of which is
+the same as calling
+
+  memory_access(addresses[i], write_data[i], controls[i], &read_data[i]);
+
+The accesses are done in order, and leave the memory
+subsystem (including the miss counts) exactly as the n
+calls to memory_access() would, but faster: the whole
+batch is known in advance, so the host can start fetching
+what each access will need a few entries before it is
+performed.
+
+write_data and read_data may be NULL if no entry writes
+or reads, respectively. If hit_levels is not NULL, then
+hit_levels[i] is set to the level that entry i was
+satisfied from: MEMORY_HIT_L1, MEMORY_HIT_L2 (an L1 miss
+that hit in L2) or MEMORY_HIT_MAIN_MEMORY (a miss in both).
+
+A clock interrupt cannot happen in the middle of a batch,
+so a caller that generates them every so many accesses
+should end each batch there.
+
+****************************************************/
+
+#define MEMORY_HIT_L1 1
+#define MEMORY_HIT_L2 2
+#define MEMORY_HIT_MAIN_MEMORY 3
+
+void memory_access_batch(const uint64_t addresses[], const uint64_t write_data[],
+			 const uint8_t controls[], uint64_t read_data[], uint8_t hit_levels[], uint64_t n);
+
+
+
+/*****************************************************
+
+              memory_read_block() / memory_write_block()
+
+These procedures read or write the num_bytes / 8 consecutive
+words starting at (the word containing) address: word i of
+the block is read into read_data[i], or written from
+write_data[i]. The result, including the miss counts, is
+exactly that of calling
+
+  memory_access(address + 8 * i, ...);
+
+for each word in turn, but each cache line of the block is
+only looked up once, rather than once per word.
+
+****************************************************/
+
+void memory_read_block(uint64_t address, uint64_t num_bytes, uint64_t read_data[]);
+
+void memory_write_block(uint64_t address, uint64_t num_bytes, const uint64_t write_data[]);
+
+
+
+/*****************************************************
+
+              memory_subsystem_flush()
+
+This procedure writes every dirty line in the caches
+to main memory, without changing the caches or the miss
+counts (see memory_subsystem_flush_r(), below).
+
+****************************************************/
+
+void memory_subsystem_flush();
  
+
+
+/*****************************************************
+
+              memory_subsystem_set_recorder()
+
+This procedure makes the memory subsystem hand every
+access, including each entry of a batch and each word of
+a block, and every clock interrupt, to recorder, which
+writes them to a trace file (see trace.h). Passing NULL
+stops the recording. The recorder is not owned by the
+memory subsystem: the caller destroys it, after stopping
+the recording, to finish the file.
+
+****************************************************/
+
+void memory_subsystem_set_recorder(TRACE_RECORDER *recorder);
+
+
+
+/*****************************************************************
+
+       Reentrant interface
+
+The procedures above all operate on one process-wide memory
+subsystem. The procedures below operate on a MEMORY_SUBSYSTEM
+instance instead. Each instance owns its own L1 cache, L2 cache,
+main memory and statistics, so any number of them can be used
+at once, including from different threads (as long as each
+instance is only used by one thread at a time).
+
+memory_subsystem_create() builds a subsystem with the default
+L1 and L2 geometries; memory_subsystem_create_with_config() takes
+them from a MEMORY_SUBSYSTEM_CONFIG. Both return NULL if the
+memory size is not a multiple of 64 bytes, the configuration is
+not valid, or the allocation fails.
+
+*****************************************************************/
+
+typedef struct MEMORY_SUBSYSTEM MEMORY_SUBSYSTEM;
+
+//The shape of a memory subsystem. The L1 and L2 caches may have
+//any valid geometry (see l1_cache.h and l2_cache.h) with 64-byte
+//lines, which is the line size used by main memory, and any of the
+//replacement policies in replacement_policy.h (REPLACEMENT_DEFAULT
+//being NRU for L1 and LRU for L2). Main memory is only allocated as
+//it is written, so its size can be anything up to MAIN_MEMORY_FULL_SIZE
+//(the whole 48-bit address space, see main_memory.h).
+//
+//If main_memory_file is not NULL, main memory is a mapping of that
+//file, opened with main_memory_file_mode (see main_memory_create_from_file()
+//in main_memory.h; a main_memory_size_in_bytes of 0 means the size of
+//the file). The dirty lines in the caches are written to it when the
+//subsystem is destroyed, so that a later run can start from the same
+//memory image.
+typedef struct {
+  uint64_t main_memory_size_in_bytes;
+  L1_GEOMETRY l1_geometry;
+  L2_GEOMETRY l2_geometry;
+  REPLACEMENT_POLICY l1_replacement_policy;
+  REPLACEMENT_POLICY l2_replacement_policy;
+  const char *main_memory_file;
+  int main_memory_file_mode;
+} MEMORY_SUBSYSTEM_CONFIG;
+
+#define MEMORY_SUBSYSTEM_DEFAULT_CONFIG(memory_size_in_bytes) \
+  {memory_size_in_bytes, L1_DEFAULT_GEOMETRY, L2_DEFAULT_GEOMETRY, \
+   REPLACEMENT_DEFAULT, REPLACEMENT_DEFAULT, NULL, MAIN_MEMORY_FILE_SHARED}
+
+
+/*******************************************************
+
+        memory_subsystem_initialize_with_config()
+
+The same as memory_subsystem_initialize(), but the shape
+of the memory subsystem (including the geometries of the
+caches) is given by a MEMORY_SUBSYSTEM_CONFIG, described
+above. It prints an error and exits if the configuration
+is not valid.
+
+*******************************************************/
+
+void memory_subsystem_initialize_with_config(const MEMORY_SUBSYSTEM_CONFIG *config);
+
+//Statistics gathered by a memory subsystem instance.
+//A writeback is counted each time a dirty line evicted
+//from L1 is written into L2 (num_l1_writebacks), or a dirty
+//line evicted from L2 is written to main memory (num_l2_writebacks).
+//
+//Every access (each entry of a batch, and each word of a block) is
+//also counted by its outcome: the level it was satisfied from, how
+//many lines it wrote back from L1 (0 or 1), and how many from L2 (up
+//to 2, one to make room for the line it missed on and one for the
+//line written back from L1). These are what a latency model needs
+//to give each access its cycles (see latency.h), and counting them
+//costs one increment per access.
+#define MEMORY_NUM_OUTCOMES 18
+#define MEMORY_OUTCOME(level, l1_writebacks, l2_writebacks) \
+  (((level) - MEMORY_HIT_L1) * 6 + (l1_writebacks) * 3 + (l2_writebacks))
+
+typedef struct {
+  uint64_t num_l1_misses;
+  uint64_t num_l2_misses;
+  uint64_t num_l1_writebacks;
+  uint64_t num_l2_writebacks;
+  uint64_t num_accesses_by_outcome[MEMORY_NUM_OUTCOMES];
+} MEMORY_SUBSYSTEM_STATS;
+
+MEMORY_SUBSYSTEM *memory_subsystem_create(uint64_t memory_size_in_bytes);
+
+MEMORY_SUBSYSTEM *memory_subsystem_create_with_config(const MEMORY_SUBSYSTEM_CONFIG *config);
+
+void memory_subsystem_destroy(MEMORY_SUBSYSTEM *ms);
+
+void memory_access_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t write_data,
+		     uint8_t control, uint64_t *read_data);
+
+void memory_access_batch_r(MEMORY_SUBSYSTEM *ms, const uint64_t addresses[], const uint64_t write_data[],
+			   const uint8_t controls[], uint64_t read_data[], uint8_t hit_levels[], uint64_t n);
+
+void memory_read_block_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_bytes, uint64_t read_data[]);
+
+void memory_write_block_r(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t num_bytes, const uint64_t write_data[]);
+
+void memory_handle_clock_interrupt_r(MEMORY_SUBSYSTEM *ms);
+
+//Writes every dirty line in the L2 and then the L1 cache to main
+//memory, so that main memory holds the current contents of every
+//address. The caches keep their lines (still dirty) and the
+//statistics are unchanged, so the simulation can carry on exactly
+//as if this had not been called.
+void memory_subsystem_flush_r(MEMORY_SUBSYSTEM *ms);
+
+//Checkpoints, for starting many runs from the same warmed-up state.
+//memory_subsystem_save_r() writes the whole state of a subsystem to
+//one file at path: its configuration, its statistics, the tags,
+//status bits, replacement state and data of both caches, and the
+//regions of main memory that have been written to (see
+//main_memory_save_r(); blocks of zeroes take no space in the file).
+//The file is written under another name and then renamed, so a
+//subsystem restored from an earlier checkpoint at path is not
+//disturbed. The subsystem is unchanged. Returns 0, or -1 if main
+//memory is a file or the checkpoint cannot be written.
+//
+//memory_subsystem_restore() creates a subsystem from a checkpoint,
+//which carries on exactly as the one saved would have (its trace
+//recorder aside). Main memory is mapped from the file privately, so
+//restoring takes milliseconds whatever the size of the checkpoint,
+//any number of subsystems can be restored from the same one at once,
+//and the file is never written. It must not be changed while they
+//exist. Checkpoints are only meant to be restored by the same build
+//on the same kind of host. Returns NULL if the file cannot be read or
+//is not a checkpoint, or the allocation fails.
+int memory_subsystem_save_r(MEMORY_SUBSYSTEM *ms, const char *path);
+
+MEMORY_SUBSYSTEM *memory_subsystem_restore(const char *path);
+
+//Fast-forwarding, for getting through the accesses before the ones
+//of interest quickly. memory_start_fast_forward_r() writes the dirty
+//lines in the caches to main memory and empties both caches; from
+//then on, every access (including those of memory_access_batch_r()
+//and the block procedures) reads or writes main memory directly,
+//with no caches at all, so the data is still right but nothing is
+//counted, and hit_levels are all MEMORY_HIT_MAIN_MEMORY. The last
+//num_warming_accesses accesses and clock interrupts are kept, and
+//memory_stop_fast_forward_r() makes them again of the caches (reads
+//as reads, and writes as writes of the data the words already hold)
+//to warm them up, without counting them either, before going back to
+//simulating the caches in full. Warming with every access made since
+//fast-forwarding started leaves the caches exactly as simulating
+//those accesses from empty caches would have. A checkpoint taken
+//while fast-forwarding is restored with empty caches, not
+//fast-forwarding. memory_start_fast_forward_r() returns 0, or -1 if
+//the subsystem is already fast-forwarding or the allocation fails.
+//Stopping a subsystem that is not fast-forwarding does nothing.
+int memory_start_fast_forward_r(MEMORY_SUBSYSTEM *ms, uint64_t num_warming_accesses);
+
+void memory_stop_fast_forward_r(MEMORY_SUBSYSTEM *ms);
+
+void memory_subsystem_set_recorder_r(MEMORY_SUBSYSTEM *ms, TRACE_RECORDER *recorder);
+
+void memory_get_stats_r(MEMORY_SUBSYSTEM *ms, MEMORY_SUBSYSTEM_STATS *stats);
+
+void memory_reset_stats_r(MEMORY_SUBSYSTEM *ms);
+
+#endif
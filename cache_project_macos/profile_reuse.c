@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "text_trace.h"
+#include "workload.h"
+#include "sweep.h"
+#include "reuse_profile.h"
+
+// Profiles the reuse distances of a workload in one pass (see
+// reuse_profile.h), and prints the LRU miss-ratio curves they give as
+// CSV: the misses of fully-associative caches (1 set) of every power
+// of two lines, and of set-associative caches of every number of sets
+// profiled and every power of two ways.
+//
+// usage: profile_reuse [options] (trace_file | -w workload)
+//
+//   -w workload     a synthetic workload (see workload_config_from_name()
+//                   in workload.h) instead of a trace file
+//   -n accesses     the number of accesses the workload makes
+//   -m bytes        the size of the memory the workload accesses (32M)
+//   -d bytes        the size of the largest cache to give misses for (256M)
+//   -s min,max      profile caches of 2^min to 2^max sets (6,15)
+//
+// A trace file may be binary or text, as for replay_trace. Sizes are
+// in bytes with an optional K, M or G. Progress is reported on stderr.
+//
+// For example,
+//   profile_reuse -w zipf -s 8,8
+// gives the misses of fully-associative caches, and of caches of 256
+// sets (as the default L1 cache has) of 1 to 16384 ways.
+
+#define TEXT_INTERRUPT_INTERVAL 0x2000
+
+static void usage(const char *program)
+{
+  printf("usage: %s [-w workload [-n accesses] [-m bytes]] [-d bytes] [-s min,max] [trace_file]\n", program);
+  exit(1);
+}
+
+static uint64_t parse_size(const char *s)
+{
+  char *end;
+  uint64_t value = strtoull(s, &end, 0);
+  if (*end == 'K' || *end == 'k')
+    value <<= 10;
+  else if (*end == 'M' || *end == 'm')
+    value <<= 20;
+  else if (*end == 'G' || *end == 'g')
+    value <<= 30;
+  return value;
+}
+
+//Returns TRUE if the file at path starts as a binary trace does.
+static int is_binary_trace(const char *path)
+{
+  char magic[sizeof(TRACE_MAGIC) - 1];
+  FILE *file = fopen(path, "rb");
+  int binary = file && fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+  if (file)
+    fclose(file);
+  return binary;
+}
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Prints the misses of caches of num_sets sets of every power of two ways.
+static void print_curve(REUSE_PROFILE *profile, uint64_t num_sets, uint64_t num_accesses)
+{
+  uint64_t misses;
+  for (uint64_t ways = 1; reuse_profile_misses(profile, num_sets, ways, &misses) == 0; ways *= 2)
+    printf("%llu,%llu,%llu,%llu,%llu,%.6f\n", num_sets, ways, num_sets * ways * BYTES_PER_CACHE_LINE,
+	   num_accesses, misses, num_accesses ? (double) misses / num_accesses : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+  REUSE_PROFILE_CONFIG config = REUSE_PROFILE_DEFAULT_CONFIG;
+  const char *workload_name = NULL, *path = NULL;
+  uint64_t num_accesses = 0, memory_size = 1 << 25;
+
+  for (int i = 1; i < argc; i++) {
+    const char *option = argv[i];
+    if (option[0] != '-') {
+      path = option;
+      continue;
+    }
+    if (i + 1 == argc)
+      usage(argv[0]);
+    const char *value = argv[++i];
+    if (!strcmp(option, "-w"))
+      workload_name = value;
+    else if (!strcmp(option, "-n"))
+      num_accesses = parse_size(value);
+    else if (!strcmp(option, "-m"))
+      memory_size = parse_size(value);
+    else if (!strcmp(option, "-d"))
+      config.max_distance = parse_size(value) / BYTES_PER_CACHE_LINE;
+    else if (!strcmp(option, "-s")) {
+      if (sscanf(value, "%d,%d", &config.min_set_bits, &config.max_set_bits) != 2)
+	usage(argv[0]);
+    } else
+      usage(argv[0]);
+  }
+  if (!workload_name == !path)
+    usage(argv[0]);
+
+  double start = now_in_seconds();
+  SWEEP_TRACE *trace;
+  if (workload_name) {
+    WORKLOAD_CONFIG workload_config;
+    if (workload_config_from_name(workload_name, memory_size, &workload_config) != 0) {
+      printf("Error: Unknown workload %s\n", workload_name);
+      exit(1);
+    }
+    if (num_accesses)
+      workload_config.num_accesses = num_accesses;
+    trace = sweep_trace_from_workload(&workload_config);
+  } else if (is_binary_trace(path)) {
+    trace = sweep_trace_from_file(path);
+  } else {
+    trace = sweep_trace_from_text(path, text_trace_detect_format(path), TEXT_INTERRUPT_INTERVAL);
+  }
+  if (!trace) {
+    printf("Error: Could not read the workload\n");
+    exit(1);
+  }
+  fprintf(stderr, "%llu accesses made ready in %.3f seconds\n", trace->num_accesses, now_in_seconds() - start);
+
+  REUSE_PROFILE *profile = reuse_profile_create(&config);
+  if (!profile) {
+    printf("Error: Could not create the profile\n");
+    exit(1);
+  }
+  start = now_in_seconds();
+  if (reuse_profile_batch(profile, trace->addresses, trace->num_accesses) != 0) {
+    printf("Error: Ran out of memory profiling the workload\n");
+    exit(1);
+  }
+  fprintf(stderr, "%llu accesses profiled in %.3f seconds\n", trace->num_accesses, now_in_seconds() - start);
+
+  printf("sets,ways,size,accesses,misses,miss_ratio\n");
+  print_curve(profile, 1, trace->num_accesses);
+  for (int set_bits = config.min_set_bits; set_bits <= config.max_set_bits; set_bits++)
+    if (set_bits > 0)
+      print_curve(profile, (uint64_t) 1 << set_bits, trace->num_accesses);
+
+  reuse_profile_destroy(profile);
+  sweep_trace_free(trace);
+}
@@ -0,0 +1,249 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "replacement_policy.h"
+
+/***************************************************
+The replacement policies described in replacement_policy.h.
+The hit updates are inline in the header; victim choice
+and insertion, which only happen on a miss, are here.
+****************************************************/
+
+//Fixed seed, so that RANDOM and BRRIP runs can be repeated.
+#define REPLACEMENT_RANDOM_SEED 0x9E3779B97F4A7C15
+
+//BRRIP inserts 1 line in BRRIP_LONG_INTERVAL with RRPV 2
+//(a "long" re-reference interval) instead of 3.
+#define BRRIP_LONG_INTERVAL 32
+
+static const char *policy_names[] = {
+  "default", "nru", "lru", "plru", "srrip", "brrip", "random"
+};
+
+//xorshift64* generator.
+static uint64_t replacement_random(REPLACEMENT_STATE *rs) {
+  uint64_t x = rs->random_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  rs->random_state = x;
+  return x * 0x2545F4914F6CDD1D;
+}
+
+int replacement_setup(REPLACEMENT_STATE *rs, REPLACEMENT_POLICY policy, uint64_t lines_per_set,
+		      uint64_t valid_mask, uint64_t dirty_mask) {
+  if (lines_per_set == 0) {
+    return 0;
+  }
+  switch (policy) {
+  case REPLACEMENT_NRU:
+  case REPLACEMENT_SRRIP:
+  case REPLACEMENT_BRRIP:
+  case REPLACEMENT_RANDOM:
+    break;
+  case REPLACEMENT_LRU:
+    //The rank has to fit in the 8 policy bits.
+    if (lines_per_set > 256) {
+      return 0;
+    }
+    break;
+  case REPLACEMENT_TREE_PLRU:
+    if (lines_per_set & (lines_per_set - 1)) {
+      return 0;
+    }
+    break;
+  default:
+    return 0;
+  }
+
+  rs->policy = policy;
+  rs->lines_per_set = lines_per_set;
+  rs->valid_mask = valid_mask;
+  rs->dirty_mask = dirty_mask;
+  rs->epoch_bits = (uint64_t) 1 << REPLACEMENT_STATE_SHIFT;
+  rs->random_state = REPLACEMENT_RANDOM_SEED;
+  return 1;
+}
+
+void replacement_reset(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t num_sets) {
+  rs->random_state = REPLACEMENT_RANDOM_SEED;
+  rs->epoch_bits = (uint64_t) 1 << REPLACEMENT_STATE_SHIFT;
+  if (rs->policy != REPLACEMENT_LRU) {
+    return;
+  }
+  //Give the lines of each set the ranks 0, 1, ... lines_per_set - 1.
+  for (uint64_t set = 0; set < num_sets; set++) {
+    for (uint64_t line = 0; line < rs->lines_per_set; line++) {
+      tags[set * rs->lines_per_set + line] |= line << REPLACEMENT_STATE_SHIFT;
+    }
+  }
+}
+
+//The NRU choice (the original L1 policy): the first line in the
+//best of the classes r=0 d=0, r=0 d=1, r=1 d=0; otherwise line 0.
+//The class of a line is (r << 1) | d, so the best class is the
+//smallest, with r=1 d=1 (3) never preferred over line 0. A line's
+//r bit is set if its stamp is the current epoch.
+static uint64_t nru_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]) {
+  uint64_t chosen = 0;
+  int best_class = 3;
+  for (uint64_t line = 0; line < rs->lines_per_set && best_class; line++) {
+    int is_r_set = (tags[line] & REPLACEMENT_NRU_EPOCH_MASK) == rs->epoch_bits;
+    int line_class = (is_r_set ? 2 : 0) | ((tags[line] & rs->dirty_mask) ? 1 : 0);
+    if (line_class < best_class) {
+      best_class = line_class;
+      chosen = line;
+    }
+  }
+  return chosen;
+}
+
+static uint64_t lru_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]) {
+  uint64_t oldest = (rs->lines_per_set - 1) << REPLACEMENT_STATE_SHIFT;
+  for (uint64_t line = 0; line < rs->lines_per_set; line++) {
+    if ((tags[line] & REPLACEMENT_LRU_RANK_MASK) == oldest) {
+      return line;
+    }
+  }
+  return 0;  // not reached while the ranks are a permutation
+}
+
+//Follows the tree bits from the root down to a line.
+static uint64_t plru_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]) {
+  uint64_t node = 0;
+  while (node < rs->lines_per_set - 1) {
+    node = 2 * node + ((tags[node] & REPLACEMENT_PLRU_NODE_MASK) ? 2 : 1);
+  }
+  return node - (rs->lines_per_set - 1);
+}
+
+//Chooses the first line with the largest RRPV. (Aging every line
+//until one reaches RRPV 3 never changes which line that is.)
+static uint64_t rrip_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]) {
+  uint64_t max_rrpv = 0;
+  uint64_t chosen = 0;
+  for (uint64_t line = 0; line < rs->lines_per_set; line++) {
+    uint64_t rrpv = (tags[line] & REPLACEMENT_RRPV_MASK) >> REPLACEMENT_STATE_SHIFT;
+    if (rrpv > max_rrpv) {
+      max_rrpv = rrpv;
+      chosen = line;
+    }
+  }
+  return chosen;
+}
+
+//Ages every line by as much as it takes for the victim to reach RRPV 3.
+static void rrip_age(uint64_t tags[], uint64_t lines_per_set, uint64_t victim) {
+  uint64_t max_rrpv = (tags[victim] & REPLACEMENT_RRPV_MASK) >> REPLACEMENT_STATE_SHIFT;
+  if (max_rrpv < REPLACEMENT_RRPV_MAX) {
+    uint64_t age = (REPLACEMENT_RRPV_MAX - max_rrpv) << REPLACEMENT_STATE_SHIFT;
+    for (uint64_t line = 0; line < lines_per_set; line++) {
+      tags[line] += age;
+    }
+  }
+}
+
+uint64_t replacement_peek_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]) {
+  for (uint64_t line = 0; line < rs->lines_per_set; line++) {
+    if (!(tags[line] & rs->valid_mask)) {
+      return line;
+    }
+  }
+
+  REPLACEMENT_STATE copy;
+  switch (rs->policy) {
+  case REPLACEMENT_LRU:
+    return lru_victim(rs, tags);
+  case REPLACEMENT_TREE_PLRU:
+    return plru_victim(rs, tags);
+  case REPLACEMENT_SRRIP:
+  case REPLACEMENT_BRRIP:
+    return rrip_victim(rs, tags);
+  case REPLACEMENT_RANDOM:
+    copy = *rs;
+    return replacement_random(&copy) % rs->lines_per_set;
+  default:
+    return nru_victim(rs, tags);
+  }
+}
+
+uint64_t replacement_choose_victim(REPLACEMENT_STATE *rs, uint64_t tags[]) {
+  uint64_t victim = replacement_peek_victim(rs, tags);
+  if (!(tags[victim] & rs->valid_mask)) {
+    return victim;
+  }
+
+  //The set is full: do what choosing the victim changes.
+  switch (rs->policy) {
+  case REPLACEMENT_SRRIP:
+  case REPLACEMENT_BRRIP:
+    rrip_age(tags, rs->lines_per_set, victim);
+    break;
+  case REPLACEMENT_RANDOM:
+    replacement_random(rs);
+    break;
+  default:
+    break;
+  }
+  return victim;
+}
+
+void replacement_on_insert(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t line) {
+  uint64_t rrpv;
+
+  switch (rs->policy) {
+  case REPLACEMENT_LRU:
+    replacement_lru_touch(tags, rs->lines_per_set, line);
+    break;
+  case REPLACEMENT_TREE_PLRU:
+    replacement_plru_touch(tags, rs->lines_per_set, line);
+    break;
+  case REPLACEMENT_SRRIP:
+  case REPLACEMENT_BRRIP:
+    rrpv = REPLACEMENT_RRPV_MAX - 1;
+    if (rs->policy == REPLACEMENT_BRRIP && replacement_random(rs) % BRRIP_LONG_INTERVAL) {
+      rrpv = REPLACEMENT_RRPV_MAX;
+    }
+    tags[line] = (tags[line] & ~REPLACEMENT_RRPV_MASK) | (rrpv << REPLACEMENT_STATE_SHIFT);
+    break;
+  case REPLACEMENT_NRU:
+    //The line still has the victim's stamp, which may be current.
+    tags[line] &= ~REPLACEMENT_NRU_EPOCH_MASK;
+    break;
+  default:
+    //RANDOM: nothing to do.
+    break;
+  }
+}
+
+void replacement_clear_references(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t num_lines) {
+  if (rs->policy != REPLACEMENT_NRU) {
+    return;
+  }
+  uint64_t epoch = rs->epoch_bits >> REPLACEMENT_STATE_SHIFT;
+  if (epoch < REPLACEMENT_NRU_EPOCH_MAX) {
+    rs->epoch_bits = (epoch + 1) << REPLACEMENT_STATE_SHIFT;
+    return;
+  }
+  //Out of epochs: make every stamp stale and start again.
+  for (uint64_t i = 0; i < num_lines; i++) {
+    tags[i] &= ~REPLACEMENT_NRU_EPOCH_MASK;
+  }
+  rs->epoch_bits = (uint64_t) 1 << REPLACEMENT_STATE_SHIFT;
+}
+
+const char *replacement_policy_name(REPLACEMENT_POLICY policy) {
+  if ((unsigned) policy < sizeof(policy_names) / sizeof(policy_names[0])) {
+    return policy_names[policy];
+  }
+  return policy_names[REPLACEMENT_DEFAULT];
+}
+
+REPLACEMENT_POLICY replacement_policy_from_name(const char *name) {
+  for (unsigned i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+    if (strcmp(name, policy_names[i]) == 0) {
+      return (REPLACEMENT_POLICY) i;
+    }
+  }
+  return REPLACEMENT_DEFAULT;
+}
@@ -0,0 +1,197 @@
+/************************************************************
+
+                 replacement_policy.h
+
+The replacement policies that the L1 and L2 caches can use to
+choose which line of a full set to evict. A cache picks its
+policy when it is created:
+
+  REPLACEMENT_NRU:       not recently used, the original L1 policy.
+                         A line is chosen in the order invalid,
+                         r=0 d=0, r=0 d=1, r=1 d=0, and otherwise
+                         the first line. The r bits are cleared
+                         periodically (memory_handle_clock_interrupt()
+                         calls replacement_clear_references()).
+  REPLACEMENT_LRU:       least recently used.
+  REPLACEMENT_TREE_PLRU: tree pseudo-LRU. The lines per set must be
+                         a power of two.
+  REPLACEMENT_SRRIP:     static re-reference interval prediction, with
+                         a 2-bit re-reference prediction value (RRPV)
+                         per line. Lines are inserted with RRPV 2, a
+                         hit sets RRPV to 0, and a line with RRPV 3
+                         is evicted (aging every line until there is one).
+  REPLACEMENT_BRRIP:     bimodal RRIP. As SRRIP, but lines are inserted
+                         with RRPV 3, except for 1 insertion in 32
+                         (chosen pseudo-randomly) that uses RRPV 2.
+  REPLACEMENT_RANDOM:    a pseudo-random line, from a generator with a
+                         fixed seed so that runs are reproducible.
+
+REPLACEMENT_DEFAULT asks for the cache's own default (NRU for the
+L1 cache, LRU for the L2 cache).
+
+Whatever the policy, an invalid line is always chosen before a
+valid one.
+
+All of the state a policy keeps lives in the caches' 64-bit tag
+words, in bits 48-60 (above the largest possible tag, and below
+the cache's valid and dirty bits), so that it sits in the same host
+cache line as the tags that are being compared anyway:
+  NRU:       each line holds an epoch stamp in bits 48-60, and the
+             cache's dirty bit serves as the d bit. A line's r bit
+             counts as set only while its stamp equals the current
+             epoch (kept in the REPLACEMENT_STATE, starting at 1): a
+             hit sets the stamp to the current epoch, and a newly
+             inserted line gets the stamp 0, which is never current,
+             whatever the stamp of the line it replaced.
+             Clearing every r bit is then just advancing the epoch,
+             whatever the size of the cache. When the epoch outgrows
+             its 13 bits, every stamp is reset to 0 and the epoch
+             goes back to 1, so that an old stamp can never become
+             current again; that sweep happens once every 8191 calls.
+  LRU:       each line holds its rank, 0 for the most recently used
+             line up to lines_per_set - 1 for the least recently used.
+             The ranks of a set are always a permutation of those
+             numbers. (So at most 256 lines per set.)
+  TREE_PLRU: the lines_per_set - 1 bits of the tree are spread over
+             the tag words of the set, node i in bit 48 of line i.
+  SRRIP and BRRIP: each line holds its RRPV in bits 48-49.
+  RANDOM:    nothing per line; the generator state is per cache.
+
+A cache uses a policy through a REPLACEMENT_STATE:
+  replacement_setup()         once, when the cache is created.
+  replacement_reset()         after the cache's tags have all been
+                              invalidated (zeroed).
+  replacement_on_hit()        on every hit.
+  replacement_choose_victim() to find the line to replace.
+  replacement_on_insert()     after the new tag has been stored in
+                              the chosen line. The cache must keep
+                              the REPLACEMENT_STATE_MASK bits of
+                              the tag word when storing a new tag.
+  replacement_clear_references()  periodically, to clear the r bits
+                              of every line for NRU.
+
+**************************************************************/
+
+#ifndef REPLACEMENT_POLICY_H
+#define REPLACEMENT_POLICY_H
+
+#include <stdint.h>
+
+typedef enum {
+  REPLACEMENT_DEFAULT = 0,
+  REPLACEMENT_NRU,
+  REPLACEMENT_LRU,
+  REPLACEMENT_TREE_PLRU,
+  REPLACEMENT_SRRIP,
+  REPLACEMENT_BRRIP,
+  REPLACEMENT_RANDOM
+} REPLACEMENT_POLICY;
+
+#define REPLACEMENT_STATE_SHIFT 48
+#define REPLACEMENT_STATE_MASK ((uint64_t) 0x1FFF << REPLACEMENT_STATE_SHIFT)
+
+//Fields of the policy bits
+#define REPLACEMENT_NRU_EPOCH_MASK REPLACEMENT_STATE_MASK
+#define REPLACEMENT_NRU_EPOCH_MAX 0x1FFF
+#define REPLACEMENT_LRU_RANK_MASK ((uint64_t) 0xFF << REPLACEMENT_STATE_SHIFT)
+#define REPLACEMENT_PLRU_NODE_MASK ((uint64_t) 1 << REPLACEMENT_STATE_SHIFT)
+#define REPLACEMENT_RRPV_MASK ((uint64_t) 0x3 << REPLACEMENT_STATE_SHIFT)
+#define REPLACEMENT_RRPV_MAX 3
+
+typedef struct {
+  REPLACEMENT_POLICY policy;
+  uint64_t lines_per_set;
+  uint64_t valid_mask;       // the cache's valid bit
+  uint64_t dirty_mask;       // the cache's dirty bit (NRU only)
+  uint64_t epoch_bits;       // the current NRU epoch, shifted into place
+  uint64_t random_state;     // generator for RANDOM and BRRIP
+} REPLACEMENT_STATE;
+
+
+/************************************************************
+Sets up a REPLACEMENT_STATE for a cache with the given number
+of lines per set, whose tag words use the given valid and
+dirty bits. policy must not be REPLACEMENT_DEFAULT. Returns 0
+if the policy cannot be used with that many lines per set, 1
+otherwise.
+************************************************************/
+
+int replacement_setup(REPLACEMENT_STATE *rs, REPLACEMENT_POLICY policy, uint64_t lines_per_set,
+		      uint64_t valid_mask, uint64_t dirty_mask);
+
+void replacement_reset(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t num_sets);
+
+uint64_t replacement_choose_victim(REPLACEMENT_STATE *rs, uint64_t tags[]);
+
+//Returns the line replacement_choose_victim() would choose, without
+//changing anything (for looking ahead).
+uint64_t replacement_peek_victim(const REPLACEMENT_STATE *rs, const uint64_t tags[]);
+
+void replacement_on_insert(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t line);
+
+//Clears the r bit of all num_lines lines of the cache (a no-op
+//unless the policy is NRU).
+void replacement_clear_references(REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t num_lines);
+
+//Returns the name of a policy ("nru", "lru", "plru", "srrip", "brrip",
+//"random"), or "default".
+const char *replacement_policy_name(REPLACEMENT_POLICY policy);
+
+//Returns the policy with the given name, or REPLACEMENT_DEFAULT if
+//there is none.
+REPLACEMENT_POLICY replacement_policy_from_name(const char *name);
+
+
+//Makes line the most recently used line of an LRU set.
+static inline void replacement_lru_touch(uint64_t tags[], uint64_t lines_per_set, uint64_t line) {
+  uint64_t rank = tags[line] & REPLACEMENT_LRU_RANK_MASK;
+  for (uint64_t i = 0; i < lines_per_set; i++) {
+    if ((tags[i] & REPLACEMENT_LRU_RANK_MASK) < rank) {
+      tags[i] += (uint64_t) 1 << REPLACEMENT_STATE_SHIFT;
+    }
+  }
+  tags[line] &= ~REPLACEMENT_LRU_RANK_MASK;
+}
+
+//Points every tree node on the path to line away from it.
+//Node n's children are 2n+1 (lower half, bit 0) and 2n+2 (upper
+//half, bit 1); a bit gives the direction to go to find a victim.
+static inline void replacement_plru_touch(uint64_t tags[], uint64_t lines_per_set, uint64_t line) {
+  uint64_t node = 0;
+  for (uint64_t half = lines_per_set >> 1; half; half >>= 1) {
+    if (line & half) {
+      tags[node] &= ~REPLACEMENT_PLRU_NODE_MASK;
+      node = 2 * node + 2;
+    } else {
+      tags[node] |= REPLACEMENT_PLRU_NODE_MASK;
+      node = 2 * node + 1;
+    }
+  }
+}
+
+/************************************************************
+Records a hit on a line. The hit path only ever touches the tag
+words of the set being accessed, whichever policy is in use.
+************************************************************/
+
+static inline void replacement_on_hit(const REPLACEMENT_STATE *rs, uint64_t tags[], uint64_t line) {
+  switch (rs->policy) {
+  case REPLACEMENT_NRU:
+    tags[line] = (tags[line] & ~REPLACEMENT_NRU_EPOCH_MASK) | rs->epoch_bits;
+    break;
+  case REPLACEMENT_LRU:
+    replacement_lru_touch(tags, rs->lines_per_set, line);
+    break;
+  case REPLACEMENT_TREE_PLRU:
+    replacement_plru_touch(tags, rs->lines_per_set, line);
+    break;
+  case REPLACEMENT_SRRIP:
+  case REPLACEMENT_BRRIP:
+    tags[line] &= ~REPLACEMENT_RRPV_MASK;
+    break;
+  default:
+    break;
+  }
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace_replay.h"
+#include "text_trace.h"
+#include "sampler.h"
+#include "latency.h"
+
+// Replays a trace file against a memory subsystem, and reports its
+// miss and writeback counts, the simulated cycles, average memory
+// access time, stall cycles and latency histogram of its accesses
+// (see latency.h), and how fast the trace was replayed.
+// The trace may be a binary trace (see trace.h), or a Dinero "din"
+// or plain hexadecimal text trace (see text_trace.h), which is told
+// apart by its first line. Text traces have no clock interrupts, so
+// one is generated every TEXT_INTERRUPT_INTERVAL accesses, as in
+// Pass 3 of test_memory_subsystem.
+//
+// usage: replay_trace [-j threads] [-S sets|lines:rate] [-R checkpoint] [-C checkpoint]
+//                     [-F warming] [-L latencies] trace_file [L2 lines per set [L2 policy [L1 policy]]]
+//
+// The optional arguments are those of test_l2_ways. Main
+// memory covers the whole 48-bit address space, so any trace can be
+// replayed. With -j, a binary trace is replayed on up to that many
+// threads, split up by cache set (see trace_replay_parallel()). With
+// -S, only a sample of a binary trace's sets or lines, at the given
+// rate (0.01, say), is simulated, and the statistics printed are
+// estimates for the full caches, with 95% confidence intervals (see
+// sampler.h). With -R, the replay starts from the state saved in a
+// checkpoint (see memory_subsystem_save_r()) instead of from empty
+// caches and memory, the optional arguments are ignored, and the
+// statistics printed are only those of the trace; with -C, the state
+// the replay ends in is saved to a checkpoint. So a warm-up trace can
+// be replayed once with -C, and then any number of traces after it
+// with -R. With -F, the trace is fast-forwarded through (see
+// memory_start_fast_forward_r()), so that only main memory is kept
+// up to date, and the caches are then warmed up with its last warming
+// accesses; no misses are counted, so this is for getting to a
+// checkpoint (-C) quickly. None of -R, -C and -F can be used with -j
+// or -S. With -L, the cycles are worked out with the given latencies
+// (see latency_config_from_string()) rather than the defaults; a
+// sampled replay has no cycles.
+
+#define TEXT_INTERRUPT_INTERVAL 0x2000
+
+//Returns TRUE if the file at path starts as a binary trace does.
+static int is_binary_trace(const char *path)
+{
+  char magic[sizeof(TRACE_MAGIC) - 1];
+  FILE *file = fopen(path, "rb");
+  int binary = file && fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+  if (file)
+    fclose(file);
+  return binary;
+}
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Replays the binary trace at path sampled, and prints the estimates.
+static void replay_sampled(const MEMORY_SUBSYSTEM_CONFIG *config, const SAMPLER_CONFIG *sampling, const char *path)
+{
+  TRACE_REPLAY_STATS replayed;
+  SAMPLER_STATS stats;
+
+  SAMPLER *sampler = sampler_create(config, sampling);
+  if (!sampler) {
+    printf("Error: These caches cannot be sampled at that rate\n");
+    exit(1);
+  }
+  double start = now_in_seconds();
+  if (sampler_replay_r(sampler, path, &replayed) != 0) {
+    printf("Error: Could not replay %s\n", path);
+    exit(1);
+  }
+  sampler_get_stats_r(sampler, &stats);
+  double seconds = now_in_seconds() - start;
+
+  printf("Sampled %s at a rate of %g, in %d groups, simulating %llu accesses\n",
+	 sampling->mode == SAMPLER_LINES ? "lines" : "sets", stats.rate, stats.num_groups, stats.num_simulated);
+  printf("Number of memory accesses = %llu\n", replayed.num_accesses);
+  printf("Number of clock interrupts = %llu\n", replayed.num_interrupts);
+  printf("Number of L1 misses = %.0f +- %.0f\n", stats.l1_misses.estimate, stats.l1_misses.half_width);
+  printf("Number of L2 misses = %.0f +- %.0f\n", stats.l2_misses.estimate, stats.l2_misses.half_width);
+  printf("Number of L1 writebacks = %.0f +- %.0f\n", stats.l1_writebacks.estimate, stats.l1_writebacks.half_width);
+  printf("Number of L2 writebacks = %.0f +- %.0f\n", stats.l2_writebacks.estimate, stats.l2_writebacks.half_width);
+  printf("Replayed in %.3f seconds (%.1f million accesses per second)\n",
+	 seconds, replayed.num_accesses / seconds / 1e6);
+  sampler_destroy(sampler);
+}
+
+int main(int argc, char *argv[])
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_FULL_SIZE);
+  MEMORY_SUBSYSTEM_STATS stats;
+  TRACE_REPLAY_STATS replayed;
+  SAMPLER_CONFIG sampling = {SAMPLER_SETS, 0, 1};
+  const char *restore_path = NULL, *save_path = NULL;
+  int num_threads = 1;
+  int64_t num_warming = -1;
+  LATENCY_CONFIG latencies = LATENCY_DEFAULT_CONFIG;
+  LATENCY_REPORT latency;
+
+  while (argc >= 3 && strlen(argv[1]) == 2 && argv[1][0] == '-' && strchr("jSRCFL", argv[1][1])) {
+    if (argv[1][1] == 'j') {
+      num_threads = atoi(argv[2]);
+    } else if (argv[1][1] == 'F') {
+      num_warming = atoll(argv[2]);
+    } else if (argv[1][1] == 'R') {
+      restore_path = argv[2];
+    } else if (argv[1][1] == 'C') {
+      save_path = argv[2];
+    } else if (argv[1][1] == 'L') {
+      if (latency_config_from_string(argv[2], &latencies) != 0) {
+	printf("Error: Invalid latencies %s\n", argv[2]);
+	exit(1);
+      }
+    } else {
+      sampling.mode = strncmp(argv[2], "lines:", 6) == 0 ? SAMPLER_LINES : SAMPLER_SETS;
+      sampling.rate = strchr(argv[2], ':') ? atof(strchr(argv[2], ':') + 1) : 0;
+      if (sampling.rate <= 0) {
+	printf("Error: Invalid sampling %s\n", argv[2]);
+	exit(1);
+      }
+    }
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+  if (argc < 2) {
+    printf("usage: %s [-j threads] [-S sets|lines:rate] [-R checkpoint] [-C checkpoint]\n"
+	   "       [-F warming] [-L latencies] trace_file [L2 lines per set [L2 policy [L1 policy]]]\n", argv[0]);
+    exit(1);
+  }
+  if ((restore_path || save_path || num_warming >= 0) && (num_threads > 1 || sampling.rate > 0)) {
+    printf("Error: -R, -C and -F cannot be used with -j or -S\n");
+    exit(1);
+  }
+  if (argc >= 3)
+    config.l2_geometry.lines_per_set = atoi(argv[2]);
+  if (argc >= 4)
+    config.l2_replacement_policy = replacement_policy_from_name(argv[3]);
+  if (argc >= 5)
+    config.l1_replacement_policy = replacement_policy_from_name(argv[4]);
+
+  MEMORY_SUBSYSTEM *ms;
+  if (restore_path) {
+    double start = now_in_seconds();
+    ms = memory_subsystem_restore(restore_path);
+    if (!ms) {
+      printf("Error: Could not restore the checkpoint %s\n", restore_path);
+      exit(1);
+    }
+    memory_reset_stats_r(ms);
+    printf("Replaying %s, from the checkpoint %s (restored in %.3f seconds)\n", argv[1], restore_path,
+	   now_in_seconds() - start);
+  } else {
+    ms = memory_subsystem_create_with_config(&config);
+    if (!ms) {
+      printf("Error: Invalid memory subsystem configuration\n");
+      exit(1);
+    }
+    printf("Replaying %s, L2 cache has %u lines per set (%s), L1 cache uses %s\n", argv[1],
+	   config.l2_geometry.lines_per_set,
+	   replacement_policy_name(config.l2_replacement_policy),
+	   replacement_policy_name(config.l1_replacement_policy));
+  }
+
+  int binary = is_binary_trace(argv[1]);
+  if (sampling.rate > 0) {
+    if (!binary) {
+      printf("Error: Only a binary trace can be sampled\n");
+      exit(1);
+    }
+    replay_sampled(&config, &sampling, argv[1]);
+    memory_subsystem_destroy(ms);
+    return 0;
+  }
+
+  if (num_warming >= 0 && memory_start_fast_forward_r(ms, num_warming) != 0) {
+    printf("Error: Could not keep %lld accesses for warming up\n", (long long) num_warming);
+    exit(1);
+  }
+  double start = now_in_seconds();
+  if (binary && num_threads > 1) {
+    printf("Replaying on %d threads\n", trace_replay_num_shards(&config, num_threads));
+    if (trace_replay_parallel(&config, argv[1], num_threads, &stats, &replayed) != 0) {
+      printf("Error: Could not replay %s\n", argv[1]);
+      exit(1);
+    }
+  } else if (binary) {
+    if (trace_replay_r(ms, argv[1], &replayed) != 0) {
+      printf("Error: Could not replay %s\n", argv[1]);
+      exit(1);
+    }
+  } else {
+    TEXT_TRACE_STATS text;
+    int format = text_trace_detect_format(argv[1]);
+    if (text_trace_replay_r(ms, argv[1], format, TEXT_INTERRUPT_INTERVAL, &text) != 0) {
+      printf("Error: Could not read %s\n", argv[1]);
+      exit(1);
+    }
+    printf("Read %s as a %s trace, skipping %llu lines\n", argv[1],
+	   format == TEXT_TRACE_DINERO ? "Dinero" : "hexadecimal", text.num_skipped);
+    replayed.num_accesses = text.num_accesses;
+    replayed.num_interrupts = text.num_accesses / TEXT_INTERRUPT_INTERVAL;
+  }
+  double seconds = now_in_seconds() - start;
+
+  if (!binary || num_threads <= 1)
+    memory_get_stats_r(ms, &stats);
+  printf("Number of memory accesses = %llu\n", replayed.num_accesses);
+  printf("Number of clock interrupts = %llu\n", replayed.num_interrupts);
+  printf("Number of L1 misses = %llu\n", stats.num_l1_misses);
+  printf("Number of L2 misses = %llu\n", stats.num_l2_misses);
+  printf("Number of L1 writebacks = %llu\n", stats.num_l1_writebacks);
+  printf("Number of L2 writebacks = %llu\n", stats.num_l2_writebacks);
+  latency_report(&latencies, &stats, &latency);
+  latency_print_report(&latency);
+  printf("Replayed in %.3f seconds (%.1f million accesses per second)\n",
+	 seconds, replayed.num_accesses / seconds / 1e6);
+
+  if (num_warming >= 0) {
+    double start = now_in_seconds();
+    memory_stop_fast_forward_r(ms);
+    printf("Fast-forwarded, then warmed up with the last %lld accesses in %.3f seconds\n",
+	   (long long) num_warming, now_in_seconds() - start);
+  }
+  if (save_path) {
+    double start = now_in_seconds();
+    if (memory_subsystem_save_r(ms, save_path) != 0) {
+      printf("Error: Could not save the checkpoint %s\n", save_path);
+      exit(1);
+    }
+    printf("Saved the checkpoint %s in %.3f seconds\n", save_path, now_in_seconds() - start);
+  }
+  memory_subsystem_destroy(ms);
+}
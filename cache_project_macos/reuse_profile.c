@@ -0,0 +1,298 @@
+/************************************************************
+
+                      reuse_profile.c
+
+The reuse-distance profiler (see reuse_profile.h).
+
+Each histogram (a REUSE_LEVEL) has a REUSE_STACK per set. A stack
+counts time in the accesses to its own set, from 1, and keeps:
+  - an open-addressing hash table from each line (plus 1, so that
+    0 marks an empty slot) to the time of its last access, and
+  - a Fenwick tree over the times 1..tree_size, holding a 1 at the
+    time of each line's last access and 0 elsewhere.
+The distance of an access to a line last accessed at time p is
+then the number of 1s after p, which is the number of lines less
+the prefix sum up to p.
+
+A stack is rebuilt, when its times reach tree_size or its hash
+table gets 3/4 full, with its lines numbered again from 1 in the
+order of their last accesses (found by putting each line at its
+time in a scratch array), room for as many times again (and 16
+more), and a hash table at most half full. Stacks are created
+empty (all zero), so that the first access to a set rebuilds it
+too, and sets that are never accessed take no more than their
+REUSE_STACK.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "reuse_profile.h"
+
+#define REUSE_LINE_SHIFT 6             // log2(BYTES_PER_CACHE_LINE)
+#define REUSE_MIN_TREE_ROOM 16
+#define REUSE_MIN_HASH_BITS 4
+#define REUSE_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+//A line and the time of its last access, together so that finding
+//one takes a single host cache miss.
+typedef struct {
+  uint64_t key;                 // line + 1, or 0 for an empty slot
+  uint32_t time;
+} REUSE_SLOT;
+
+typedef struct {
+  REUSE_SLOT *slots;
+  uint32_t *tree;               // the Fenwick tree, tree[1..tree_size]
+  int hash_bits;
+  uint32_t tree_size;
+  uint32_t now;                 // the time of the last access
+  uint32_t num_lines;
+} REUSE_STACK;
+
+typedef struct {
+  uint64_t set_mask;            // of the line
+  REUSE_STACK *stacks;          // one per set
+  uint64_t num_cold;
+  uint64_t num_distances;
+  uint64_t *counts;
+  uint64_t num_far;
+} REUSE_LEVEL;
+
+struct REUSE_PROFILE {
+  REUSE_PROFILE_CONFIG config;
+  uint64_t num_accesses;
+  BOOL failed;
+  int num_levels;
+  REUSE_LEVEL levels[REUSE_PROFILE_MAX_SET_BITS + 2];  // fully-associative first
+};
+
+static uint64_t reuse_hash_slot(const REUSE_STACK *stack, uint64_t key) {
+  return (key * REUSE_HASH_MULTIPLIER) >> (64 - stack->hash_bits);
+}
+
+//Returns the slot of key, or the empty slot where it belongs.
+static uint64_t reuse_find(const REUSE_STACK *stack, uint64_t key) {
+  uint64_t mask = ((uint64_t) 1 << stack->hash_bits) - 1;
+  uint64_t slot = reuse_hash_slot(stack, key);
+  while (stack->slots[slot].key && stack->slots[slot].key != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+//Returns the number of lines last accessed at or before time.
+static uint32_t reuse_prefix(const REUSE_STACK *stack, uint32_t time) {
+  uint32_t sum = 0;
+  for (; time; time &= time - 1) {
+    sum += stack->tree[time];
+  }
+  return sum;
+}
+
+static void reuse_add(REUSE_STACK *stack, uint32_t time, uint32_t delta) {
+  for (; time <= stack->tree_size; time += time & -time) {
+    stack->tree[time] += delta;
+  }
+}
+
+//Rebuilds stack, as described above. Returns FALSE if the memory
+//cannot be allocated (leaving stack as it was).
+static BOOL reuse_rebuild(REUSE_STACK *stack) {
+  uint32_t n = stack->num_lines;
+  uint64_t old_hash_size = stack->slots ? (uint64_t) 1 << stack->hash_bits : 0;
+  int hash_bits = REUSE_MIN_HASH_BITS;
+  while (((uint64_t) 1 << hash_bits) < 2 * ((uint64_t) n + 1)) {
+    hash_bits++;
+  }
+  uint64_t hash_size = (uint64_t) 1 << hash_bits;
+  uint64_t tree_size = 2 * (uint64_t) n + REUSE_MIN_TREE_ROOM;
+  if (tree_size > INT32_MAX) {
+    return FALSE;
+  }
+
+  uint64_t *by_time = (uint64_t *) calloc((uint64_t) stack->now + 1, sizeof(uint64_t));
+  REUSE_SLOT *slots = (REUSE_SLOT *) calloc(hash_size, sizeof(REUSE_SLOT));
+  uint32_t *tree = (uint32_t *) malloc((tree_size + 1) * sizeof(uint32_t));
+  if (!by_time || !slots || !tree) {
+    free(by_time);
+    free(slots);
+    free(tree);
+    return FALSE;
+  }
+
+  for (uint64_t slot = 0; slot < old_hash_size; slot++) {
+    if (stack->slots[slot].key) {
+      by_time[stack->slots[slot].time] = stack->slots[slot].key;
+    }
+  }
+  free(stack->slots);
+  free(stack->tree);
+  stack->slots = slots;
+  stack->tree = tree;
+  stack->hash_bits = hash_bits;
+  stack->tree_size = (uint32_t) tree_size;
+
+  uint32_t time = 0;
+  for (uint64_t t = 1; t <= stack->now; t++) {
+    if (by_time[t]) {
+      uint64_t slot = reuse_find(stack, by_time[t]);
+      slots[slot].key = by_time[t];
+      slots[slot].time = ++time;
+    }
+  }
+  free(by_time);
+  stack->now = time;
+
+  //Node i covers the times (i - lowbit(i), i], of which the first n are 1s.
+  for (uint64_t i = 1; i <= tree_size; i++) {
+    uint64_t low = i & -i;
+    uint64_t first = i - low;
+    tree[i] = (uint32_t) (n <= first ? 0 : n - first < low ? n - first : low);
+  }
+  return TRUE;
+}
+
+static BOOL reuse_level_access(REUSE_LEVEL *level, uint64_t line) {
+  REUSE_STACK *stack = &level->stacks[line & level->set_mask];
+  uint64_t hash_size = stack->slots ? (uint64_t) 1 << stack->hash_bits : 0;
+
+  if (stack->now == stack->tree_size || 4 * ((uint64_t) stack->num_lines + 1) > 3 * hash_size) {
+    if (!reuse_rebuild(stack)) {
+      return FALSE;
+    }
+  }
+
+  uint64_t key = line + 1;
+  REUSE_SLOT *slot = &stack->slots[reuse_find(stack, key)];
+  if (slot->key) {
+    uint32_t last = slot->time;
+    uint64_t distance = stack->num_lines - reuse_prefix(stack, last);
+    if (distance < level->num_distances) {
+      level->counts[distance]++;
+    } else {
+      level->num_far++;
+    }
+    reuse_add(stack, last, (uint32_t) -1);
+  } else {
+    level->num_cold++;
+    slot->key = key;
+    stack->num_lines++;
+  }
+  slot->time = ++stack->now;
+  reuse_add(stack, stack->now, 1);
+  return TRUE;
+}
+
+static const REUSE_LEVEL *reuse_level(const REUSE_PROFILE *profile, uint64_t num_sets) {
+  if (profile->failed) {
+    return NULL;
+  }
+  for (int i = 0; i < profile->num_levels; i++) {
+    if (profile->levels[i].set_mask + 1 == num_sets) {
+      return &profile->levels[i];
+    }
+  }
+  return NULL;
+}
+
+REUSE_PROFILE *reuse_profile_create(const REUSE_PROFILE_CONFIG *config) {
+  if (config->max_distance == 0 || config->min_set_bits < 0 || config->max_set_bits > REUSE_PROFILE_MAX_SET_BITS) {
+    return NULL;
+  }
+
+  REUSE_PROFILE *profile = (REUSE_PROFILE *) calloc(1, sizeof(REUSE_PROFILE));
+  if (!profile) {
+    return NULL;
+  }
+  profile->config = *config;
+
+  for (int set_bits = 0; set_bits == 0 || set_bits <= config->max_set_bits; set_bits++) {
+    if (set_bits && set_bits < config->min_set_bits) {
+      continue;
+    }
+    REUSE_LEVEL *level = &profile->levels[profile->num_levels++];
+    uint64_t num_sets = (uint64_t) 1 << set_bits;
+    level->set_mask = num_sets - 1;
+    level->num_distances = config->max_distance >> set_bits;
+    if (level->num_distances == 0) {
+      level->num_distances = 1;
+    }
+    level->stacks = (REUSE_STACK *) calloc(num_sets, sizeof(REUSE_STACK));
+    level->counts = (uint64_t *) calloc(level->num_distances, sizeof(uint64_t));
+    if (!level->stacks || !level->counts) {
+      reuse_profile_destroy(profile);
+      return NULL;
+    }
+  }
+  return profile;
+}
+
+void reuse_profile_destroy(REUSE_PROFILE *profile) {
+  if (!profile) {
+    return;
+  }
+  for (int i = 0; i < profile->num_levels; i++) {
+    REUSE_LEVEL *level = &profile->levels[i];
+    if (level->stacks) {
+      for (uint64_t set = 0; set <= level->set_mask; set++) {
+        free(level->stacks[set].slots);
+        free(level->stacks[set].tree);
+      }
+    }
+    free(level->stacks);
+    free(level->counts);
+  }
+  free(profile);
+}
+
+int reuse_profile_access(REUSE_PROFILE *profile, uint64_t address) {
+  return reuse_profile_batch(profile, &address, 1);
+}
+
+int reuse_profile_batch(REUSE_PROFILE *profile, const uint64_t addresses[], uint64_t num_accesses) {
+  if (profile->failed) {
+    return -1;
+  }
+  for (uint64_t i = 0; i < num_accesses; i++) {
+    uint64_t line = addresses[i] >> REUSE_LINE_SHIFT;
+    for (int l = 0; l < profile->num_levels; l++) {
+      if (!reuse_level_access(&profile->levels[l], line)) {
+        profile->failed = TRUE;
+        return -1;
+      }
+    }
+    profile->num_accesses++;
+  }
+  return 0;
+}
+
+int reuse_profile_histogram(const REUSE_PROFILE *profile, uint64_t num_sets, REUSE_HISTOGRAM *histogram) {
+  const REUSE_LEVEL *level = reuse_level(profile, num_sets);
+  if (!level) {
+    return -1;
+  }
+  histogram->num_accesses = profile->num_accesses;
+  histogram->num_cold = level->num_cold;
+  histogram->num_distances = level->num_distances;
+  histogram->counts = level->counts;
+  histogram->num_far = level->num_far;
+  return 0;
+}
+
+int reuse_profile_misses(const REUSE_PROFILE *profile, uint64_t num_sets, uint64_t lines_per_set, uint64_t *misses) {
+  const REUSE_LEVEL *level = reuse_level(profile, num_sets);
+  if (!level || lines_per_set == 0 || lines_per_set > level->num_distances) {
+    return -1;
+  }
+  uint64_t sum = level->num_cold + level->num_far;
+  for (uint64_t d = lines_per_set; d < level->num_distances; d++) {
+    sum += level->counts[d];
+  }
+  *misses = sum;
+  return 0;
+}
@@ -0,0 +1,103 @@
+/************************************************************
+
+                      reuse_profile.h
+
+A single-pass reuse-distance (LRU stack distance) profiler, from
+which the LRU miss counts of caches of every size can be read at
+once, instead of simulating each size separately.
+
+The profiler is given the addresses that memory_access() is given
+(from a trace or a workload, see sweep.h), and works on the 64-byte
+cache lines they fall in. The reuse distance of an access is the
+number of other lines accessed since the last access to its line:
+a fully-associative LRU cache of C lines hits exactly the accesses
+whose distance is less than C. Accesses to a line never accessed
+before are cold, and miss in any cache.
+
+For a set-associative cache, with the set index taken from the
+bits just above the line offset as the L1 and L2 caches do, what
+matters is the distance within the set, counting only the other
+lines of the same set: an LRU cache of S sets of W ways each hits
+exactly the accesses whose distance within their set of S is less
+than W. The profiler keeps a histogram of those distances for each
+number of sets S = 2^b asked for, along with the fully-associative
+one (S = 1), so a single pass gives the misses of every size and
+associativity of those numbers of sets.
+
+Each histogram is kept exactly for the distances below a limit,
+config.max_distance lines for the fully-associative one and
+max_distance / S for S sets, and the longer ones only counted
+together, so the misses are known for caches of up to max_distance
+lines.
+
+Every access takes O(log n) time, n being the number of lines
+(of its set) accessed so far, in each histogram: each set keeps
+the time of the last access to each of its lines in a hash table,
+and a Fenwick tree over those times, with a 1 at the time of
+each line's last access, counts the lines accessed after a given
+time in O(log n). When the times run out, the lines are numbered
+again from 1 in the order of their last accesses, which costs O(n)
+once every n accesses or more. It takes about 50 bytes of host
+memory per line accessed, per histogram.
+
+For the L2 cache, the curves give the misses that a cache of its
+shape would have with the whole access stream, not just the L1
+misses that reach it; with an L1 cache much smaller than the L2
+cache, the two are close.
+
+**************************************************************/
+
+#ifndef REUSE_PROFILE_H
+#define REUSE_PROFILE_H
+
+#include <stdint.h>
+
+#define REUSE_PROFILE_MAX_SET_BITS 20
+
+typedef struct {
+  uint64_t max_distance;        // in lines, the fully-associative histogram's limit
+  int min_set_bits;             // also profile caches of 2^min_set_bits ...
+  int max_set_bits;             // ... 2^max_set_bits sets, if min_set_bits <= max_set_bits
+} REUSE_PROFILE_CONFIG;
+
+//Caches of up to 256MB, and of 64 (a 16KB 4-way L1 cache) to 32768
+//sets (the default 2MB direct-mapped L2 cache).
+#define REUSE_PROFILE_DEFAULT_CONFIG {1 << 22, 6, 15}
+
+typedef struct {
+  uint64_t num_accesses;
+  uint64_t num_cold;            // first accesses to a line
+  uint64_t num_distances;
+  const uint64_t *counts;       // counts[d]: the accesses at distance d, for d < num_distances
+  uint64_t num_far;             // the accesses at distance num_distances or more
+} REUSE_HISTOGRAM;
+
+typedef struct REUSE_PROFILE REUSE_PROFILE;
+
+//Returns NULL if the configuration is not valid (set bits beyond
+//REUSE_PROFILE_MAX_SET_BITS, or a max_distance of 0), or the memory
+//cannot be allocated.
+REUSE_PROFILE *reuse_profile_create(const REUSE_PROFILE_CONFIG *config);
+
+//Passing NULL does nothing.
+void reuse_profile_destroy(REUSE_PROFILE *profile);
+
+//Profiles an access to address, or to each of the num_accesses
+//addresses. They return 0, or -1 if host memory runs out, after
+//which the profile no longer changes and cannot be read.
+int reuse_profile_access(REUSE_PROFILE *profile, uint64_t address);
+int reuse_profile_batch(REUSE_PROFILE *profile, const uint64_t addresses[], uint64_t num_accesses);
+
+//Fills in the histogram of the distances within a set of num_sets
+//(1 for the fully-associative one). It stays valid until the next
+//access or the profile is destroyed. Returns -1 if num_sets was
+//not profiled, or the profile could not be kept.
+int reuse_profile_histogram(const REUSE_PROFILE *profile, uint64_t num_sets, REUSE_HISTOGRAM *histogram);
+
+//Fills in the misses of an LRU cache of num_sets sets of
+//lines_per_set lines (of 64 bytes) each. Returns -1 if num_sets was
+//not profiled, lines_per_set is 0 or beyond the histogram's limit,
+//or the profile could not be kept.
+int reuse_profile_misses(const REUSE_PROFILE *profile, uint64_t num_sets, uint64_t lines_per_set, uint64_t *misses);
+
+#endif
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "main_memory.h"
+#include "trace.h"
+#include "text_trace.h"
+#include "workload.h"
+#include "trace_replay.h"
+#include "sweep.h"
+#include "latency.h"
+
+// Runs a workload against every combination of the L1 and L2 cache
+// sizes, associativities and replacement policies given, on a pool of
+// threads (see sweep.h), and prints a table of the misses, writebacks,
+// simulated cycles and average memory access time (see latency.h) and
+// run time of each, as CSV or JSON.
+//
+// usage: run_sweep [options] (trace_file | -w workload)
+//
+//   -w workload     a synthetic workload (see workload_config_from_name()
+//                   in workload.h) instead of a trace file
+//   -n accesses     the number of accesses the workload makes
+//   -m bytes        the size of the memory the workload accesses (32M)
+//   -j threads      the number of threads to run the points on (1)
+//   -f csv|json     the format of the table (csv)
+//   -L latencies    the latencies the cycles are worked out with, as
+//                   for replay_trace (4,12,200,2,40)
+//   -l              stream a binary trace file through each thread,
+//                   running its share of the points in lockstep (see
+//                   sweep_run_lockstep()), rather than decoding the
+//                   whole trace into host memory first
+//   --l1-size, --l1-ways, --l1-policy, --l2-size, --l2-ways, --l2-policy
+//                   comma-separated lists of the values to try, sizes
+//                   in bytes with an optional K, M or G. Each defaults
+//                   to the default geometry's (or policy).
+//
+// A trace file may be binary or text, as for replay_trace. Main memory
+// covers the whole 48-bit address space. Points whose configuration is
+// not valid (a tree PLRU policy with 3 ways, say) are listed with a
+// valid of 0 and statistics of 0. Progress is reported on stderr.
+//
+// For example,
+//   run_sweep -j 8 -w zipf --l1-size 16K,32K,64K --l2-ways 1,4,16 --l2-policy lru,srrip
+// runs the 18 points of that grid on 8 threads.
+
+#define TEXT_INTERRUPT_INTERVAL 0x2000
+#define MAX_VALUES 64
+
+typedef struct {
+  uint64_t values[MAX_VALUES];
+  int n;
+} VALUE_LIST;
+
+static void usage(const char *program)
+{
+  printf("usage: %s [-w workload [-n accesses] [-m bytes]] [-j threads] [-f csv|json] [-L latencies] [-l]\n"
+	 "       [--l1-size list] [--l1-ways list] [--l1-policy list]\n"
+	 "       [--l2-size list] [--l2-ways list] [--l2-policy list] [trace_file]\n", program);
+  exit(1);
+}
+
+static uint64_t parse_size(const char *s)
+{
+  char *end;
+  uint64_t value = strtoull(s, &end, 0);
+  if (*end == 'K' || *end == 'k')
+    value <<= 10;
+  else if (*end == 'M' || *end == 'm')
+    value <<= 20;
+  else if (*end == 'G' || *end == 'g')
+    value <<= 30;
+  return value;
+}
+
+//Fills in list from a comma-separated list of sizes, or of policy names.
+static void parse_list(const char *s, VALUE_LIST *list, int policies, const char *program)
+{
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "%s", s);
+  list->n = 0;
+  for (char *value = strtok(buffer, ","); value; value = strtok(NULL, ",")) {
+    if (list->n == MAX_VALUES)
+      usage(program);
+    if (policies) {
+      REPLACEMENT_POLICY policy = replacement_policy_from_name(value);
+      if (policy == REPLACEMENT_DEFAULT && strcmp(value, "default") != 0) {
+	printf("Error: Unknown replacement policy %s\n", value);
+	exit(1);
+      }
+      list->values[list->n++] = policy;
+    } else {
+      list->values[list->n++] = parse_size(value);
+    }
+  }
+  if (!list->n)
+    usage(program);
+}
+
+//Returns TRUE if the file at path starts as a binary trace does.
+static int is_binary_trace(const char *path)
+{
+  char magic[sizeof(TRACE_MAGIC) - 1];
+  FILE *file = fopen(path, "rb");
+  int binary = file && fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+  if (file)
+    fclose(file);
+  return binary;
+}
+
+//Makes the accesses of the named workload, or of the trace at path.
+static SWEEP_TRACE *make_trace(const char *workload_name, const char *path, uint64_t memory_size, uint64_t num_accesses)
+{
+  if (workload_name) {
+    WORKLOAD_CONFIG config;
+    if (workload_config_from_name(workload_name, memory_size, &config) != 0) {
+      printf("Error: Unknown workload %s\n", workload_name);
+      exit(1);
+    }
+    if (num_accesses)
+      config.num_accesses = num_accesses;
+    return sweep_trace_from_workload(&config);
+  }
+  if (is_binary_trace(path))
+    return sweep_trace_from_file(path);
+  return sweep_trace_from_text(path, text_trace_detect_format(path), TEXT_INTERRUPT_INTERVAL);
+}
+
+static double now_in_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+  MEMORY_SUBSYSTEM_CONFIG defaults = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_FULL_SIZE);
+  VALUE_LIST l1_size = {{defaults.l1_geometry.size_in_bytes}, 1};
+  VALUE_LIST l1_ways = {{defaults.l1_geometry.lines_per_set}, 1};
+  VALUE_LIST l1_policy = {{REPLACEMENT_DEFAULT}, 1};
+  VALUE_LIST l2_size = {{defaults.l2_geometry.size_in_bytes}, 1};
+  VALUE_LIST l2_ways = {{defaults.l2_geometry.lines_per_set}, 1};
+  VALUE_LIST l2_policy = {{REPLACEMENT_DEFAULT}, 1};
+  const char *workload_name = NULL, *path = NULL;
+  uint64_t num_accesses = 0, memory_size = 1 << 25;
+  int num_threads = 1, json = 0, lockstep = 0;
+  LATENCY_CONFIG latencies = LATENCY_DEFAULT_CONFIG;
+
+  for (int i = 1; i < argc; i++) {
+    const char *option = argv[i];
+    if (option[0] != '-') {
+      path = option;
+      continue;
+    }
+    if (!strcmp(option, "-l")) {
+      lockstep = 1;
+      continue;
+    }
+    if (i + 1 == argc)
+      usage(argv[0]);
+    const char *value = argv[++i];
+    if (!strcmp(option, "-w"))
+      workload_name = value;
+    else if (!strcmp(option, "-n"))
+      num_accesses = parse_size(value);
+    else if (!strcmp(option, "-m"))
+      memory_size = parse_size(value);
+    else if (!strcmp(option, "-j"))
+      num_threads = atoi(value);
+    else if (!strcmp(option, "-f"))
+      json = !strcmp(value, "json");
+    else if (!strcmp(option, "-L")) {
+      if (latency_config_from_string(value, &latencies) != 0)
+	usage(argv[0]);
+    }
+    else if (!strcmp(option, "--l1-size"))
+      parse_list(value, &l1_size, 0, argv[0]);
+    else if (!strcmp(option, "--l1-ways"))
+      parse_list(value, &l1_ways, 0, argv[0]);
+    else if (!strcmp(option, "--l1-policy"))
+      parse_list(value, &l1_policy, 1, argv[0]);
+    else if (!strcmp(option, "--l2-size"))
+      parse_list(value, &l2_size, 0, argv[0]);
+    else if (!strcmp(option, "--l2-ways"))
+      parse_list(value, &l2_ways, 0, argv[0]);
+    else if (!strcmp(option, "--l2-policy"))
+      parse_list(value, &l2_policy, 1, argv[0]);
+    else
+      usage(argv[0]);
+  }
+  if (!workload_name == !path)
+    usage(argv[0]);
+  if (lockstep && !(path && is_binary_trace(path))) {
+    printf("Error: Only a binary trace file can be swept in lockstep\n");
+    exit(1);
+  }
+
+  //Make the workload's accesses once, for every point.
+  double start = now_in_seconds();
+  SWEEP_TRACE *trace = NULL;
+  TRACE_REPLAY_STATS replayed = {0, 0};
+  if (!lockstep) {
+    trace = make_trace(workload_name, path, memory_size, num_accesses);
+    if (!trace) {
+      printf("Error: Could not read the workload\n");
+      exit(1);
+    }
+    replayed.num_accesses = trace->num_accesses;
+    replayed.num_interrupts = trace->num_interrupts;
+    fprintf(stderr, "%llu accesses and %llu interrupts made ready in %.3f seconds\n",
+	    trace->num_accesses, trace->num_interrupts, now_in_seconds() - start);
+  }
+
+  uint64_t num_points = (uint64_t) l1_size.n * l1_ways.n * l1_policy.n * l2_size.n * l2_ways.n * l2_policy.n;
+  SWEEP_POINT *points = (SWEEP_POINT *) calloc(num_points, sizeof(SWEEP_POINT));
+  if (!points) {
+    printf("Error: Could not allocate the points\n");
+    exit(1);
+  }
+  uint64_t p = 0;
+  for (int a = 0; a < l1_size.n; a++)
+    for (int b = 0; b < l1_ways.n; b++)
+      for (int c = 0; c < l1_policy.n; c++)
+	for (int d = 0; d < l2_size.n; d++)
+	  for (int e = 0; e < l2_ways.n; e++)
+	    for (int f = 0; f < l2_policy.n; f++, p++) {
+	      points[p].config = defaults;
+	      points[p].config.l1_geometry.size_in_bytes = l1_size.values[a];
+	      points[p].config.l1_geometry.lines_per_set = l1_ways.values[b];
+	      points[p].config.l1_replacement_policy = (REPLACEMENT_POLICY) l1_policy.values[c];
+	      points[p].config.l2_geometry.size_in_bytes = l2_size.values[d];
+	      points[p].config.l2_geometry.lines_per_set = l2_ways.values[e];
+	      points[p].config.l2_replacement_policy = (REPLACEMENT_POLICY) l2_policy.values[f];
+	    }
+
+  start = now_in_seconds();
+  if (!lockstep) {
+    sweep_run(trace, points, num_points, num_threads);
+  } else if (sweep_run_lockstep(path, points, num_points, num_threads, &replayed) != 0) {
+    printf("Error: Could not replay %s\n", path);
+    exit(1);
+  }
+  fprintf(stderr, "%llu points run on %d threads in %.3f seconds\n", num_points, num_threads, now_in_seconds() - start);
+
+  if (json)
+    printf("[\n");
+  else
+    printf("l1_size,l1_ways,l1_policy,l2_size,l2_ways,l2_policy,valid,accesses,"
+	   "l1_misses,l2_misses,l1_writebacks,l2_writebacks,cycles,amat,seconds\n");
+  for (p = 0; p < num_points; p++) {
+    MEMORY_SUBSYSTEM_CONFIG *c = &points[p].config;
+    MEMORY_SUBSYSTEM_STATS *s = &points[p].stats;
+    LATENCY_REPORT latency;
+    latency_report(&latencies, s, &latency);
+    if (json)
+      printf("  {\"l1_size\": %llu, \"l1_ways\": %u, \"l1_policy\": \"%s\", "
+	     "\"l2_size\": %llu, \"l2_ways\": %u, \"l2_policy\": \"%s\", \"valid\": %s, \"accesses\": %llu, "
+	     "\"l1_misses\": %llu, \"l2_misses\": %llu, \"l1_writebacks\": %llu, \"l2_writebacks\": %llu, "
+	     "\"cycles\": %llu, \"amat\": %.4f, \"seconds\": %.6f}%s\n",
+	     c->l1_geometry.size_in_bytes, c->l1_geometry.lines_per_set, replacement_policy_name(c->l1_replacement_policy),
+	     c->l2_geometry.size_in_bytes, c->l2_geometry.lines_per_set, replacement_policy_name(c->l2_replacement_policy),
+	     points[p].valid ? "true" : "false", replayed.num_accesses,
+	     s->num_l1_misses, s->num_l2_misses, s->num_l1_writebacks, s->num_l2_writebacks,
+	     latency.num_cycles, latency.average_cycles, points[p].seconds, p + 1 < num_points ? "," : "");
+    else
+      printf("%llu,%u,%s,%llu,%u,%s,%d,%llu,%llu,%llu,%llu,%llu,%llu,%.4f,%.6f\n",
+	     c->l1_geometry.size_in_bytes, c->l1_geometry.lines_per_set, replacement_policy_name(c->l1_replacement_policy),
+	     c->l2_geometry.size_in_bytes, c->l2_geometry.lines_per_set, replacement_policy_name(c->l2_replacement_policy),
+	     points[p].valid, replayed.num_accesses,
+	     s->num_l1_misses, s->num_l2_misses, s->num_l1_writebacks, s->num_l2_writebacks,
+	     latency.num_cycles, latency.average_cycles, points[p].seconds);
+  }
+  if (json)
+    printf("]\n");
+
+  free(points);
+  sweep_trace_free(trace);
+}
@@ -0,0 +1,293 @@
+/************************************************************
+
+                        sampler.c
+
+Sampled simulation (see sampler.h).
+
+Every access is given to the group its line belongs to, if any:
+with set sampling, through a table of the group of each unit (-1 if
+the unit is not sampled); with line sampling, through the top
+k + j bits of a hash of the line number, where 2^-k is the rate and
+2^j the number of groups: the line is sampled if the top k of them
+are 0, and the other j pick its group. Each group collects its
+accesses in a batch of its own, which is made of its subsystem with
+memory_access_batch_r() when it fills up, and before a clock
+interrupt or the statistics are read.
+
+Each group's statistics times the scale (the number of units over
+the units of the group, or 2^(k+j)) is one estimate for the full
+caches.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "sampler.h"
+
+#define SAMPLER_BATCH_SIZE 1024          // accesses, per group
+#define SAMPLER_READ_SIZE 4096           // trace records
+
+typedef struct {
+  MEMORY_SUBSYSTEM *ms;
+  uint64_t n;
+  uint64_t num_simulated;
+  uint64_t addresses[SAMPLER_BATCH_SIZE];
+  uint64_t write_data[SAMPLER_BATCH_SIZE];
+  uint8_t controls[SAMPLER_BATCH_SIZE];
+} SAMPLER_GROUP;
+
+struct SAMPLER {
+  SAMPLER_MODE mode;
+  int num_groups;
+  double rate;
+  double scale;                 // of a group's statistics, to the full caches
+  uint64_t seed;
+  uint64_t unit_mask;           // set sampling: of the line number
+  int8_t *unit_groups;          // set sampling: the group of each unit, or -1
+  int hash_bits;                // line sampling: k + j
+  int group_bits;               // line sampling: j
+  uint64_t num_accesses;
+  uint64_t read_data[SAMPLER_BATCH_SIZE];
+  SAMPLER_GROUP groups[SAMPLER_MAX_GROUPS];
+};
+
+//Student's t for a two-sided 95% interval, by degrees of freedom.
+static const double sampler_student_t[SAMPLER_MAX_GROUPS] = {
+  0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365,
+  2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131
+};
+
+//The splitmix64 finalizer.
+static uint64_t sampler_hash(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static inline int sampler_group(const SAMPLER *sampler, uint64_t line) {
+  if (sampler->mode == SAMPLER_SETS) {
+    return sampler->unit_groups[line & sampler->unit_mask];
+  }
+  if (!sampler->hash_bits) {
+    return 0;
+  }
+  uint64_t bits = sampler_hash(line ^ sampler->seed) >> (64 - sampler->hash_bits);
+  return bits >> sampler->group_bits ? -1 : (int) bits;
+}
+
+static void sampler_flush(SAMPLER *sampler, SAMPLER_GROUP *group) {
+  memory_access_batch_r(group->ms, group->addresses, group->write_data, group->controls,
+                        sampler->read_data, NULL, group->n);
+  group->num_simulated += group->n;
+  group->n = 0;
+}
+
+static inline void sampler_add(SAMPLER *sampler, uint64_t address, uint64_t write_data, uint8_t control) {
+  int g = sampler_group(sampler, address / BYTES_PER_CACHE_LINE);
+  sampler->num_accesses++;
+  if (g < 0) {
+    return;
+  }
+  SAMPLER_GROUP *group = &sampler->groups[g];
+  group->addresses[group->n] = address;
+  group->write_data[group->n] = write_data;
+  group->controls[group->n] = control;
+  if (++group->n == SAMPLER_BATCH_SIZE) {
+    sampler_flush(sampler, group);
+  }
+}
+
+//Chooses n of the num_units units at random, and deals them out to
+//the groups in turn. Returns FALSE if the memory cannot be allocated.
+static BOOL sampler_choose_units(SAMPLER *sampler, uint64_t num_units, uint64_t n) {
+  uint64_t *order = (uint64_t *) malloc(num_units * sizeof(uint64_t));
+  sampler->unit_groups = (int8_t *) malloc(num_units);
+  if (!order || !sampler->unit_groups) {
+    free(order);
+    return FALSE;
+  }
+  memset(sampler->unit_groups, -1, num_units);
+  for (uint64_t i = 0; i < num_units; i++) {
+    order[i] = i;
+  }
+  uint64_t state = sampler->seed;
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t j = i + sampler_hash(state++) % (num_units - i);
+    uint64_t unit = order[j];
+    order[j] = order[i];
+    sampler->unit_groups[unit] = (int8_t) (i % sampler->num_groups);
+  }
+  free(order);
+  return TRUE;
+}
+
+SAMPLER *sampler_create(const MEMORY_SUBSYSTEM_CONFIG *config, const SAMPLER_CONFIG *sampling) {
+  const L1_GEOMETRY *l1 = &config->l1_geometry;
+  const L2_GEOMETRY *l2 = &config->l2_geometry;
+
+  if (config->main_memory_file || !(sampling->rate > 0 && sampling->rate <= 1) ||
+      !l1->lines_per_set || !l1->bytes_per_line || !l2->lines_per_set || !l2->bytes_per_line) {
+    return NULL;
+  }
+  uint64_t l1_sets = l1->size_in_bytes / ((uint64_t) l1->lines_per_set * l1->bytes_per_line);
+  uint64_t l2_sets = l2->size_in_bytes / ((uint64_t) l2->lines_per_set * l2->bytes_per_line);
+  uint64_t num_sets = l1_sets < l2_sets ? l1_sets : l2_sets;
+  if (!num_sets || (num_sets & (num_sets - 1))) {
+    return NULL;
+  }
+
+  SAMPLER *sampler = (SAMPLER *) calloc(1, sizeof(SAMPLER));
+  if (!sampler) {
+    return NULL;
+  }
+  sampler->mode = sampling->mode;
+  sampler->seed = sampling->seed;
+  MEMORY_SUBSYSTEM_CONFIG group_config = *config;
+
+  if (sampling->mode == SAMPLER_SETS) {
+    uint64_t n = (uint64_t) (sampling->rate * num_sets + 0.5);
+    if (n < 1) {
+      n = 1;
+    }
+    sampler->num_groups = n < SAMPLER_MAX_GROUPS ? (int) n : SAMPLER_MAX_GROUPS;
+    n -= n % sampler->num_groups;
+    sampler->unit_mask = num_sets - 1;
+    sampler->rate = (double) n / num_sets;
+    sampler->scale = (double) num_sets * sampler->num_groups / n;
+    if (!sampler_choose_units(sampler, num_sets, n)) {
+      sampler_destroy(sampler);
+      return NULL;
+    }
+  } else {
+    int k = 0, j = 0;
+    while (ldexp(1, -k) > sampling->rate) {
+      k++;
+    }
+    if (k >= 64 || ((uint64_t) 1 << k) > num_sets) {
+      free(sampler);
+      return NULL;
+    }
+    while ((1 << (j + 1)) <= SAMPLER_MAX_GROUPS && ((uint64_t) 1 << (k + j + 1)) <= num_sets) {
+      j++;
+    }
+    sampler->num_groups = 1 << j;
+    sampler->hash_bits = k + j;
+    sampler->group_bits = j;
+    sampler->rate = ldexp(1, -k);
+    sampler->scale = ldexp(1, k + j);
+    group_config.l1_geometry.size_in_bytes >>= k + j;
+    group_config.l2_geometry.size_in_bytes >>= k + j;
+  }
+
+  for (int g = 0; g < sampler->num_groups; g++) {
+    sampler->groups[g].ms = memory_subsystem_create_with_config(&group_config);
+    if (!sampler->groups[g].ms) {
+      sampler_destroy(sampler);
+      return NULL;
+    }
+  }
+  return sampler;
+}
+
+void sampler_destroy(SAMPLER *sampler) {
+  if (!sampler) {
+    return;
+  }
+  for (int g = 0; g < sampler->num_groups; g++) {
+    memory_subsystem_destroy(sampler->groups[g].ms);
+  }
+  free(sampler->unit_groups);
+  free(sampler);
+}
+
+void sampler_access_batch_r(SAMPLER *sampler, const uint64_t addresses[], const uint64_t write_data[],
+                            const uint8_t controls[], uint64_t num_accesses) {
+  for (uint64_t i = 0; i < num_accesses; i++) {
+    sampler_add(sampler, addresses[i], write_data[i], controls[i]);
+  }
+}
+
+void sampler_handle_clock_interrupt_r(SAMPLER *sampler) {
+  for (int g = 0; g < sampler->num_groups; g++) {
+    sampler_flush(sampler, &sampler->groups[g]);
+    memory_handle_clock_interrupt_r(sampler->groups[g].ms);
+  }
+}
+
+int sampler_replay_r(SAMPLER *sampler, const char *path, TRACE_REPLAY_STATS *stats) {
+  TRACE_RECORD records[SAMPLER_READ_SIZE];
+  TRACE_REPLAY_STATS replayed = {0, 0};
+  TRACE_READER *reader = trace_reader_open(path);
+  uint64_t n;
+
+  if (!reader) {
+    return -1;
+  }
+  while ((n = trace_reader_read(reader, records, SAMPLER_READ_SIZE)) > 0) {
+    for (uint64_t i = 0; i < n; i++) {
+      uint8_t control = trace_record_control(&records[i]);
+      if (control == TRACE_CLOCK_INTERRUPT) {
+        sampler_handle_clock_interrupt_r(sampler);
+        replayed.num_interrupts++;
+      } else {
+        sampler_add(sampler, trace_record_address(&records[i]), records[i].write_data, control);
+        replayed.num_accesses++;
+      }
+    }
+  }
+  int corrupt = trace_reader_corrupt(reader);
+  trace_reader_close(reader);
+  if (stats) {
+    *stats = replayed;
+  }
+  return corrupt ? -1 : 0;
+}
+
+//Fills in the estimate from the groups' values x[].
+static void sampler_estimate(const SAMPLER *sampler, const double x[], SAMPLER_ESTIMATE *estimate) {
+  int n = sampler->num_groups;
+  double sum = 0, squares = 0;
+  for (int g = 0; g < n; g++) {
+    sum += x[g] * sampler->scale;
+  }
+  double mean = sum / n;
+  for (int g = 0; g < n; g++) {
+    double d = x[g] * sampler->scale - mean;
+    squares += d * d;
+  }
+  estimate->estimate = mean;
+  estimate->half_width = n > 1 ? sampler_student_t[n - 1] * sqrt(squares / (n - 1) / n) : NAN;
+}
+
+void sampler_get_stats_r(SAMPLER *sampler, SAMPLER_STATS *stats) {
+  double l1_misses[SAMPLER_MAX_GROUPS], l2_misses[SAMPLER_MAX_GROUPS];
+  double l1_writebacks[SAMPLER_MAX_GROUPS], l2_writebacks[SAMPLER_MAX_GROUPS];
+
+  stats->num_simulated = 0;
+  for (int g = 0; g < sampler->num_groups; g++) {
+    MEMORY_SUBSYSTEM_STATS group_stats;
+    sampler_flush(sampler, &sampler->groups[g]);
+    memory_get_stats_r(sampler->groups[g].ms, &group_stats);
+    l1_misses[g] = (double) group_stats.num_l1_misses;
+    l2_misses[g] = (double) group_stats.num_l2_misses;
+    l1_writebacks[g] = (double) group_stats.num_l1_writebacks;
+    l2_writebacks[g] = (double) group_stats.num_l2_writebacks;
+    stats->num_simulated += sampler->groups[g].num_simulated;
+  }
+  sampler_estimate(sampler, l1_misses, &stats->l1_misses);
+  sampler_estimate(sampler, l2_misses, &stats->l2_misses);
+  sampler_estimate(sampler, l1_writebacks, &stats->l1_writebacks);
+  sampler_estimate(sampler, l2_writebacks, &stats->l2_writebacks);
+  stats->num_accesses = sampler->num_accesses;
+  stats->rate = sampler->rate;
+  stats->num_groups = sampler->num_groups;
+}
@@ -0,0 +1,103 @@
+/************************************************************
+
+                        sampler.h
+
+Sampled simulation: runs only a sample of a workload's accesses
+through the caches, and scales the statistics of the sample back up
+to estimates for the full caches, each with a 95% confidence
+interval. There are two ways of sampling:
+
+  SAMPLER_SETS:  set sampling. Only the accesses to a chosen subset
+                 of the cache sets are simulated, in caches of the
+                 full size. The sets are sampled in units of the
+                 lowest b bits of the line number, 2^b being the
+                 number of sets of the smaller cache, so that a unit
+                 is one whole set of that cache and whole sets of the
+                 other (the set index of both caches being the bits
+                 just above the line offset); the units are chosen at
+                 random (from the seed), round(rate * 2^b) of them.
+  SAMPLER_LINES: spatial hash sampling, as SHARDS does. A line is
+                 simulated if a hash of its number (and the seed) is
+                 below rate times the hash's range, in caches with
+                 rate times as many sets, so that each set sees about
+                 as many lines as a set of the full caches would. The
+                 rate is rounded down to a power of two.
+
+The sampled accesses are split into up to SAMPLER_MAX_GROUPS groups
+(of units, or by more bits of the hash), each simulated on a memory
+subsystem of its own, which gets every clock interrupt. The sets of
+one group have nothing to do with those of another, so each group
+gives an estimate of its own for the whole workload; the estimate
+is the mean of those, and its confidence interval comes from how
+much they differ (with Student's t distribution). With set sampling
+at a rate of 1, the estimates are exactly the statistics of the
+full caches, as long as neither cache uses a policy with state
+shared by its sets (REPLACEMENT_RANDOM or REPLACEMENT_BRRIP).
+
+The rate and the mode are chosen when a sampler is created, so they
+can be set per run (replay_trace -S). A subsystem whose main memory
+is a file cannot be sampled.
+
+**************************************************************/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+#include "trace_replay.h"
+
+#define SAMPLER_MAX_GROUPS 16
+
+typedef enum {
+  SAMPLER_SETS = 0,
+  SAMPLER_LINES
+} SAMPLER_MODE;
+
+typedef struct {
+  SAMPLER_MODE mode;
+  double rate;                  // the fraction of units or lines to simulate, in (0, 1]
+  uint64_t seed;                // chooses which
+} SAMPLER_CONFIG;
+
+typedef struct {
+  double estimate;              // for the full caches
+  double half_width;            // of the 95% confidence interval, NAN with a single group
+} SAMPLER_ESTIMATE;
+
+typedef struct {
+  SAMPLER_ESTIMATE l1_misses;
+  SAMPLER_ESTIMATE l2_misses;
+  SAMPLER_ESTIMATE l1_writebacks;
+  SAMPLER_ESTIMATE l2_writebacks;
+  uint64_t num_accesses;        // made of the sampler
+  uint64_t num_simulated;       // of those, made of the groups' subsystems
+  double rate;                  // the fraction of units or lines actually sampled
+  int num_groups;
+} SAMPLER_STATS;
+
+typedef struct SAMPLER SAMPLER;
+
+//Returns NULL if the configuration of the memory subsystem or of the
+//sampling is not valid (a rate outside (0, 1], or too low for the
+//caches to be made that much smaller), main memory is a file, or
+//the memory cannot be allocated.
+SAMPLER *sampler_create(const MEMORY_SUBSYSTEM_CONFIG *config, const SAMPLER_CONFIG *sampling);
+
+//Passing NULL does nothing.
+void sampler_destroy(SAMPLER *sampler);
+
+//Makes num_accesses accesses, as memory_access_batch_r() does, except
+//that nothing is read back.
+void sampler_access_batch_r(SAMPLER *sampler, const uint64_t addresses[], const uint64_t write_data[],
+			    const uint8_t controls[], uint64_t num_accesses);
+
+void sampler_handle_clock_interrupt_r(SAMPLER *sampler);
+
+//Replays the binary trace file at path, as trace_replay_r() does.
+int sampler_replay_r(SAMPLER *sampler, const char *path, TRACE_REPLAY_STATS *stats);
+
+void sampler_get_stats_r(SAMPLER *sampler, SAMPLER_STATS *stats);
+
+#endif
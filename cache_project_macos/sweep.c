@@ -0,0 +1,422 @@
+/************************************************************
+
+                        sweep.c
+
+The design-space sweep runner (see sweep.h).
+
+Each thread's points are a range [begin, end) of the array of
+points, kept in one 64-bit word (begin in the top 32 bits), so
+that the thread can take the point at begin, and another thread
+can steal the one before end, with a single compare-and-swap,
+and neither can take a point the other has taken.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "text_trace.h"
+#include "workload.h"
+#include "trace_replay.h"
+#include "sweep.h"
+
+#define SWEEP_BATCH_SIZE 4096          // accesses
+
+#define SWEEP_RANGE(begin, end) (((uint64_t)(begin) << 32) | (end))
+#define SWEEP_RANGE_BEGIN(range) ((range) >> 32)
+#define SWEEP_RANGE_END(range) ((range) & 0xFFFFFFFF)
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t range;
+} SWEEP_QUEUE;
+
+typedef struct {
+  const SWEEP_TRACE *trace;
+  SWEEP_POINT *points;
+  SWEEP_QUEUE *queues;
+  int num_threads;
+} SWEEP;
+
+typedef struct {
+  SWEEP *sweep;
+  int thread;
+  pthread_t id;
+} SWEEP_WORKER;
+
+//The points that one thread runs in lockstep.
+typedef struct {
+  const char *path;
+  SWEEP_POINT *points;
+  uint64_t num_points;
+  int result;
+  TRACE_REPLAY_STATS replayed;
+  pthread_t id;
+} SWEEP_GROUP;
+
+//Makes room for capacity accesses and interrupts. Returns FALSE if
+//the memory cannot be allocated (and frees the trace).
+static BOOL sweep_trace_reserve(SWEEP_TRACE *trace, uint64_t *capacity, uint64_t *interrupt_capacity) {
+  if (trace->num_accesses == *capacity) {
+    *capacity = *capacity ? 2 * *capacity : SWEEP_BATCH_SIZE;
+    uint64_t *addresses = (uint64_t *) realloc(trace->addresses, *capacity * sizeof(uint64_t));
+    if (addresses) {
+      trace->addresses = addresses;
+    }
+    uint64_t *write_data = (uint64_t *) realloc(trace->write_data, *capacity * sizeof(uint64_t));
+    if (write_data) {
+      trace->write_data = write_data;
+    }
+    uint8_t *controls = (uint8_t *) realloc(trace->controls, *capacity);
+    if (controls) {
+      trace->controls = controls;
+    }
+    if (!addresses || !write_data || !controls) {
+      sweep_trace_free(trace);
+      return FALSE;
+    }
+  }
+  if (trace->num_interrupts == *interrupt_capacity) {
+    *interrupt_capacity = *interrupt_capacity ? 2 * *interrupt_capacity : SWEEP_BATCH_SIZE;
+    uint64_t *interrupts = (uint64_t *) realloc(trace->interrupts, *interrupt_capacity * sizeof(uint64_t));
+    if (!interrupts) {
+      sweep_trace_free(trace);
+      return FALSE;
+    }
+    trace->interrupts = interrupts;
+  }
+  return TRUE;
+}
+
+SWEEP_TRACE *sweep_trace_from_file(const char *path) {
+  TRACE_RECORD records[SWEEP_BATCH_SIZE];
+  uint64_t capacity = 0, interrupt_capacity = 0, n;
+
+  TRACE_READER *reader = trace_reader_open(path);
+  if (!reader) {
+    return NULL;
+  }
+  SWEEP_TRACE *trace = (SWEEP_TRACE *) calloc(1, sizeof(SWEEP_TRACE));
+  if (!trace) {
+    trace_reader_close(reader);
+    return NULL;
+  }
+  while (trace && (n = trace_reader_read(reader, records, SWEEP_BATCH_SIZE)) > 0) {
+    for (uint64_t i = 0; i < n; i++) {
+      if (!sweep_trace_reserve(trace, &capacity, &interrupt_capacity)) {
+	trace = NULL;
+	break;
+      }
+      uint8_t control = trace_record_control(&records[i]);
+      if (control == TRACE_CLOCK_INTERRUPT) {
+	trace->interrupts[trace->num_interrupts++] = trace->num_accesses;
+      } else {
+	trace->addresses[trace->num_accesses] = trace_record_address(&records[i]);
+	trace->write_data[trace->num_accesses] = records[i].write_data;
+	trace->controls[trace->num_accesses] = control;
+	trace->num_accesses++;
+      }
+    }
+  }
+  if (trace && trace_reader_corrupt(reader)) {
+    sweep_trace_free(trace);
+    trace = NULL;
+  }
+  trace_reader_close(reader);
+  return trace;
+}
+
+SWEEP_TRACE *sweep_trace_from_text(const char *path, int format, uint64_t interrupt_interval) {
+  uint64_t addresses[SWEEP_BATCH_SIZE];
+  uint8_t controls[SWEEP_BATCH_SIZE];
+  uint64_t capacity = 0, interrupt_capacity = 0, n;
+
+  TEXT_TRACE *text = text_trace_open(path, format);
+  if (!text) {
+    return NULL;
+  }
+  SWEEP_TRACE *trace = (SWEEP_TRACE *) calloc(1, sizeof(SWEEP_TRACE));
+  if (!trace) {
+    text_trace_close(text);
+    return NULL;
+  }
+  while (trace && (n = text_trace_read(text, addresses, controls, SWEEP_BATCH_SIZE)) > 0) {
+    for (uint64_t i = 0; i < n; i++) {
+      if (!sweep_trace_reserve(trace, &capacity, &interrupt_capacity)) {
+	trace = NULL;
+	break;
+      }
+      trace->addresses[trace->num_accesses] = addresses[i];
+      trace->write_data[trace->num_accesses] = 0;
+      trace->controls[trace->num_accesses] = controls[i];
+      trace->num_accesses++;
+      if (interrupt_interval && !(trace->num_accesses % interrupt_interval)) {
+	trace->interrupts[trace->num_interrupts++] = trace->num_accesses;
+      }
+    }
+  }
+  text_trace_close(text);
+  return trace;
+}
+
+SWEEP_TRACE *sweep_trace_from_workload(const WORKLOAD_CONFIG *config) {
+  WORKLOAD *workload = workload_create(config);
+  SWEEP_TRACE *trace = (SWEEP_TRACE *) calloc(1, sizeof(SWEEP_TRACE));
+  uint64_t n = config->num_accesses;
+  uint64_t interval = config->interrupt_interval;
+
+  if (!workload || !trace) {
+    workload_destroy(workload);
+    free(trace);
+    return NULL;
+  }
+  trace->addresses = (uint64_t *) malloc(n * sizeof(uint64_t) + 1);
+  trace->write_data = (uint64_t *) malloc(n * sizeof(uint64_t) + 1);
+  trace->controls = (uint8_t *) malloc(n + 1);
+  trace->interrupts = (uint64_t *) malloc((interval ? n / interval : 0) * sizeof(uint64_t) + 1);
+  if (!trace->addresses || !trace->write_data || !trace->controls || !trace->interrupts) {
+    workload_destroy(workload);
+    sweep_trace_free(trace);
+    return NULL;
+  }
+  workload_generate(workload, trace->addresses, trace->write_data, trace->controls, n);
+  trace->num_accesses = n;
+  for (uint64_t i = interval; interval && i <= n; i += interval) {
+    trace->interrupts[trace->num_interrupts++] = i;
+  }
+  workload_destroy(workload);
+  return trace;
+}
+
+void sweep_trace_free(SWEEP_TRACE *trace) {
+  if (trace) {
+    free(trace->addresses);
+    free(trace->write_data);
+    free(trace->controls);
+    free(trace->interrupts);
+    free(trace);
+  }
+}
+
+void sweep_replay_r(MEMORY_SUBSYSTEM *ms, const SWEEP_TRACE *trace) {
+  uint64_t read_data[SWEEP_BATCH_SIZE];
+  uint64_t i = 0;
+
+  for (uint64_t k = 0; k <= trace->num_interrupts; k++) {
+    uint64_t end = k < trace->num_interrupts ? trace->interrupts[k] : trace->num_accesses;
+    while (i < end) {
+      uint64_t n = end - i < SWEEP_BATCH_SIZE ? end - i : SWEEP_BATCH_SIZE;
+      memory_access_batch_r(ms, trace->addresses + i, trace->write_data + i, trace->controls + i,
+			    read_data, NULL, n);
+      i += n;
+    }
+    if (k < trace->num_interrupts) {
+      memory_handle_clock_interrupt_r(ms);
+    }
+  }
+}
+
+static double now_in_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sweep_run_point(const SWEEP_TRACE *trace, SWEEP_POINT *point) {
+  double start = now_in_seconds();
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&point->config);
+  point->valid = ms != NULL;
+  memset(&point->stats, 0, sizeof(point->stats));
+  if (ms) {
+    sweep_replay_r(ms, trace);
+    memory_get_stats_r(ms, &point->stats);
+    memory_subsystem_destroy(ms);
+  }
+  point->seconds = now_in_seconds() - start;
+}
+
+//Takes the next point of queue, from the front if it is the thread's
+//own queue and from the back if it is stolen. Returns FALSE if the
+//queue is empty.
+static BOOL sweep_take(SWEEP_QUEUE *queue, BOOL own, uint64_t *point) {
+  uint64_t range = atomic_load_explicit(&queue->range, memory_order_relaxed);
+  for (;;) {
+    uint64_t begin = SWEEP_RANGE_BEGIN(range), end = SWEEP_RANGE_END(range);
+    if (begin >= end) {
+      return FALSE;
+    }
+    uint64_t taken = own ? SWEEP_RANGE(begin + 1, end) : SWEEP_RANGE(begin, end - 1);
+    if (atomic_compare_exchange_weak_explicit(&queue->range, &range, taken,
+					      memory_order_relaxed, memory_order_relaxed)) {
+      *point = own ? begin : end - 1;
+      return TRUE;
+    }
+  }
+}
+
+static void *sweep_worker(void *arg) {
+  SWEEP_WORKER *worker = (SWEEP_WORKER *) arg;
+  SWEEP *sweep = worker->sweep;
+  uint64_t point;
+
+  for (;;) {
+    if (sweep_take(&sweep->queues[worker->thread], TRUE, &point)) {
+      sweep_run_point(sweep->trace, &sweep->points[point]);
+      continue;
+    }
+
+    //Steal from the thread with the most points left.
+    int victim = -1;
+    uint64_t most = 0;
+    for (int t = 0; t < sweep->num_threads; t++) {
+      uint64_t range = atomic_load_explicit(&sweep->queues[t].range, memory_order_relaxed);
+      uint64_t left = SWEEP_RANGE_END(range) > SWEEP_RANGE_BEGIN(range) ?
+	              SWEEP_RANGE_END(range) - SWEEP_RANGE_BEGIN(range) : 0;
+      if (left > most) {
+	most = left;
+	victim = t;
+      }
+    }
+    if (victim < 0) {
+      break;
+    }
+    if (sweep_take(&sweep->queues[victim], FALSE, &point)) {
+      sweep_run_point(sweep->trace, &sweep->points[point]);
+    }
+  }
+  return NULL;
+}
+
+void sweep_run(const SWEEP_TRACE *trace, SWEEP_POINT points[], uint64_t num_points, int num_threads) {
+  SWEEP sweep;
+  SWEEP_QUEUE *queues = NULL;
+  SWEEP_WORKER *workers = NULL;
+
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  if ((uint64_t) num_threads > num_points) {
+    num_threads = num_points ? (int) num_points : 1;
+  }
+  queues = (SWEEP_QUEUE *) aligned_alloc(64, num_threads * sizeof(SWEEP_QUEUE));
+  workers = (SWEEP_WORKER *) calloc(num_threads, sizeof(SWEEP_WORKER));
+  if (!queues || !workers) {
+    //Run every point on this thread.
+    for (uint64_t i = 0; i < num_points; i++) {
+      sweep_run_point(trace, &points[i]);
+    }
+    free(queues);
+    free(workers);
+    return;
+  }
+
+  sweep.trace = trace;
+  sweep.points = points;
+  sweep.queues = queues;
+  sweep.num_threads = num_threads;
+  for (int t = 0; t < num_threads; t++) {
+    atomic_init(&queues[t].range, SWEEP_RANGE(num_points * t / num_threads, num_points * (t + 1) / num_threads));
+    workers[t].sweep = &sweep;
+    workers[t].thread = t;
+  }
+
+  //A thread that cannot be started leaves its points to be stolen.
+  int started = 1;
+  for (int t = 1; t < num_threads; t++) {
+    if (pthread_create(&workers[t].id, NULL, sweep_worker, &workers[t]) != 0) {
+      break;
+    }
+    started++;
+  }
+  sweep_worker(&workers[0]);
+  for (int t = 1; t < started; t++) {
+    pthread_join(workers[t].id, NULL);
+  }
+  free(queues);
+  free(workers);
+}
+
+static void *sweep_run_group(void *arg) {
+  SWEEP_GROUP *group = (SWEEP_GROUP *) arg;
+  MEMORY_SUBSYSTEM **ms = (MEMORY_SUBSYSTEM **) calloc(group->num_points ? group->num_points : 1, sizeof(MEMORY_SUBSYSTEM *));
+  double start = now_in_seconds();
+  int k = 0;
+
+  for (uint64_t i = 0; i < group->num_points; i++) {
+    SWEEP_POINT *point = &group->points[i];
+    memset(&point->stats, 0, sizeof(point->stats));
+    point->valid = FALSE;
+    if (ms && (ms[k] = memory_subsystem_create_with_config(&point->config)) != NULL) {
+      point->valid = TRUE;
+      k++;
+    }
+  }
+  group->result = !ms ? -1 : k ? trace_replay_lockstep_r(ms, k, group->path, &group->replayed) : 0;
+
+  //The valid points' subsystems are in ms in order.
+  double seconds = now_in_seconds() - start;
+  k = 0;
+  for (uint64_t i = 0; i < group->num_points; i++) {
+    SWEEP_POINT *point = &group->points[i];
+    if (point->valid) {
+      memory_get_stats_r(ms[k], &point->stats);
+      memory_subsystem_destroy(ms[k++]);
+    }
+    point->seconds = seconds;
+  }
+  free(ms);
+  return NULL;
+}
+
+int sweep_run_lockstep(const char *path, SWEEP_POINT points[], uint64_t num_points, int num_threads,
+		       TRACE_REPLAY_STATS *stats) {
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  if ((uint64_t) num_threads > num_points) {
+    num_threads = num_points ? (int) num_points : 1;
+  }
+  SWEEP_GROUP *groups = (SWEEP_GROUP *) calloc(num_threads, sizeof(SWEEP_GROUP));
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+  }
+  if (!groups) {
+    return -1;
+  }
+  for (int t = 0; t < num_threads; t++) {
+    groups[t].path = path;
+    groups[t].points = points + num_points * t / num_threads;
+    groups[t].num_points = num_points * (t + 1) / num_threads - num_points * t / num_threads;
+  }
+
+  //A group whose thread cannot be started is run on this one.
+  BOOL *started = (BOOL *) calloc(num_threads, sizeof(BOOL));
+  for (int t = 1; t < num_threads && started; t++) {
+    started[t] = pthread_create(&groups[t].id, NULL, sweep_run_group, &groups[t]) == 0;
+  }
+  int result = 0;
+  for (int t = 0; t < num_threads; t++) {
+    if (t > 0 && started && started[t]) {
+      pthread_join(groups[t].id, NULL);
+    } else {
+      sweep_run_group(&groups[t]);
+    }
+    result |= groups[t].result;
+    //Every group with a valid point replays the whole trace.
+    if (stats && groups[t].replayed.num_accesses + groups[t].replayed.num_interrupts >
+	         stats->num_accesses + stats->num_interrupts) {
+      *stats = groups[t].replayed;
+    }
+  }
+  free(started);
+  free(groups);
+  return result;
+}
@@ -0,0 +1,97 @@
+/************************************************************
+
+                        sweep.h
+
+Runs one workload against many memory subsystem configurations
+(the points of a design-space sweep) at once, on a pool of
+threads, and collects the statistics and run time of each.
+
+The workload is first turned into a SWEEP_TRACE: every access of
+a trace file (binary, see trace.h, or text, see text_trace.h) or of
+a synthetic workload (see workload.h), decoded into the arrays that
+memory_access_batch_r() takes, with the places of the clock
+interrupts. It is made once, and then only read, by all of the
+threads at once, so that no point pays for decoding or generating
+it, and workloads that are not reentrant (the presets that use
+rand()) can be swept too. It takes 17 bytes per access of host
+memory.
+
+sweep_run() gives each thread of the pool an equal range of the
+points to run, in order, and a thread that runs out steals points
+from the end of the range of another one, so that a few slow
+points (large caches, say) do not leave the other threads idle.
+Each point is run on a memory subsystem of its own, created for it
+and destroyed afterwards.
+
+A binary trace too large to decode into host memory can instead be
+swept with sweep_run_lockstep(), which streams it through each
+thread once, running all of that thread's points in lockstep (see
+trace_replay_lockstep_r() in trace_replay.h).
+
+**************************************************************/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+#include "workload.h"
+#include "trace_replay.h"
+
+typedef struct {
+  uint64_t num_accesses;
+  uint64_t *addresses;
+  uint64_t *write_data;
+  uint8_t *controls;
+  uint64_t num_interrupts;
+  uint64_t *interrupts;         // the number of accesses before each clock interrupt
+} SWEEP_TRACE;
+
+//One configuration to run, and once it has been run, its results.
+typedef struct {
+  MEMORY_SUBSYSTEM_CONFIG config;
+  int valid;                    // FALSE if config could not be built
+  MEMORY_SUBSYSTEM_STATS stats;
+  double seconds;               // of wall clock time, to run it
+} SWEEP_POINT;
+
+//Decodes the binary trace file at path. Returns NULL if the file
+//cannot be read, is not a trace, or is corrupt, or the host memory
+//cannot be allocated.
+SWEEP_TRACE *sweep_trace_from_file(const char *path);
+
+//Reads the text trace at path, in the given format, with a clock
+//interrupt after every interrupt_interval accesses (none if it is 0),
+//as text_trace_replay_r() does. Returns NULL as above.
+SWEEP_TRACE *sweep_trace_from_text(const char *path, int format, uint64_t interrupt_interval);
+
+//Generates the config->num_accesses accesses of a synthetic workload,
+//with its interrupts, as workload_run_r() makes them. Returns NULL if
+//the configuration is not valid, or the memory cannot be allocated.
+SWEEP_TRACE *sweep_trace_from_workload(const WORKLOAD_CONFIG *config);
+
+//Passing NULL does nothing.
+void sweep_trace_free(SWEEP_TRACE *trace);
+
+//Makes the accesses of trace of ms, and delivers its interrupts.
+void sweep_replay_r(MEMORY_SUBSYSTEM *ms, const SWEEP_TRACE *trace);
+
+//Runs trace against the configuration of each of the num_points
+//points, on num_threads threads (the calling one being one of them),
+//filling in the results of each. If some of the threads cannot be
+//started, the points are run by the others.
+void sweep_run(const SWEEP_TRACE *trace, SWEEP_POINT points[], uint64_t num_points, int num_threads);
+
+//Runs the binary trace file at path against the configuration of each
+//of the num_points points, as sweep_run() does, but with the points
+//split into num_threads equal groups, each run in lockstep by one
+//thread (with no stealing), reading the trace once. The seconds of
+//each point are those of its whole group. If stats is not NULL, it
+//is filled in with what was replayed. Returns 0, or -1 if the trace
+//could not be replayed in full (see trace_replay_r()), or the memory
+//could not be allocated.
+int sweep_run_lockstep(const char *path, SWEEP_POINT points[], uint64_t num_points, int num_threads,
+		       TRACE_REPLAY_STATS *stats);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Checks checkpoints of memory subsystems: that subsystems restored
+// from a checkpoint, with several cache shapes and replacement
+// policies, carry on exactly as the one saved does (reading the same
+// data and counting the same misses and writebacks) without affecting
+// each other, that main memory is saved sparsely and stays intact when
+// the checkpoint is replaced, and that what is not a checkpoint is
+// refused.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<20)
+#define BATCH_SIZE 4096
+
+static char path[64];
+
+//Makes NUM_ACCESSES accesses of the workload, a batch at a time with a
+//clock interrupt after each, of every one of the num_subsystems
+//subsystems, checking that they all read the same data.
+static void run(MEMORY_SUBSYSTEM *ms[], int num_subsystems, WORKLOAD *workload, const char *test)
+{
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE];
+  uint64_t expected[BATCH_SIZE], read_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+    for (int m = 0; m < num_subsystems; m++) {
+      memory_access_batch_r(ms[m], addresses, write_data, controls, m ? read_data : expected, NULL, BATCH_SIZE);
+      memory_handle_clock_interrupt_r(ms[m]);
+      for (int j = 0; m && j < BATCH_SIZE; j++) {
+	if ((controls[j] & READ_ENABLE_MASK) && read_data[j] != expected[j]) {
+	  printf("Error: %s, subsystem %d read %llu from %llx, should be %llu\n", test, m,
+		 read_data[j], addresses[j], expected[j]);
+	  exit(1);
+	}
+      }
+    }
+  }
+}
+
+static void check_stats(MEMORY_SUBSYSTEM *ms, MEMORY_SUBSYSTEM *restored, const char *test)
+{
+  MEMORY_SUBSYSTEM_STATS expected, stats;
+  memory_get_stats_r(ms, &expected);
+  memory_get_stats_r(restored, &stats);
+  if (memcmp(&stats, &expected, sizeof(stats)) != 0) {
+    printf("Error: %s, %llu L1 misses, %llu L2 misses, %llu and %llu writebacks, should be %llu, %llu, %llu and %llu\n",
+	   test, stats.num_l1_misses, stats.num_l2_misses, stats.num_l1_writebacks, stats.num_l2_writebacks,
+	   expected.num_l1_misses, expected.num_l2_misses, expected.num_l1_writebacks, expected.num_l2_writebacks);
+    exit(1);
+  }
+}
+
+static void test_carry_on(uint32_t l2_lines_per_set, REPLACEMENT_POLICY l2_policy, REPLACEMENT_POLICY l1_policy)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG workload_config = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *ms[2];
+  char test[128];
+
+  config.l2_geometry.lines_per_set = l2_lines_per_set;
+  config.l2_replacement_policy = l2_policy;
+  config.l1_replacement_policy = l1_policy;
+  workload_config.random = WORKLOAD_RANDOM_XOSHIRO;
+  snprintf(test, sizeof(test), "Restoring with %u-way L2 (%s) and L1 (%s)", l2_lines_per_set,
+	   replacement_policy_name(l2_policy), replacement_policy_name(l1_policy));
+  printf("%s\n", test);
+
+  WORKLOAD *workload = workload_create(&workload_config);
+  ms[0] = memory_subsystem_create_with_config(&config);
+  run(ms, 1, workload, test);
+  if (memory_subsystem_save_r(ms[0], path) != 0) {
+    printf("Error: %s, could not save a checkpoint to %s\n", test, path);
+    exit(1);
+  }
+
+  //The first restored subsystem carries on along with the one saved;
+  //the second then does the same on its own.
+  ms[1] = memory_subsystem_restore(path);
+  MEMORY_SUBSYSTEM *second = memory_subsystem_restore(path);
+  if (!ms[1] || !second) {
+    printf("Error: %s, could not restore the checkpoint\n", test);
+    exit(1);
+  }
+  check_stats(ms[0], ms[1], test);
+  run(ms, 2, workload, test);
+  check_stats(ms[0], ms[1], test);
+
+  //The same accesses, made of the second after the first has written
+  //to its memory.
+  WORKLOAD *again = workload_create(&workload_config);
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE];
+    uint8_t controls[BATCH_SIZE];
+    workload_generate(again, addresses, write_data, controls, BATCH_SIZE);
+  }
+  run(&second, 1, again, test);
+  check_stats(ms[0], second, test);
+
+  workload_destroy(workload);
+  workload_destroy(again);
+  memory_subsystem_destroy(ms[0]);
+  memory_subsystem_destroy(ms[1]);
+  memory_subsystem_destroy(second);
+}
+
+static void check_word(MEMORY_SUBSYSTEM *ms, uint64_t address, uint64_t expected, const char *test)
+{
+  uint64_t read_data;
+  memory_access_r(ms, address, 0, READ_ENABLE_MASK, &read_data);
+  if (read_data != expected) {
+    printf("Error: %s, address %llx holds %llu, should be %llu\n", test, address, read_data, expected);
+    exit(1);
+  }
+}
+
+static void test_sparse()
+{
+  uint64_t addresses[] = {0, (uint64_t) 1 << 40, MAIN_MEMORY_FULL_SIZE - 8};
+  int num_addresses = sizeof(addresses) / sizeof(addresses[0]);
+  struct stat file_status;
+
+  printf("Saving a sparse main memory\n");
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_FULL_SIZE);
+  for (int i = 0; i < num_addresses; i++)
+    memory_access_r(ms, addresses[i], 1000 + i, WRITE_ENABLE_MASK, NULL);
+  memory_subsystem_flush_r(ms);
+  if (memory_subsystem_save_r(ms, path) != 0 || stat(path, &file_status) != 0) {
+    printf("Error: Could not save a checkpoint to %s\n", path);
+    exit(1);
+  }
+  //The caches take up about 2.4MB, and main memory three 4KB blocks.
+  if ((uint64_t) file_status.st_blocks * 512 > 3 << 20) {
+    printf("Error: The checkpoint of a nearly empty memory takes up %llu bytes\n", (uint64_t) file_status.st_blocks * 512);
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+
+  MEMORY_SUBSYSTEM *restored = memory_subsystem_restore(path);
+  if (!restored) {
+    printf("Error: Could not restore the checkpoint of a sparse memory\n");
+    exit(1);
+  }
+  //Replacing the checkpoint leaves the subsystem restored from it alone.
+  ms = memory_subsystem_create(MAIN_MEMORY_FULL_SIZE);
+  memory_access_r(ms, addresses[0], 5, WRITE_ENABLE_MASK, NULL);
+  memory_subsystem_save_r(ms, path);
+  memory_subsystem_destroy(ms);
+  for (int i = 0; i < num_addresses; i++)
+    check_word(restored, addresses[i], 1000 + i, "Sparse memory restored");
+  check_word(restored, (uint64_t) 1 << 30, 0, "Sparse memory restored");
+
+  //What was saved from main memory, not the caches, is there too.
+  MEMORY_SUBSYSTEM *cold = memory_subsystem_create(MAIN_MEMORY_FULL_SIZE);
+  for (uint64_t address = 0; address < (4 << 20); address += 8)
+    memory_access_r(cold, address, address, WRITE_ENABLE_MASK, NULL);
+  memory_subsystem_save_r(cold, path);
+  memory_subsystem_destroy(cold);
+  memory_subsystem_destroy(restored);
+  restored = memory_subsystem_restore(path);
+  for (uint64_t address = 0; address < (4 << 20); address += 4096 + 8)
+    check_word(restored, address, address, "Main memory restored");
+  memory_subsystem_destroy(restored);
+}
+
+static void test_invalid()
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  struct stat file_status;
+
+  printf("Refusing what is not a checkpoint\n");
+  if (memory_subsystem_restore("/nonexistent/checkpoint")) {
+    printf("Error: Restored a checkpoint that does not exist\n");
+    exit(1);
+  }
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  if (memory_subsystem_save_r(ms, "/nonexistent/checkpoint") != -1) {
+    printf("Error: Saved a checkpoint where there is no directory\n");
+    exit(1);
+  }
+  memory_access_r(ms, 0, 1, WRITE_ENABLE_MASK, NULL);
+  memory_subsystem_flush_r(ms);
+  memory_subsystem_save_r(ms, path);
+  memory_subsystem_destroy(ms);
+
+  //A checkpoint cut short loses its main memory.
+  stat(path, &file_status);
+  if (truncate(path, file_status.st_size - 4096) != 0 || memory_subsystem_restore(path)) {
+    printf("Error: Restored a checkpoint that was cut short\n");
+    exit(1);
+  }
+  FILE *file = fopen(path, "wb");
+  fprintf(file, "This is not a checkpoint, although it is long enough to hold the header of one.\n");
+  fclose(file);
+  if (memory_subsystem_restore(path)) {
+    printf("Error: Restored a file that is not a checkpoint\n");
+    exit(1);
+  }
+
+  //A main memory that is a file is saved in the file instead.
+  config.main_memory_file = path;
+  ms = memory_subsystem_create_with_config(&config);
+  if (!ms || memory_subsystem_save_r(ms, path) != -1) {
+    printf("Error: Saved a checkpoint of a main memory that is a file\n");
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_checkpoint_%d", (int) getpid());
+  test_carry_on(1, REPLACEMENT_DEFAULT, REPLACEMENT_DEFAULT);
+  test_carry_on(4, REPLACEMENT_NRU, REPLACEMENT_BRRIP);
+  test_carry_on(8, REPLACEMENT_SRRIP, REPLACEMENT_TREE_PLRU);
+  test_sparse();
+  test_invalid();
+  unlink(path);
+  printf("Passed\n");
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Checks fast-forwarding: that a subsystem that fast-forwards through
+// part of a workload reads exactly the data one simulating it in full
+// does, through the whole workload, and counts nothing while it
+// fast-forwards; that warming the caches up with every access made
+// fast-forwarding leaves them exactly as simulating those accesses
+// would, with several cache shapes and replacement policies; that
+// warming with only some of them helps; and that block accesses
+// fast-forward too.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<19)
+#define BATCH_SIZE 4096
+
+//Makes NUM_ACCESSES accesses of the workload, a batch at a time with a
+//clock interrupt after each, of every one of the num_subsystems
+//subsystems, checking that they all read the same data.
+static void run(MEMORY_SUBSYSTEM *ms[], int num_subsystems, WORKLOAD *workload, const char *test)
+{
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE];
+  uint64_t expected[BATCH_SIZE], read_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+    for (int m = 0; m < num_subsystems; m++) {
+      memory_access_batch_r(ms[m], addresses, write_data, controls, m ? read_data : expected, NULL, BATCH_SIZE);
+      memory_handle_clock_interrupt_r(ms[m]);
+      for (int j = 0; m && j < BATCH_SIZE; j++) {
+	if ((controls[j] & READ_ENABLE_MASK) && read_data[j] != expected[j]) {
+	  printf("Error: %s, subsystem %d read %llu from %llx, should be %llu\n", test, m,
+		 read_data[j], addresses[j], expected[j]);
+	  exit(1);
+	}
+      }
+    }
+  }
+}
+
+//Generates num_phases * NUM_ACCESSES accesses of the workload, without
+//making them of anything.
+static void skip(WORKLOAD *workload, int num_phases)
+{
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+
+  for (uint64_t i = 0; i < num_phases * (uint64_t) NUM_ACCESSES; i += BATCH_SIZE)
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+}
+
+//Checks that the misses and writebacks counted by a and b since
+//a_before and b_before are the same.
+static void check_counted(MEMORY_SUBSYSTEM *a, MEMORY_SUBSYSTEM_STATS *a_before,
+			  MEMORY_SUBSYSTEM *b, MEMORY_SUBSYSTEM_STATS *b_before, const char *test)
+{
+  MEMORY_SUBSYSTEM_STATS a_after, b_after;
+  memory_get_stats_r(a, &a_after);
+  memory_get_stats_r(b, &b_after);
+  if (a_after.num_l1_misses - a_before->num_l1_misses != b_after.num_l1_misses - b_before->num_l1_misses ||
+      a_after.num_l2_misses - a_before->num_l2_misses != b_after.num_l2_misses - b_before->num_l2_misses ||
+      a_after.num_l1_writebacks - a_before->num_l1_writebacks != b_after.num_l1_writebacks - b_before->num_l1_writebacks ||
+      a_after.num_l2_writebacks - a_before->num_l2_writebacks != b_after.num_l2_writebacks - b_before->num_l2_writebacks) {
+    printf("Error: %s, counted %llu L1 misses and %llu L2 misses, should be %llu and %llu\n", test,
+	   b_after.num_l1_misses - b_before->num_l1_misses, b_after.num_l2_misses - b_before->num_l2_misses,
+	   a_after.num_l1_misses - a_before->num_l1_misses, a_after.num_l2_misses - a_before->num_l2_misses);
+    exit(1);
+  }
+}
+
+//Runs three phases of a workload on a subsystem simulated in full and
+//on one that fast-forwards through the second, warming up with every
+//access of it. After the second phase, the second subsystem's caches
+//should be those of a third, which simulates the second phase alone,
+//from empty caches; so the third phase should count the same on both.
+static void test_warm_exactly(uint32_t l2_lines_per_set, REPLACEMENT_POLICY l2_policy, REPLACEMENT_POLICY l1_policy)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG workload_config = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS before, alone_before;
+  MEMORY_SUBSYSTEM *ms[2], *alone[1];
+  char test[128];
+
+  config.l2_geometry.lines_per_set = l2_lines_per_set;
+  config.l2_replacement_policy = l2_policy;
+  config.l1_replacement_policy = l1_policy;
+  workload_config.random = WORKLOAD_RANDOM_XOSHIRO;
+  snprintf(test, sizeof(test), "Fast-forwarding with %u-way L2 (%s) and L1 (%s)", l2_lines_per_set,
+	   replacement_policy_name(l2_policy), replacement_policy_name(l1_policy));
+  printf("%s\n", test);
+
+  WORKLOAD *workload = workload_create(&workload_config);
+  WORKLOAD *second_phase = workload_create(&workload_config);
+  ms[0] = memory_subsystem_create_with_config(&config);
+  ms[1] = memory_subsystem_create_with_config(&config);
+  alone[0] = memory_subsystem_create_with_config(&config);
+  run(ms, 2, workload, test);
+  skip(second_phase, 1);
+  run(alone, 1, second_phase, test);
+
+  memory_get_stats_r(ms[1], &before);
+  if (memory_start_fast_forward_r(ms[1], NUM_ACCESSES + NUM_ACCESSES / BATCH_SIZE) != 0 ||
+      memory_start_fast_forward_r(ms[1], 1) != -1) {
+    printf("Error: %s, could not start fast-forwarding just once\n", test);
+    exit(1);
+  }
+  run(ms, 2, workload, test);
+  check_counted(ms[1], &before, ms[1], &before, test);
+  memory_stop_fast_forward_r(ms[1]);
+  memory_stop_fast_forward_r(ms[1]);
+  check_counted(ms[1], &before, ms[1], &before, test);
+
+  //The third phase, of the subsystem that simulated the second alone
+  //too. The data it reads is not the same (it never made the first
+  //phase's writes), but what it counts should be.
+  memory_get_stats_r(alone[0], &alone_before);
+  memory_get_stats_r(ms[1], &before);
+  run(ms, 2, workload, test);
+  run(alone, 1, second_phase, test);
+  check_counted(alone[0], &alone_before, ms[1], &before, test);
+
+  workload_destroy(workload);
+  workload_destroy(second_phase);
+  memory_subsystem_destroy(ms[0]);
+  memory_subsystem_destroy(ms[1]);
+  memory_subsystem_destroy(alone[0]);
+}
+
+//Fast-forwards through the second of three phases of a workload,
+//warming up with the last num_warming accesses, and returns the L1
+//misses counted in the third.
+static uint64_t third_phase_misses(uint64_t num_warming)
+{
+  WORKLOAD_CONFIG workload_config = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS stats;
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  workload_config.random = WORKLOAD_RANDOM_XOSHIRO;
+  WORKLOAD *workload = workload_create(&workload_config);
+  run(&ms, 1, workload, "Warming partly");
+  memory_start_fast_forward_r(ms, num_warming);
+  run(&ms, 1, workload, "Warming partly");
+  memory_stop_fast_forward_r(ms);
+  memory_reset_stats_r(ms);
+  run(&ms, 1, workload, "Warming partly");
+  memory_get_stats_r(ms, &stats);
+  workload_destroy(workload);
+  memory_subsystem_destroy(ms);
+  return stats.num_l1_misses;
+}
+
+static void test_warm_partly()
+{
+  printf("Warming up with only the last accesses\n");
+  uint64_t cold = third_phase_misses(0);
+  uint64_t warm = third_phase_misses(1 << 14);
+  uint64_t warmest = third_phase_misses(NUM_ACCESSES);
+  if (!(warmest <= warm && warm < cold)) {
+    printf("Error: Warming up gave %llu, %llu and %llu L1 misses, should be fewer with more warming\n",
+	   cold, warm, warmest);
+    exit(1);
+  }
+}
+
+static void test_blocks()
+{
+  uint64_t block[100], read_back[100];
+  uint64_t read_data;
+  MEMORY_SUBSYSTEM_STATS stats;
+
+  printf("Fast-forwarding block accesses\n");
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  for (int i = 0; i < 100; i++)
+    block[i] = 5000 + i;
+  memory_write_block_r(ms, 0x1008, sizeof(block), block);
+  memory_access_r(ms, 0x2000, 77, WRITE_ENABLE_MASK, NULL);
+  memory_reset_stats_r(ms);
+
+  //What was still dirty in the caches is in main memory for fast-forwarding.
+  memory_start_fast_forward_r(ms, 0);
+  memory_read_block_r(ms, 0x1008, sizeof(read_back), read_back);
+  memory_access_r(ms, 0x2000, 0, READ_ENABLE_MASK, &read_data);
+  if (memcmp(block, read_back, sizeof(block)) != 0 || read_data != 77) {
+    printf("Error: Fast-forwarding did not read what was in the caches\n");
+    exit(1);
+  }
+  for (int i = 0; i < 100; i++)
+    block[i] = 9000 + i;
+  memory_write_block_r(ms, 0x1100, sizeof(block), block);
+  memory_stop_fast_forward_r(ms);
+
+  memory_read_block_r(ms, 0x1100, sizeof(read_back), read_back);
+  memory_get_stats_r(ms, &stats);
+  if (memcmp(block, read_back, sizeof(block)) != 0 || stats.num_l1_misses == 0) {
+    printf("Error: Block written fast-forwarding read back wrong\n");
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+}
+
+int main()
+{
+  test_warm_exactly(1, REPLACEMENT_DEFAULT, REPLACEMENT_DEFAULT);
+  test_warm_exactly(4, REPLACEMENT_NRU, REPLACEMENT_BRRIP);
+  test_warm_exactly(8, REPLACEMENT_SRRIP, REPLACEMENT_TREE_PLRU);
+  test_warm_partly();
+  test_blocks();
+  printf("Passed\n");
+}
@@ -0,0 +1,114 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "l1_cache.h"
+
+// Checks L1 caches of several geometries: a cache should hold exactly
+// size_in_bytes of data, every line should be found again after it is
+// inserted, and a dirty line should be written back to the address it
+// came from.
+
+static void test_geometry(L1_GEOMETRY geometry)
+{
+  uint64_t words_per_line = geometry.bytes_per_line / BYTES_PER_WORD;
+  uint64_t *write_data = (uint64_t *)malloc(geometry.bytes_per_line);
+  uint64_t *evicted_writeback_data = (uint64_t *)malloc(geometry.bytes_per_line);
+  uint64_t evicted_writeback_address;
+  uint64_t read_data;
+  uint8_t status;
+  uint64_t address, j;
+
+  printf("Testing %llu bytes, %u lines per set, %u bytes per line\n",
+	 geometry.size_in_bytes, geometry.lines_per_set, geometry.bytes_per_line);
+
+  L1_CACHE *l1 = l1_create_with_geometry(&geometry);
+  if (!l1) {
+    printf("Error: Could not create the L1 cache\n");
+    exit(1);
+  }
+
+  //Pass 1: fill the cache, writing the address into each word.
+  for(address = 0; address < geometry.size_in_bytes; address += geometry.bytes_per_line) {
+    l1_cache_access_r(l1, address, 0, READ_ENABLE_MASK, &read_data, &status);
+    if (status & 0x1) {
+      printf("Error: Hit on address %llx in an empty cache\n", address);
+      exit(1);
+    }
+    for(j = 0; j < words_per_line; j++)
+      write_data[j] = 0;
+    l1_insert_line_r(l1, address, write_data, &evicted_writeback_address,
+		     evicted_writeback_data, &status);
+    if (status & 0x1) {
+      printf("Error: Writeback while filling an empty cache\n");
+      exit(1);
+    }
+    for(j = 0; j < words_per_line; j++)
+      l1_cache_access_r(l1, address + (j << 3), address + (j << 3), WRITE_ENABLE_MASK, NULL, &status);
+  }
+
+  //Pass 2: every word should now hit, with the value written to it.
+  for(address = 0; address < geometry.size_in_bytes; address += BYTES_PER_WORD) {
+    l1_cache_access_r(l1, address, 0, READ_ENABLE_MASK, &read_data, &status);
+    if (!(status & 0x1) || read_data != address) {
+      printf("Error: Address %llx should hold %llx\n", address, address);
+      exit(1);
+    }
+  }
+
+  //Pass 3: inserting the lines one cache size further on (and writing
+  //to each, so that NRU prefers the older lines) should evict every
+  //line from Pass 1, each written back to its own address.
+  l1_clear_r_bits_r(l1);
+  for(address = 0; address < geometry.size_in_bytes; address += geometry.bytes_per_line) {
+    l1_insert_line_r(l1, address + geometry.size_in_bytes, write_data,
+		     &evicted_writeback_address, evicted_writeback_data, &status);
+    if (!(status & 0x1)) {
+      printf("Error: No writeback when evicting a dirty line\n");
+      exit(1);
+    }
+    if (evicted_writeback_data[0] != evicted_writeback_address ||
+	evicted_writeback_address >= geometry.size_in_bytes) {
+      printf("Error: Line written back to address %llx holds data from %llx\n",
+	     evicted_writeback_address, evicted_writeback_data[0]);
+      exit(1);
+    }
+    l1_cache_access_r(l1, address + geometry.size_in_bytes, 0, WRITE_ENABLE_MASK, NULL, &status);
+  }
+
+  l1_destroy(l1);
+  free(write_data);
+  free(evicted_writeback_data);
+}
+
+int main()
+{
+  L1_GEOMETRY valid[] = {
+    L1_DEFAULT_GEOMETRY,
+    {4 * 1024, 1, 64},
+    {32 * 1024, 8, 64},
+    {128 * 1024, 16, 32},
+    {1024 * 1024, 4, 256},
+  };
+  L1_GEOMETRY invalid[] = {
+    {64 * 1024, 4, 48},     // line size not a power of two
+    {64 * 1024, 4, 4},      // line smaller than a word
+    {96 * 1024, 4, 64},     // number of sets not a power of two
+    {64 * 1024, 0, 64},     // no lines per set
+  };
+
+  for (int i = 0; i < (int) (sizeof(valid) / sizeof(valid[0])); i++)
+    test_geometry(valid[i]);
+
+  printf("Testing that invalid geometries are rejected\n");
+  for (int i = 0; i < (int) (sizeof(invalid) / sizeof(invalid[0])); i++) {
+    if (l1_create_with_geometry(&invalid[i])) {
+      printf("Error: Geometry %d should have been rejected\n", i);
+      exit(1);
+    }
+  }
+
+  printf("Passed\n");
+}
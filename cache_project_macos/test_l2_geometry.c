@@ -0,0 +1,88 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "l2_cache.h"
+
+// Checks set-associative L2 caches: a cache should hold exactly
+// size_in_bytes of data, a full set should evict its least recently
+// used line, and a dirty line should be written back to its own address.
+
+#define L2_SIZE_IN_BYTES (256 * 1024)
+
+static void test_lines_per_set(uint32_t lines_per_set)
+{
+  L2_GEOMETRY geometry = {L2_SIZE_IN_BYTES, lines_per_set, BYTES_PER_CACHE_LINE};
+  uint64_t num_sets = L2_SIZE_IN_BYTES / (lines_per_set * BYTES_PER_CACHE_LINE);
+  uint64_t set_stride = num_sets * BYTES_PER_CACHE_LINE;  // addresses this far apart share a set
+  uint64_t read_data[WORDS_PER_CACHE_LINE];
+  uint64_t write_data[WORDS_PER_CACHE_LINE];
+  uint64_t evicted_writeback_data[WORDS_PER_CACHE_LINE];
+  uint64_t evicted_writeback_address;
+  uint8_t status;
+  uint64_t address, j;
+
+  printf("Testing %u lines per set\n", lines_per_set);
+
+  L2_CACHE *l2 = l2_create_with_geometry(&geometry);
+  if (!l2) {
+    printf("Error: Could not create the L2 cache\n");
+    exit(1);
+  }
+
+  //Pass 1: fill the cache with dirty lines holding their own address.
+  for(address = 0; address < L2_SIZE_IN_BYTES; address += BYTES_PER_CACHE_LINE) {
+    for(j = 0; j < WORDS_PER_CACHE_LINE; j++)
+      write_data[j] = address;
+    l2_insert_line_r(l2, address, write_data, &evicted_writeback_address,
+		     evicted_writeback_data, &status);
+    if (status & 0x1) {
+      printf("Error: Writeback while filling an empty cache\n");
+      exit(1);
+    }
+    l2_cache_access_r(l2, address, write_data, WRITE_ENABLE_MASK, NULL, &status);
+  }
+
+  //Pass 2: every line should still be there.
+  for(address = 0; address < L2_SIZE_IN_BYTES; address += BYTES_PER_CACHE_LINE) {
+    l2_cache_access_r(l2, address, NULL, READ_ENABLE_MASK, read_data, &status);
+    if (!(status & 0x1) || read_data[0] != address) {
+      printf("Error: Line at address %llx is missing or wrong\n", address);
+      exit(1);
+    }
+  }
+
+  //Pass 3: in set 0, touch every line except the first way's, then insert
+  //a new line. The untouched line is the least recently used, so it is
+  //the one evicted (and written back, being dirty).
+  for(j = 1; j < lines_per_set; j++) {
+    l2_cache_access_r(l2, j * set_stride, NULL, READ_ENABLE_MASK, read_data, &status);
+  }
+  l2_insert_line_r(l2, lines_per_set * set_stride, write_data, &evicted_writeback_address,
+		   evicted_writeback_data, &status);
+  if (!(status & 0x1) || evicted_writeback_address != 0 || evicted_writeback_data[0] != 0) {
+    printf("Error: The least recently used line (address 0) should have been written back\n");
+    exit(1);
+  }
+  for(j = 1; j <= lines_per_set; j++) {
+    l2_cache_access_r(l2, j * set_stride, NULL, READ_ENABLE_MASK, read_data, &status);
+    if (!(status & 0x1)) {
+      printf("Error: Line at address %llx should not have been evicted\n", j * set_stride);
+      exit(1);
+    }
+  }
+
+  l2_destroy(l2);
+}
+
+int main()
+{
+  uint32_t lines_per_set;
+
+  for (lines_per_set = 1; lines_per_set <= 16; lines_per_set <<= 1)
+    test_lines_per_set(lines_per_set);
+
+  printf("Passed\n");
+}
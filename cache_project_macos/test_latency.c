@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+#include "latency.h"
+
+// Checks the latency model: that every access is counted by its
+// outcome, the same way whether it is made alone, in a batch or in a
+// block, and in agreement with the misses and writebacks counted;
+// that a report of a few accesses worked out by hand gives their
+// cycles, stall cycles and histogram; and that latencies are read
+// from strings.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<19)
+#define BATCH_SIZE 4096
+
+//Checks that the outcomes add up to the accesses, misses and
+//writebacks counted.
+static void check_outcomes(MEMORY_SUBSYSTEM_STATS *stats, uint64_t num_accesses, const char *test)
+{
+  uint64_t accesses = 0, l1_misses = 0, l2_misses = 0, l1_writebacks = 0, l2_writebacks = 0;
+
+  for (int level = MEMORY_HIT_L1; level <= MEMORY_HIT_MAIN_MEMORY; level++) {
+    for (int l1 = 0; l1 <= 1; l1++) {
+      for (int l2 = 0; l2 <= 2; l2++) {
+	uint64_t n = stats->num_accesses_by_outcome[MEMORY_OUTCOME(level, l1, l2)];
+	accesses += n;
+	l1_misses += level >= MEMORY_HIT_L2 ? n : 0;
+	l2_misses += level == MEMORY_HIT_MAIN_MEMORY ? n : 0;
+	l1_writebacks += l1 * n;
+	l2_writebacks += l2 * n;
+      }
+    }
+  }
+  if (accesses != num_accesses || l1_misses != stats->num_l1_misses || l2_misses != stats->num_l2_misses ||
+      l1_writebacks != stats->num_l1_writebacks || l2_writebacks != stats->num_l2_writebacks) {
+    printf("Error: %s, the outcomes add up to %llu accesses, %llu and %llu misses and %llu and %llu writebacks, "
+	   "should be %llu, %llu, %llu, %llu and %llu\n", test, accesses, l1_misses, l2_misses, l1_writebacks,
+	   l2_writebacks, num_accesses, stats->num_l1_misses, stats->num_l2_misses, stats->num_l1_writebacks,
+	   stats->num_l2_writebacks);
+    exit(1);
+  }
+}
+
+//Makes the accesses of a Pass 4 workload one at a time, in batches
+//and as blocks of the words of each line, on three subsystems, which
+//should count exactly the same.
+static void test_outcomes(uint32_t l2_lines_per_set)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG workload_config = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE], read_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+  MEMORY_SUBSYSTEM_STATS one, batch, block;
+  char test[128];
+
+  config.l2_geometry.lines_per_set = l2_lines_per_set;
+  workload_config.random = WORKLOAD_RANDOM_XOSHIRO;
+  snprintf(test, sizeof(test), "Counting outcomes with %u-way L2", l2_lines_per_set);
+  printf("%s\n", test);
+  WORKLOAD *workload = workload_create(&workload_config);
+  MEMORY_SUBSYSTEM *ms[3];
+  for (int m = 0; m < 3; m++)
+    ms[m] = memory_subsystem_create_with_config(&config);
+
+  for (uint64_t i = 0; i < NUM_ACCESSES; i += BATCH_SIZE) {
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+    for (int j = 0; j < BATCH_SIZE; j++)
+      memory_access_r(ms[0], addresses[j], write_data[j], controls[j], &read_data[j]);
+    memory_access_batch_r(ms[1], addresses, write_data, controls, read_data, NULL, BATCH_SIZE);
+    //A run of writes to the same line is one block.
+    for (int j = 0, k; j < BATCH_SIZE; j = k) {
+      for (k = j + 1; k < BATCH_SIZE && controls[k] == controls[j] && addresses[k] == addresses[k - 1] + 8 &&
+	     (addresses[k] & (BYTES_PER_CACHE_LINE - 1)); k++)
+	;
+      if (controls[j] & WRITE_ENABLE_MASK)
+	memory_write_block_r(ms[2], addresses[j], (k - j) * 8, &write_data[j]);
+      else
+	memory_read_block_r(ms[2], addresses[j], (k - j) * 8, &read_data[j]);
+    }
+    for (int m = 0; m < 3; m++)
+      memory_handle_clock_interrupt_r(ms[m]);
+  }
+
+  memory_get_stats_r(ms[0], &one);
+  memory_get_stats_r(ms[1], &batch);
+  memory_get_stats_r(ms[2], &block);
+  check_outcomes(&one, NUM_ACCESSES, test);
+  if (memcmp(&one, &batch, sizeof(one)) != 0 || memcmp(&one, &block, sizeof(one)) != 0) {
+    printf("Error: %s, batches or blocks counted different outcomes\n", test);
+    exit(1);
+  }
+  if (one.num_l1_writebacks == 0 || one.num_l2_writebacks == 0) {
+    printf("Error: %s, the workload should write back from both caches\n", test);
+    exit(1);
+  }
+  workload_destroy(workload);
+  for (int m = 0; m < 3; m++)
+    memory_subsystem_destroy(ms[m]);
+}
+
+static void check_value(uint64_t value, uint64_t expected, const char *name)
+{
+  if (value != expected) {
+    printf("Error: %s is %llu, should be %llu\n", name, value, expected);
+    exit(1);
+  }
+}
+
+//A few accesses of the default caches (L1 of 256 sets, 4 ways and
+//NRU, L2 direct-mapped with 32768 sets), with latencies that tell
+//apart what each access cost.
+static void test_by_hand()
+{
+  LATENCY_CONFIG latencies = {1, 10, 100, 1000, 10000};
+  LATENCY_REPORT report;
+  MEMORY_SUBSYSTEM_STATS stats;
+  uint64_t read_data;
+
+  printf("Reporting the cycles of a few accesses\n");
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  memory_access_r(ms, 0, 0, READ_ENABLE_MASK, &read_data);    // 111, from main memory
+  memory_access_r(ms, 0, 5, WRITE_ENABLE_MASK, NULL);         // 1
+  memory_handle_clock_interrupt_r(ms);
+  //Three more lines in L1 set 0, and then a fourth, which evicts the
+  //dirty line 0, the only one not used since the interrupt, into L2.
+  for (uint64_t address = 16 << 10; address <= 48 << 10; address += 16 << 10)
+    memory_access_r(ms, address, 0, READ_ENABLE_MASK, &read_data);   // 111 each
+  memory_access_r(ms, 64 << 10, 0, READ_ENABLE_MASK, &read_data);    // 1111
+  //A line in L2 set 0 too, which writes line 0 back to main memory.
+  memory_access_r(ms, 2 << 20, 0, READ_ENABLE_MASK, &read_data);     // 10111
+  memory_access_r(ms, 2 << 20, 0, READ_ENABLE_MASK, &read_data);     // 1
+
+  memory_get_stats_r(ms, &stats);
+  latency_report(&latencies, &stats, &report);
+  check_value(report.num_accesses, 8, "The number of accesses");
+  check_value(report.num_cycles, 2 + 4 * 111 + 1111 + 10111, "The number of cycles");
+  check_value(report.l1_cycles, 8, "The cycles in L1");
+  check_value(report.l2_stall_cycles, 6 * 10, "The stall cycles in L2");
+  check_value(report.main_memory_stall_cycles, 6 * 100, "The stall cycles in main memory");
+  check_value(report.l1_writeback_stall_cycles, 1000, "The stall cycles writing back from L1");
+  check_value(report.l2_writeback_stall_cycles, 10000, "The stall cycles writing back from L2");
+  if (report.average_cycles != (2 + 4 * 111 + 1111 + 10111) / 8.0) {
+    printf("Error: The average memory access time is %g\n", report.average_cycles);
+    exit(1);
+  }
+  LATENCY_BUCKET buckets[] = {{1, 2}, {111, 4}, {1111, 1}, {10111, 1}};
+  if (report.num_buckets != 4 || memcmp(report.buckets, buckets, sizeof(buckets)) != 0) {
+    printf("Error: The latency histogram has %d buckets, should be 1: 2, 111: 4, 1111: 1 and 10111: 1\n",
+	   report.num_buckets);
+    exit(1);
+  }
+
+  //Outcomes that take as long share a bucket.
+  LATENCY_CONFIG free_writebacks = {1, 10, 100, 0, 0};
+  latency_report(&free_writebacks, &stats, &report);
+  if (report.num_buckets != 2 || report.buckets[1].cycles != 111 || report.buckets[1].num_accesses != 6) {
+    printf("Error: Accesses that took as long are not in the same bucket\n");
+    exit(1);
+  }
+
+  memory_reset_stats_r(ms);
+  memory_get_stats_r(ms, &stats);
+  latency_report(&latencies, &stats, &report);
+  if (report.num_accesses != 0 || report.num_buckets != 0 || report.average_cycles != 0) {
+    printf("Error: A report of no accesses is not empty\n");
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+}
+
+static void test_strings()
+{
+  LATENCY_CONFIG latencies = LATENCY_DEFAULT_CONFIG, expected = {3, 9, 150, 0, 25};
+  const char *invalid[] = {"", "3,9,150,0", "3,9,150,0,25,1", "3,9,150,0,25x", "3,9,-150,0,25", "fast"};
+
+  printf("Reading latencies from strings\n");
+  if (latency_config_from_string("3,9,150,0,25", &latencies) != 0 ||
+      memcmp(&latencies, &expected, sizeof(latencies)) != 0) {
+    printf("Error: Could not read 3,9,150,0,25\n");
+    exit(1);
+  }
+  for (int i = 0; i < (int) (sizeof(invalid) / sizeof(invalid[0])); i++) {
+    if (latency_config_from_string(invalid[i], &latencies) != -1 ||
+	memcmp(&latencies, &expected, sizeof(latencies)) != 0) {
+      printf("Error: Read latencies from \"%s\"\n", invalid[i]);
+      exit(1);
+    }
+  }
+}
+
+int main()
+{
+  test_outcomes(1);
+  test_outcomes(8);
+  test_by_hand();
+  test_strings();
+  printf("Passed\n");
+}
@@ -0,0 +1,146 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+
+// Checks that memory_access_batch_r() leaves a memory subsystem in
+// exactly the state that the same accesses made one at a time with
+// memory_access_r() do: the same statistics, the same values read,
+// and afterwards the same contents. Also checks that the hit levels
+// it reports agree with the miss counts.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<22)
+#define INTERRUPT_INTERVAL 0x2000
+
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void check_stats(MEMORY_SUBSYSTEM *one, MEMORY_SUBSYSTEM *batch, const char *when)
+{
+  MEMORY_SUBSYSTEM_STATS a, b;
+  memory_get_stats_r(one, &a);
+  memory_get_stats_r(batch, &b);
+  if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+      a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks) {
+    printf("Error: %s, statistics differ (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   when, a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+    exit(1);
+  }
+}
+
+int main()
+{
+  MEMORY_SUBSYSTEM *one = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *batch = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  uint64_t *addresses = (uint64_t *)malloc(NUM_ACCESSES * sizeof(uint64_t));
+  uint64_t *write_data = (uint64_t *)malloc(NUM_ACCESSES * sizeof(uint64_t));
+  uint64_t *read_data = (uint64_t *)calloc(NUM_ACCESSES, sizeof(uint64_t));
+  uint8_t *controls = (uint8_t *)malloc(NUM_ACCESSES);
+  uint8_t *hit_levels = (uint8_t *)malloc(NUM_ACCESSES);
+  uint64_t state = 12345;
+  uint64_t i;
+
+  if (!one || !batch || !addresses || !write_data || !read_data || !controls || !hit_levels) {
+    printf("Error: Allocation failed\n");
+    exit(1);
+  }
+
+  //Half the accesses are random, half are runs of consecutive words,
+  //so that all three levels are hit often.
+  printf("Generating %d accesses\n", NUM_ACCESSES);
+  for (i = 0; i < NUM_ACCESSES; ) {
+    uint64_t address = next_random(&state) % MAIN_MEMORY_SIZE_IN_BYTES & ~0x7;
+    uint64_t run = (next_random(&state) & 1) ? 1 : next_random(&state) % 64;
+    for (uint64_t j = 0; j < run && i < NUM_ACCESSES && address < MAIN_MEMORY_SIZE_IN_BYTES; j++, i++) {
+      addresses[i] = address;
+      write_data[i] = next_random(&state);
+      controls[i] = (next_random(&state) & 1) ? READ_ENABLE_MASK : WRITE_ENABLE_MASK;
+      address += BYTES_PER_WORD;
+    }
+  }
+
+  printf("Performing them one at a time\n");
+  uint64_t levels_seen[4] = {0};
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    uint64_t value = 0;
+    memory_access_r(one, addresses[i], write_data[i], controls[i], &value);
+    if (controls[i] & READ_ENABLE_MASK)
+      read_data[i] = value;
+    if (!((i + 1) % INTERRUPT_INTERVAL))
+      memory_handle_clock_interrupt_r(one);
+  }
+
+  //The batches end at each interrupt, and are also cut at odd places
+  //so that some are shorter than the look-ahead.
+  printf("Performing them in batches\n");
+  uint64_t *batch_read_data = (uint64_t *)calloc(NUM_ACCESSES, sizeof(uint64_t));
+  for (i = 0; i < NUM_ACCESSES; ) {
+    uint64_t to_interrupt = INTERRUPT_INTERVAL - i % INTERRUPT_INTERVAL;
+    uint64_t n = next_random(&state) % 3 ? to_interrupt : 1 + next_random(&state) % 13;
+    if (n > to_interrupt)
+      n = to_interrupt;
+    MEMORY_SUBSYSTEM_STATS before, after;
+    memory_get_stats_r(batch, &before);
+    memory_access_batch_r(batch, addresses + i, write_data + i, controls + i,
+			  batch_read_data + i, hit_levels + i, n);
+    memory_get_stats_r(batch, &after);
+
+    uint64_t l1_misses = 0, l2_misses = 0;
+    for (uint64_t j = i; j < i + n; j++) {
+      levels_seen[hit_levels[j]]++;
+      l1_misses += hit_levels[j] != MEMORY_HIT_L1;
+      l2_misses += hit_levels[j] == MEMORY_HIT_MAIN_MEMORY;
+    }
+    if (l1_misses != after.num_l1_misses - before.num_l1_misses ||
+	l2_misses != after.num_l2_misses - before.num_l2_misses) {
+      printf("Error: Hit levels of accesses %llu to %llu do not match the miss counts\n", i, i + n - 1);
+      exit(1);
+    }
+
+    i += n;
+    if (!(i % INTERRUPT_INTERVAL))
+      memory_handle_clock_interrupt_r(batch);
+  }
+  printf("L1 hits %llu, L2 hits %llu, main memory %llu\n",
+	 levels_seen[MEMORY_HIT_L1], levels_seen[MEMORY_HIT_L2], levels_seen[MEMORY_HIT_MAIN_MEMORY]);
+  if (!levels_seen[MEMORY_HIT_L1] || !levels_seen[MEMORY_HIT_L2] || !levels_seen[MEMORY_HIT_MAIN_MEMORY]) {
+    printf("Error: Some level was never reached\n");
+    exit(1);
+  }
+
+  check_stats(one, batch, "After the accesses");
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    if ((controls[i] & READ_ENABLE_MASK) && read_data[i] != batch_read_data[i]) {
+      printf("Error: Access %llu read %llx one at a time, %llx in a batch\n",
+	     i, read_data[i], batch_read_data[i]);
+      exit(1);
+    }
+  }
+
+  printf("Reading back every word\n");
+  for (uint64_t address = 0; address < MAIN_MEMORY_SIZE_IN_BYTES; address += BYTES_PER_WORD) {
+    uint64_t a, b;
+    memory_access_r(one, address, 0, READ_ENABLE_MASK, &a);
+    memory_access_r(batch, address, 0, READ_ENABLE_MASK, &b);
+    if (a != b) {
+      printf("Error: Address %llx holds %llx, should be %llx\n", address, b, a);
+      exit(1);
+    }
+  }
+  check_stats(one, batch, "After reading back");
+
+  memory_subsystem_destroy(one);
+  memory_subsystem_destroy(batch);
+  printf("Passed\n");
+}
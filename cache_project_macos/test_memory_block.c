@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+
+// Checks that memory_read_block_r() and memory_write_block_r() leave
+// a memory subsystem in exactly the state that the same words read
+// or written one at a time with memory_access_r() do: the same
+// statistics, the same values read, and afterwards the same contents.
+// The blocks start at any word, and have any length, so that they
+// begin and end part way through lines as well as covering whole ones.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_BLOCKS (1<<17)
+#define LONGEST_BLOCK 300          // in words
+#define INTERRUPT_INTERVAL 256     // in blocks
+
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void check_stats(MEMORY_SUBSYSTEM *one, MEMORY_SUBSYSTEM *block, const char *when)
+{
+  MEMORY_SUBSYSTEM_STATS a, b;
+  memory_get_stats_r(one, &a);
+  memory_get_stats_r(block, &b);
+  if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+      a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks) {
+    printf("Error: %s, statistics differ (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   when, a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+    exit(1);
+  }
+}
+
+int main()
+{
+  MEMORY_SUBSYSTEM *one = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *block = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  uint64_t data[LONGEST_BLOCK], one_data[LONGEST_BLOCK], block_data[LONGEST_BLOCK];
+  uint64_t state = 54321;
+  uint64_t i, j;
+
+  if (!one || !block) {
+    printf("Error: Allocation failed\n");
+    exit(1);
+  }
+
+  //Pass 1 of test_memory_subsystem.c, as one block.
+  printf("Writing every word in memory\n");
+  uint64_t *whole = (uint64_t *)malloc(MAIN_MEMORY_SIZE_IN_BYTES);
+  if (!whole) {
+    printf("Error: Allocation failed\n");
+    exit(1);
+  }
+  for (i = 0; i < MAIN_MEMORY_SIZE_IN_BYTES / BYTES_PER_WORD; i++) {
+    whole[i] = i;
+    memory_access_r(one, i * BYTES_PER_WORD, i, WRITE_ENABLE_MASK, NULL);
+  }
+  memory_write_block_r(block, 0, MAIN_MEMORY_SIZE_IN_BYTES, whole);
+  check_stats(one, block, "After writing every word");
+  free(whole);
+
+  //Half the blocks are made of whole lines, the rest start and end
+  //at any word.
+  printf("Reading and writing %d blocks\n", NUM_BLOCKS);
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    uint64_t num_words = next_random(&state) % LONGEST_BLOCK;
+    uint64_t address = next_random(&state) % (MAIN_MEMORY_SIZE_IN_BYTES - LONGEST_BLOCK * BYTES_PER_WORD) & ~0x7;
+    if (next_random(&state) & 1) {
+      address &= ~(uint64_t)(BYTES_PER_CACHE_LINE - 1);
+      num_words &= ~(uint64_t)(WORDS_PER_CACHE_LINE - 1);
+    }
+
+    if (next_random(&state) & 1) {
+      for (j = 0; j < num_words; j++) {
+	memory_access_r(one, address + j * BYTES_PER_WORD, 0, READ_ENABLE_MASK, &one_data[j]);
+      }
+      memory_read_block_r(block, address, num_words * BYTES_PER_WORD, block_data);
+      for (j = 0; j < num_words; j++) {
+	if (one_data[j] != block_data[j]) {
+	  printf("Error: Block %llu, word %llu read %llx, should be %llx\n", i, j, block_data[j], one_data[j]);
+	  exit(1);
+	}
+      }
+    } else {
+      for (j = 0; j < num_words; j++) {
+	data[j] = next_random(&state);
+	memory_access_r(one, address + j * BYTES_PER_WORD, data[j], WRITE_ENABLE_MASK, NULL);
+      }
+      memory_write_block_r(block, address, num_words * BYTES_PER_WORD, data);
+    }
+
+    if (!((i + 1) % INTERRUPT_INTERVAL)) {
+      memory_handle_clock_interrupt_r(one);
+      memory_handle_clock_interrupt_r(block);
+    }
+  }
+  check_stats(one, block, "After the blocks");
+
+  printf("Reading back every word\n");
+  for (uint64_t address = 0; address < MAIN_MEMORY_SIZE_IN_BYTES; address += BYTES_PER_WORD) {
+    uint64_t a, b;
+    memory_access_r(one, address, 0, READ_ENABLE_MASK, &a);
+    memory_access_r(block, address, 0, READ_ENABLE_MASK, &b);
+    if (a != b) {
+      printf("Error: Address %llx holds %llx, should be %llx\n", address, b, a);
+      exit(1);
+    }
+  }
+  check_stats(one, block, "After reading back");
+
+  memory_subsystem_destroy(one);
+  memory_subsystem_destroy(block);
+  printf("Passed\n");
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "main_memory.h"
+#include "memory_subsystem.h"
+
+// Checks main memories that are mappings of a file: that what is
+// written to a shared one is in the file when it is opened again, that
+// what is written to a private one is not, and that a memory subsystem
+// whose main memory is a file leaves everything that was written to
+// it, including what was still in the caches, in the file.
+
+#define MEMORY_SIZE_IN_BYTES (1<<22)
+#define NUM_WRITES 200000
+
+static char path[64];
+
+static void check_line(MAIN_MEMORY *memory, uint64_t address, uint64_t first, const char *test)
+{
+  uint64_t read_data[WORDS_PER_CACHE_LINE];
+  main_memory_access_r(memory, address, NULL, READ_ENABLE_MASK, read_data);
+  for (int j = 0; j < WORDS_PER_CACHE_LINE; j++) {
+    if (read_data[j] != first + j) {
+      printf("Error: %s, address %llx holds %llu, should be %llu\n", test, address + j * 8, read_data[j], first + j);
+      exit(1);
+    }
+  }
+}
+
+static void test_main_memory_file()
+{
+  uint64_t write_data[WORDS_PER_CACHE_LINE];
+  uint64_t address;
+  MAIN_MEMORY *memory;
+
+  printf("Writing a shared memory file\n");
+  memory = main_memory_create_from_file(path, MEMORY_SIZE_IN_BYTES, MAIN_MEMORY_FILE_SHARED);
+  if (!memory) {
+    printf("Error: Could not create %s\n", path);
+    exit(1);
+  }
+  for (address = 0; address < MEMORY_SIZE_IN_BYTES; address += BYTES_PER_CACHE_LINE) {
+    for (int j = 0; j < WORDS_PER_CACHE_LINE; j++)
+      write_data[j] = (address >> 3) + j;
+    main_memory_access_r(memory, address, write_data, WRITE_ENABLE_MASK, NULL);
+  }
+  main_memory_destroy(memory);
+
+  printf("Reading it back, and writing to a private mapping of it\n");
+  memory = main_memory_create_from_file(path, 0, MAIN_MEMORY_FILE_PRIVATE);
+  if (!memory || main_memory_allocated_bytes_r(memory) != MEMORY_SIZE_IN_BYTES) {
+    printf("Error: Could not open %s with its own size\n", path);
+    exit(1);
+  }
+  for (address = 0; address < MEMORY_SIZE_IN_BYTES; address += BYTES_PER_CACHE_LINE)
+    check_line(memory, address, address >> 3, "Reopened file");
+  for (int j = 0; j < WORDS_PER_CACHE_LINE; j++)
+    write_data[j] = 1000 + j;
+  main_memory_access_r(memory, 0, write_data, WRITE_ENABLE_MASK, NULL);
+  check_line(memory, 0, 1000, "Private write");
+  main_memory_destroy(memory);
+
+  memory = main_memory_create_from_file(path, 0, MAIN_MEMORY_FILE_SHARED);
+  check_line(memory, 0, 0, "After a private write");
+  main_memory_destroy(memory);
+
+  //A private mapping cannot grow the file, and sizes must be whole lines.
+  if (main_memory_create_from_file(path, 2 * MEMORY_SIZE_IN_BYTES, MAIN_MEMORY_FILE_PRIVATE) ||
+      main_memory_create_from_file(path, 100, MAIN_MEMORY_FILE_SHARED)) {
+    printf("Error: Invalid size accepted\n");
+    exit(1);
+  }
+}
+
+static void test_memory_subsystem_file()
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MEMORY_SIZE_IN_BYTES);
+  uint64_t *expected = (uint64_t *)calloc(MEMORY_SIZE_IN_BYTES / BYTES_PER_WORD, sizeof(uint64_t));
+  uint64_t state = 98765;
+  MEMORY_SUBSYSTEM *ms;
+  MEMORY_SUBSYSTEM_STATS before, after;
+
+  unlink(path);
+  config.main_memory_file = path;
+
+  printf("Writing through a memory subsystem whose main memory is a file\n");
+  ms = memory_subsystem_create_with_config(&config);
+  if (!ms || !expected) {
+    printf("Error: Could not create a memory subsystem using %s\n", path);
+    exit(1);
+  }
+  for (int i = 0; i < NUM_WRITES; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    uint64_t word = state % (MEMORY_SIZE_IN_BYTES / BYTES_PER_WORD);
+    expected[word] = state;
+    memory_access_r(ms, word * BYTES_PER_WORD, state, WRITE_ENABLE_MASK, NULL);
+
+    //Flushing part way through changes nothing that can be seen.
+    if (i == NUM_WRITES / 2) {
+      memory_get_stats_r(ms, &before);
+      memory_subsystem_flush_r(ms);
+      memory_get_stats_r(ms, &after);
+      if (before.num_l1_writebacks != after.num_l1_writebacks || before.num_l2_misses != after.num_l2_misses) {
+	printf("Error: Flushing changed the statistics\n");
+	exit(1);
+      }
+    }
+  }
+  memory_subsystem_destroy(ms);
+
+  printf("Checking the file, and reading it through a new memory subsystem\n");
+  MAIN_MEMORY *memory = main_memory_create_from_file(path, 0, MAIN_MEMORY_FILE_PRIVATE);
+  uint64_t read_data[WORDS_PER_CACHE_LINE];
+  for (uint64_t address = 0; address < MEMORY_SIZE_IN_BYTES; address += BYTES_PER_CACHE_LINE) {
+    main_memory_access_r(memory, address, NULL, READ_ENABLE_MASK, read_data);
+    for (int j = 0; j < WORDS_PER_CACHE_LINE; j++) {
+      if (read_data[j] != expected[(address >> 3) + j]) {
+	printf("Error: Word %llu of the file is %llu, should be %llu\n",
+	       (address >> 3) + j, read_data[j], expected[(address >> 3) + j]);
+	exit(1);
+      }
+    }
+  }
+  main_memory_destroy(memory);
+
+  config.main_memory_size_in_bytes = 0;
+  ms = memory_subsystem_create_with_config(&config);
+  for (uint64_t word = 0; word < MEMORY_SIZE_IN_BYTES / BYTES_PER_WORD; word++) {
+    uint64_t value;
+    memory_access_r(ms, word * BYTES_PER_WORD, 0, READ_ENABLE_MASK, &value);
+    if (value != expected[word]) {
+      printf("Error: Word %llu read %llu, should be %llu\n", word, value, expected[word]);
+      exit(1);
+    }
+  }
+  memory_subsystem_destroy(ms);
+  free(expected);
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_memory_file_%d.img", (int) getpid());
+  unlink(path);
+
+  test_main_memory_file();
+  test_memory_subsystem_file();
+
+  unlink(path);
+  printf("Passed\n");
+}
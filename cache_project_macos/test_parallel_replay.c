@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "workload.h"
+
+// Checks that replaying a trace split over several threads by cache
+// set gives exactly the statistics of replaying it on one, for plain
+// and compact traces, every number of threads up to 16, and (for a
+// compact trace) caches of several shapes and replacement policies,
+// and that the number of shards is limited by the number of sets and
+// by the policies.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_ACCESSES 400000         // per workload
+
+static char path[64];
+
+//Records a trace of several workloads, with interrupts at the start
+//and two in a row.
+static void record_trace(uint32_t flags)
+{
+  const char *names[] = {"runs", "zipf", "uniform", "chase", "strided"};
+  TRACE_RECORDER *recorder = trace_recorder_create(path, flags);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG config;
+
+  if (!recorder || !ms) {
+    printf("Error: Could not create %s\n", path);
+    exit(1);
+  }
+  memory_subsystem_set_recorder_r(ms, recorder);
+  memory_handle_clock_interrupt_r(ms);
+  for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+    workload_config_from_name(names[i], MAIN_MEMORY_SIZE_IN_BYTES, &config);
+    config.num_accesses = NUM_ACCESSES;
+    config.interrupt_interval = 5000 + i;
+    config.seed = i + 1;
+    WORKLOAD *workload = workload_create(&config);
+    workload_run_r(ms, workload);
+    workload_destroy(workload);
+    memory_handle_clock_interrupt_r(ms);
+    memory_handle_clock_interrupt_r(ms);
+  }
+  memory_subsystem_set_recorder_r(ms, NULL);
+  if (trace_recorder_destroy(recorder) != 0) {
+    printf("Error: Could not write %s\n", path);
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+}
+
+static void check_config(MEMORY_SUBSYSTEM_CONFIG *config, int max_shards, const char *test)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(config);
+  MEMORY_SUBSYSTEM_STATS a, b;
+  TRACE_REPLAY_STATS serial, parallel;
+
+  if (!ms || trace_replay_r(ms, path, &serial) != 0) {
+    printf("Error: %s, could not replay the trace\n", test);
+    exit(1);
+  }
+  memory_get_stats_r(ms, &a);
+  memory_subsystem_destroy(ms);
+
+  for (int num_threads = 1; num_threads <= 16; num_threads++) {
+    int num_shards = trace_replay_num_shards(config, num_threads);
+    int expected = 1;
+    while (expected * 2 <= num_threads && expected * 2 <= max_shards)
+      expected *= 2;
+    if (num_shards != expected) {
+      printf("Error: %s, %d shards on %d threads, should be %d\n", test, num_shards, num_threads, expected);
+      exit(1);
+    }
+    //Only the numbers of threads that change the number of shards
+    if (num_threads > 1 && num_shards == trace_replay_num_shards(config, num_threads - 1))
+      continue;
+
+    if (trace_replay_parallel(config, path, num_threads, &b, &parallel) != 0) {
+      printf("Error: %s, could not replay the trace on %d threads\n", test, num_threads);
+      exit(1);
+    }
+    if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+	a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks ||
+	serial.num_accesses != parallel.num_accesses || serial.num_interrupts != parallel.num_interrupts) {
+      printf("Error: %s, on %d threads the statistics differ (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	     test, num_threads, a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+      exit(1);
+    }
+  }
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_parallel_replay_%d.trace", (int) getpid());
+
+  for (int compact = 0; compact <= 1; compact++) {
+    printf("Replaying a %s trace in parallel\n", compact ? "compact" : "plain");
+    record_trace(compact ? TRACE_COMPACT : 0);
+
+    MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    check_config(&config, 16, "default caches");
+    if (!compact)
+      continue;
+
+    //A set-associative L2 cache, and the other policies that keep
+    //their state per set
+    config.l2_geometry.lines_per_set = 8;
+    config.l1_replacement_policy = REPLACEMENT_TREE_PLRU;
+    check_config(&config, 16, "8-way L2, PLRU L1");
+    config.l1_replacement_policy = REPLACEMENT_SRRIP;
+    config.l2_replacement_policy = REPLACEMENT_SRRIP;
+    check_config(&config, 16, "SRRIP");
+
+    //An L1 cache of only 4 sets
+    MEMORY_SUBSYSTEM_CONFIG small = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    small.l1_geometry.size_in_bytes = 4 * 4 * BYTES_PER_CACHE_LINE;
+    check_config(&small, 4, "4-set L1");
+
+    //A policy with state shared by the sets
+    MEMORY_SUBSYSTEM_CONFIG random = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    random.l2_geometry.lines_per_set = 4;
+    random.l2_replacement_policy = REPLACEMENT_RANDOM;
+    check_config(&random, 1, "random L2");
+  }
+
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS stats;
+  if (trace_replay_parallel(&config, "/nonexistent/trace", 4, &stats, NULL) != -1) {
+    printf("Error: Replayed a trace that does not exist\n");
+    exit(1);
+  }
+
+  unlink(path);
+  printf("Passed\n");
+}
@@ -0,0 +1,99 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+
+// Each thread gets its own 4MB memory subsystem
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<22)
+
+#define NUM_THREADS 4
+
+// Each thread writes a value to every word of its own subsystem,
+// reads every word back, and records the resulting statistics.
+// The value written depends on the thread number, so that any
+// sharing of state between subsystems would show up as a mismatch.
+
+typedef struct {
+  uint64_t thread_number;
+  MEMORY_SUBSYSTEM_STATS stats;
+  int failed;
+} THREAD_ARGS;
+
+void *run_subsystem(void *arg)
+{
+  THREAD_ARGS *args = (THREAD_ARGS *) arg;
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  uint64_t address, read_data;
+
+  if (!ms) {
+    args->failed = 1;
+    return NULL;
+  }
+
+  for(address = 0; address < MAIN_MEMORY_SIZE_IN_BYTES; address+=8) {
+    memory_access_r(ms, address, (address >> 3) + args->thread_number, WRITE_ENABLE_MASK, NULL);
+    if (!(address & 0xffff)) {
+      memory_handle_clock_interrupt_r(ms);
+    }
+  }
+
+  for(address = 0; address < MAIN_MEMORY_SIZE_IN_BYTES; address+=8) {
+    memory_access_r(ms, address, 0, READ_ENABLE_MASK, &read_data);
+    if (read_data != (address >> 3) + args->thread_number) {
+      args->failed = 1;
+      break;
+    }
+  }
+
+  memory_get_stats_r(ms, &args->stats);
+  memory_subsystem_destroy(ms);
+  return NULL;
+}
+
+
+int main()
+{
+  pthread_t threads[NUM_THREADS];
+  THREAD_ARGS args[NUM_THREADS];
+  int i;
+
+  printf("Pass 1: Running %d independent memory subsystems on separate threads\n", NUM_THREADS);
+
+  for(i = 0; i < NUM_THREADS; i++) {
+    args[i].thread_number = i;
+    args[i].failed = 0;
+    pthread_create(&threads[i], NULL, run_subsystem, &args[i]);
+  }
+  for(i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for(i = 0; i < NUM_THREADS; i++) {
+    if (args[i].failed) {
+      printf("Error: Thread %d read back a value it did not write\n", i);
+      exit(1);
+    }
+  }
+
+  printf("Pass 2: Checking that every subsystem gathered the same statistics\n");
+
+  for(i = 1; i < NUM_THREADS; i++) {
+    if ((args[i].stats.num_l1_misses != args[0].stats.num_l1_misses) ||
+	(args[i].stats.num_l2_misses != args[0].stats.num_l2_misses) ||
+	(args[i].stats.num_l1_writebacks != args[0].stats.num_l1_writebacks) ||
+	(args[i].stats.num_l2_writebacks != args[0].stats.num_l2_writebacks)) {
+      printf("Error: Statistics of thread %d differ from those of thread 0\n", i);
+      exit(1);
+    }
+  }
+
+  printf("L1 misses = %llu, L2 misses = %llu, L1 writebacks = %llu, L2 writebacks = %llu\n",
+	 args[0].stats.num_l1_misses, args[0].stats.num_l2_misses,
+	 args[0].stats.num_l1_writebacks, args[0].stats.num_l2_writebacks);
+
+  printf("Passed\n");
+}
@@ -0,0 +1,241 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "l1_cache.h"
+#include "l2_cache.h"
+
+// Checks the replacement policies of replacement_policy.h, in both the
+// L1 and the L2 cache. Each test uses a cache with a single 4-line set,
+// so that line i of memory (address i * 64) always maps to that set,
+// and checks which lines are still in the cache after a sequence of
+// accesses and insertions.
+
+#define LINE(i) ((uint64_t)(i) * BYTES_PER_CACHE_LINE)
+
+static L1_CACHE *l1;
+static L2_CACHE *l2;
+
+static uint64_t line_data[WORDS_PER_CACHE_LINE];
+static uint64_t evicted_data[WORDS_PER_CACHE_LINE];
+
+//Creates a one-set, 4-line cache at the given level (1 or 2).
+static void create(int level, REPLACEMENT_POLICY policy)
+{
+  L1_GEOMETRY l1_geometry = {4 * 64, 4, 64};
+  L2_GEOMETRY l2_geometry = {4 * 64, 4, 64};
+  if (level == 1)
+    l1 = l1_create_with_policy(&l1_geometry, policy);
+  else
+    l2 = l2_create_with_policy(&l2_geometry, policy);
+  if ((level == 1 && !l1) || (level == 2 && !l2)) {
+    printf("Error: Could not create an L%d cache using %s\n", level, replacement_policy_name(policy));
+    exit(1);
+  }
+}
+
+static void destroy(int level)
+{
+  if (level == 1)
+    l1_destroy(l1);
+  else
+    l2_destroy(l2);
+}
+
+static int access_line(int level, uint64_t address)
+{
+  uint64_t read_data;
+  uint8_t status;
+  if (level == 1)
+    l1_cache_access_r(l1, address, 0, READ_ENABLE_MASK, &read_data, &status);
+  else
+    l2_cache_access_r(l2, address, NULL, READ_ENABLE_MASK, line_data, &status);
+  return status & 0x1;
+}
+
+static void insert_line(int level, uint64_t address)
+{
+  uint64_t evicted_address;
+  uint8_t status;
+  if (level == 1)
+    l1_insert_line_r(l1, address, line_data, &evicted_address, evicted_data, &status);
+  else
+    l2_insert_line_r(l2, address, line_data, &evicted_address, evicted_data, &status);
+}
+
+static void clear_r_bits(int level)
+{
+  if (level == 1)
+    l1_clear_r_bits_r(l1);
+  else
+    l2_clear_r_bits_r(l2);
+}
+
+//Returns the r bit of line (0 to 3) of the set, for NRU, from a copy
+//of the cache's state (see l1_save_state_r()), which starts with the
+//REPLACEMENT_STATE and then the tags. Nothing in the cache changes.
+static int r_bit(int level, uint64_t line)
+{
+  uint64_t size = level == 1 ? l1_state_size_r(l1) : l2_state_size_r(l2);
+  uint8_t *state = (uint8_t *) malloc(size);
+  if (level == 1)
+    l1_save_state_r(l1, state);
+  else
+    l2_save_state_r(l2, state);
+  REPLACEMENT_STATE *rs = (REPLACEMENT_STATE *) state;
+  uint64_t *tags = (uint64_t *) (state + sizeof(REPLACEMENT_STATE));
+  int r = (tags[line] & REPLACEMENT_NRU_EPOCH_MASK) == rs->epoch_bits;
+  free(state);
+  return r;
+}
+
+//Inserts lines first .. first + 3, which fill the set.
+static void fill(int level, int first)
+{
+  for (int i = first; i < first + 4; i++)
+    insert_line(level, LINE(i));
+}
+
+//Checks that exactly the lines whose bits are set in expected are in
+//the cache, among lines 0 .. num_lines - 1. Looking the lines up counts
+//as accesses, so this is only done at the end of a test.
+static void expect(int level, REPLACEMENT_POLICY policy, const char *test,
+		   int num_lines, uint32_t expected)
+{
+  for (int i = 0; i < num_lines; i++) {
+    if (access_line(level, LINE(i)) != (int) ((expected >> i) & 1)) {
+      printf("Error: L%d %s, %s: line %d should%s be in the cache\n", level,
+	     replacement_policy_name(policy), test, i, ((expected >> i) & 1) ? "" : " not");
+      exit(1);
+    }
+  }
+}
+
+static void test_policies(int level)
+{
+  //LRU: after touching line 0, the least recently used line is 1.
+  create(level, REPLACEMENT_LRU);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  insert_line(level, LINE(4));
+  access_line(level, LINE(2));
+  insert_line(level, LINE(5));
+  expect(level, REPLACEMENT_LRU, "touch then insert", 6, 0x35);
+  destroy(level);
+
+  //Tree-PLRU: filling the set in order leaves the tree pointing at
+  //line 0; touching line 0 makes it point at line 2 instead.
+  create(level, REPLACEMENT_TREE_PLRU);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  insert_line(level, LINE(4));
+  expect(level, REPLACEMENT_TREE_PLRU, "touch then insert", 5, 0x1B);
+  destroy(level);
+
+  //SRRIP: lines 0 and 1 are hit (RRPV 0); the others were inserted
+  //with RRPV 2, so lines 2 and then 3 go first.
+  create(level, REPLACEMENT_SRRIP);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  access_line(level, LINE(1));
+  insert_line(level, LINE(4));
+  insert_line(level, LINE(5));
+  expect(level, REPLACEMENT_SRRIP, "hits survive two insertions", 6, 0x33);
+  destroy(level);
+
+  //BRRIP: a line that has been hit survives a long scan of lines
+  //that are never reused, since they are nearly all inserted with
+  //RRPV 3 and so are evicted first.
+  create(level, REPLACEMENT_BRRIP);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  for (int i = 4; i < 100; i++)
+    insert_line(level, LINE(i));
+  expect(level, REPLACEMENT_BRRIP, "scan resistance", 1, 0x1);
+  destroy(level);
+
+  //NRU: lines that were hit since the r bits were last cleared stay,
+  //and the first unreferenced line (1, then 4 in its place) goes.
+  create(level, REPLACEMENT_NRU);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  access_line(level, LINE(2));
+  insert_line(level, LINE(4));
+  insert_line(level, LINE(5));
+  expect(level, REPLACEMENT_NRU, "referenced lines stay", 6, 0x2D);
+  destroy(level);
+
+  //NRU: a line inserted in place of one referenced since the r bits
+  //were last cleared (every line is, so the victim is line 0) starts
+  //with its r bit clear, rather than taking the victim's.
+  create(level, REPLACEMENT_NRU);
+  fill(level, 0);
+  for (int i = 0; i < 4; i++)
+    access_line(level, LINE(i));
+  insert_line(level, LINE(4));
+  if (!r_bit(level, 1) || r_bit(level, 0)) {
+    printf("Error: L%d nru: a line inserted in place of a referenced line has its r bit set\n", level);
+    exit(1);
+  }
+  expect(level, REPLACEMENT_NRU, "insert in place of a referenced line", 5, 0x1E);
+  destroy(level);
+
+  //NRU again: a line referenced before thousands of clock interrupts,
+  //enough to use up the epochs and start them again, is no longer
+  //referenced.
+  create(level, REPLACEMENT_NRU);
+  fill(level, 0);
+  access_line(level, LINE(0));
+  for (int i = 0; i < 3 * 8191; i++)
+    clear_r_bits(level);
+  access_line(level, LINE(1));
+  insert_line(level, LINE(4));
+  expect(level, REPLACEMENT_NRU, "references age across epochs", 5, 0x1E);
+  destroy(level);
+
+  //Random: the victims vary, and are the same after the cache has
+  //been reinitialized.
+  uint32_t present[2];
+  create(level, REPLACEMENT_RANDOM);
+  for (int run = 0; run < 2; run++) {
+    if (level == 1)
+      l1_initialize_r(l1);
+    else
+      l2_initialize_r(l2);
+    fill(level, 0);
+    for (int i = 4; i < 12; i++)
+      insert_line(level, LINE(i));
+    present[run] = 0;
+    for (int i = 0; i < 12; i++)
+      present[run] |= (uint32_t) access_line(level, LINE(i)) << i;
+  }
+  //Always choosing the same line would leave only line 11 of 4 .. 11.
+  if (present[0] != present[1] || __builtin_popcount(present[0] >> 4) < 2) {
+    printf("Error: L%d random: lines present %x and %x\n", level, present[0], present[1]);
+    exit(1);
+  }
+  destroy(level);
+}
+
+int main()
+{
+  for (int level = 1; level <= 2; level++) {
+    printf("Testing the replacement policies of the L%d cache\n", level);
+    test_policies(level);
+  }
+
+  printf("Testing that unusable policies are rejected\n");
+  L1_GEOMETRY three_way = {3 * 64 * 16, 3, 64};
+  L1_GEOMETRY wide = {512 * 64, 512, 64};
+  if (!l1_create_with_policy(&three_way, REPLACEMENT_NRU) ||
+      l1_create_with_policy(&three_way, REPLACEMENT_TREE_PLRU) ||
+      l1_create_with_policy(&wide, REPLACEMENT_LRU) ||
+      !l1_create_with_policy(&wide, REPLACEMENT_SRRIP)) {
+    printf("Error: Wrong policy accepted or rejected\n");
+    exit(1);
+  }
+
+  printf("Passed\n");
+}
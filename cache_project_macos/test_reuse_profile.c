@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+#include "sweep.h"
+#include "reuse_profile.h"
+
+// Checks the reuse-distance profiler: its histograms against distances
+// found by searching an LRU stack of every line, fully-associative and
+// within sets, and the misses it predicts against those of L1 caches
+// of several shapes with the LRU policy, for several workloads.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_ACCESSES 200000
+
+static void check_histogram(REUSE_PROFILE *profile, uint64_t num_sets, uint64_t num_cold,
+			    const uint64_t *counts, uint64_t num_counts, const char *test)
+{
+  REUSE_HISTOGRAM histogram;
+  if (reuse_profile_histogram(profile, num_sets, &histogram) != 0) {
+    printf("Error: %s, no histogram for %llu sets\n", test, num_sets);
+    exit(1);
+  }
+  uint64_t far = 0;
+  for (uint64_t d = histogram.num_distances; d < num_counts; d++)
+    far += counts[d];
+  if (histogram.num_cold != num_cold || histogram.num_far != far) {
+    printf("Error: %s, %llu sets: %llu cold and %llu far accesses, should be %llu and %llu\n",
+	   test, num_sets, histogram.num_cold, histogram.num_far, num_cold, far);
+    exit(1);
+  }
+  for (uint64_t d = 0; d < histogram.num_distances; d++) {
+    uint64_t expected = d < num_counts ? counts[d] : 0;
+    if (histogram.counts[d] != expected) {
+      printf("Error: %s, %llu sets: %llu accesses at distance %llu, should be %llu\n",
+	     test, num_sets, histogram.counts[d], d, expected);
+      exit(1);
+    }
+  }
+}
+
+static void test_small()
+{
+  //Lines A B C A B B D A: distances -, -, -, 2, 2, 0, -, 2
+  uint64_t lines[] = {0, 1, 2, 0, 1, 1, 3, 0};
+  uint64_t counts[] = {1, 0, 3};
+  REUSE_PROFILE_CONFIG config = {16, 1, 1};
+  REUSE_PROFILE *profile = reuse_profile_create(&config);
+  uint64_t misses;
+
+  printf("Profiling a few accesses\n");
+  for (int i = 0; i < (int) (sizeof(lines) / sizeof(lines[0])); i++)
+    reuse_profile_access(profile, lines[i] * BYTES_PER_CACHE_LINE + i % BYTES_PER_CACHE_LINE);
+  check_histogram(profile, 1, 4, counts, 3, "a few accesses");
+  //With 2 sets, A and C in one, and B and D in the other: -, -, -, 1, 0, 0, -, 0
+  uint64_t set_counts[] = {3, 1};
+  check_histogram(profile, 2, 4, set_counts, 2, "a few accesses");
+
+  if (reuse_profile_misses(profile, 1, 2, &misses) != 0 || misses != 7 ||
+      reuse_profile_misses(profile, 1, 3, &misses) != 0 || misses != 4 ||
+      reuse_profile_misses(profile, 2, 1, &misses) != 0 || misses != 5 ||
+      reuse_profile_misses(profile, 2, 2, &misses) != 0 || misses != 4) {
+    printf("Error: Wrong misses for a few accesses\n");
+    exit(1);
+  }
+  if (reuse_profile_misses(profile, 4, 1, &misses) != -1 || reuse_profile_misses(profile, 1, 0, &misses) != -1 ||
+      reuse_profile_misses(profile, 1, 17, &misses) != -1 || reuse_profile_misses(profile, 2, 8, &misses) != 0 ||
+      reuse_profile_misses(profile, 2, 9, &misses) != -1) {
+    printf("Error: Misses of a cache that was not profiled\n");
+    exit(1);
+  }
+  reuse_profile_destroy(profile);
+
+  REUSE_PROFILE_CONFIG bad_distance = {0, 1, 1}, bad_sets = {16, 0, REUSE_PROFILE_MAX_SET_BITS + 1};
+  if (reuse_profile_create(&bad_distance) || reuse_profile_create(&bad_sets)) {
+    printf("Error: Created a profile with an invalid configuration\n");
+    exit(1);
+  }
+  reuse_profile_destroy(NULL);
+}
+
+//Checks the histograms against distances counted in an LRU stack of
+//every line (most recent first), for a workload over few lines.
+static void test_stack(const char *name, uint64_t memory_size)
+{
+  WORKLOAD_CONFIG workload_config;
+  workload_config_from_name(name, memory_size, &workload_config);
+  workload_config.num_accesses = NUM_ACCESSES;
+  SWEEP_TRACE *trace = sweep_trace_from_workload(&workload_config);
+  int set_bits[] = {0, 2, 5};
+  uint64_t num_lines = memory_size / BYTES_PER_CACHE_LINE;
+  uint64_t *stack = (uint64_t *) malloc(num_lines * sizeof(uint64_t));
+  uint64_t *counts = (uint64_t *) malloc(num_lines * sizeof(uint64_t));
+
+  printf("Profiling %s over %llu lines\n", name, num_lines);
+  REUSE_PROFILE_CONFIG config = {num_lines / 4, 2, 5};
+  REUSE_PROFILE *profile = reuse_profile_create(&config);
+  if (!trace || !profile || reuse_profile_batch(profile, trace->addresses, trace->num_accesses) != 0) {
+    printf("Error: Could not profile %s\n", name);
+    exit(1);
+  }
+
+  for (int b = 0; b < (int) (sizeof(set_bits) / sizeof(set_bits[0])); b++) {
+    uint64_t set_mask = ((uint64_t) 1 << set_bits[b]) - 1;
+    uint64_t depth = 0, num_cold = 0;
+    memset(counts, 0, num_lines * sizeof(uint64_t));
+    for (uint64_t i = 0; i < trace->num_accesses; i++) {
+      uint64_t line = trace->addresses[i] / BYTES_PER_CACHE_LINE;
+      uint64_t position = 0, distance = 0;
+      while (position < depth && stack[position] != line) {
+	if ((stack[position] & set_mask) == (line & set_mask))
+	  distance++;
+	position++;
+      }
+      if (position == depth) {
+	num_cold++;
+	depth++;
+      } else {
+	counts[distance]++;
+      }
+      memmove(stack + 1, stack, position * sizeof(uint64_t));
+      stack[0] = line;
+    }
+    check_histogram(profile, set_mask + 1, num_cold, counts, num_lines, name);
+  }
+
+  reuse_profile_destroy(profile);
+  sweep_trace_free(trace);
+  free(stack);
+  free(counts);
+}
+
+//Checks the misses predicted for L1 caches of several shapes against
+//those of the caches themselves.
+static void test_caches(const char *name)
+{
+  uint32_t shapes[][2] = {{1, 1}, {1, 64}, {1, 256}, {4, 16}, {64, 4}, {256, 1}, {256, 4}, {1024, 8}};
+  WORKLOAD_CONFIG workload_config;
+  workload_config_from_name(name, MAIN_MEMORY_SIZE_IN_BYTES, &workload_config);
+  workload_config.num_accesses = NUM_ACCESSES;
+  SWEEP_TRACE *trace = sweep_trace_from_workload(&workload_config);
+
+  printf("Profiling %s against L1 caches\n", name);
+  REUSE_PROFILE_CONFIG config = {1 << 14, 2, 10};
+  REUSE_PROFILE *profile = reuse_profile_create(&config);
+  if (!trace || !profile || reuse_profile_batch(profile, trace->addresses, trace->num_accesses) != 0) {
+    printf("Error: Could not profile %s\n", name);
+    exit(1);
+  }
+
+  for (int s = 0; s < (int) (sizeof(shapes) / sizeof(shapes[0])); s++) {
+    MEMORY_SUBSYSTEM_CONFIG ms_config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    MEMORY_SUBSYSTEM_STATS stats;
+    uint64_t misses;
+    ms_config.l1_geometry.size_in_bytes = shapes[s][0] * shapes[s][1] * BYTES_PER_CACHE_LINE;
+    ms_config.l1_geometry.lines_per_set = shapes[s][1];
+    ms_config.l1_replacement_policy = REPLACEMENT_LRU;
+    MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&ms_config);
+    sweep_replay_r(ms, trace);
+    memory_get_stats_r(ms, &stats);
+    memory_subsystem_destroy(ms);
+    if (reuse_profile_misses(profile, shapes[s][0], shapes[s][1], &misses) != 0 || misses != stats.num_l1_misses) {
+      printf("Error: %s, %u sets of %u lines: %llu misses predicted, the cache had %llu\n",
+	     name, shapes[s][0], shapes[s][1], misses, stats.num_l1_misses);
+      exit(1);
+    }
+  }
+
+  reuse_profile_destroy(profile);
+  sweep_trace_free(trace);
+}
+
+int main()
+{
+  test_small();
+
+  test_stack("uniform", 2048 * BYTES_PER_CACHE_LINE);
+  test_stack("zipf", 4096 * BYTES_PER_CACHE_LINE);
+  test_stack("chase", 1024 * BYTES_PER_CACHE_LINE);
+
+  const char *names[] = {"runs", "zipf", "uniform", "strided", "chase"};
+  for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++)
+    test_caches(names[i]);
+
+  printf("Passed\n");
+}
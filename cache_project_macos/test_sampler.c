@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "workload.h"
+#include "sampler.h"
+
+// Checks sampled simulation: that sampling every set gives exactly the
+// statistics of the full caches, that replaying a trace sampled is the
+// same as making its accesses of the sampler, that the estimates for
+// shortened Pass 3 and Pass 4 workloads, sampled by set and by line,
+// are close to the statistics of the full caches and their confidence
+// intervals cover them, and that sampling that cannot be done is
+// refused.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_ACCESSES (1<<21)
+#define BATCH_SIZE 4096
+
+static char path[64];
+
+//Runs the workload on the default subsystem, recording it to path,
+//and on the sampler, and returns the statistics of the full caches.
+static void run(WORKLOAD_CONFIG *workload_config, SAMPLER *sampler, MEMORY_SUBSYSTEM_STATS *full)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, TRACE_COMPACT);
+  WORKLOAD *workload = workload_create(workload_config);
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE], read_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+
+  memory_subsystem_set_recorder_r(ms, recorder);
+  for (uint64_t i = 0; i < workload_config->num_accesses; i += BATCH_SIZE) {
+    workload_generate(workload, addresses, write_data, controls, BATCH_SIZE);
+    memory_access_batch_r(ms, addresses, write_data, controls, read_data, NULL, BATCH_SIZE);
+    sampler_access_batch_r(sampler, addresses, write_data, controls, BATCH_SIZE);
+    memory_handle_clock_interrupt_r(ms);
+    sampler_handle_clock_interrupt_r(sampler);
+  }
+  memory_subsystem_set_recorder_r(ms, NULL);
+  trace_recorder_destroy(recorder);
+  workload_destroy(workload);
+  memory_get_stats_r(ms, full);
+  memory_subsystem_destroy(ms);
+}
+
+static void check_exact(SAMPLER_ESTIMATE *estimate, uint64_t actual, const char *name)
+{
+  if (estimate->estimate != (double) actual) {
+    printf("Error: Sampling every set, %s estimated as %.0f, should be %llu\n", name, estimate->estimate, actual);
+    exit(1);
+  }
+}
+
+static void test_every_set()
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  SAMPLER_CONFIG sampling = {SAMPLER_SETS, 1.0, 7};
+  WORKLOAD_CONFIG workload_config;
+  MEMORY_SUBSYSTEM_STATS full;
+  SAMPLER_STATS stats, replayed_stats;
+  TRACE_REPLAY_STATS replayed;
+
+  printf("Sampling every set\n");
+  config.l2_geometry.lines_per_set = 4;
+  config.l1_replacement_policy = REPLACEMENT_LRU;
+  workload_config_from_name("runs", MAIN_MEMORY_SIZE_IN_BYTES, &workload_config);
+  workload_config.num_accesses = NUM_ACCESSES / 4;
+  SAMPLER *sampler = sampler_create(&config, &sampling);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  SAMPLER *replay = sampler_create(&config, &sampling);
+  if (!sampler || !ms || !replay) {
+    printf("Error: Could not create the samplers\n");
+    exit(1);
+  }
+  run(&workload_config, sampler, &full);
+  trace_replay_r(ms, path, NULL);
+  memory_get_stats_r(ms, &full);
+  memory_subsystem_destroy(ms);
+
+  sampler_get_stats_r(sampler, &stats);
+  if (stats.rate != 1.0 || stats.num_groups != SAMPLER_MAX_GROUPS ||
+      stats.num_accesses != workload_config.num_accesses || stats.num_simulated != stats.num_accesses) {
+    printf("Error: Sampling every set simulated %llu of %llu accesses\n", stats.num_simulated, stats.num_accesses);
+    exit(1);
+  }
+  check_exact(&stats.l1_misses, full.num_l1_misses, "L1 misses");
+  check_exact(&stats.l2_misses, full.num_l2_misses, "L2 misses");
+  check_exact(&stats.l1_writebacks, full.num_l1_writebacks, "L1 writebacks");
+  check_exact(&stats.l2_writebacks, full.num_l2_writebacks, "L2 writebacks");
+
+  printf("Replaying a trace sampled\n");
+  if (sampler_replay_r(replay, path, &replayed) != 0 || replayed.num_accesses != workload_config.num_accesses ||
+      replayed.num_interrupts != workload_config.num_accesses / BATCH_SIZE) {
+    printf("Error: Could not replay the trace sampled\n");
+    exit(1);
+  }
+  sampler_get_stats_r(replay, &replayed_stats);
+  if (replayed_stats.l1_misses.estimate != stats.l1_misses.estimate ||
+      replayed_stats.l2_writebacks.estimate != stats.l2_writebacks.estimate ||
+      replayed_stats.num_simulated != stats.num_simulated) {
+    printf("Error: Replaying the trace sampled gave different estimates\n");
+    exit(1);
+  }
+  if (sampler_replay_r(replay, "/nonexistent/trace", NULL) != -1) {
+    printf("Error: Replayed a trace that does not exist\n");
+    exit(1);
+  }
+  sampler_destroy(sampler);
+  sampler_destroy(replay);
+}
+
+static void check_estimate(SAMPLER_ESTIMATE *estimate, uint64_t actual, const char *test)
+{
+  double error = fabs(estimate->estimate - actual);
+  if (error > estimate->half_width || error > 0.05 * actual) {
+    printf("Error: %s, estimated %.0f +- %.0f, actually %llu\n", test, estimate->estimate, estimate->half_width, actual);
+    exit(1);
+  }
+}
+
+static void test_accuracy(WORKLOAD_CONFIG *workload_config, const char *name)
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  double rates[] = {1.0 / 8, 1.0 / 32};
+  char test[128];
+
+  workload_config->num_accesses = NUM_ACCESSES;
+  workload_config->random = WORKLOAD_RANDOM_XOSHIRO;
+  for (int mode = SAMPLER_SETS; mode <= SAMPLER_LINES; mode++) {
+    for (int r = 0; r < (int) (sizeof(rates) / sizeof(rates[0])); r++) {
+      SAMPLER_CONFIG sampling = {(SAMPLER_MODE) mode, rates[r], 3};
+      MEMORY_SUBSYSTEM_STATS full;
+      SAMPLER_STATS stats;
+      snprintf(test, sizeof(test), "%s sampled by %s at 1/%.0f", name, mode == SAMPLER_SETS ? "set" : "line", 1 / rates[r]);
+      printf("%s\n", test);
+      SAMPLER *sampler = sampler_create(&config, &sampling);
+      run(workload_config, sampler, &full);
+      sampler_get_stats_r(sampler, &stats);
+      if (stats.rate != rates[r] || stats.num_simulated > 2 * rates[r] * NUM_ACCESSES) {
+	printf("Error: %s, simulated %llu accesses at a rate of %g\n", test, stats.num_simulated, stats.rate);
+	exit(1);
+      }
+      check_estimate(&stats.l1_misses, full.num_l1_misses, test);
+      check_estimate(&stats.l2_misses, full.num_l2_misses, test);
+      sampler_destroy(sampler);
+    }
+  }
+}
+
+static void test_invalid()
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  SAMPLER_CONFIG zero = {SAMPLER_SETS, 0, 1}, above = {SAMPLER_LINES, 1.5, 1};
+  SAMPLER_CONFIG too_few_sets = {SAMPLER_LINES, 1.0 / 512, 1}, one_unit = {SAMPLER_SETS, 1.0 / 1000, 1};
+  SAMPLER_STATS stats;
+
+  printf("Refusing sampling that cannot be done\n");
+  if (sampler_create(&config, &zero) || sampler_create(&config, &above) || sampler_create(&config, &too_few_sets)) {
+    printf("Error: Created a sampler that cannot sample\n");
+    exit(1);
+  }
+  MEMORY_SUBSYSTEM_CONFIG file = config;
+  file.main_memory_file = path;
+  if (sampler_create(&file, &one_unit)) {
+    printf("Error: Sampled a main memory that is a file\n");
+    exit(1);
+  }
+  SAMPLER *sampler = sampler_create(&config, &one_unit);
+  sampler_get_stats_r(sampler, &stats);
+  if (stats.num_groups != 1 || stats.rate != 1.0 / 256 || !isnan(stats.l1_misses.half_width)) {
+    printf("Error: Sampling one unit should give one group and no interval\n");
+    exit(1);
+  }
+  sampler_destroy(sampler);
+  sampler_destroy(NULL);
+}
+
+int main()
+{
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  snprintf(path, sizeof(path), "/tmp/test_sampler_%d.trace", (int) getpid());
+  test_every_set();
+  test_accuracy(&pass3, "Pass 3");
+  test_accuracy(&pass4, "Pass 4");
+  test_invalid();
+  unlink(path);
+  printf("Passed\n");
+}
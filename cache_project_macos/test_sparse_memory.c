@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_subsystem_constants.h"
+#include "main_memory.h"
+
+// Checks a sparse main memory covering the whole 48-bit address space:
+// that an empty one takes no memory, that lines written in regions far
+// apart read back, that only the 2MB regions written to are allocated,
+// and that what was never written, in those regions or others, reads
+// as 0 without allocating anything.
+
+//Two lines in each of 1000 2MB regions, 2^36 bytes apart.
+#define SPARSE_REGIONS 1000
+#define SPARSE_STRIDE ((uint64_t) 1 << 36)
+#define REGION_SIZE_IN_BYTES ((uint64_t) 2 << 20)
+
+int main()
+{
+  uint64_t write_data[WORDS_PER_CACHE_LINE], read_data[WORDS_PER_CACHE_LINE];
+
+  printf("Writing and reading lines scattered over the whole 48-bit address space\n");
+
+  MAIN_MEMORY *sparse = main_memory_create(MAIN_MEMORY_FULL_SIZE);
+  if (!sparse || main_memory_allocated_bytes_r(sparse) != 0) {
+    printf("Error: Could not create an empty memory of the full size\n");
+    exit(1);
+  }
+
+  for (uint64_t i = 0; i < SPARSE_REGIONS; i++) {
+    uint64_t address = i * SPARSE_STRIDE + i * 64 % 4096;
+    for (int j = 0; j < WORDS_PER_CACHE_LINE; j++)
+      write_data[j] = address + j;
+    main_memory_access_r(sparse, address, write_data, WRITE_ENABLE_MASK, NULL);
+    main_memory_access_r(sparse, address ^ 0xFC0, write_data, WRITE_ENABLE_MASK, NULL);
+  }
+
+  if (main_memory_allocated_bytes_r(sparse) != SPARSE_REGIONS * REGION_SIZE_IN_BYTES) {
+    printf("Error: %llu bytes allocated for %d regions\n", main_memory_allocated_bytes_r(sparse), SPARSE_REGIONS);
+    exit(1);
+  }
+
+  for (uint64_t i = 0; i < SPARSE_REGIONS; i++) {
+    uint64_t address = i * SPARSE_STRIDE + i * 64 % 4096;
+    main_memory_access_r(sparse, address, NULL, READ_ENABLE_MASK, read_data);
+    for (int j = 0; j < WORDS_PER_CACHE_LINE; j++) {
+      if (read_data[j] != address + j) {
+	printf("Memory read error: address %llx contains %llu\n", address + j * 8, read_data[j]);
+	exit(1);
+      }
+    }
+    //Lines that were never written, in written regions and in others, are 0.
+    main_memory_access_r(sparse, address ^ 0x40, NULL, READ_ENABLE_MASK, read_data);
+    main_memory_access_r(sparse, address + SPARSE_STRIDE / 2, NULL, READ_ENABLE_MASK, read_data + 4);
+    if (read_data[0] || read_data[4]) {
+      printf("Error: Unwritten memory near address %llx is not 0\n", address);
+      exit(1);
+    }
+  }
+
+  if (main_memory_allocated_bytes_r(sparse) != SPARSE_REGIONS * REGION_SIZE_IN_BYTES) {
+    printf("Error: Reading allocated memory\n");
+    exit(1);
+  }
+  main_memory_destroy(sparse);
+
+  printf("Passed\n");
+}
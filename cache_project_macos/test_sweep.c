@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+#include "text_trace.h"
+#include "workload.h"
+#include "sweep.h"
+
+// Checks the sweep runner: that a workload or a trace made ready for a
+// sweep makes exactly the accesses and interrupts of the workload run
+// directly or of the trace replayed, and that sweeping a grid of points
+// (with an invalid one among them) gives every point the statistics of
+// running it on its own, on any number of threads, whether the trace
+// is decoded first or streamed through each thread in lockstep.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_ACCESSES 300000
+#define NUM_POINTS 24
+
+static char path[64];
+static SWEEP_POINT expected[NUM_POINTS];
+
+static void check_stats(MEMORY_SUBSYSTEM_STATS *a, MEMORY_SUBSYSTEM_STATS *b, const char *test)
+{
+  if (a->num_l1_misses != b->num_l1_misses || a->num_l2_misses != b->num_l2_misses ||
+      a->num_l1_writebacks != b->num_l1_writebacks || a->num_l2_writebacks != b->num_l2_writebacks) {
+    printf("Error: %s, statistics differ (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   test, a->num_l1_misses, b->num_l1_misses, a->num_l2_misses, b->num_l2_misses);
+    exit(1);
+  }
+}
+
+//Runs trace on a new subsystem with config, and returns its statistics.
+static void run_trace(const SWEEP_TRACE *trace, MEMORY_SUBSYSTEM_CONFIG *config, MEMORY_SUBSYSTEM_STATS *stats)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(config);
+  sweep_replay_r(ms, trace);
+  memory_get_stats_r(ms, stats);
+  memory_subsystem_destroy(ms);
+}
+
+static SWEEP_TRACE *test_sources()
+{
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS a, b;
+  WORKLOAD_CONFIG workload_config;
+
+  printf("Making a workload ready for a sweep\n");
+  workload_config_from_name("runs", MAIN_MEMORY_SIZE_IN_BYTES, &workload_config);
+  workload_config.num_accesses = NUM_ACCESSES;
+  workload_config.interrupt_interval = 1000;
+  SWEEP_TRACE *trace = sweep_trace_from_workload(&workload_config);
+  if (!trace || trace->num_accesses != NUM_ACCESSES || trace->num_interrupts != NUM_ACCESSES / 1000) {
+    printf("Error: Could not generate the workload\n");
+    exit(1);
+  }
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, TRACE_COMPACT);
+  WORKLOAD *workload = workload_create(&workload_config);
+  memory_subsystem_set_recorder_r(ms, recorder);
+  workload_run_r(ms, workload);
+  memory_subsystem_set_recorder_r(ms, NULL);
+  trace_recorder_destroy(recorder);
+  workload_destroy(workload);
+  memory_get_stats_r(ms, &a);
+  memory_subsystem_destroy(ms);
+  run_trace(trace, &config, &b);
+  check_stats(&a, &b, "generated workload");
+
+  printf("Making a trace file ready for a sweep\n");
+  SWEEP_TRACE *decoded = sweep_trace_from_file(path);
+  if (!decoded || decoded->num_accesses != NUM_ACCESSES || decoded->num_interrupts != NUM_ACCESSES / 1000 ||
+      memcmp(decoded->addresses, trace->addresses, NUM_ACCESSES * sizeof(uint64_t)) ||
+      memcmp(decoded->interrupts, trace->interrupts, decoded->num_interrupts * sizeof(uint64_t))) {
+    printf("Error: The decoded trace is not the workload\n");
+    exit(1);
+  }
+  run_trace(decoded, &config, &b);
+  check_stats(&a, &b, "decoded trace");
+  sweep_trace_free(decoded);
+
+  printf("Making a text trace ready for a sweep\n");
+  FILE *file = fopen(path, "w");
+  for (uint64_t i = 0; i < NUM_ACCESSES; i++)
+    fprintf(file, "%d %llx\n", trace->controls[i] == WRITE_ENABLE_MASK ? 1 : 0, trace->addresses[i]);
+  fclose(file);
+  decoded = sweep_trace_from_text(path, TEXT_TRACE_DINERO, 1000);
+  ms = memory_subsystem_create_with_config(&config);
+  text_trace_replay_r(ms, path, TEXT_TRACE_DINERO, 1000, NULL);
+  memory_get_stats_r(ms, &a);
+  memory_subsystem_destroy(ms);
+  if (!decoded || decoded->num_accesses != NUM_ACCESSES) {
+    printf("Error: Could not read the text trace\n");
+    exit(1);
+  }
+  run_trace(decoded, &config, &b);
+  check_stats(&a, &b, "text trace");
+  sweep_trace_free(decoded);
+
+  if (sweep_trace_from_file("/nonexistent/trace") || sweep_trace_from_file(path)) {
+    printf("Error: Read a trace from a file that is not one\n");
+    exit(1);
+  }
+  return trace;
+}
+
+static void test_sweep(SWEEP_TRACE *trace)
+{
+  SWEEP_POINT points[NUM_POINTS];
+  REPLACEMENT_POLICY policies[] = {REPLACEMENT_LRU, REPLACEMENT_TREE_PLRU, REPLACEMENT_SRRIP};
+
+  printf("Sweeping %d points\n", NUM_POINTS);
+  for (int p = 0; p < NUM_POINTS; p++) {
+    MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    config.l1_geometry.size_in_bytes = (16 * 1024) << (p % 2);
+    config.l2_geometry.size_in_bytes = (256 * 1024) << (p / 2 % 2);
+    config.l2_geometry.lines_per_set = 1 << (p / 4 % 2 * 3);
+    config.l2_replacement_policy = policies[p / 8];
+    //An invalid one: tree PLRU needs a power of two ways
+    if (p == 13)
+      config.l2_geometry.lines_per_set = 3;
+    expected[p].config = config;
+    expected[p].valid = p != 13;
+    memset(&expected[p].stats, 0, sizeof(expected[p].stats));
+    if (expected[p].valid)
+      run_trace(trace, &config, &expected[p].stats);
+  }
+
+  for (int num_threads = 1; num_threads <= 32; num_threads *= 2) {
+    for (int p = 0; p < NUM_POINTS; p++) {
+      points[p].config = expected[p].config;
+      points[p].valid = -1;
+      points[p].seconds = -1;
+    }
+    sweep_run(trace, points, NUM_POINTS, num_threads);
+    for (int p = 0; p < NUM_POINTS; p++) {
+      if (points[p].valid != expected[p].valid || points[p].seconds < 0) {
+	printf("Error: On %d threads, point %d was not run as it should have been\n", num_threads, p);
+	exit(1);
+      }
+      check_stats(&expected[p].stats, &points[p].stats, "sweep");
+    }
+  }
+  sweep_run(trace, points, 0, 4);
+}
+
+//Sweeps the points of test_sweep() again, in lockstep, from the trace
+//recorded to a file.
+static void test_lockstep(SWEEP_TRACE *trace)
+{
+  SWEEP_POINT points[NUM_POINTS];
+  TRACE_REPLAY_STATS replayed;
+  MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(&config);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, TRACE_COMPACT);
+  memory_subsystem_set_recorder_r(ms, recorder);
+  sweep_replay_r(ms, trace);
+  memory_subsystem_set_recorder_r(ms, NULL);
+  trace_recorder_destroy(recorder);
+  memory_subsystem_destroy(ms);
+
+  printf("Sweeping %d points in lockstep\n", NUM_POINTS);
+  for (int num_threads = 1; num_threads <= 32; num_threads *= 4) {
+    for (int p = 0; p < NUM_POINTS; p++) {
+      points[p].config = expected[p].config;
+      points[p].valid = -1;
+      points[p].seconds = -1;
+    }
+    if (sweep_run_lockstep(path, points, NUM_POINTS, num_threads, &replayed) != 0 ||
+	replayed.num_accesses != trace->num_accesses || replayed.num_interrupts != trace->num_interrupts) {
+      printf("Error: On %d threads, could not sweep in lockstep\n", num_threads);
+      exit(1);
+    }
+    for (int p = 0; p < NUM_POINTS; p++) {
+      if (points[p].valid != expected[p].valid || points[p].seconds < 0) {
+	printf("Error: On %d threads, point %d was not run in lockstep as it should have been\n", num_threads, p);
+	exit(1);
+      }
+      check_stats(&expected[p].stats, &points[p].stats, "lockstep sweep");
+    }
+  }
+  if (sweep_run_lockstep("/nonexistent/trace", points, NUM_POINTS, 2, NULL) != -1) {
+    printf("Error: Swept a trace that does not exist\n");
+    exit(1);
+  }
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_sweep_%d.trace", (int) getpid());
+
+  SWEEP_TRACE *trace = test_sources();
+  test_sweep(trace);
+  test_lockstep(trace);
+  sweep_trace_free(trace);
+  sweep_trace_free(NULL);
+
+  unlink(path);
+  printf("Passed\n");
+}
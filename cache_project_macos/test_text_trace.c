@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "text_trace.h"
+
+// Checks the text trace reader: that Dinero and plain hexadecimal
+// lines are read as the accesses they stand for, whatever their
+// spacing, prefixes, case and line endings, that comments, blank
+// lines and lines that are not accesses are skipped, and that
+// replaying a text trace does exactly what making its accesses with
+// memory_access_r() does.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_ACCESSES 2000000
+#define INTERRUPT_INTERVAL 1000
+
+static char path[64];
+
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void write_file(const char *text)
+{
+  FILE *file = fopen(path, "wb");
+  fputs(text, file);
+  fclose(file);
+}
+
+//Reads the trace at path, a few accesses at a time, and checks what
+//is read against the expected accesses.
+static void check_read(int format, const uint64_t expected_addresses[], const uint8_t expected_controls[],
+		       uint64_t num_expected, uint64_t num_skipped, const char *test)
+{
+  uint64_t addresses[2];
+  uint8_t controls[2];
+  TEXT_TRACE_STATS stats;
+  uint64_t i = 0, n;
+
+  if (text_trace_detect_format(path) != format) {
+    printf("Error: %s, the format was not recognized\n", test);
+    exit(1);
+  }
+  TEXT_TRACE *trace = text_trace_open(path, format);
+  while ((n = text_trace_read(trace, addresses, controls, 2)) > 0) {
+    for (uint64_t j = 0; j < n; j++, i++) {
+      if (i >= num_expected || addresses[j] != expected_addresses[i] || controls[j] != expected_controls[i]) {
+	printf("Error: %s, access %llu is (%llx, %u)\n", test, i, addresses[j], controls[j]);
+	exit(1);
+      }
+    }
+  }
+  text_trace_get_stats(trace, &stats);
+  if (i != num_expected || stats.num_accesses != num_expected || stats.num_skipped != num_skipped) {
+    printf("Error: %s, %llu accesses read and %llu lines skipped\n", test, stats.num_accesses, stats.num_skipped);
+    exit(1);
+  }
+  text_trace_close(trace);
+}
+
+static void test_parsing()
+{
+  printf("Reading Dinero and hexadecimal lines\n");
+  write_file("# A Dinero trace\n"
+	     "0 1000\n"
+	     "1 0x2008\r\n"
+	     "2\tABCDEF  and the rest of the line\n"
+	     "  0   ffffffffffffffff\n"
+	     "\n"
+	     "3 10\n"
+	     "4 0\n"
+	     "7 100\n"
+	     "1 12g4\n"
+	     "0\n"
+	     "1 fff8");
+  uint64_t din_addresses[] = {0x1000, 0x2008, 0xABCDEF, 0xFFFFFFFFFFFF, 0xFFF8};
+  uint8_t din_controls[] = {READ_ENABLE_MASK, WRITE_ENABLE_MASK, READ_ENABLE_MASK, READ_ENABLE_MASK, WRITE_ENABLE_MASK};
+  check_read(TEXT_TRACE_DINERO, din_addresses, din_controls, 5, 5, "Dinero");
+
+  write_file("1000\n"
+	     "0X20\r\n"
+	     "  abc  \n"
+	     "# a comment\n"
+	     "xyz\n"
+	     "\n"
+	     "40");
+  uint64_t hex_addresses[] = {0x1000, 0x20, 0xABC, 0x40};
+  uint8_t hex_controls[] = {READ_ENABLE_MASK, READ_ENABLE_MASK, READ_ENABLE_MASK, READ_ENABLE_MASK};
+  check_read(TEXT_TRACE_HEX, hex_addresses, hex_controls, 4, 1, "Hexadecimal");
+
+  write_file("");
+  check_read(TEXT_TRACE_HEX, NULL, NULL, 0, 0, "Empty file");
+  if (text_trace_open("/nonexistent/trace", TEXT_TRACE_HEX) || text_trace_open(path, 5)) {
+    printf("Error: Opened a file that does not exist, or in an unknown format\n");
+    exit(1);
+  }
+}
+
+//Writes a workload as a text trace in the given format, making the
+//same accesses of ms as it goes, and then checks that replaying the
+//trace into a new memory subsystem gives the same statistics.
+static void test_replay(int format)
+{
+  MEMORY_SUBSYSTEM *direct = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *replayed = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS a, b;
+  TEXT_TRACE_STATS stats;
+  uint64_t state = 11111;
+  uint64_t address = 0, value;
+  FILE *file = fopen(path, "w");
+
+  for (uint64_t i = 0; i < NUM_ACCESSES; i++) {
+    uint64_t r = next_random(&state);
+    address = (r & 0x30) ? (address + BYTES_PER_WORD) % MAIN_MEMORY_SIZE_IN_BYTES
+                         : (r >> 16) % MAIN_MEMORY_SIZE_IN_BYTES & ~(uint64_t)(BYTES_PER_WORD - 1);
+    if (format == TEXT_TRACE_DINERO) {
+      int label = r % 3;
+      fprintf(file, (r & 4) ? "%d 0x%llx\n" : "%d %llX\n", label, address);
+      memory_access_r(direct, address, 0, label == 1 ? WRITE_ENABLE_MASK : READ_ENABLE_MASK, &value);
+    } else {
+      fprintf(file, "%llx\n", address);
+      memory_access_r(direct, address, 0, READ_ENABLE_MASK, &value);
+    }
+    if (!((i + 1) % INTERRUPT_INTERVAL))
+      memory_handle_clock_interrupt_r(direct);
+  }
+  fclose(file);
+
+  if (text_trace_replay_r(replayed, path, format, INTERRUPT_INTERVAL, &stats) != 0 ||
+      stats.num_accesses != NUM_ACCESSES || stats.num_skipped != 0) {
+    printf("Error: Could not replay %s\n", path);
+    exit(1);
+  }
+  memory_get_stats_r(direct, &a);
+  memory_get_stats_r(replayed, &b);
+  if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+      a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks) {
+    printf("Error: Replaying the text trace gave different statistics (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+    exit(1);
+  }
+  memory_subsystem_destroy(direct);
+  memory_subsystem_destroy(replayed);
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_text_trace_%d.txt", (int) getpid());
+
+  test_parsing();
+
+  printf("Replaying a Dinero trace\n");
+  test_replay(TEXT_TRACE_DINERO);
+
+  printf("Replaying a hexadecimal trace\n");
+  test_replay(TEXT_TRACE_HEX);
+
+  unlink(path);
+  printf("Passed\n");
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+
+// Checks that a memory subsystem with a trace recorder writes every
+// access made of it, including each entry of a batch and each word
+// of a block, and every clock interrupt, to the trace file in order.
+// Far more events are recorded than the recorder's ring holds, so the
+// ring wraps around many times. The trace is written with and without
+// timestamps, both plain (read back by hand, following trace.h) and
+// compact, and is read back with a trace reader, from the start and
+// from each of its blocks. A compact trace is also read without its
+// index, as if its recording had not finished, and with a byte of it
+// changed.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_ROUNDS 2000
+#define BATCH_SIZE 64
+#define BLOCK_WORDS 40
+#define ACCESSES_PER_ROUND 200
+
+static char path[64];
+
+static TRACE_RECORD *expected;
+static uint64_t num_expected;
+
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void expect(uint64_t address, uint8_t control, uint64_t write_data)
+{
+  expected[num_expected].address_control = (address & TRACE_ADDRESS_MASK) | ((uint64_t) control << TRACE_CONTROL_SHIFT);
+  expected[num_expected].write_data = write_data;
+  num_expected++;
+}
+
+static uint64_t random_address(uint64_t *state)
+{
+  return next_random(state) % MAIN_MEMORY_SIZE_IN_BYTES & ~(uint64_t)(BYTES_PER_WORD - 1);
+}
+
+static void record_workload(uint32_t flags)
+{
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  TRACE_RECORDER *recorder = trace_recorder_create(path, flags);
+  uint64_t addresses[BATCH_SIZE], write_data[BATCH_SIZE], read_data[BATCH_SIZE];
+  uint8_t controls[BATCH_SIZE];
+  uint64_t state = 13579;
+  uint64_t value;
+
+  if (!ms || !recorder) {
+    printf("Error: Could not create a memory subsystem and a recorder for %s\n", path);
+    exit(1);
+  }
+  num_expected = 0;
+
+  //Nothing is recorded before the recorder is set, or after it is taken away.
+  memory_access_r(ms, 0, 1, WRITE_ENABLE_MASK, NULL);
+  memory_subsystem_set_recorder_r(ms, recorder);
+
+  for (int round = 0; round < NUM_ROUNDS; round++) {
+    for (int i = 0; i < ACCESSES_PER_ROUND; i++) {
+      uint64_t address = random_address(&state);
+      if (next_random(&state) & 1) {
+	memory_access_r(ms, address, 99, READ_ENABLE_MASK, &value);
+	expect(address, READ_ENABLE_MASK, 0);
+      } else {
+	memory_access_r(ms, address, state, WRITE_ENABLE_MASK, NULL);
+	expect(address, WRITE_ENABLE_MASK, state);
+      }
+    }
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+      addresses[i] = random_address(&state);
+      controls[i] = (next_random(&state) & 1) ? READ_ENABLE_MASK : WRITE_ENABLE_MASK;
+      write_data[i] = state;
+      expect(addresses[i], controls[i], controls[i] == WRITE_ENABLE_MASK ? write_data[i] : 0);
+    }
+    memory_access_batch_r(ms, addresses, write_data, controls, read_data, NULL, BATCH_SIZE);
+
+    uint64_t address = random_address(&state) % (MAIN_MEMORY_SIZE_IN_BYTES - BLOCK_WORDS * BYTES_PER_WORD);
+    if (round & 1) {
+      memory_read_block_r(ms, address, BLOCK_WORDS * BYTES_PER_WORD, read_data);
+      for (int i = 0; i < BLOCK_WORDS; i++)
+	expect(address + i * BYTES_PER_WORD, READ_ENABLE_MASK, 0);
+    } else {
+      memory_write_block_r(ms, address, BLOCK_WORDS * BYTES_PER_WORD, write_data);
+      for (int i = 0; i < BLOCK_WORDS; i++)
+	expect(address + i * BYTES_PER_WORD, WRITE_ENABLE_MASK, write_data[i]);
+    }
+
+    memory_handle_clock_interrupt_r(ms);
+    expect(0, TRACE_CLOCK_INTERRUPT, 0);
+  }
+
+  memory_subsystem_set_recorder_r(ms, NULL);
+  memory_access_r(ms, 0, 2, WRITE_ENABLE_MASK, NULL);
+
+  if (trace_recorder_count(recorder) != num_expected) {
+    printf("Error: %llu events recorded, should be %llu\n", trace_recorder_count(recorder), num_expected);
+    exit(1);
+  }
+  if (trace_recorder_destroy(recorder) != 0) {
+    printf("Error: Writing %s failed\n", path);
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+}
+
+static void check_trace(uint32_t flags)
+{
+  FILE *file = fopen(path, "rb");
+  TRACE_HEADER header;
+  uint64_t words[3];
+  uint64_t size = trace_record_size(flags);
+  uint64_t last_timestamp = 0;
+  uint64_t i;
+
+  if (!file || fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION || header.flags != flags) {
+    printf("Error: %s does not have the right header\n", path);
+    exit(1);
+  }
+
+  for (i = 0; fread(words, size, 1, file) == 1; i++) {
+    if (i >= num_expected) {
+      printf("Error: The trace has more than %llu records\n", num_expected);
+      exit(1);
+    }
+    TRACE_RECORD record = {words[0], words[1], 0};
+    if (trace_record_address(&record) != trace_record_address(&expected[i]) ||
+	trace_record_control(&record) != trace_record_control(&expected[i]) ||
+	record.write_data != expected[i].write_data) {
+      printf("Error: Record %llu is (%llx, %u, %llx), should be (%llx, %u, %llx)\n", i,
+	     trace_record_address(&record), trace_record_control(&record), record.write_data,
+	     trace_record_address(&expected[i]), trace_record_control(&expected[i]), expected[i].write_data);
+      exit(1);
+    }
+    if (flags & TRACE_TIMESTAMPS) {
+      if (words[2] < last_timestamp) {
+	printf("Error: Record %llu has an earlier timestamp than the one before it\n", i);
+	exit(1);
+      }
+      last_timestamp = words[2];
+    }
+  }
+  if (i != num_expected) {
+    printf("Error: The trace has %llu records, should be %llu\n", i, num_expected);
+    exit(1);
+  }
+  fclose(file);
+}
+
+//Checks the records decoded by a reader against the expected ones,
+//from the start of the given block to the end of the trace.
+static void check_records(TRACE_READER *reader, uint64_t block, uint32_t flags)
+{
+  TRACE_RECORD records[1000];
+  uint64_t event = trace_reader_seek_block(reader, block);
+  uint64_t last_timestamp = 0;
+  uint64_t n;
+
+  while ((n = trace_reader_read(reader, records, 1 + event % 1000)) > 0) {
+    for (uint64_t i = 0; i < n; i++, event++) {
+      if (event >= num_expected ||
+	  records[i].address_control != expected[event].address_control ||
+	  records[i].write_data != expected[event].write_data) {
+	printf("Error: Event %llu read from block %llu is not the one recorded\n", event, block);
+	exit(1);
+      }
+      if ((flags & TRACE_TIMESTAMPS) && records[i].timestamp < last_timestamp) {
+	printf("Error: Event %llu has an earlier timestamp than the one before it\n", event);
+	exit(1);
+      }
+      last_timestamp = records[i].timestamp;
+    }
+  }
+  if (event != num_expected || trace_reader_corrupt(reader)) {
+    printf("Error: Reading from block %llu stopped at event %llu of %llu\n", block, event, num_expected);
+    exit(1);
+  }
+}
+
+static void check_reader(uint32_t flags)
+{
+  TRACE_READER *reader = trace_reader_open(path);
+  if (!reader || trace_reader_flags(reader) != flags || trace_reader_num_events(reader) != num_expected ||
+      trace_reader_num_blocks(reader) != (num_expected + TRACE_BLOCK_EVENTS - 1) / TRACE_BLOCK_EVENTS) {
+    printf("Error: The reader did not find %llu events in %s\n", num_expected, path);
+    exit(1);
+  }
+  for (uint64_t block = 0; block <= trace_reader_num_blocks(reader); block++) {
+    check_records(reader, block, flags);
+  }
+  trace_reader_close(reader);
+}
+
+//Checks a compact trace that has lost its index, and then one that
+//has had a byte changed.
+static void check_damaged_compact_trace()
+{
+  struct stat file_status;
+  stat(path, &file_status);
+  TRACE_READER *reader = trace_reader_open(path);
+  uint64_t num_blocks = trace_reader_num_blocks(reader);
+  trace_reader_close(reader);
+
+  if (truncate(path, file_status.st_size - sizeof(TRACE_FOOTER) - 1) != 0) {
+    printf("Error: Could not truncate %s\n", path);
+    exit(1);
+  }
+  reader = trace_reader_open(path);
+  if (!reader || trace_reader_num_blocks(reader) != num_blocks || trace_reader_num_events(reader) != num_expected) {
+    printf("Error: The blocks of a trace without an index were not found\n");
+    exit(1);
+  }
+  check_records(reader, 0, TRACE_COMPACT);
+  check_records(reader, num_blocks / 2, TRACE_COMPACT);
+  trace_reader_close(reader);
+
+  //Changing a byte may or may not make the trace corrupt, but must
+  //not make the reader go past the end of a block.
+  TRACE_RECORD records[1000];
+  for (int k = 0; k < 100; k++) {
+    FILE *file = fopen(path, "r+b");
+    long offset = sizeof(TRACE_HEADER) + sizeof(TRACE_BLOCK_HEADER) + k * 997;
+    fseek(file, offset, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, offset, SEEK_SET);
+    fputc(byte ^ 0xFF, file);
+    fclose(file);
+
+    reader = trace_reader_open(path);
+    uint64_t total = 0, n;
+    while ((n = trace_reader_read(reader, records, 1000)) > 0)
+      total += n;
+    if (total > num_expected) {
+      printf("Error: %llu events read from a trace of %llu\n", total, num_expected);
+      exit(1);
+    }
+    trace_reader_close(reader);
+  }
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_trace_%d.trace", (int) getpid());
+  expected = (TRACE_RECORD *)malloc(NUM_ROUNDS * (ACCESSES_PER_ROUND + BATCH_SIZE + BLOCK_WORDS + 1) * sizeof(TRACE_RECORD));
+  if (!expected) {
+    printf("Error: Allocation failed\n");
+    exit(1);
+  }
+
+  printf("Recording a trace without timestamps\n");
+  record_workload(0);
+  check_trace(0);
+
+  check_reader(0);
+
+  printf("Recording a trace with timestamps\n");
+  record_workload(TRACE_TIMESTAMPS);
+  check_trace(TRACE_TIMESTAMPS);
+  check_reader(TRACE_TIMESTAMPS);
+
+  printf("Recording compact traces, with and without timestamps\n");
+  record_workload(TRACE_COMPACT | TRACE_TIMESTAMPS);
+  check_reader(TRACE_COMPACT | TRACE_TIMESTAMPS);
+  record_workload(TRACE_COMPACT);
+  check_reader(TRACE_COMPACT);
+  check_damaged_compact_trace();
+
+  //A recorder cannot be created where there is no directory.
+  if (trace_recorder_create("/nonexistent/directory/trace", 0)) {
+    printf("Error: Recorder created in a missing directory\n");
+    exit(1);
+  }
+  if (trace_recorder_destroy(NULL) != 0) {
+    printf("Error: Destroying NULL failed\n");
+    exit(1);
+  }
+
+  unlink(path);
+  free(expected);
+  printf("Passed\n");
+}
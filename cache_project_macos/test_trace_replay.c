@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+// Checks that replaying a trace leaves a memory subsystem in exactly
+// the state that the recorded workload left the one it ran on: the
+// same statistics and the same contents. The workload has runs of
+// consecutive words and random words, runs much longer than a replay
+// batch, interrupts at the very start and two in a row. It is
+// recorded with and without timestamps, plain and compact. Also checks
+// that a trace cut off part way through a record (or a block, if it is
+// compact) replays all the records (or blocks) before it, that a
+// replay against several subsystems in lockstep leaves each as a
+// replay against it alone does, and that a file that is not a trace
+// is refused.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<24)
+#define NUM_RUNS 3000
+#define LONGEST_RUN 10000
+#define INTERRUPT_INTERVAL 1000     // in runs
+#define NUM_LOCKSTEP 3
+
+static char path[64];
+
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void check_same(MEMORY_SUBSYSTEM *recorded, MEMORY_SUBSYSTEM *replayed, const char *test)
+{
+  MEMORY_SUBSYSTEM_STATS a, b;
+  memory_get_stats_r(recorded, &a);
+  memory_get_stats_r(replayed, &b);
+  if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+      a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks) {
+    printf("Error: %s, statistics differ (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   test, a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+    exit(1);
+  }
+  for (uint64_t address = 0; address < MAIN_MEMORY_SIZE_IN_BYTES; address += BYTES_PER_WORD) {
+    uint64_t x, y;
+    memory_access_r(recorded, address, 0, READ_ENABLE_MASK, &x);
+    memory_access_r(replayed, address, 0, READ_ENABLE_MASK, &y);
+    if (x != y) {
+      printf("Error: %s, address %llx holds %llx, should be %llx\n", test, address, y, x);
+      exit(1);
+    }
+  }
+}
+
+//Runs the workload on ms with a recorder attached, and returns the
+//number of accesses made.
+static uint64_t record_workload(MEMORY_SUBSYSTEM *ms, uint32_t flags)
+{
+  TRACE_RECORDER *recorder = trace_recorder_create(path, flags);
+  uint64_t state = 24680;
+  uint64_t num_accesses = 0;
+  uint64_t value;
+
+  if (!recorder) {
+    printf("Error: Could not create %s\n", path);
+    exit(1);
+  }
+  memory_subsystem_set_recorder_r(ms, recorder);
+
+  memory_handle_clock_interrupt_r(ms);
+  for (int run = 0; run < NUM_RUNS; run++) {
+    uint64_t length = (run & 1) ? next_random(&state) % LONGEST_RUN : 1;
+    uint64_t address = next_random(&state) % MAIN_MEMORY_SIZE_IN_BYTES & ~(uint64_t)(BYTES_PER_WORD - 1);
+    for (uint64_t j = 0; j < length && address + (j << 3) < MAIN_MEMORY_SIZE_IN_BYTES; j++) {
+      if (next_random(&state) & 1)
+	memory_access_r(ms, address + (j << 3), 0, READ_ENABLE_MASK, &value);
+      else
+	memory_access_r(ms, address + (j << 3), state, WRITE_ENABLE_MASK, NULL);
+      num_accesses++;
+    }
+    if (!((run + 1) % INTERRUPT_INTERVAL)) {
+      memory_handle_clock_interrupt_r(ms);
+      memory_handle_clock_interrupt_r(ms);
+    }
+  }
+
+  memory_subsystem_set_recorder_r(ms, NULL);
+  if (trace_recorder_destroy(recorder) != 0) {
+    printf("Error: Writing %s failed\n", path);
+    exit(1);
+  }
+  return num_accesses;
+}
+
+//Replays the trace against subsystems of several configurations in
+//lockstep, and against each of them alone.
+static void test_lockstep(uint64_t num_accesses)
+{
+  MEMORY_SUBSYSTEM *lockstep[NUM_LOCKSTEP];
+  MEMORY_SUBSYSTEM_CONFIG configs[NUM_LOCKSTEP];
+  TRACE_REPLAY_STATS stats;
+
+  for (int k = 0; k < NUM_LOCKSTEP; k++) {
+    MEMORY_SUBSYSTEM_CONFIG config = MEMORY_SUBSYSTEM_DEFAULT_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+    if (k == 1) {
+      config.l2_geometry.lines_per_set = 8;
+      config.l1_replacement_policy = REPLACEMENT_LRU;
+    } else if (k == 2) {
+      config.l1_geometry.size_in_bytes = 4 * 4 * BYTES_PER_CACHE_LINE;
+      config.l1_replacement_policy = REPLACEMENT_SRRIP;
+      config.l2_replacement_policy = REPLACEMENT_RANDOM;
+    }
+    configs[k] = config;
+    lockstep[k] = memory_subsystem_create_with_config(&config);
+  }
+  if (trace_replay_lockstep_r(lockstep, NUM_LOCKSTEP, path, &stats) != 0 || stats.num_accesses != num_accesses) {
+    printf("Error: Could not replay %s in lockstep\n", path);
+    exit(1);
+  }
+  for (int k = 0; k < NUM_LOCKSTEP; k++) {
+    MEMORY_SUBSYSTEM *alone = memory_subsystem_create_with_config(&configs[k]);
+    trace_replay_r(alone, path, NULL);
+    check_same(alone, lockstep[k], "After a replay in lockstep");
+    memory_subsystem_destroy(alone);
+    memory_subsystem_destroy(lockstep[k]);
+  }
+}
+
+static void test_replay(uint32_t flags)
+{
+  MEMORY_SUBSYSTEM *recorded = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *replayed = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  TRACE_REPLAY_STATS stats;
+
+  uint64_t num_accesses = record_workload(recorded, flags);
+  if (trace_replay_r(replayed, path, &stats) != 0) {
+    printf("Error: Could not replay %s\n", path);
+    exit(1);
+  }
+  if (stats.num_accesses != num_accesses || stats.num_interrupts != 1 + 2 * (NUM_RUNS / INTERRUPT_INTERVAL)) {
+    printf("Error: Replayed %llu accesses and %llu interrupts\n", stats.num_accesses, stats.num_interrupts);
+    exit(1);
+  }
+  check_same(recorded, replayed, "After the replay");
+  memory_subsystem_destroy(replayed);
+  test_lockstep(num_accesses);
+
+  //Cut the trace off part way through its last record (an interrupt),
+  //or for a compact trace part way through its last block.
+  struct stat file_status;
+  stat(path, &file_status);
+  TRACE_READER *reader = trace_reader_open(path);
+  uint64_t num_blocks = trace_reader_num_blocks(reader);
+  uint64_t last_block_events = trace_reader_num_events(reader) - trace_reader_seek_block(reader, num_blocks - 1);
+  trace_reader_close(reader);
+  uint64_t cut = (flags & TRACE_COMPACT) ? num_blocks * sizeof(TRACE_INDEX_ENTRY) + sizeof(TRACE_FOOTER) + 5 : 5;
+  if (truncate(path, file_status.st_size - cut) != 0) {
+    printf("Error: Could not truncate %s\n", path);
+    exit(1);
+  }
+  replayed = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  uint64_t num_events = 1 + 2 * (NUM_RUNS / INTERRUPT_INTERVAL) + num_accesses;
+  uint64_t kept = (flags & TRACE_COMPACT) ? num_events - last_block_events : num_events - 1;
+  if (trace_replay_r(replayed, path, &stats) != 0 || stats.num_accesses + stats.num_interrupts != kept) {
+    printf("Error: The truncated trace was not replayed up to its last whole record or block\n");
+    exit(1);
+  }
+  memory_subsystem_destroy(replayed);
+  memory_subsystem_destroy(recorded);
+}
+
+int main()
+{
+  snprintf(path, sizeof(path), "/tmp/test_trace_replay_%d.trace", (int) getpid());
+
+  printf("Replaying a trace without timestamps\n");
+  test_replay(0);
+
+  printf("Replaying a trace with timestamps\n");
+  test_replay(TRACE_TIMESTAMPS);
+
+  printf("Replaying compact traces, with and without timestamps\n");
+  test_replay(TRACE_COMPACT);
+  test_replay(TRACE_COMPACT | TRACE_TIMESTAMPS);
+
+  //A file that is not a trace.
+  FILE *file = fopen(path, "wb");
+  fprintf(file, "This is not a trace file\n");
+  fclose(file);
+  MEMORY_SUBSYSTEM *ms = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  if (trace_replay_r(ms, path, NULL) != -1 || trace_replay_r(ms, "/nonexistent/trace", NULL) != -1) {
+    printf("Error: Replayed something that is not a trace\n");
+    exit(1);
+  }
+  memory_subsystem_destroy(ms);
+
+  unlink(path);
+  printf("Passed\n");
+}
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+// Checks the synthetic workloads: that the Pass 3 and Pass 4 presets
+// make exactly the accesses that test_memory_subsystem makes, that a
+// workload is the same every time for the same seed, that each pattern
+// makes the accesses it should, and that workload_run_r() does what
+// making the accesses one at a time does.
+
+#define MAIN_MEMORY_SIZE_IN_BYTES (1<<25)
+#define NUM_TEST_ACCESSES (1<<25)
+#define LONGEST_SEQUENCE 10000
+#define NUM_ACCESSES 1000000
+
+static uint64_t addresses[NUM_ACCESSES];
+static uint64_t write_data[NUM_ACCESSES];
+static uint8_t controls[NUM_ACCESSES];
+
+static uint64_t hash_access(uint64_t hash, uint64_t address, uint64_t data, uint8_t control)
+{
+  hash = (hash ^ address) * 0x100000001B3;
+  hash = (hash ^ data) * 0x100000001B3;
+  return (hash ^ control) * 0x100000001B3;
+}
+
+//Hashes the accesses of Passes 3 and 4, made as test_memory_subsystem
+//makes them.
+static uint64_t hash_pass3()
+{
+  uint64_t hash = 0, address;
+  srand(12345);
+  for (uint64_t i = 0; i < NUM_TEST_ACCESSES; i++) {
+    address = (rand() % MAIN_MEMORY_SIZE_IN_BYTES) & ~0x3;
+    if (rand()%2)
+      hash = hash_access(hash, address, (1<<20) - address, READ_ENABLE_MASK);
+    else
+      hash = hash_access(hash, address, (1<<20) - address, WRITE_ENABLE_MASK);
+  }
+  return hash;
+}
+
+static uint64_t hash_pass4()
+{
+  uint64_t hash = 0, address, sequence_length, i = 0, j;
+  srand(54321);
+  while (i < NUM_TEST_ACCESSES) {
+    sequence_length = rand() % LONGEST_SEQUENCE;
+    address = (rand()%MAIN_MEMORY_SIZE_IN_BYTES) & ~0x7;
+    for (j = 0; (j < sequence_length) && ((address+(j<<3)) < MAIN_MEMORY_SIZE_IN_BYTES) && (i < NUM_TEST_ACCESSES); j++) {
+      if (rand()%2)
+	hash = hash_access(hash, address + (j<<3), (1<<20) - address, READ_ENABLE_MASK);
+      else
+	hash = hash_access(hash, address + (j<<3), (1<<20) - address, WRITE_ENABLE_MASK);
+      i++;
+    }
+  }
+  return hash;
+}
+
+static uint64_t hash_workload(WORKLOAD_CONFIG *config)
+{
+  WORKLOAD *workload = workload_create(config);
+  uint64_t hash = 0;
+  for (uint64_t i = 0; i < config->num_accesses; i += NUM_ACCESSES) {
+    uint64_t n = config->num_accesses - i < NUM_ACCESSES ? config->num_accesses - i : NUM_ACCESSES;
+    workload_generate(workload, addresses, write_data, controls, n);
+    for (uint64_t j = 0; j < n; j++)
+      hash = hash_access(hash, addresses[j], write_data[j], controls[j]);
+  }
+  workload_destroy(workload);
+  return hash;
+}
+
+static void test_presets()
+{
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(MAIN_MEMORY_SIZE_IN_BYTES);
+
+  printf("Comparing the presets with Passes 3 and 4\n");
+  if (hash_workload(&pass3) != hash_pass3()) {
+    printf("Error: The Pass 3 preset does not make the accesses of Pass 3\n");
+    exit(1);
+  }
+  if (hash_workload(&pass4) != hash_pass4()) {
+    printf("Error: The Pass 4 preset does not make the accesses of Pass 4\n");
+    exit(1);
+  }
+}
+
+//Generates NUM_ACCESSES accesses of config into the arrays, checking
+//that each is in the region, aligned, and a read or a write.
+static void generate(WORKLOAD_CONFIG *config, const char *test)
+{
+  WORKLOAD *workload = workload_create(config);
+  if (!workload) {
+    printf("Error: %s, could not create the workload\n", test);
+    exit(1);
+  }
+  workload_generate(workload, addresses, write_data, controls, NUM_ACCESSES / 2);
+  workload_generate(workload, addresses + NUM_ACCESSES / 2, write_data + NUM_ACCESSES / 2,
+		    controls + NUM_ACCESSES / 2, NUM_ACCESSES / 2);
+  for (uint64_t i = 0; i < NUM_ACCESSES; i++) {
+    if (addresses[i] < config->base || addresses[i] >= config->base + config->size ||
+	addresses[i] % config->alignment ||
+	(controls[i] != READ_ENABLE_MASK && controls[i] != WRITE_ENABLE_MASK)) {
+      printf("Error: %s, access %llu is (%llx, %u)\n", test, i, addresses[i], controls[i]);
+      exit(1);
+    }
+  }
+  workload_destroy(workload);
+}
+
+static void test_patterns()
+{
+  WORKLOAD_CONFIG config;
+  uint64_t base = 1 << 20;
+  uint64_t i, count;
+
+  printf("Checking each pattern\n");
+  workload_config_from_name("stream", 1 << 16, &config);
+  config.base = base;
+  generate(&config, "stream");
+  for (i = 0, count = 0; i < NUM_ACCESSES; i++) {
+    if (addresses[i] != base + (i * BYTES_PER_WORD) % (1 << 16)) {
+      printf("Error: stream, access %llu is to %llx\n", i, addresses[i]);
+      exit(1);
+    }
+    count += controls[i] == WRITE_ENABLE_MASK;
+  }
+  //One write for every two reads
+  if (count < NUM_ACCESSES / 3 - NUM_ACCESSES / 100 || count > NUM_ACCESSES / 3 + NUM_ACCESSES / 100) {
+    printf("Error: stream, %llu writes\n", count);
+    exit(1);
+  }
+
+  workload_config_from_name("strided", 1 << 16, &config);
+  config.stride = 3 * 4096;
+  generate(&config, "strided");
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    if (addresses[i] != (i * 3 * 4096) % (1 << 16)) {
+      printf("Error: strided, access %llu is to %llx\n", i, addresses[i]);
+      exit(1);
+    }
+  }
+
+  workload_config_from_name("uniform", 1 << 16, &config);
+  config.write_weight = 0;
+  generate(&config, "uniform");
+  uint64_t counts[(1 << 16) / BYTES_PER_WORD] = {0};
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    counts[addresses[i] / BYTES_PER_WORD]++;
+    if (controls[i] != READ_ENABLE_MASK) {
+      printf("Error: uniform, a write with no write weight\n");
+      exit(1);
+    }
+  }
+  //About 122 accesses per word, give or take 11.
+  for (i = 0; i < (1 << 16) / BYTES_PER_WORD; i++) {
+    if (counts[i] < 60 || counts[i] > 190) {
+      printf("Error: uniform, %llu accesses to word %llu\n", counts[i], i);
+      exit(1);
+    }
+  }
+
+  //With an exponent of 1 and 1000 items, the item of rank 1 (which is
+  //item 0) is chosen with probability 1 / (1 + 1/2 + ... + 1/1000),
+  //about 0.1336, and the item of rank 2 with half of that.
+  workload_config_from_name("zipf", 1000 * BYTES_PER_CACHE_LINE, &config);
+  config.zipf_exponent = 1;
+  generate(&config, "zipf");
+  uint64_t first = 0, second = 0;
+  uint64_t second_item = (uint64_t)(2654435761ULL % 1000) * BYTES_PER_CACHE_LINE;
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    first += addresses[i] == 0;
+    second += addresses[i] == second_item;
+  }
+  if (first < 0.130 * NUM_ACCESSES || first > 0.137 * NUM_ACCESSES ||
+      second < 0.065 * NUM_ACCESSES || second > 0.0685 * NUM_ACCESSES) {
+    printf("Error: zipf, the two hottest items were chosen %llu and %llu times\n", first, second);
+    exit(1);
+  }
+
+  //Every item once, before any is visited again
+  workload_config_from_name("chase", 1000 * BYTES_PER_CACHE_LINE, &config);
+  generate(&config, "chase");
+  uint16_t visited[1000] = {0};
+  for (i = 0; i < NUM_ACCESSES; i++) {
+    uint64_t item = addresses[i] / BYTES_PER_CACHE_LINE;
+    if (visited[item]++ != i / 1000) {
+      printf("Error: chase, access %llu is to %llx\n", i, addresses[i]);
+      exit(1);
+    }
+  }
+
+  //Runs of consecutive words, all writing the same value
+  workload_config_from_name("runs", 1 << 20, &config);
+  config.longest_run = 100;
+  generate(&config, "runs");
+  uint64_t run_length = 1;
+  for (i = 1; i < NUM_ACCESSES; i++) {
+    if (addresses[i] == addresses[i - 1] + BYTES_PER_WORD && write_data[i] == write_data[i - 1]) {
+      if (++run_length >= 100) {
+	printf("Error: runs, a run of %llu words\n", run_length);
+	exit(1);
+      }
+    } else {
+      if (write_data[i] != (1 << 20) - addresses[i]) {
+	printf("Error: runs, a run starting at %llx writes %llx\n", addresses[i], write_data[i]);
+	exit(1);
+      }
+      run_length = 1;
+    }
+  }
+}
+
+static void test_seeds()
+{
+  WORKLOAD_CONFIG config;
+
+  printf("Checking that workloads can be repeated\n");
+  workload_config_from_name("zipf", MAIN_MEMORY_SIZE_IN_BYTES, &config);
+  config.num_accesses = NUM_ACCESSES;
+  uint64_t hash = hash_workload(&config);
+  if (hash_workload(&config) != hash) {
+    printf("Error: The same seed gave different accesses\n");
+    exit(1);
+  }
+  config.seed = 2;
+  if (hash_workload(&config) == hash) {
+    printf("Error: A different seed gave the same accesses\n");
+    exit(1);
+  }
+
+  workload_config_from_name("chase", MAIN_MEMORY_SIZE_IN_BYTES, &config);
+  WORKLOAD *workload = workload_create(&config);
+  workload_generate(workload, addresses, write_data, controls, NUM_ACCESSES / 2);
+  workload_reset(workload);
+  workload_generate(workload, addresses + NUM_ACCESSES / 2, write_data + NUM_ACCESSES / 2,
+		    controls + NUM_ACCESSES / 2, NUM_ACCESSES / 2);
+  if (memcmp(addresses, addresses + NUM_ACCESSES / 2, NUM_ACCESSES / 2 * sizeof(uint64_t)) ||
+      memcmp(controls, controls + NUM_ACCESSES / 2, NUM_ACCESSES / 2)) {
+    printf("Error: workload_reset() did not start the workload over\n");
+    exit(1);
+  }
+  workload_destroy(workload);
+}
+
+static void test_invalid()
+{
+  WORKLOAD_CONFIG config;
+
+  printf("Checking invalid configurations\n");
+  if (workload_config_from_name("nothing", MAIN_MEMORY_SIZE_IN_BYTES, &config) != -1) {
+    printf("Error: Found a workload that does not exist\n");
+    exit(1);
+  }
+  workload_config_from_name("strided", MAIN_MEMORY_SIZE_IN_BYTES, &config);
+  WORKLOAD_CONFIG bad[6];
+  for (int i = 0; i < 6; i++)
+    bad[i] = config;
+  bad[0].alignment = 12;
+  bad[1].size = 0;
+  bad[2].base = 4;
+  bad[3].stride = 4;
+  bad[4].read_weight = bad[4].write_weight = 0;
+  bad[5].pattern = (WORKLOAD_PATTERN) 17;
+  for (int i = 0; i < 6; i++) {
+    if (workload_create(&bad[i])) {
+      printf("Error: Invalid configuration %d was accepted\n", i);
+      exit(1);
+    }
+  }
+  workload_destroy(NULL);
+}
+
+//Runs a workload with workload_run_r(), and again an access at a time,
+//and compares the statistics.
+static void test_run(const char *name)
+{
+  MEMORY_SUBSYSTEM *batched = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM *direct = memory_subsystem_create(MAIN_MEMORY_SIZE_IN_BYTES);
+  MEMORY_SUBSYSTEM_STATS a, b;
+  WORKLOAD_CONFIG config;
+  uint64_t read_data;
+
+  printf("Running %s\n", name);
+  workload_config_from_name(name, MAIN_MEMORY_SIZE_IN_BYTES, &config);
+  config.num_accesses = 3 * NUM_ACCESSES + 7;
+  WORKLOAD *workload = workload_create(&config);
+  workload_run_r(batched, workload);
+
+  workload_reset(workload);
+  for (uint64_t i = 0; i < config.num_accesses; i++) {
+    workload_generate(workload, addresses, write_data, controls, 1);
+    memory_access_r(direct, addresses[0], write_data[0], controls[0], &read_data);
+    if (!((i + 1) % config.interrupt_interval))
+      memory_handle_clock_interrupt_r(direct);
+  }
+  workload_destroy(workload);
+
+  memory_get_stats_r(batched, &a);
+  memory_get_stats_r(direct, &b);
+  if (a.num_l1_misses != b.num_l1_misses || a.num_l2_misses != b.num_l2_misses ||
+      a.num_l1_writebacks != b.num_l1_writebacks || a.num_l2_writebacks != b.num_l2_writebacks) {
+    printf("Error: %s, workload_run_r() gave different statistics (L1 misses %llu vs %llu, L2 misses %llu vs %llu)\n",
+	   name, a.num_l1_misses, b.num_l1_misses, a.num_l2_misses, b.num_l2_misses);
+    exit(1);
+  }
+  memory_subsystem_destroy(batched);
+  memory_subsystem_destroy(direct);
+}
+
+int main()
+{
+  test_presets();
+  test_patterns();
+  test_seeds();
+  test_invalid();
+  test_run("pass4");
+  test_run("zipf");
+  printf("Passed\n");
+}
@@ -0,0 +1,241 @@
+/************************************************************
+
+                        text_trace.c
+
+The text trace reader (see text_trace.h).
+
+Each line is parsed in place in the mapping of the file: blanks
+are skipped, the label (for Dinero) is a single digit, and the
+address is converted a digit at a time through a table that says
+whether each byte is a hexadecimal digit, and if so its value.
+Whatever follows the address, in the lines that do not end
+right after it, is skipped with memchr().
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "text_trace.h"
+
+#define TEXT_TRACE_BATCH_SIZE 4096            // accesses
+#define TEXT_TRACE_RELEASE_BYTES (64 << 20)   // of the mapping at a time
+
+struct TEXT_TRACE {
+  const uint8_t *mapping;     // NULL for an empty file
+  uint64_t size;
+  int format;
+  const uint8_t *next;        // the start of the next line
+  uint64_t released;          // bytes of the mapping given back
+  TEXT_TRACE_STATS stats;
+};
+
+//For each byte, 0x10 plus its value if it is a hexadecimal digit,
+//and 0 if it is not.
+#define TEXT_TRACE_HEX_VALUE_MASK 0xF
+
+static const uint8_t text_trace_hex[256] = {
+  ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+  ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+  ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+  ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+};
+
+static inline BOOL is_blank(uint8_t c) {
+  return c == ' ' || c == '\t';
+}
+
+TEXT_TRACE *text_trace_open(const char *path, int format) {
+  if (format != TEXT_TRACE_DINERO && format != TEXT_TRACE_HEX) {
+    return NULL;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat file_status;
+  void *mapping = NULL;
+  if (fstat(fd, &file_status) != 0) {
+    close(fd);
+    return NULL;
+  }
+  if (file_status.st_size > 0) {
+    mapping = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  TEXT_TRACE *trace = (TEXT_TRACE *) calloc(1, sizeof(TEXT_TRACE));
+  if (!trace) {
+    if (mapping) {
+      munmap(mapping, file_status.st_size);
+    }
+    return NULL;
+  }
+  if (mapping) {
+    madvise(mapping, file_status.st_size, MADV_SEQUENTIAL);
+  }
+  trace->mapping = (const uint8_t *) mapping;
+  trace->size = file_status.st_size;
+  trace->format = format;
+  trace->next = trace->mapping;
+  return trace;
+}
+
+void text_trace_close(TEXT_TRACE *trace) {
+  if (trace) {
+    if (trace->mapping) {
+      munmap((void *) trace->mapping, trace->size);
+    }
+    free(trace);
+  }
+}
+
+uint64_t text_trace_read(TEXT_TRACE *trace, uint64_t addresses[], uint8_t controls[], uint64_t max) {
+  if (!trace->mapping) {
+    return 0;
+  }
+  const uint8_t *p = trace->next;
+  const uint8_t *end = trace->mapping + trace->size;
+  uint64_t n = 0;
+
+  while (n < max && p < end) {
+    while (p < end && is_blank(*p)) {
+      p++;
+    }
+
+    //Blank lines and comments
+    if (p == end || *p == '\n' || *p == '\r' || *p == '#') {
+      goto next_line;
+    }
+
+    uint8_t control = READ_ENABLE_MASK;
+    if (trace->format == TEXT_TRACE_DINERO) {
+      uint8_t label = *p++ - '0';
+      if (label > 4 || p == end || !is_blank(*p)) {
+	trace->stats.num_skipped++;
+	goto next_line;
+      }
+      if (label == 3 || label == 4) {
+	trace->stats.num_skipped++;
+	goto next_line;
+      }
+      control = label == 1 ? WRITE_ENABLE_MASK : READ_ENABLE_MASK;
+      while (p < end && is_blank(*p)) {
+	p++;
+      }
+    }
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && text_trace_hex[p[2]]) {
+      p += 2;
+    }
+    uint64_t address = 0;
+    const uint8_t *digits = p;
+    for (uint8_t digit; p < end && (digit = text_trace_hex[*p]); p++) {
+      address = (address << 4) | (digit & TEXT_TRACE_HEX_VALUE_MASK);
+    }
+    if (p == digits || (p < end && !is_blank(*p) && *p != '\r' && *p != '\n')) {
+      trace->stats.num_skipped++;
+      goto next_line;
+    }
+    addresses[n] = address & TRACE_ADDRESS_MASK;
+    controls[n] = control;
+    n++;
+
+    //Most lines end right after the address.
+    if (p < end && *p == '\n') {
+      p++;
+      continue;
+    }
+
+  next_line:
+    p = (const uint8_t *) memchr(p, '\n', end - p);
+    p = p ? p + 1 : end;
+  }
+
+  trace->next = p;
+  trace->stats.num_accesses += n;
+  trace->stats.num_bytes = p - trace->mapping;
+
+  //Give back the host pages of the part of the file already read.
+  if (trace->stats.num_bytes - trace->released >= TEXT_TRACE_RELEASE_BYTES) {
+    uint64_t release_end = trace->stats.num_bytes & ~(uint64_t)(TEXT_TRACE_RELEASE_BYTES - 1);
+    madvise((void *)(trace->mapping + trace->released), release_end - trace->released, MADV_DONTNEED);
+    trace->released = release_end;
+  }
+  return n;
+}
+
+void text_trace_get_stats(TEXT_TRACE *trace, TEXT_TRACE_STATS *stats) {
+  *stats = trace->stats;
+}
+
+int text_trace_detect_format(const char *path) {
+  char buffer[4096];
+  int format = TEXT_TRACE_HEX;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return format;
+  }
+  while (fgets(buffer, sizeof(buffer), file)) {
+    char first[64], second[64];
+    if (buffer[strspn(buffer, " \t\r\n")] == '\0' || buffer[strspn(buffer, " \t")] == '#') {
+      continue;
+    }
+    if (sscanf(buffer, "%63s %63s", first, second) == 2) {
+      format = TEXT_TRACE_DINERO;
+    }
+    break;
+  }
+  fclose(file);
+  return format;
+}
+
+int text_trace_replay_r(MEMORY_SUBSYSTEM *ms, const char *path, int format,
+			uint64_t interrupt_interval, TEXT_TRACE_STATS *stats) {
+  static const uint64_t write_data[TEXT_TRACE_BATCH_SIZE];   // every write is of 0
+  uint64_t addresses[TEXT_TRACE_BATCH_SIZE];
+  uint64_t read_data[TEXT_TRACE_BATCH_SIZE];
+  uint8_t controls[TEXT_TRACE_BATCH_SIZE];
+  uint64_t until_interrupt = interrupt_interval;
+  uint64_t n;
+
+  TEXT_TRACE *trace = text_trace_open(path, format);
+  if (!trace) {
+    return -1;
+  }
+
+  //A batch never goes past the next interrupt.
+  for (;;) {
+    uint64_t max = TEXT_TRACE_BATCH_SIZE;
+    if (interrupt_interval && until_interrupt < max) {
+      max = until_interrupt;
+    }
+    if (!(n = text_trace_read(trace, addresses, controls, max))) {
+      break;
+    }
+    memory_access_batch_r(ms, addresses, write_data, controls, read_data, NULL, n);
+    if (interrupt_interval && !(until_interrupt -= n)) {
+      memory_handle_clock_interrupt_r(ms);
+      until_interrupt = interrupt_interval;
+    }
+  }
+
+  if (stats) {
+    text_trace_get_stats(trace, stats);
+  }
+  text_trace_close(trace);
+  return 0;
+}
@@ -0,0 +1,82 @@
+/************************************************************
+
+                        text_trace.h
+
+Reads address traces kept as text, a line per access, so that
+they can be run against a memory subsystem without converting
+them first. Two formats are understood:
+
+TEXT_TRACE_DINERO, the "din" format of the Dinero IV cache
+simulator: each line is a label and a hexadecimal address,
+separated by spaces or tabs, and optionally followed by anything
+else, which is ignored. The labels are
+
+  0  a data read          -> a read
+  1  a data write         -> a write (of the value 0)
+  2  an instruction fetch -> a read
+  3  an escape record     -> skipped
+  4  a cache flush        -> skipped
+
+TEXT_TRACE_HEX: each line is just a hexadecimal address, which
+is read.
+
+In both, an address may have a "0x" or "0X" prefix and digits of
+either case, and is taken modulo 2^48 (the size of the address
+space, see main_memory.h). Lines may end in "\n" or "\r\n", blank
+lines and lines starting with '#' are skipped, and so is any line
+that is not in the format (which is counted, see TEXT_TRACE_STATS).
+
+The file is mapped into memory and read in one pass, with a
+hand-written tokenizer rather than scanf(), and the parts of it
+already read are released as the reader goes along, so text traces
+far larger than host memory can be read.
+
+**************************************************************/
+
+#ifndef TEXT_TRACE_H
+#define TEXT_TRACE_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+
+#define TEXT_TRACE_DINERO 0
+#define TEXT_TRACE_HEX 1
+
+//What has been read from a text trace.
+typedef struct {
+  uint64_t num_accesses;
+  uint64_t num_skipped;     // lines that are not accesses, other than blank and comment lines
+  uint64_t num_bytes;       // of the file read so far
+} TEXT_TRACE_STATS;
+
+typedef struct TEXT_TRACE TEXT_TRACE;
+
+//Opens the text trace at path, in the given format. Returns NULL if
+//the file cannot be opened or mapped, or the format is not known.
+TEXT_TRACE *text_trace_open(const char *path, int format);
+
+//Unmaps the file and frees the reader. Passing NULL does nothing.
+void text_trace_close(TEXT_TRACE *trace);
+
+//Guesses the format of the text trace at path from its first line
+//that is not blank or a comment: TEXT_TRACE_DINERO if it has two
+//fields, otherwise TEXT_TRACE_HEX.
+int text_trace_detect_format(const char *path);
+
+//Reads the next accesses in the trace, up to max of them, into
+//addresses and controls (READ_ENABLE_MASK or WRITE_ENABLE_MASK).
+//Returns the number read, which is only less than max at the end of
+//the file.
+uint64_t text_trace_read(TEXT_TRACE *trace, uint64_t addresses[], uint8_t controls[], uint64_t max);
+
+void text_trace_get_stats(TEXT_TRACE *trace, TEXT_TRACE_STATS *stats);
+
+//Runs every access in the text trace at path against ms, in order,
+//with memory_access_batch_r(), delivering a clock interrupt after
+//every interrupt_interval accesses (never, if it is 0), and if stats
+//is not NULL fills it in. Returns 0, or -1 if the file cannot be read.
+int text_trace_replay_r(MEMORY_SUBSYSTEM *ms, const char *path, int format,
+			uint64_t interrupt_interval, TEXT_TRACE_STATS *stats);
+
+#endif
@@ -0,0 +1,39 @@
+/************************************************************
+
+The C interface of l1_cache.h (l1_initialize(), l1_cache_access(),
+l1_insert_line() and l1_clear_r_bits()), implemented with the
+compile-time specialized L1Cache from cache_template.hpp. Linking
+test_l1.o against this file instead of l1_cache.o runs the L1
+tests against the template (see the tmpl targets in the makefile).
+
+**************************************************************/
+
+#include "cache_template.hpp"
+
+extern "C" {
+#include "memory_subsystem_constants.h"
+#include "l1_cache.h"
+}
+
+static cache_template::L1Cache l1_template_cache;
+
+extern "C" void l1_initialize() {
+  l1_template_cache.initialize();
+}
+
+extern "C" void l1_cache_access(uint64_t address, uint64_t write_data, 
+				uint8_t control, uint64_t *read_data, uint8_t *status) {
+  *status = l1_template_cache.access_word(address, write_data, control, read_data) ? 1 : 0;
+}
+
+extern "C" void l1_insert_line(uint64_t address, uint64_t write_data[], 
+			       uint64_t *evicted_writeback_address, 
+			       uint64_t evicted_writeback_data[], 
+			       uint8_t *status) {
+  *status = l1_template_cache.insert_line(address, write_data, evicted_writeback_address,
+					  evicted_writeback_data) ? 1 : 0;
+}
+
+extern "C" void l1_clear_r_bits() {
+  l1_template_cache.clear_r_bits();
+}
@@ -0,0 +1,35 @@
+/************************************************************
+
+The C interface of l2_cache.h (l2_initialize(), l2_cache_access()
+and l2_insert_line()), implemented with the compile-time specialized
+L2Cache from cache_template.hpp. Linking test_l2.o against this file
+instead of l2_cache.o runs the L2 tests against the template (see
+the tmpl targets in the makefile).
+
+**************************************************************/
+
+#include "cache_template.hpp"
+
+extern "C" {
+#include "memory_subsystem_constants.h"
+#include "l2_cache.h"
+}
+
+static cache_template::L2Cache l2_template_cache;
+
+extern "C" void l2_initialize() {
+  l2_template_cache.initialize();
+}
+
+extern "C" void l2_cache_access(uint64_t address, uint64_t write_data[], 
+				uint8_t control, uint64_t read_data[], uint8_t *status) {
+  *status = l2_template_cache.access_line(address, write_data, control, read_data) ? 1 : 0;
+}
+
+extern "C" void l2_insert_line(uint64_t address, uint64_t write_data[], 
+			       uint64_t *evicted_writeback_address, 
+			       uint64_t evicted_writeback_data[], 
+			       uint8_t *status) {
+  *status = l2_template_cache.insert_line(address, write_data, evicted_writeback_address,
+					  evicted_writeback_data) ? 1 : 0;
+}
@@ -0,0 +1,762 @@
+/************************************************************
+
+                        trace.c
+
+The trace recorder and reader (see trace.h).
+
+The ring buffer holds TRACE_RING_SIZE records. head counts the
+records the producer (the thread being traced) has stored, and
+tail the records the writer thread has written to the file; both
+only ever grow, and record i lives in slot i % TRACE_RING_SIZE.
+Each side only writes its own counter, so no lock is needed:
+the producer publishes a record by storing head with release
+order after filling the slot, and the writer frees slots by
+storing tail with release order after copying them out. Each
+side keeps a copy of the other's counter, and only reloads it
+when the ring looks full (producer) or empty (writer), so the
+two threads rarely touch the same host cache line.
+
+When the ring is empty the writer sleeps briefly; when it is
+full the producer yields until the writer has made room, since
+no event may be lost.
+
+For a compact trace, the writer encodes the records it drains
+into the current block, and writes the block out when it is
+full. Runs are found by looking ahead through the records drained
+at once, so a run that is split between two drains, or two blocks,
+is simply encoded as two runs.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "memory_subsystem_constants.h"
+#include "trace.h"
+
+#define TRACE_RING_SIZE (1 << 14)          // records, a power of two
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_WRITER_SLEEP_NS 200000       // when the ring is empty
+
+//The most bytes that one encoded event can take: an op byte, a
+//control byte and three varints.
+#define TRACE_MAX_EVENT_BYTES 32
+
+//How much of a file a reader reads before releasing it.
+#define TRACE_RELEASE_BYTES (64 << 20)
+
+struct TRACE_RECORDER {
+  //Written by the producer
+  _Alignas(64) _Atomic uint64_t head;
+  uint64_t cached_tail;
+  uint64_t start_ns;
+
+  //Written by the writer thread
+  _Alignas(64) _Atomic uint64_t tail;
+  _Atomic int stopping;
+  int failed;
+
+  _Alignas(64) FILE *file;
+  uint32_t flags;
+  pthread_t writer;
+  TRACE_RECORD *ring;
+
+  //The block being encoded, for a compact trace, and what its
+  //events are encoded relative to.
+  uint8_t *block;
+  uint64_t block_bytes;
+  uint64_t block_events;
+  uint64_t previous_address;
+  uint64_t previous_data;
+  uint64_t previous_timestamp;
+
+  //The index of the blocks written so far.
+  TRACE_INDEX_ENTRY *index;
+  uint64_t num_blocks;
+  uint64_t index_capacity;
+  uint64_t file_offset;
+  uint64_t events_written;
+};
+
+
+/************************************************************
+
+Varints, as described in trace.h.
+
+**************************************************************/
+
+static inline uint8_t *trace_put_varint(uint8_t *p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = (uint8_t) value | 0x80;
+    value >>= 7;
+  }
+  *p++ = (uint8_t) value;
+  return p;
+}
+
+static inline uint64_t trace_zigzag(uint64_t difference) {
+  return (difference << 1) ^ (uint64_t)((int64_t) difference >> 63);
+}
+
+static inline uint64_t trace_unzigzag(uint64_t value) {
+  return (value >> 1) ^ -(value & 1);
+}
+
+//Reads a varint from p, which must be before end, into *value.
+//Returns the byte after it, or NULL if it runs past end.
+static inline const uint8_t *trace_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    result |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static inline uint8_t *trace_put_op(uint8_t *p, uint8_t kind, uint8_t control) {
+  if (control < TRACE_OP_CONTROL_ESCAPE) {
+    *p++ = kind | (control << TRACE_OP_CONTROL_SHIFT);
+  } else {
+    *p++ = kind | (TRACE_OP_CONTROL_ESCAPE << TRACE_OP_CONTROL_SHIFT);
+    *p++ = control;
+  }
+  return p;
+}
+
+
+static uint64_t trace_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Writes records first .. last - 1 from the ring to the file.
+static void trace_write_records(TRACE_RECORDER *recorder, uint64_t first, uint64_t last) {
+  uint64_t words = trace_record_size(recorder->flags) / sizeof(uint64_t);
+  uint64_t buffer[3 * 1024];
+
+  while (first < last) {
+    uint64_t n = 0;
+    for (; first < last && n + words <= sizeof(buffer) / sizeof(uint64_t); first++) {
+      const TRACE_RECORD *record = &recorder->ring[first & TRACE_RING_MASK];
+      buffer[n++] = record->address_control;
+      buffer[n++] = record->write_data;
+      if (words == 3) {
+        buffer[n++] = record->timestamp;
+      }
+    }
+    if (fwrite(buffer, sizeof(uint64_t), n, recorder->file) != n) {
+      recorder->failed = 1;
+    }
+  }
+}
+
+//Writes the block being encoded to the file, adds it to the index,
+//and starts a new one.
+static void trace_write_block(TRACE_RECORDER *recorder) {
+  if (!recorder->block_events) {
+    return;
+  }
+  if (recorder->num_blocks == recorder->index_capacity) {
+    uint64_t capacity = recorder->index_capacity ? 2 * recorder->index_capacity : 1024;
+    TRACE_INDEX_ENTRY *index = (TRACE_INDEX_ENTRY *) realloc(recorder->index, capacity * sizeof(TRACE_INDEX_ENTRY));
+    if (!index) {
+      recorder->failed = 1;
+      return;
+    }
+    recorder->index = index;
+    recorder->index_capacity = capacity;
+  }
+  TRACE_INDEX_ENTRY *entry = &recorder->index[recorder->num_blocks++];
+  entry->offset = recorder->file_offset;
+  entry->first_event = recorder->events_written;
+
+  TRACE_BLOCK_HEADER header = {recorder->block_events, recorder->block_bytes};
+  if (fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+      fwrite(recorder->block, 1, recorder->block_bytes, recorder->file) != recorder->block_bytes) {
+    recorder->failed = 1;
+  }
+  recorder->file_offset += sizeof(header) + recorder->block_bytes;
+  recorder->events_written += recorder->block_events;
+  recorder->block_bytes = 0;
+  recorder->block_events = 0;
+  recorder->previous_address = 0;
+  recorder->previous_data = 0;
+  recorder->previous_timestamp = 0;
+}
+
+//Encodes the value written and the timestamp of one access, as
+//needed, at p.
+static inline uint8_t *trace_put_data(TRACE_RECORDER *recorder, uint8_t *p, const TRACE_RECORD *record, BOOL write) {
+  if (write) {
+    p = trace_put_varint(p, trace_zigzag(record->write_data - recorder->previous_data));
+    recorder->previous_data = record->write_data;
+  }
+  if (recorder->flags & TRACE_TIMESTAMPS) {
+    p = trace_put_varint(p, trace_zigzag(record->timestamp - recorder->previous_timestamp));
+    recorder->previous_timestamp = record->timestamp;
+  }
+  return p;
+}
+
+//Encodes the n records that start at records into blocks.
+static void trace_encode_records(TRACE_RECORDER *recorder, const TRACE_RECORD *records, uint64_t n) {
+  uint64_t i = 0;
+
+  while (i < n) {
+    if (recorder->block_events == TRACE_BLOCK_EVENTS) {
+      trace_write_block(recorder);
+    }
+    const TRACE_RECORD *record = &records[i];
+    uint8_t control = trace_record_control(record);
+    uint8_t *p = recorder->block + recorder->block_bytes;
+
+    if (control == TRACE_CLOCK_INTERRUPT) {
+      p = trace_put_op(p, TRACE_OP_INTERRUPT, 0);
+      p = trace_put_data(recorder, p, record, FALSE);
+      recorder->block_bytes = p - recorder->block;
+      recorder->block_events++;
+      i++;
+      continue;
+    }
+
+    //Find how many of the records that follow carry on a run of
+    //consecutive words with the same control (comparing the whole
+    //first word of the records compares both).
+    uint64_t room = TRACE_BLOCK_EVENTS - recorder->block_events;
+    uint64_t length = 1;
+    while (i + length < n && length < room &&
+           records[i + length].address_control == record->address_control + (length << WORDS_TO_BYTES_SHIFT)) {
+      length++;
+    }
+
+    uint64_t address = trace_record_address(record);
+    BOOL write = (control & WRITE_ENABLE_MASK) != 0;
+    p = trace_put_op(p, length == 1 ? TRACE_OP_ACCESS : TRACE_OP_RUN, control);
+    p = trace_put_varint(p, trace_zigzag(address - recorder->previous_address));
+    if (length > 1) {
+      p = trace_put_varint(p, length - 2);
+    }
+    for (uint64_t j = 0; j < length; j++) {
+      p = trace_put_data(recorder, p, &records[i + j], write);
+    }
+    recorder->previous_address = address + ((length - 1) << WORDS_TO_BYTES_SHIFT);
+    recorder->block_bytes = p - recorder->block;
+    recorder->block_events += length;
+    i += length;
+  }
+}
+
+//The writer thread: drains the ring until the recorder is stopped
+//and the ring is empty.
+static void *trace_writer(void *arg) {
+  TRACE_RECORDER *recorder = (TRACE_RECORDER *) arg;
+  uint64_t tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+
+  for (;;) {
+    int stopping = atomic_load_explicit(&recorder->stopping, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&recorder->head, memory_order_acquire);
+    if (head != tail) {
+      if (recorder->flags & TRACE_COMPACT) {
+        //The records are contiguous up to the end of the ring.
+        uint64_t wrap = (tail | TRACE_RING_MASK) + 1;
+        if (head > wrap) {
+          trace_encode_records(recorder, &recorder->ring[tail & TRACE_RING_MASK], wrap - tail);
+          trace_encode_records(recorder, recorder->ring, head - wrap);
+        } else {
+          trace_encode_records(recorder, &recorder->ring[tail & TRACE_RING_MASK], head - tail);
+        }
+      } else {
+        trace_write_records(recorder, tail, head);
+      }
+      tail = head;
+      atomic_store_explicit(&recorder->tail, tail, memory_order_release);
+    } else if (stopping) {
+      return NULL;
+    } else {
+      struct timespec pause = {0, TRACE_WRITER_SLEEP_NS};
+      nanosleep(&pause, NULL);
+    }
+  }
+}
+
+TRACE_RECORDER *trace_recorder_create(const char *path, uint32_t flags) {
+  TRACE_RECORDER *recorder = (TRACE_RECORDER *) aligned_alloc(64, sizeof(TRACE_RECORDER));
+  if (!recorder) {
+    return NULL;
+  }
+  memset(recorder, 0, sizeof(TRACE_RECORDER));
+  recorder->flags = flags & (TRACE_TIMESTAMPS | TRACE_COMPACT);
+  recorder->start_ns = trace_now_ns();
+  recorder->ring = (TRACE_RECORD *) malloc(TRACE_RING_SIZE * sizeof(TRACE_RECORD));
+  if (recorder->flags & TRACE_COMPACT) {
+    recorder->block = (uint8_t *) malloc(TRACE_BLOCK_EVENTS * TRACE_MAX_EVENT_BYTES);
+  }
+  recorder->file = fopen(path, "wb");
+  recorder->file_offset = sizeof(TRACE_HEADER);
+
+  TRACE_HEADER header;
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.flags = recorder->flags;
+
+  if (!recorder->ring || !recorder->file || ((recorder->flags & TRACE_COMPACT) && !recorder->block) ||
+      fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+      pthread_create(&recorder->writer, NULL, trace_writer, recorder) != 0) {
+    if (recorder->file) {
+      fclose(recorder->file);
+    }
+    free(recorder->block);
+    free(recorder->ring);
+    free(recorder);
+    return NULL;
+  }
+  return recorder;
+}
+
+int trace_recorder_destroy(TRACE_RECORDER *recorder) {
+  if (!recorder) {
+    return 0;
+  }
+  atomic_store_explicit(&recorder->stopping, 1, memory_order_release);
+  pthread_join(recorder->writer, NULL);
+
+  //Finish a compact trace with its last block and the index.
+  if (recorder->flags & TRACE_COMPACT) {
+    trace_write_block(recorder);
+    TRACE_FOOTER footer;
+    footer.num_blocks = recorder->num_blocks;
+    footer.index_offset = recorder->file_offset;
+    memcpy(footer.magic, TRACE_INDEX_MAGIC, sizeof(footer.magic));
+    if (fwrite(recorder->index, sizeof(TRACE_INDEX_ENTRY), recorder->num_blocks, recorder->file) != recorder->num_blocks ||
+        fwrite(&footer, sizeof(footer), 1, recorder->file) != 1) {
+      recorder->failed = 1;
+    }
+  }
+
+  int failed = recorder->failed;
+  if (fclose(recorder->file) != 0) {
+    failed = 1;
+  }
+  free(recorder->index);
+  free(recorder->block);
+  free(recorder->ring);
+  free(recorder);
+  return failed ? -1 : 0;
+}
+
+void trace_recorder_record(TRACE_RECORDER *recorder, uint64_t address,
+                           uint8_t control, uint64_t write_data) {
+  uint64_t head = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+
+  //Wait for the writer if the ring is full.
+  while (head - recorder->cached_tail >= TRACE_RING_SIZE) {
+    recorder->cached_tail = atomic_load_explicit(&recorder->tail, memory_order_acquire);
+    if (head - recorder->cached_tail >= TRACE_RING_SIZE) {
+      sched_yield();
+    }
+  }
+
+  TRACE_RECORD *record = &recorder->ring[head & TRACE_RING_MASK];
+  record->address_control = (address & TRACE_ADDRESS_MASK) | ((uint64_t) control << TRACE_CONTROL_SHIFT);
+  record->write_data = write_data;
+  if (recorder->flags & TRACE_TIMESTAMPS) {
+    record->timestamp = trace_now_ns() - recorder->start_ns;
+  }
+  atomic_store_explicit(&recorder->head, head + 1, memory_order_release);
+}
+
+uint64_t trace_recorder_count(TRACE_RECORDER *recorder) {
+  return atomic_load_explicit(&recorder->head, memory_order_relaxed);
+}
+
+
+/************************************************************
+
+The trace reader.
+
+The file is mapped read-only. For a compact trace, the index is
+read from the end of the file if it is there, and otherwise built
+by walking through the block headers. The reader decodes one block
+at a time, keeping what the next event is encoded relative to, and
+how much is left of a run that did not fit in the records asked for.
+
+**************************************************************/
+
+struct TRACE_READER {
+  const uint8_t *mapping;
+  uint64_t mapping_size;
+  uint32_t flags;
+  uint64_t record_words;       // 2, or 3 with timestamps
+  uint64_t num_events;
+  uint64_t num_blocks;
+  TRACE_INDEX_ENTRY *index;    // compact traces only
+  BOOL corrupt;
+
+  //Where the reader is: the next event, and for a compact trace the
+  //encoded events left in the current block.
+  uint64_t event;
+  uint64_t block;
+  const uint8_t *next;
+  const uint8_t *block_end;
+  uint64_t block_events_left;
+  uint64_t previous_address;
+  uint64_t previous_data;
+  uint64_t previous_timestamp;
+  uint64_t run_left;
+  uint64_t run_address;
+  uint8_t run_control;
+
+  uint64_t released;           // bytes of the mapping given back
+};
+
+//Returns TRUE if a block header could have been written by a
+//recorder, with room bytes of the file after it. Every block holds
+//at least one event, and every event takes at least one byte, so
+//this is never true of the first entry of an index, and walking
+//through the blocks of a trace without a footer stops at its index.
+static inline BOOL trace_block_header_valid(const TRACE_BLOCK_HEADER *header, uint64_t room) {
+  return header->num_events >= 1 && header->num_events <= TRACE_BLOCK_EVENTS &&
+         header->num_bytes >= 1 && header->num_bytes <= room;
+}
+
+//Checks that the blocks listed in the index of a compact trace
+//follow each other from the header up to the index itself, and
+//sets num_events.
+static BOOL trace_reader_check_index(TRACE_READER *reader, uint64_t index_offset) {
+  uint64_t offset = sizeof(TRACE_HEADER);
+  uint64_t num_events = 0;
+
+  for (uint64_t i = 0; i < reader->num_blocks; i++) {
+    TRACE_BLOCK_HEADER header;
+    if (reader->index[i].offset != offset || reader->index[i].first_event != num_events ||
+        index_offset - offset < sizeof(header)) {
+      return FALSE;
+    }
+    memcpy(&header, reader->mapping + offset, sizeof(header));
+    if (!trace_block_header_valid(&header, index_offset - offset - sizeof(header))) {
+      return FALSE;
+    }
+    offset += sizeof(header) + header.num_bytes;
+    num_events += header.num_events;
+  }
+  reader->num_events = num_events;
+  return offset == index_offset;
+}
+
+//Reads the index of a compact trace, from its footer if it has one
+//that makes sense. Returns FALSE if it cannot be allocated.
+static BOOL trace_reader_load_index(TRACE_READER *reader) {
+  TRACE_FOOTER footer;
+  uint64_t size = reader->mapping_size;
+
+  if (size >= sizeof(TRACE_HEADER) + sizeof(footer)) {
+    memcpy(&footer, reader->mapping + size - sizeof(footer), sizeof(footer));
+    if (memcmp(footer.magic, TRACE_INDEX_MAGIC, sizeof(footer.magic)) == 0 &&
+        footer.index_offset >= sizeof(TRACE_HEADER) && footer.index_offset <= size - sizeof(footer) &&
+        footer.num_blocks == (size - sizeof(footer) - footer.index_offset) / sizeof(TRACE_INDEX_ENTRY) &&
+        footer.index_offset + footer.num_blocks * sizeof(TRACE_INDEX_ENTRY) + sizeof(footer) == size) {
+      reader->num_blocks = footer.num_blocks;
+      reader->index = (TRACE_INDEX_ENTRY *) malloc((footer.num_blocks + 1) * sizeof(TRACE_INDEX_ENTRY));
+      if (!reader->index) {
+        return FALSE;
+      }
+      memcpy(reader->index, reader->mapping + footer.index_offset, footer.num_blocks * sizeof(TRACE_INDEX_ENTRY));
+      if (trace_reader_check_index(reader, footer.index_offset)) {
+        reader->index[footer.num_blocks].offset = footer.index_offset;
+        reader->index[footer.num_blocks].first_event = reader->num_events;
+        return TRUE;
+      }
+      free(reader->index);
+    }
+  }
+
+  //No index: walk through the blocks, stopping at one that does
+  //not fit in the file.
+  uint64_t capacity = 1024;
+  uint64_t offset = sizeof(TRACE_HEADER);
+  reader->index = (TRACE_INDEX_ENTRY *) malloc(capacity * sizeof(TRACE_INDEX_ENTRY));
+  reader->num_blocks = 0;
+  reader->num_events = 0;
+  for (;;) {
+    if (!reader->index) {
+      return FALSE;
+    }
+    reader->index[reader->num_blocks].offset = offset;
+    reader->index[reader->num_blocks].first_event = reader->num_events;
+
+    TRACE_BLOCK_HEADER header;
+    if (size - offset < sizeof(header)) {
+      return TRUE;
+    }
+    memcpy(&header, reader->mapping + offset, sizeof(header));
+    if (!trace_block_header_valid(&header, size - offset - sizeof(header))) {
+      return TRUE;
+    }
+    offset += sizeof(header) + header.num_bytes;
+    reader->num_events += header.num_events;
+    if (++reader->num_blocks == capacity) {
+      capacity *= 2;
+      TRACE_INDEX_ENTRY *index = (TRACE_INDEX_ENTRY *) realloc(reader->index, capacity * sizeof(TRACE_INDEX_ENTRY));
+      if (!index) {
+        free(reader->index);
+      }
+      reader->index = index;
+    }
+  }
+}
+
+TRACE_READER *trace_reader_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  TRACE_HEADER header;
+  struct stat file_status;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &file_status) == 0 && file_status.st_size >= (off_t) sizeof(TRACE_HEADER) &&
+      pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == TRACE_VERSION && !(header.flags & ~(TRACE_TIMESTAMPS | TRACE_COMPACT))) {
+    mapping = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(mapping, file_status.st_size, MADV_SEQUENTIAL);
+
+  TRACE_READER *reader = (TRACE_READER *) calloc(1, sizeof(TRACE_READER));
+  if (!reader) {
+    munmap(mapping, file_status.st_size);
+    return NULL;
+  }
+  reader->mapping = (const uint8_t *) mapping;
+  reader->mapping_size = file_status.st_size;
+  reader->flags = header.flags;
+  reader->record_words = trace_record_size(header.flags) / sizeof(uint64_t);
+
+  if (header.flags & TRACE_COMPACT) {
+    if (!trace_reader_load_index(reader)) {
+      trace_reader_close(reader);
+      return NULL;
+    }
+  } else {
+    reader->num_events = (reader->mapping_size - sizeof(TRACE_HEADER)) / (reader->record_words * sizeof(uint64_t));
+    reader->num_blocks = (reader->num_events + TRACE_BLOCK_EVENTS - 1) / TRACE_BLOCK_EVENTS;
+  }
+  trace_reader_seek_block(reader, 0);
+  return reader;
+}
+
+void trace_reader_close(TRACE_READER *reader) {
+  if (reader) {
+    munmap((void *) reader->mapping, reader->mapping_size);
+    free(reader->index);
+    free(reader);
+  }
+}
+
+uint32_t trace_reader_flags(TRACE_READER *reader) {
+  return reader->flags;
+}
+
+uint64_t trace_reader_num_events(TRACE_READER *reader) {
+  return reader->num_events;
+}
+
+uint64_t trace_reader_num_blocks(TRACE_READER *reader) {
+  return reader->num_blocks;
+}
+
+int trace_reader_corrupt(TRACE_READER *reader) {
+  return reader->corrupt;
+}
+
+//Starts decoding the given block of a compact trace.
+static void trace_reader_enter_block(TRACE_READER *reader, uint64_t block) {
+  reader->block = block;
+  reader->previous_address = 0;
+  reader->previous_data = 0;
+  reader->previous_timestamp = 0;
+  reader->run_left = 0;
+  if (block < reader->num_blocks) {
+    TRACE_BLOCK_HEADER header;
+    memcpy(&header, reader->mapping + reader->index[block].offset, sizeof(header));
+    reader->next = reader->mapping + reader->index[block].offset + sizeof(header);
+    reader->block_end = reader->next + header.num_bytes;
+    reader->block_events_left = header.num_events;
+  } else {
+    reader->next = reader->block_end = NULL;
+    reader->block_events_left = 0;
+  }
+}
+
+uint64_t trace_reader_seek_block(TRACE_READER *reader, uint64_t block) {
+  if (block > reader->num_blocks) {
+    block = reader->num_blocks;
+  }
+  reader->corrupt = FALSE;
+  if (reader->flags & TRACE_COMPACT) {
+    trace_reader_enter_block(reader, block);
+    reader->event = reader->index[block].first_event;
+    reader->released = reader->index[block].offset;
+  } else {
+    reader->event = block * TRACE_BLOCK_EVENTS;
+    if (reader->event > reader->num_events) {
+      reader->event = reader->num_events;
+    }
+    reader->released = sizeof(TRACE_HEADER) + reader->event * reader->record_words * sizeof(uint64_t);
+  }
+  reader->released &= ~(uint64_t)(TRACE_RELEASE_BYTES - 1);
+  return reader->event;
+}
+
+//Gives back the host memory holding the parts of the file before
+//offset, every TRACE_RELEASE_BYTES.
+static inline void trace_reader_release(TRACE_READER *reader, uint64_t offset) {
+  if (offset - reader->released >= TRACE_RELEASE_BYTES) {
+    uint64_t end = offset & ~(uint64_t)(TRACE_RELEASE_BYTES - 1);
+    madvise((void *)(reader->mapping + reader->released), end - reader->released, MADV_DONTNEED);
+    reader->released = end;
+  }
+}
+
+//Decodes the value written and the timestamp of one access, as
+//needed, into record. Returns NULL if they run past the end of the block.
+static inline const uint8_t *trace_get_data(TRACE_READER *reader, const uint8_t *p, TRACE_RECORD *record, BOOL write) {
+  uint64_t value;
+  record->write_data = 0;
+  record->timestamp = 0;
+  if (write) {
+    if (!(p = trace_get_varint(p, reader->block_end, &value))) {
+      return NULL;
+    }
+    reader->previous_data += trace_unzigzag(value);
+    record->write_data = reader->previous_data;
+  }
+  if (reader->flags & TRACE_TIMESTAMPS) {
+    if (!(p = trace_get_varint(p, reader->block_end, &value))) {
+      return NULL;
+    }
+    reader->previous_timestamp += trace_unzigzag(value);
+    record->timestamp = reader->previous_timestamp;
+  }
+  return p;
+}
+
+//Decodes up to max events of a compact trace.
+static uint64_t trace_reader_decode(TRACE_READER *reader, TRACE_RECORD records[], uint64_t max) {
+  const uint8_t *p = reader->next;
+  uint64_t n = 0;
+
+  while (n < max && !reader->corrupt) {
+    //Carry on with a run.
+    if (reader->run_left) {
+      BOOL write = (reader->run_control & WRITE_ENABLE_MASK) != 0;
+      uint64_t control_bits = (uint64_t) reader->run_control << TRACE_CONTROL_SHIFT;
+      for (; reader->run_left && n < max; reader->run_left--, n++) {
+        records[n].address_control = reader->run_address | control_bits;
+        if (!(p = trace_get_data(reader, p, &records[n], write))) {
+          reader->corrupt = TRUE;
+          break;
+        }
+        reader->previous_address = reader->run_address;
+        reader->run_address = (reader->run_address + BYTES_PER_WORD) & TRACE_ADDRESS_MASK;
+      }
+      if (reader->corrupt) {
+        break;
+      }
+      continue;
+    }
+
+    if (!reader->block_events_left) {
+      if (reader->block + 1 >= reader->num_blocks) {
+        break;
+      }
+      trace_reader_enter_block(reader, reader->block + 1);
+      p = reader->next;
+      continue;
+    }
+    if (p >= reader->block_end) {
+      reader->corrupt = TRUE;
+      break;
+    }
+
+    uint8_t op = *p++;
+    uint8_t kind = op & TRACE_OP_KIND_MASK;
+    uint8_t control = op >> TRACE_OP_CONTROL_SHIFT;
+    uint64_t difference, length = 1;
+    if (control == TRACE_OP_CONTROL_ESCAPE) {
+      if (p >= reader->block_end) {
+        reader->corrupt = TRUE;
+        break;
+      }
+      control = *p++;
+    }
+
+    if (kind == TRACE_OP_INTERRUPT) {
+      records[n].address_control = (uint64_t) TRACE_CLOCK_INTERRUPT << TRACE_CONTROL_SHIFT;
+      if (!(p = trace_get_data(reader, p, &records[n], FALSE))) {
+        reader->corrupt = TRUE;
+        break;
+      }
+      n++;
+      reader->block_events_left--;
+      continue;
+    }
+    if (kind > TRACE_OP_RUN || !(p = trace_get_varint(p, reader->block_end, &difference)) ||
+        (kind == TRACE_OP_RUN && (!(p = trace_get_varint(p, reader->block_end, &length)) ||
+                                  (length += 2) > reader->block_events_left))) {
+      reader->corrupt = TRUE;
+      break;
+    }
+    reader->run_address = (reader->previous_address + trace_unzigzag(difference)) & TRACE_ADDRESS_MASK;
+    reader->run_control = control;
+    reader->run_left = length;
+    reader->block_events_left -= length;
+  }
+
+  reader->next = p ? p : reader->next;
+  if (p) {
+    trace_reader_release(reader, p - reader->mapping);
+  }
+  return n;
+}
+
+uint64_t trace_reader_read(TRACE_READER *reader, TRACE_RECORD records[], uint64_t max) {
+  uint64_t n;
+
+  if (reader->flags & TRACE_COMPACT) {
+    n = trace_reader_decode(reader, records, max);
+  } else {
+    const uint64_t *record = (const uint64_t *)(reader->mapping + sizeof(TRACE_HEADER)) + reader->event * reader->record_words;
+    n = reader->num_events - reader->event;
+    if (n > max) {
+      n = max;
+    }
+    for (uint64_t i = 0; i < n; i++, record += reader->record_words) {
+      records[i].address_control = record[0];
+      records[i].write_data = record[1];
+      records[i].timestamp = reader->record_words == 3 ? record[2] : 0;
+    }
+    trace_reader_release(reader, (const uint8_t *) record - reader->mapping);
+  }
+  reader->event += n;
+  return n;
+}
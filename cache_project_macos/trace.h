@@ -0,0 +1,226 @@
+/************************************************************
+
+                        trace.h
+
+Binary traces of the requests made of a memory subsystem, so
+that a workload can be captured once and replayed against other
+configurations.
+
+A trace file is a TRACE_HEADER followed by one record per event,
+in the order the events happened. An event is a call to
+memory_access() (or one of the words of a batch or block, which
+are recorded as the memory_access() calls they stand for), or a
+clock interrupt. Each record is, in host byte order:
+
+  word 0: the address in bits 0-47, and the control byte in
+          bits 56-63 (TRACE_CLOCK_INTERRUPT for an interrupt,
+          otherwise the control passed to memory_access()).
+  word 1: the value written (0 for a read or an interrupt).
+  word 2: only if the header has TRACE_TIMESTAMPS set: when the
+          event happened, in nanoseconds since recording started.
+
+so records are 16 bytes, or 24 with timestamps.
+
+Compact traces
+
+A trace whose header has TRACE_COMPACT set holds the same events,
+but encoded in far fewer bytes. The events are split into blocks of
+at most TRACE_BLOCK_EVENTS, each a TRACE_BLOCK_HEADER followed by
+its encoded events, and each decodable on its own: everything that
+an event is encoded relative to starts again from 0 in each block.
+In a block, each event starts with an op byte, whose low two bits
+are its kind, and whose other six bits are the control byte (or 63,
+followed by the control byte, if that is 63 or more):
+
+  TRACE_OP_ACCESS     one access: the address, as the zig-zag
+                      varint of its difference from the address
+                      of the access before it, and then, for a
+                      write, the value, as the zig-zag varint of
+                      its difference from the value before it.
+  TRACE_OP_RUN        a run of 2 or more accesses with the same
+                      control to consecutive words: the address of
+                      the first, as for TRACE_OP_ACCESS, the varint
+                      of the length less 2, and then for a write
+                      each value in turn, as for TRACE_OP_ACCESS.
+  TRACE_OP_INTERRUPT  a clock interrupt.
+
+(A varint is 7 bits per byte, lowest first, with bit 7 set in every
+byte but the last; the zig-zag of a difference d is 2d for d >= 0
+and -2d - 1 otherwise, so small differences either way are short.)
+With timestamps, every event, including each access of a run, is
+followed by the varint of its timestamp less the one before it.
+
+After the last block come the index, a TRACE_INDEX_ENTRY for each
+block, and a TRACE_FOOTER, so that a reader can go straight to any
+block; a trace whose recording did not finish has no index, and its
+blocks are found by walking from the first.
+
+Recording
+
+A TRACE_RECORDER writes a trace file. Events are handed to it
+with trace_recorder_record() (memory_subsystem_set_recorder_r()
+makes a memory subsystem do so for every access), which only
+stores the record in a lock-free ring buffer. A background
+thread belonging to the recorder drains the ring into the file,
+so the thread being traced never waits for the disk unless the
+ring fills up.
+
+The ring has a single producer: a recorder must only be given
+events by one thread at a time. To trace several threads, give
+each its own recorder (and file); there is no per-thread
+buffering within one recorder. For a compact trace, the writer
+thread also does the encoding.
+
+bench_trace measures the cost of recording Pass 3 and Pass 4 of
+test_memory_subsystem, both in wall time and in the CPU time of the
+thread being traced. On a single-core host, where the writer thread
+shares the core, recording adds 25-45% to the wall time (flat) and
+more for compact traces, and 0-30% to the traced thread's own CPU
+time, which there includes waiting for the ring to drain and the
+caches the writer disturbs. Run it on a host with a spare core to
+see the producer's cost alone; it has not been measured there.
+
+Reading
+
+A TRACE_READER maps a trace file of either kind into memory and
+hands back its events, decoded into TRACE_RECORDs. The events can
+be read from the start of any block (the blocks of a trace that is
+not compact are taken to be runs of TRACE_BLOCK_EVENTS records), so
+several readers of the same file can each take a share of it.
+
+**************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "MEMTRACE"
+#define TRACE_VERSION 1
+
+//Header flags
+#define TRACE_TIMESTAMPS 0x1
+#define TRACE_COMPACT 0x2
+
+//The control byte of a clock interrupt record.
+#define TRACE_CLOCK_INTERRUPT 0x80
+
+#define TRACE_ADDRESS_MASK 0xFFFFFFFFFFFF
+#define TRACE_CONTROL_SHIFT 56
+
+typedef struct {
+  char magic[8];        // TRACE_MAGIC, without a terminating 0
+  uint32_t version;     // TRACE_VERSION
+  uint32_t flags;       // TRACE_TIMESTAMPS, or 0
+} TRACE_HEADER;
+
+//Compact traces
+#define TRACE_BLOCK_EVENTS 65536         // the most events in a block
+#define TRACE_INDEX_MAGIC "MEMINDEX"
+
+#define TRACE_OP_ACCESS 0
+#define TRACE_OP_RUN 1
+#define TRACE_OP_INTERRUPT 2
+#define TRACE_OP_KIND_MASK 0x3
+#define TRACE_OP_CONTROL_SHIFT 2
+#define TRACE_OP_CONTROL_ESCAPE 63
+
+typedef struct {
+  uint64_t num_events;
+  uint64_t num_bytes;   // of encoded events, after this header
+} TRACE_BLOCK_HEADER;
+
+typedef struct {
+  uint64_t offset;        // of the block's header, from the start of the file
+  uint64_t first_event;   // the number of events in the blocks before it
+} TRACE_INDEX_ENTRY;
+
+typedef struct {
+  uint64_t num_blocks;
+  uint64_t index_offset;  // of the first TRACE_INDEX_ENTRY
+  char magic[8];          // TRACE_INDEX_MAGIC, without a terminating 0
+} TRACE_FOOTER;
+
+//One record, as it is kept in memory. The timestamp is only written
+//to the file if the trace has timestamps.
+typedef struct {
+  uint64_t address_control;
+  uint64_t write_data;
+  uint64_t timestamp;
+} TRACE_RECORD;
+
+static inline uint64_t trace_record_address(const TRACE_RECORD *record) {
+  return record->address_control & TRACE_ADDRESS_MASK;
+}
+
+static inline uint8_t trace_record_control(const TRACE_RECORD *record) {
+  return (uint8_t)(record->address_control >> TRACE_CONTROL_SHIFT);
+}
+
+//Returns the size in bytes of each record of a trace with the given
+//header flags.
+static inline uint64_t trace_record_size(uint32_t flags) {
+  return (flags & TRACE_TIMESTAMPS) ? 3 * sizeof(uint64_t) : 2 * sizeof(uint64_t);
+}
+
+
+typedef struct TRACE_RECORDER TRACE_RECORDER;
+
+//Creates (or truncates) the trace file at path, writes its header
+//and starts the recorder's writer thread. flags is TRACE_TIMESTAMPS
+//TRACE_COMPACT, or both, or 0. Returns NULL if the file cannot be
+//created or the thread cannot be started.
+TRACE_RECORDER *trace_recorder_create(const char *path, uint32_t flags);
+
+//Writes every event recorded so far to the file, stops the writer
+//thread, closes the file and frees the recorder. Returns 0 if all
+//of the trace was written, -1 if writing failed. Passing NULL does
+//nothing (and returns 0).
+int trace_recorder_destroy(TRACE_RECORDER *recorder);
+
+//Records one event: an access (see memory_access() for address,
+//write_data and control) or, with control TRACE_CLOCK_INTERRUPT,
+//a clock interrupt.
+void trace_recorder_record(TRACE_RECORDER *recorder, uint64_t address,
+			   uint8_t control, uint64_t write_data);
+
+//Returns the number of events recorded so far.
+uint64_t trace_recorder_count(TRACE_RECORDER *recorder);
+
+
+typedef struct TRACE_READER TRACE_READER;
+
+//Opens the trace file at path, and places the reader at its first
+//event. Returns NULL if the file cannot be opened or mapped, or is
+//not a trace.
+TRACE_READER *trace_reader_open(const char *path);
+
+//Unmaps the file and frees the reader. Passing NULL does nothing.
+void trace_reader_close(TRACE_READER *reader);
+
+//Returns the header flags of the trace.
+uint32_t trace_reader_flags(TRACE_READER *reader);
+
+//Returns the number of events in the trace, and the number of blocks
+//that they are in. A partial record or block at the end of the file
+//(left by a recording that did not finish) is not counted.
+uint64_t trace_reader_num_events(TRACE_READER *reader);
+uint64_t trace_reader_num_blocks(TRACE_READER *reader);
+
+//Places the reader at the first event of the given block (block
+//num_blocks being the end of the trace), and returns the number of
+//events before it.
+uint64_t trace_reader_seek_block(TRACE_READER *reader, uint64_t block);
+
+//Decodes up to max events, starting at the reader's place, into
+//records, and moves past them. Returns the number decoded, which is
+//only less than max at the end of the trace, or if the rest of the
+//trace is corrupt (see trace_reader_corrupt()). The parts of the
+//file already read are released from host memory as the reader goes
+//along.
+uint64_t trace_reader_read(TRACE_READER *reader, TRACE_RECORD records[], uint64_t max);
+
+//Returns TRUE if reading stopped at an encoded event that made no sense.
+int trace_reader_corrupt(TRACE_READER *reader);
+
+#endif
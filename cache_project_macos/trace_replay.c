@@ -0,0 +1,481 @@
+/************************************************************
+
+                        trace_replay.c
+
+The trace replay engine (see trace_replay.h).
+
+The decoding thread fills the batches of a ring of
+TRACE_REPLAY_QUEUE_SLOTS, and the calling thread empties them,
+in the same way as the trace recorder's ring (see trace.c):
+head counts the batches filled and tail the batches emptied,
+each side only writes its own counter, with release order after
+it has finished with the slot, and reads the other's with acquire
+order. A side that finds the queue full (decoder) or empty (caller)
+yields the host processor to the other one.
+
+A batch ends when it is full or when the trace has a clock
+interrupt, so that memory_access_batch_r() never has to be
+interrupted; a batch can be empty, if the trace has two interrupts
+in a row. In a lockstep replay, the calling thread performs each
+batch on every subsystem in turn before it releases the slot.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+#define TRACE_REPLAY_BATCH_SIZE 4096             // accesses
+#define TRACE_REPLAY_QUEUE_SLOTS 4               // batches, a power of two
+
+typedef struct {
+  uint64_t addresses[TRACE_REPLAY_BATCH_SIZE];
+  uint64_t write_data[TRACE_REPLAY_BATCH_SIZE];
+  uint8_t controls[TRACE_REPLAY_BATCH_SIZE];
+  uint64_t n;
+  BOOL interrupt;         // the batch is followed by a clock interrupt
+} TRACE_REPLAY_BATCH;
+
+typedef struct {
+  //Written by the decoding thread
+  _Alignas(64) _Atomic uint64_t head;
+  _Atomic int done;
+
+  //Written by the calling thread
+  _Alignas(64) _Atomic uint64_t tail;
+
+  _Alignas(64) TRACE_READER *reader;
+  TRACE_REPLAY_BATCH *slots;
+} TRACE_REPLAY_QUEUE;
+
+
+//The decoding thread: turns the events of the trace into batches.
+static void *trace_replay_decode(void *arg) {
+  TRACE_REPLAY_QUEUE *queue = (TRACE_REPLAY_QUEUE *) arg;
+  TRACE_RECORD records[TRACE_REPLAY_BATCH_SIZE];
+  uint64_t num_records = 0;
+  uint64_t i = 0;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+
+  for (;;) {
+    if (i == num_records) {
+      num_records = trace_reader_read(queue->reader, records, TRACE_REPLAY_BATCH_SIZE);
+      i = 0;
+      if (!num_records) {
+        break;
+      }
+    }
+
+    //Wait for a free slot.
+    while (head - tail >= TRACE_REPLAY_QUEUE_SLOTS) {
+      tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+      if (head - tail >= TRACE_REPLAY_QUEUE_SLOTS) {
+	sched_yield();
+      }
+    }
+
+    //Fill it from the records decoded, up to the next interrupt.
+    //A batch that has room left when they run out is sent anyway,
+    //rather than waiting for the next records.
+    TRACE_REPLAY_BATCH *batch = &queue->slots[head & (TRACE_REPLAY_QUEUE_SLOTS - 1)];
+    uint64_t n = 0;
+    batch->interrupt = FALSE;
+    for (; i < num_records; i++) {
+      uint8_t control = trace_record_control(&records[i]);
+      if (control == TRACE_CLOCK_INTERRUPT) {
+	batch->interrupt = TRUE;
+	i++;
+	break;
+      }
+      batch->addresses[n] = trace_record_address(&records[i]);
+      batch->write_data[n] = records[i].write_data;
+      batch->controls[n] = control;
+      n++;
+    }
+    batch->n = n;
+    head++;
+    atomic_store_explicit(&queue->head, head, memory_order_release);
+  }
+  atomic_store_explicit(&queue->done, 1, memory_order_release);
+  return NULL;
+}
+
+
+int trace_replay_r(MEMORY_SUBSYSTEM *ms, const char *path, TRACE_REPLAY_STATS *stats) {
+  return trace_replay_lockstep_r(&ms, 1, path, stats);
+}
+
+int trace_replay_lockstep_r(MEMORY_SUBSYSTEM *ms[], int num_subsystems, const char *path, TRACE_REPLAY_STATS *stats) {
+  TRACE_REPLAY_QUEUE queue;
+  TRACE_REPLAY_STATS replayed = {0, 0};
+  uint64_t read_data[TRACE_REPLAY_BATCH_SIZE];
+  pthread_t decoder;
+
+  memset(&queue, 0, sizeof(queue));
+  queue.reader = trace_reader_open(path);
+  if (!queue.reader) {
+    return -1;
+  }
+  queue.slots = (TRACE_REPLAY_BATCH *) malloc(TRACE_REPLAY_QUEUE_SLOTS * sizeof(TRACE_REPLAY_BATCH));
+  if (!queue.slots || pthread_create(&decoder, NULL, trace_replay_decode, &queue) != 0) {
+    free(queue.slots);
+    trace_reader_close(queue.reader);
+    return -1;
+  }
+
+  uint64_t tail = 0;
+  for (;;) {
+    //Wait for a full slot, or for the end of the trace. done is read
+    //before head, so that no batch is missed.
+    int done = atomic_load_explicit(&queue.done, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&queue.head, memory_order_acquire);
+    if (head == tail) {
+      if (done) {
+	break;
+      }
+      sched_yield();
+      continue;
+    }
+
+    for (; tail < head; tail++) {
+      TRACE_REPLAY_BATCH *batch = &queue.slots[tail & (TRACE_REPLAY_QUEUE_SLOTS - 1)];
+      for (int k = 0; k < num_subsystems; k++) {
+	memory_access_batch_r(ms[k], batch->addresses, batch->write_data, batch->controls, read_data, NULL, batch->n);
+	if (batch->interrupt) {
+	  memory_handle_clock_interrupt_r(ms[k]);
+	}
+      }
+      replayed.num_accesses += batch->n;
+      replayed.num_interrupts += batch->interrupt;
+      atomic_store_explicit(&queue.tail, tail + 1, memory_order_release);
+    }
+  }
+
+  pthread_join(decoder, NULL);
+  int corrupt = trace_reader_corrupt(queue.reader);
+  free(queue.slots);
+  trace_reader_close(queue.reader);
+  if (stats) {
+    *stats = replayed;
+  }
+  return corrupt ? -1 : 0;
+}
+
+
+/***************************************************
+Parallel replay (see trace_replay.h).
+
+Each thread decodes TRACE_REPLAY_ROUND_BLOCKS blocks
+per round with a TRACE_READER of its own, and has a
+bucket for each shard in each of the two buffers; the
+buckets of buffer b that decoding thread d fills for
+shard s are buckets[(b * num_shards + d) * num_shards + s].
+Shard s replays the buckets of every decoding thread
+for it, in the order of the threads, which is trace
+order. A clock interrupt goes into every bucket, as an
+entry with control TRACE_CLOCK_INTERRUPT.
+
+The barrier is a count of the threads that have reached
+it, which only goes up: round r is over when it reaches
+(r + 1) times the number of threads.
+****************************************************/
+
+#define TRACE_REPLAY_ROUND_BLOCKS 2           // per thread
+#define TRACE_REPLAY_BUCKET_MIN 4096          // entries
+
+typedef struct {
+  uint64_t *addresses;
+  uint64_t *write_data;
+  uint8_t *controls;
+  uint64_t n;
+  uint64_t capacity;
+} TRACE_REPLAY_BUCKET;
+
+typedef struct TRACE_REPLAY_PARALLEL TRACE_REPLAY_PARALLEL;
+
+typedef struct {
+  TRACE_REPLAY_PARALLEL *parallel;
+  int shard;
+  TRACE_READER *reader;
+  MEMORY_SUBSYSTEM *ms;
+  TRACE_REPLAY_STATS replayed;   // of the blocks this thread decoded
+  pthread_t thread;
+} TRACE_REPLAY_SHARD;
+
+struct TRACE_REPLAY_PARALLEL {
+  _Alignas(64) _Atomic uint64_t arrived;
+  _Atomic int start;              // 1 once every thread is running, -1 if one could not be started
+  _Atomic int failed;             // a bucket could not grow, or a block was corrupt
+
+  _Alignas(64) int num_shards;
+  int shard_shift;
+  uint64_t num_blocks;
+  uint64_t num_rounds;
+  TRACE_REPLAY_SHARD *shards;
+  TRACE_REPLAY_BUCKET *buckets;
+};
+
+int trace_replay_num_shards(const MEMORY_SUBSYSTEM_CONFIG *config, int num_threads) {
+  const L1_GEOMETRY *l1 = &config->l1_geometry;
+  const L2_GEOMETRY *l2 = &config->l2_geometry;
+  uint64_t num_shards = 1;
+
+  if (config->l1_replacement_policy == REPLACEMENT_RANDOM || config->l1_replacement_policy == REPLACEMENT_BRRIP ||
+      config->l2_replacement_policy == REPLACEMENT_RANDOM || config->l2_replacement_policy == REPLACEMENT_BRRIP ||
+      config->main_memory_file || !l1->lines_per_set || !l1->bytes_per_line ||
+      !l2->lines_per_set || !l2->bytes_per_line) {
+    return 1;
+  }
+  uint64_t l1_sets = l1->size_in_bytes / ((uint64_t) l1->lines_per_set * l1->bytes_per_line);
+  uint64_t l2_sets = l2->size_in_bytes / ((uint64_t) l2->lines_per_set * l2->bytes_per_line);
+  while (num_shards * 2 <= (uint64_t) num_threads && num_shards * 2 <= l1_sets && num_shards * 2 <= l2_sets &&
+	 !(config->main_memory_size_in_bytes % (num_shards * 2 * BYTES_PER_CACHE_LINE))) {
+    num_shards *= 2;
+  }
+  return (int) num_shards;
+}
+
+static inline BOOL trace_replay_bucket_add(TRACE_REPLAY_BUCKET *bucket, uint64_t address,
+					   uint64_t write_data, uint8_t control) {
+  if (bucket->n == bucket->capacity) {
+    uint64_t capacity = bucket->capacity ? 2 * bucket->capacity : TRACE_REPLAY_BUCKET_MIN;
+    uint64_t *addresses = (uint64_t *) realloc(bucket->addresses, capacity * sizeof(uint64_t));
+    if (addresses) {
+      bucket->addresses = addresses;
+    }
+    uint64_t *data = (uint64_t *) realloc(bucket->write_data, capacity * sizeof(uint64_t));
+    if (data) {
+      bucket->write_data = data;
+    }
+    uint8_t *controls = (uint8_t *) realloc(bucket->controls, capacity);
+    if (controls) {
+      bucket->controls = controls;
+    }
+    if (!addresses || !data || !controls) {
+      return FALSE;
+    }
+    bucket->capacity = capacity;
+  }
+  bucket->addresses[bucket->n] = address;
+  bucket->write_data[bucket->n] = write_data;
+  bucket->controls[bucket->n] = control;
+  bucket->n++;
+  return TRUE;
+}
+
+//Decodes this thread's blocks of the given round into its buckets of
+//the given buffer, taking the shard bits out of each address.
+static void trace_replay_sort_round(TRACE_REPLAY_SHARD *shard, uint64_t round, int buffer) {
+  TRACE_REPLAY_PARALLEL *parallel = shard->parallel;
+  TRACE_REPLAY_BUCKET *buckets = &parallel->buckets[(buffer * parallel->num_shards + shard->shard) * parallel->num_shards];
+  TRACE_RECORD records[TRACE_REPLAY_BATCH_SIZE];
+  uint64_t shard_mask = parallel->num_shards - 1;
+  int shift = parallel->shard_shift;
+  BOOL added = TRUE;
+
+  for (int s = 0; s < parallel->num_shards; s++) {
+    buckets[s].n = 0;
+  }
+  uint64_t first_block = (round * parallel->num_shards + shard->shard) * TRACE_REPLAY_ROUND_BLOCKS;
+  uint64_t end = trace_reader_seek_block(shard->reader, first_block + TRACE_REPLAY_ROUND_BLOCKS);
+  uint64_t left = end - trace_reader_seek_block(shard->reader, first_block);
+
+  while (left) {
+    uint64_t n = trace_reader_read(shard->reader, records, left < TRACE_REPLAY_BATCH_SIZE ? left : TRACE_REPLAY_BATCH_SIZE);
+    if (!n) {
+      break;
+    }
+    left -= n;
+    for (uint64_t i = 0; i < n; i++) {
+      uint8_t control = trace_record_control(&records[i]);
+      if (control == TRACE_CLOCK_INTERRUPT) {
+	for (int s = 0; s < parallel->num_shards; s++) {
+	  added &= trace_replay_bucket_add(&buckets[s], 0, 0, control);
+	}
+	shard->replayed.num_interrupts++;
+	continue;
+      }
+      uint64_t address = trace_record_address(&records[i]);
+      uint64_t line = address / BYTES_PER_CACHE_LINE;
+      added &= trace_replay_bucket_add(&buckets[line & shard_mask],
+				       (line >> shift) * BYTES_PER_CACHE_LINE + address % BYTES_PER_CACHE_LINE,
+				       records[i].write_data, control);
+      shard->replayed.num_accesses++;
+    }
+  }
+  if (!added || left || trace_reader_corrupt(shard->reader)) {
+    atomic_store_explicit(&parallel->failed, 1, memory_order_relaxed);
+  }
+}
+
+//Replays the buckets for this thread's shard from the given buffer.
+static void trace_replay_shard_round(TRACE_REPLAY_SHARD *shard, int buffer) {
+  TRACE_REPLAY_PARALLEL *parallel = shard->parallel;
+  uint64_t read_data[TRACE_REPLAY_BATCH_SIZE];
+
+  for (int d = 0; d < parallel->num_shards; d++) {
+    TRACE_REPLAY_BUCKET *bucket = &parallel->buckets[(buffer * parallel->num_shards + d) * parallel->num_shards + shard->shard];
+    uint64_t i = 0;
+    while (i < bucket->n) {
+      uint64_t j = i;
+      while (j < bucket->n && j - i < TRACE_REPLAY_BATCH_SIZE && bucket->controls[j] != TRACE_CLOCK_INTERRUPT) {
+	j++;
+      }
+      memory_access_batch_r(shard->ms, bucket->addresses + i, bucket->write_data + i, bucket->controls + i,
+			    read_data, NULL, j - i);
+      if (j < bucket->n && bucket->controls[j] == TRACE_CLOCK_INTERRUPT) {
+	memory_handle_clock_interrupt_r(shard->ms);
+	j++;
+      }
+      i = j;
+    }
+  }
+}
+
+static void trace_replay_barrier(TRACE_REPLAY_PARALLEL *parallel, uint64_t round) {
+  uint64_t target = (round + 1) * parallel->num_shards;
+  atomic_fetch_add_explicit(&parallel->arrived, 1, memory_order_acq_rel);
+  while (atomic_load_explicit(&parallel->arrived, memory_order_acquire) < target) {
+    sched_yield();
+  }
+}
+
+//Each thread, including the calling one: decodes round r while
+//replaying round r - 1.
+static void *trace_replay_shard_thread(void *arg) {
+  TRACE_REPLAY_SHARD *shard = (TRACE_REPLAY_SHARD *) arg;
+  TRACE_REPLAY_PARALLEL *parallel = shard->parallel;
+  int start;
+
+  while (!(start = atomic_load_explicit(&parallel->start, memory_order_acquire))) {
+    sched_yield();
+  }
+  if (start < 0) {
+    return NULL;
+  }
+  for (uint64_t round = 0; round <= parallel->num_rounds; round++) {
+    if (round < parallel->num_rounds) {
+      trace_replay_sort_round(shard, round, round & 1);
+    }
+    if (round > 0) {
+      trace_replay_shard_round(shard, (round - 1) & 1);
+    }
+    trace_replay_barrier(parallel, round);
+  }
+  return NULL;
+}
+
+int trace_replay_parallel(const MEMORY_SUBSYSTEM_CONFIG *config, const char *path, int num_threads,
+			  MEMORY_SUBSYSTEM_STATS *memory_stats, TRACE_REPLAY_STATS *stats) {
+  TRACE_REPLAY_PARALLEL parallel;
+  MEMORY_SUBSYSTEM_CONFIG shard_config = *config;
+  int num_shards = trace_replay_num_shards(config, num_threads);
+  int result = 0;
+
+  //One shard is just a replay.
+  if (num_shards == 1) {
+    MEMORY_SUBSYSTEM *ms = memory_subsystem_create_with_config(config);
+    if (!ms) {
+      return -1;
+    }
+    result = trace_replay_r(ms, path, stats);
+    memory_get_stats_r(ms, memory_stats);
+    memory_subsystem_destroy(ms);
+    return result;
+  }
+
+  memset(&parallel, 0, sizeof(parallel));
+  parallel.num_shards = num_shards;
+  while ((1 << parallel.shard_shift) < num_shards) {
+    parallel.shard_shift++;
+  }
+  shard_config.l1_geometry.size_in_bytes >>= parallel.shard_shift;
+  shard_config.l2_geometry.size_in_bytes >>= parallel.shard_shift;
+  shard_config.main_memory_size_in_bytes >>= parallel.shard_shift;
+
+  parallel.shards = (TRACE_REPLAY_SHARD *) calloc(num_shards, sizeof(TRACE_REPLAY_SHARD));
+  parallel.buckets = (TRACE_REPLAY_BUCKET *) calloc(2 * num_shards * num_shards, sizeof(TRACE_REPLAY_BUCKET));
+  if (!parallel.shards || !parallel.buckets) {
+    result = -1;
+  }
+  for (int s = 0; s < num_shards && result == 0; s++) {
+    TRACE_REPLAY_SHARD *shard = &parallel.shards[s];
+    shard->parallel = &parallel;
+    shard->shard = s;
+    shard->reader = trace_reader_open(path);
+    shard->ms = memory_subsystem_create_with_config(&shard_config);
+    if (!shard->reader || !shard->ms) {
+      result = -1;
+    }
+  }
+
+  if (result == 0) {
+    parallel.num_blocks = trace_reader_num_blocks(parallel.shards[0].reader);
+    uint64_t round_blocks = (uint64_t) num_shards * TRACE_REPLAY_ROUND_BLOCKS;
+    parallel.num_rounds = (parallel.num_blocks + round_blocks - 1) / round_blocks;
+
+    //The threads wait until all of them have been started, and if one
+    //cannot be, the others give up.
+    int started = 1;
+    for (; started < num_shards; started++) {
+      if (pthread_create(&parallel.shards[started].thread, NULL, trace_replay_shard_thread, &parallel.shards[started]) != 0) {
+	break;
+      }
+    }
+    if (started < num_shards) {
+      result = -1;
+      atomic_store_explicit(&parallel.start, -1, memory_order_release);
+    } else {
+      atomic_store_explicit(&parallel.start, 1, memory_order_release);
+      trace_replay_shard_thread(&parallel.shards[0]);
+    }
+    for (int s = 1; s < started; s++) {
+      pthread_join(parallel.shards[s].thread, NULL);
+    }
+  }
+  if (atomic_load(&parallel.failed)) {
+    result = -1;
+  }
+
+  TRACE_REPLAY_STATS replayed = {0, 0};
+  memset(memory_stats, 0, sizeof(*memory_stats));
+  for (int s = 0; parallel.shards && s < num_shards; s++) {
+    TRACE_REPLAY_SHARD *shard = &parallel.shards[s];
+    if (shard->ms) {
+      MEMORY_SUBSYSTEM_STATS shard_stats;
+      memory_get_stats_r(shard->ms, &shard_stats);
+      memory_stats->num_l1_misses += shard_stats.num_l1_misses;
+      memory_stats->num_l2_misses += shard_stats.num_l2_misses;
+      memory_stats->num_l1_writebacks += shard_stats.num_l1_writebacks;
+      memory_stats->num_l2_writebacks += shard_stats.num_l2_writebacks;
+      for (int o = 0; o < MEMORY_NUM_OUTCOMES; o++) {
+	memory_stats->num_accesses_by_outcome[o] += shard_stats.num_accesses_by_outcome[o];
+      }
+      memory_subsystem_destroy(shard->ms);
+    }
+    trace_reader_close(shard->reader);
+    replayed.num_accesses += shard->replayed.num_accesses;
+    replayed.num_interrupts += shard->replayed.num_interrupts;
+  }
+  for (int i = 0; parallel.buckets && i < 2 * num_shards * num_shards; i++) {
+    free(parallel.buckets[i].addresses);
+    free(parallel.buckets[i].write_data);
+    free(parallel.buckets[i].controls);
+  }
+  free(parallel.buckets);
+  free(parallel.shards);
+  if (stats) {
+    *stats = replayed;
+  }
+  return result;
+}
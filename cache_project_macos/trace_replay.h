@@ -0,0 +1,119 @@
+/************************************************************
+
+                        trace_replay.h
+
+Replays a trace file (see trace.h) against a memory subsystem:
+each access in the trace is made of the subsystem, and each clock
+interrupt is delivered to it, in the order they were recorded.
+So the workload that made the trace can be run again under any
+configuration, without the program that produced it.
+
+Traces of either kind (see trace.h) are read with a TRACE_READER,
+which maps the file into memory rather than using read() calls,
+and they are replayed by two threads. A decoding thread reads
+the events, turning them into batches of accesses, which it passes
+to the calling thread through a bounded single-producer, single-
+consumer queue; the calling thread performs each batch with
+memory_access_batch_r(), and delivers the interrupt that ended it,
+if any. Decoding the next batches thus overlaps simulating this one,
+and the parts of the file already decoded are released as the replay
+goes along, so traces much larger than host memory can be replayed.
+
+A trace can also be replayed against several subsystems at once
+(see trace_replay_lockstep_r()), and on several threads at once,
+with the same results, by splitting it up by cache set (see
+Parallel replay, below).
+
+**************************************************************/
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+#include "trace.h"
+
+//What a replay did.
+typedef struct {
+  uint64_t num_accesses;
+  uint64_t num_interrupts;
+} TRACE_REPLAY_STATS;
+
+//Replays the trace file at path against ms, and if stats is not NULL
+//fills it in. A partial record or block at the end of the file (left
+//by a recording that did not finish) is ignored. Returns 0, or -1 if
+//the file cannot be opened or mapped, is not a trace, or the decoding
+//thread cannot be started, in which case nothing is replayed, or if
+//part of a compact trace is corrupt, in which case the events before
+//it have been replayed.
+int trace_replay_r(MEMORY_SUBSYSTEM *ms, const char *path, TRACE_REPLAY_STATS *stats);
+
+//Replays the trace file at path against each of the num_subsystems
+//subsystems in ms, in lockstep: the trace is read and decoded once,
+//and each batch of its accesses is made of every subsystem in turn
+//(followed by the interrupt that ended it, if any), while it is still
+//in the host's caches. Each subsystem ends up exactly as if the trace
+//had been replayed against it alone, but the decoding is shared, and
+//the trace does not have to fit in host memory. The subsystems must
+//be distinct. Returns 0 or -1, as trace_replay_r() does.
+int trace_replay_lockstep_r(MEMORY_SUBSYSTEM *ms[], int num_subsystems, const char *path, TRACE_REPLAY_STATS *stats);
+
+
+/************************************************************
+
+                 Parallel replay
+
+The sets of a cache have nothing to do with each other: an access
+only ever looks at, and changes, the set its address maps to, in
+the L1 cache and in the L2 cache (as long as the replacement policy
+keeps no state across sets, which is true of all but RANDOM and
+BRRIP, whose generator is per cache). And since the set index of
+both is the bits just above the 64-byte line offset, the lowest s
+bits of the line number of an address pick out a group of L1 sets
+and a group of L2 sets (and a group of main memory lines) that no
+address outside the group maps to, when there are at least 2^s sets
+in each cache. So a trace can be split into 2^s shards by those
+bits and each shard replayed on its own, with the sum of the shards'
+statistics being exactly those of replaying the whole trace.
+
+trace_replay_parallel() does this with one thread per shard. Each
+shard is a memory subsystem of its own, with caches and a main
+memory 2^s times smaller than those of config: the s shard bits
+are taken out of each address (whose line number is shifted right
+by s), which maps the shard's sets, in order, onto all of the sets
+of the smaller caches, and leaves tags as they were. Every clock
+interrupt is delivered to every shard, after the same accesses as
+in the trace.
+
+The trace is read in rounds. In each, every thread decodes its
+share of the round's blocks (see trace.h), sorting the accesses
+into a bucket for each shard; then, once every thread has finished
+(a barrier), every thread replays its own shard's buckets in trace
+order. The buckets are double-buffered, so that the decoding of the
+next round and the replaying of this one happen between the same
+two barriers, and neither decoding nor replaying is ever done by
+one thread on its own.
+
+**************************************************************/
+
+//Returns the number of shards (and of threads) trace_replay_parallel()
+//would use for a subsystem of the given configuration on at most
+//num_threads threads: the largest power of two that is at most
+//num_threads and at most the number of sets in each cache, and 1 if
+//either cache uses REPLACEMENT_RANDOM or REPLACEMENT_BRRIP, or main
+//memory is a file.
+int trace_replay_num_shards(const MEMORY_SUBSYSTEM_CONFIG *config, int num_threads);
+
+//Replays the trace file at path, as trace_replay_r() does, on a new
+//memory subsystem with the given configuration, split over up to
+//num_threads threads (see above), and fills in the statistics of the
+//subsystem as a whole in memory_stats and, if stats is not NULL, what
+//was replayed. The subsystem is destroyed afterwards. Returns 0 or,
+//as trace_replay_r() does, -1 (when the configuration is not valid,
+//or memory cannot be allocated, too). If part of a compact trace is
+//corrupt the statistics are of an unspecified part of the trace.
+int trace_replay_parallel(const MEMORY_SUBSYSTEM_CONFIG *config, const char *path, int num_threads,
+			  MEMORY_SUBSYSTEM_STATS *memory_stats, TRACE_REPLAY_STATS *stats);
+
+#endif
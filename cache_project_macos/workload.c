@@ -0,0 +1,387 @@
+/************************************************************
+
+                        workload.c
+
+The synthetic workloads described in workload.h.
+
+Random numbers in a range are taken from the top of a 64 by 64
+bit product (Lemire's method), which needs no division, and the
+Zipf ranks by rejection-inversion sampling (Hörmann and
+Derflinger, "Rejection-inversion to generate variates from
+monotone discrete distributions", 1996), which needs no table,
+whatever the number of items, and rarely more than one try.
+
+**************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "memory_subsystem_constants.h"
+#include "memory_subsystem.h"
+#include "workload.h"
+
+#define WORKLOAD_BATCH_SIZE 4096            // accesses
+
+//The ranks of the ZIPF items are multiplied by this (prime) number,
+//modulo the number of items, to scatter them over the region.
+#define WORKLOAD_ZIPF_SCATTER 2654435761ULL
+
+//What a write stores, as in test_memory_subsystem.
+#define WORKLOAD_WRITE_VALUE(address) ((1 << 20) - (address))
+
+struct WORKLOAD {
+  WORKLOAD_CONFIG config;
+  uint64_t random_state[4];   // xoshiro256**
+  uint64_t alignment_mask;
+  uint64_t total_weight;
+  uint64_t num_items;         // ZIPF and POINTER_CHASE
+  uint64_t zipf_scatter;
+  uint64_t *next_item;        // POINTER_CHASE, the cycle of items
+  double zipf_h_integral_x1;  // ZIPF sampling constants
+  double zipf_h_integral_n;
+  double zipf_s;
+
+  //STREAM and STRIDED: the offset in the region of the next access.
+  //POINTER_CHASE: the item of the next access. RUNS: the address of
+  //the next access in the current run.
+  uint64_t position;
+  uint64_t run_start;         // RUNS
+  uint64_t run_end;
+};
+
+static const char *pattern_names[] = {
+  "stream", "strided", "uniform", "zipf", "chase", "runs"
+};
+
+static inline uint64_t rotate_left(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro_next(uint64_t s[4]) {
+  uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotate_left(s[3], 45);
+  return result;
+}
+
+static uint64_t splitmix64_next(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+//A random number from 0 to n - 1.
+static inline uint64_t random_below(WORKLOAD *w, uint64_t n) {
+  if (w->config.random == WORKLOAD_RANDOM_LIBC) {
+    return (uint64_t) rand() % n;
+  }
+  return (uint64_t)(((unsigned __int128) xoshiro_next(w->random_state) * n) >> 64);
+}
+
+//A random number in [0, 1).
+static inline double random_unit(WORKLOAD *w) {
+  if (w->config.random == WORKLOAD_RANDOM_LIBC) {
+    return rand() / ((double) RAND_MAX + 1);
+  }
+  return (xoshiro_next(w->random_state) >> 11) * 0x1.0p-53;
+}
+
+static inline uint8_t random_control(WORKLOAD *w) {
+  if (!w->config.write_weight) {
+    return READ_ENABLE_MASK;
+  }
+  if (!w->config.read_weight) {
+    return WRITE_ENABLE_MASK;
+  }
+  return random_below(w, w->total_weight) < w->config.write_weight ? WRITE_ENABLE_MASK : READ_ENABLE_MASK;
+}
+
+/***************************************************
+Zipf sampling. h(x) = x^-s is the (unnormalized)
+probability of rank x, H is an integral of h, and
+H_inverse its inverse; the helpers compute log1p(x)/x
+and expm1(x)/x without losing precision near x = 0
+(as happens for s near 1).
+****************************************************/
+
+static double zipf_helper1(double x) {
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double zipf_helper2(double x) {
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+}
+
+static double zipf_h(double s, double x) {
+  return exp(-s * log(x));
+}
+
+static double zipf_h_integral(double s, double x) {
+  double log_x = log(x);
+  return zipf_helper2((1 - s) * log_x) * log_x;
+}
+
+static double zipf_h_integral_inverse(double s, double x) {
+  double t = x * (1 - s);
+  if (t < -1) {
+    t = -1;
+  }
+  return exp(zipf_helper1(t) * x);
+}
+
+//A rank from 1 to the number of items.
+static uint64_t zipf_rank(WORKLOAD *w) {
+  double s = w->config.zipf_exponent;
+  double n = (double) w->num_items;
+  for (;;) {
+    double u = w->zipf_h_integral_n + random_unit(w) * (w->zipf_h_integral_x1 - w->zipf_h_integral_n);
+    double x = zipf_h_integral_inverse(s, u);
+    double k = floor(x + 0.5);
+    if (k < 1) {
+      k = 1;
+    } else if (k > n) {
+      k = n;
+    }
+    if (k - x <= w->zipf_s || u >= zipf_h_integral(s, k + 0.5) - zipf_h(s, k)) {
+      return (uint64_t) k;
+    }
+  }
+}
+
+static int config_valid(const WORKLOAD_CONFIG *c) {
+  uint64_t alignment = c->alignment;
+  if (!alignment || (alignment & (alignment - 1)) || !c->size ||
+      c->base % alignment || c->size % alignment || c->base + c->size < c->base) {
+    return 0;
+  }
+  if ((uint64_t) c->read_weight + c->write_weight == 0) {
+    return 0;
+  }
+  if (c->random != WORKLOAD_RANDOM_XOSHIRO && c->random != WORKLOAD_RANDOM_LIBC) {
+    return 0;
+  }
+  switch (c->pattern) {
+  case WORKLOAD_STREAM:
+  case WORKLOAD_UNIFORM:
+  case WORKLOAD_POINTER_CHASE:
+    return 1;
+  case WORKLOAD_STRIDED:
+    return c->stride && !(c->stride % alignment);
+  case WORKLOAD_ZIPF:
+    return c->zipf_exponent > 0;
+  case WORKLOAD_RUNS:
+    return c->longest_run > 0;
+  default:
+    return 0;
+  }
+}
+
+WORKLOAD *workload_create(const WORKLOAD_CONFIG *config) {
+  if (!config_valid(config)) {
+    return NULL;
+  }
+  WORKLOAD *w = (WORKLOAD *) calloc(1, sizeof(WORKLOAD));
+  if (!w) {
+    return NULL;
+  }
+  w->config = *config;
+  w->alignment_mask = ~(config->alignment - 1);
+  w->total_weight = (uint64_t) config->read_weight + config->write_weight;
+  w->num_items = config->size / config->alignment;
+
+  if (config->pattern == WORKLOAD_POINTER_CHASE) {
+    w->next_item = (uint64_t *) malloc(w->num_items * sizeof(uint64_t));
+    if (!w->next_item) {
+      free(w);
+      return NULL;
+    }
+  }
+  if (config->pattern == WORKLOAD_ZIPF) {
+    double s = config->zipf_exponent;
+    w->zipf_scatter = w->num_items % WORKLOAD_ZIPF_SCATTER ? WORKLOAD_ZIPF_SCATTER : 1;
+    w->zipf_h_integral_x1 = zipf_h_integral(s, 1.5) - 1;
+    w->zipf_h_integral_n = zipf_h_integral(s, w->num_items + 0.5);
+    w->zipf_s = 2 - zipf_h_integral_inverse(s, zipf_h_integral(s, 2.5) - zipf_h(s, 2));
+  }
+  workload_reset(w);
+  return w;
+}
+
+void workload_destroy(WORKLOAD *workload) {
+  if (workload) {
+    free(workload->next_item);
+    free(workload);
+  }
+}
+
+void workload_reset(WORKLOAD *w) {
+  if (w->config.random == WORKLOAD_RANDOM_LIBC) {
+    srand((unsigned) w->config.seed);
+  } else {
+    uint64_t x = w->config.seed;
+    for (int i = 0; i < 4; i++) {
+      w->random_state[i] = splitmix64_next(&x);
+    }
+  }
+  w->position = 0;
+  w->run_start = w->run_end = 0;
+
+  //Sattolo's algorithm, which shuffles the items into a single cycle.
+  if (w->config.pattern == WORKLOAD_POINTER_CHASE) {
+    for (uint64_t i = 0; i < w->num_items; i++) {
+      w->next_item[i] = i;
+    }
+    for (uint64_t i = w->num_items - 1; i > 0; i--) {
+      uint64_t j = random_below(w, i);
+      uint64_t t = w->next_item[i];
+      w->next_item[i] = w->next_item[j];
+      w->next_item[j] = t;
+    }
+  }
+}
+
+void workload_generate(WORKLOAD *w, uint64_t addresses[], uint64_t write_data[],
+		       uint8_t controls[], uint64_t max) {
+  const WORKLOAD_CONFIG *c = &w->config;
+  uint64_t address, i = 0;
+
+  switch (c->pattern) {
+  case WORKLOAD_STREAM:
+    for (; i < max; i++) {
+      address = c->base + w->position;
+      if ((w->position += c->alignment) == c->size) {
+	w->position = 0;
+      }
+      addresses[i] = address;
+      write_data[i] = WORKLOAD_WRITE_VALUE(address);
+      controls[i] = random_control(w);
+    }
+    break;
+
+  case WORKLOAD_STRIDED:
+    for (; i < max; i++) {
+      address = c->base + w->position;
+      w->position = (w->position + c->stride) % c->size;
+      addresses[i] = address;
+      write_data[i] = WORKLOAD_WRITE_VALUE(address);
+      controls[i] = random_control(w);
+    }
+    break;
+
+  case WORKLOAD_UNIFORM:
+    for (; i < max; i++) {
+      address = c->base + (random_below(w, c->size) & w->alignment_mask);
+      addresses[i] = address;
+      write_data[i] = WORKLOAD_WRITE_VALUE(address);
+      controls[i] = random_control(w);
+    }
+    break;
+
+  case WORKLOAD_ZIPF:
+    for (; i < max; i++) {
+      uint64_t item = (uint64_t)(((unsigned __int128)(zipf_rank(w) - 1) * w->zipf_scatter) % w->num_items);
+      address = c->base + item * c->alignment;
+      addresses[i] = address;
+      write_data[i] = WORKLOAD_WRITE_VALUE(address);
+      controls[i] = random_control(w);
+    }
+    break;
+
+  case WORKLOAD_POINTER_CHASE:
+    for (; i < max; i++) {
+      address = c->base + w->position * c->alignment;
+      w->position = w->next_item[w->position];
+      addresses[i] = address;
+      write_data[i] = WORKLOAD_WRITE_VALUE(address);
+      controls[i] = random_control(w);
+    }
+    break;
+
+  case WORKLOAD_RUNS:
+    //The length is drawn before the start, and a run may be empty,
+    //as in Pass 4 of test_memory_subsystem.
+    while (i < max) {
+      if (w->position >= w->run_end) {
+	uint64_t length = random_below(w, c->longest_run);
+	w->run_start = w->position = c->base + (random_below(w, c->size) & w->alignment_mask);
+	w->run_end = c->base + c->size - w->run_start > length * c->alignment ?
+	             w->run_start + length * c->alignment : c->base + c->size;
+	continue;
+      }
+      addresses[i] = w->position;
+      write_data[i] = WORKLOAD_WRITE_VALUE(w->run_start);
+      controls[i] = random_control(w);
+      w->position += c->alignment;
+      i++;
+    }
+    break;
+  }
+}
+
+void workload_run_r(MEMORY_SUBSYSTEM *ms, WORKLOAD *workload) {
+  uint64_t addresses[WORKLOAD_BATCH_SIZE];
+  uint64_t write_data[WORKLOAD_BATCH_SIZE];
+  uint64_t read_data[WORKLOAD_BATCH_SIZE];
+  uint8_t controls[WORKLOAD_BATCH_SIZE];
+  uint64_t interrupt_interval = workload->config.interrupt_interval;
+  uint64_t until_interrupt = interrupt_interval;
+  uint64_t remaining = workload->config.num_accesses;
+
+  //A batch never goes past the next interrupt.
+  while (remaining) {
+    uint64_t n = remaining < WORKLOAD_BATCH_SIZE ? remaining : WORKLOAD_BATCH_SIZE;
+    if (interrupt_interval && until_interrupt < n) {
+      n = until_interrupt;
+    }
+    workload_generate(workload, addresses, write_data, controls, n);
+    memory_access_batch_r(ms, addresses, write_data, controls, read_data, NULL, n);
+    remaining -= n;
+    if (interrupt_interval && !(until_interrupt -= n)) {
+      memory_handle_clock_interrupt_r(ms);
+      until_interrupt = interrupt_interval;
+    }
+  }
+}
+
+int workload_config_from_name(const char *name, uint64_t memory_size_in_bytes, WORKLOAD_CONFIG *config) {
+  WORKLOAD_CONFIG pass3 = WORKLOAD_PASS3_CONFIG(memory_size_in_bytes);
+  WORKLOAD_CONFIG pass4 = WORKLOAD_PASS4_CONFIG(memory_size_in_bytes);
+
+  if (!strcmp(name, "pass3")) {
+    *config = pass3;
+    return 0;
+  }
+  if (!strcmp(name, "pass4")) {
+    *config = pass4;
+    return 0;
+  }
+
+  for (unsigned i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); i++) {
+    if (strcmp(name, pattern_names[i]) == 0) {
+      WORKLOAD_CONFIG c = {(WORKLOAD_PATTERN) i, 0, memory_size_in_bytes, BYTES_PER_WORD, 4096, 0.99,
+			   pass4.longest_run, 2, 1, 1 << 25, 0x2000, WORKLOAD_RANDOM_XOSHIRO, 1};
+      if (c.pattern == WORKLOAD_ZIPF || c.pattern == WORKLOAD_POINTER_CHASE) {
+	c.alignment = BYTES_PER_CACHE_LINE;
+      }
+      *config = c;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *workload_pattern_name(WORKLOAD_PATTERN pattern) {
+  if ((unsigned) pattern >= sizeof(pattern_names) / sizeof(pattern_names[0])) {
+    return "unknown";
+  }
+  return pattern_names[pattern];
+}
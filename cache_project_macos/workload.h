@@ -0,0 +1,150 @@
+/************************************************************
+
+                        workload.h
+
+Synthetic workloads: generators of memory accesses, in the
+patterns a cache is usually tried on, that can be run against a
+memory subsystem. A workload is described by a WORKLOAD_CONFIG,
+and makes its accesses within a region of size bytes starting at
+base, at addresses that are multiples of alignment (a power of
+two):
+
+  WORKLOAD_STREAM:        consecutive addresses, alignment bytes
+                          apart, going back to the start of the
+                          region at its end.
+  WORKLOAD_STRIDED:       addresses stride bytes apart, wrapping
+                          around within the region.
+  WORKLOAD_UNIFORM:       uniformly random addresses in the region.
+  WORKLOAD_ZIPF:          the region is a set of items, each
+                          alignment bytes long, chosen at random
+                          with Zipf's law: the item of rank k with
+                          a probability proportional to
+                          1 / k^zipf_exponent. The ranks are
+                          scattered over the region, so that the
+                          hot items are not next to each other.
+  WORKLOAD_POINTER_CHASE: the items of the region (as for ZIPF)
+                          linked in a single random cycle, each
+                          access going to the item the last one
+                          "points" to, as walking a linked list
+                          does. So there is no pattern for a
+                          prefetcher to find, and every item is
+                          visited once before any is visited again.
+  WORKLOAD_RUNS:          runs of consecutive addresses, alignment
+                          bytes apart, each of a random length from
+                          0 to longest_run - 1 and starting at a
+                          random address, and stopping early at the
+                          end of the region.
+
+Each access is a write with probability write_weight /
+(read_weight + write_weight), and otherwise a read. A write stores
+(1<<20) minus its address (for RUNS, minus the address the run
+started at), as test_memory_subsystem does.
+
+The random numbers come from a xoshiro256** generator, seeded
+(through splitmix64) from seed, so a workload is the same every
+time it is run with the same seed, on any host. It costs a few
+cycles per number, against the much slower (and not reentrant)
+rand() of the C library. WORKLOAD_RANDOM_LIBC instead draws them
+from rand(), after calling srand(seed), exactly as test_memory_subsystem
+does; it exists so that the presets below make exactly the accesses
+of Passes 3 and 4 of test_memory_subsystem, on whatever C library
+it is built with. (Such a workload uses the C library's one global
+generator, so only one of them can be used at a time.)
+
+WORKLOAD_PASS3_CONFIG and WORKLOAD_PASS4_CONFIG are the presets:
+Pass 3 (uniformly random word reads and writes, with a clock
+interrupt every 8K accesses) and Pass 4 (random-length runs of
+words, with an interrupt every 32K accesses), 2^25 accesses each.
+Setting random to WORKLOAD_RANDOM_XOSHIRO in them gives the same
+mix of accesses (though not the same accesses), generated much
+faster.
+
+**************************************************************/
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+
+#include "memory_subsystem.h"
+
+typedef enum {
+  WORKLOAD_STREAM = 0,
+  WORKLOAD_STRIDED,
+  WORKLOAD_UNIFORM,
+  WORKLOAD_ZIPF,
+  WORKLOAD_POINTER_CHASE,
+  WORKLOAD_RUNS
+} WORKLOAD_PATTERN;
+
+typedef enum {
+  WORKLOAD_RANDOM_XOSHIRO = 0,
+  WORKLOAD_RANDOM_LIBC
+} WORKLOAD_RANDOM;
+
+typedef struct {
+  WORKLOAD_PATTERN pattern;
+  uint64_t base;                // the region accessed, in bytes
+  uint64_t size;
+  uint64_t alignment;           // of each address, and the size of an item
+  uint64_t stride;              // STRIDED
+  double zipf_exponent;         // ZIPF, greater than 0
+  uint64_t longest_run;         // RUNS
+  uint32_t read_weight;
+  uint32_t write_weight;
+  uint64_t num_accesses;        // made by workload_run_r()
+  uint64_t interrupt_interval;  // accesses between clock interrupts, 0 for none
+  WORKLOAD_RANDOM random;
+  uint64_t seed;
+} WORKLOAD_CONFIG;
+
+#define WORKLOAD_PASS3_CONFIG(memory_size_in_bytes) \
+  {WORKLOAD_UNIFORM, 0, memory_size_in_bytes, 4, 0, 0.0, 0, 1, 1, \
+   1 << 25, 0x2000, WORKLOAD_RANDOM_LIBC, 12345}
+
+#define WORKLOAD_PASS4_CONFIG(memory_size_in_bytes) \
+  {WORKLOAD_RUNS, 0, memory_size_in_bytes, 8, 0, 0.0, 10000, 1, 1, \
+   1 << 25, 0x8000, WORKLOAD_RANDOM_LIBC, 54321}
+
+typedef struct WORKLOAD WORKLOAD;
+
+//Creates a workload. Returns NULL if the configuration is not valid
+//(an empty or misaligned region, an alignment that is not a power of
+//two, no read or write weight, a stride or zipf_exponent of 0 for
+//those patterns, ...) or the allocation fails.
+WORKLOAD *workload_create(const WORKLOAD_CONFIG *config);
+
+//Passing NULL does nothing.
+void workload_destroy(WORKLOAD *workload);
+
+//Starts the workload over from its seed, so that it makes the same
+//accesses again.
+void workload_reset(WORKLOAD *workload);
+
+//Generates the next max accesses of the workload into addresses,
+//write_data and controls (READ_ENABLE_MASK or WRITE_ENABLE_MASK), in
+//the form memory_access_batch_r() takes. A workload never ends, so
+//this always generates max accesses.
+void workload_generate(WORKLOAD *workload, uint64_t addresses[], uint64_t write_data[],
+		       uint8_t controls[], uint64_t max);
+
+//Makes the workload's next num_accesses accesses (see WORKLOAD_CONFIG)
+//of ms, in batches, delivering a clock interrupt after every
+//interrupt_interval of them.
+void workload_run_r(MEMORY_SUBSYSTEM *ms, WORKLOAD *workload);
+
+//Fills in config with the named workload ("pass3", "pass4", "stream",
+//"strided", "uniform", "zipf", "chase" or "runs") over a region of
+//memory_size_in_bytes bytes at address 0. The ones other than "pass3"
+//and "pass4" use xoshiro256** with seed 1, an 8K interrupt interval,
+//2^25 accesses and one write for every two reads, on words, except
+//that "zipf" (with an exponent of 0.99) and "chase" use 64-byte
+//items, "strided" has a 4KB stride, and "runs" has Pass 4's longest
+//run. Returns 0, or -1 if there is no workload with that name.
+int workload_config_from_name(const char *name, uint64_t memory_size_in_bytes, WORKLOAD_CONFIG *config);
+
+//Returns the name of a pattern ("stream", "strided", "uniform", "zipf",
+//"chase" or "runs").
+const char *workload_pattern_name(WORKLOAD_PATTERN pattern);
+
+#endif